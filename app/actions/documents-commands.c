@@ -33,7 +33,10 @@
 #include "core/gimpcontext.h"
 #include "core/gimpimagefile.h"
 
+#include "plug-in/gimppluginmanager.h"
+
 #include "file/file-open.h"
+#include "file/file-procedure.h"
 #include "file/file-utils.h"
 
 #include "widgets/gimpclipboard.h"
@@ -273,18 +276,88 @@ documents_recreate_preview_cmd_callback (GtkAction *action,
     }
 }
 
+static void
+documents_reload_previews_foreach (GimpImagefile *imagefile,
+                                   GPtrArray     *imagefiles)
+{
+  g_ptr_array_add (imagefiles, g_object_ref (imagefile));
+}
+
 void
 documents_reload_previews_cmd_callback (GtkAction *action,
                                         gpointer   data)
 {
   GimpContainerEditor *editor = GIMP_CONTAINER_EDITOR (data);
+  GimpContext         *context;
   GimpContainer       *container;
+  Gimp                *gimp;
+  GPtrArray           *imagefiles;
+  const gchar        **uris   = NULL;
+  GimpThumbState      *states = NULL;
+  gint                 i;
 
+  context   = gimp_container_view_get_context (editor->view);
   container = gimp_container_view_get_container (editor->view);
+  gimp      = context->gimp;
+
+  imagefiles = g_ptr_array_new_with_free_func (g_object_unref);
 
   gimp_container_foreach (container,
-                          (GFunc) gimp_imagefile_update,
-                          editor->view);
+                          (GFunc) documents_reload_previews_foreach,
+                          imagefiles);
+
+  gimp_set_busy (gimp);
+
+  /*  check all thumbnails at once, without loading them, and create
+   *  the missing and outdated ones the way the open dialog does
+   */
+  if (gimp->config->thumbnail_size != GIMP_THUMBNAIL_SIZE_NONE)
+    {
+      GimpBaseConfig *config = GIMP_BASE_CONFIG (gimp->config);
+
+      uris = g_new0 (const gchar *, imagefiles->len + 1);
+
+      for (i = 0; i < imagefiles->len; i++)
+        uris[i] = gimp_object_get_name (g_ptr_array_index (imagefiles, i));
+
+      states = gimp_thumb_batch_process (uris,
+                                         gimp->config->thumbnail_size,
+                                         NULL, NULL, NULL,
+                                         config->num_processors);
+    }
+
+  for (i = 0; i < imagefiles->len; i++)
+    {
+      GimpImagefile *imagefile = g_ptr_array_index (imagefiles, i);
+
+      if (states &&
+          (states[i] == GIMP_THUMB_STATE_NOT_FOUND ||
+           states[i] == GIMP_THUMB_STATE_OLD))
+        {
+          GimpThumbnail *thumbnail = gimp_imagefile_get_thumbnail (imagefile);
+
+          gimp_thumbnail_peek_image (thumbnail);
+
+          if (thumbnail->image_filesize <
+              gimp->config->thumbnail_filesize_limit &&
+              file_procedure_find_by_extension (gimp->plug_in_manager->load_procs,
+                                                gimp_object_get_name (imagefile)))
+            {
+              gimp_imagefile_create_thumbnail_weak (imagefile, context, NULL,
+                                                    gimp->config->thumbnail_size,
+                                                    TRUE);
+              continue;
+            }
+        }
+
+      gimp_imagefile_update (imagefile);
+    }
+
+  gimp_unset_busy (gimp);
+
+  g_free (states);
+  g_free (uris);
+  g_ptr_array_free (imagefiles, TRUE);
 }
 
 static void
@@ -31,6 +31,7 @@
 #include "gimphistogram.h"
 #include "pixel-processor.h"
 #include "pixel-region.h"
+#include "tile.h"
 
 
 #ifdef ENABLE_MP
@@ -39,6 +40,11 @@
 #define NUM_SLOTS  1
 #endif
 
+/*  size of the blocks gimp_histogram_calculate_incremental() caches
+ *  values for, a multiple of the tile size
+ */
+#define BLOCK_SIZE (8 * TILE_WIDTH)
+
 
 struct _GimpHistogram
 {
@@ -49,6 +55,17 @@ struct _GimpHistogram
   gchar          slots[NUM_SLOTS];
 #endif
   gdouble       *values[NUM_SLOTS];
+
+  /*  per-block values of the last incremental calculation  */
+  TileManager   *block_tiles;
+  gint           block_x;
+  gint           block_y;
+  gint           block_width;
+  gint           block_height;
+  gint           n_blocks_x;
+  gint           n_blocks_y;
+  gdouble      **block_values;
+  gboolean      *block_dirty;
 };
 
 
@@ -57,9 +74,12 @@ struct _GimpHistogram
 static void  gimp_histogram_alloc_values         (GimpHistogram *histogram,
                                                   gint           bytes);
 static void  gimp_histogram_free_values          (GimpHistogram *histogram);
+static void  gimp_histogram_free_blocks          (GimpHistogram *histogram);
 static void  gimp_histogram_calculate_sub_region (GimpHistogram *histogram,
                                                   PixelRegion   *region,
                                                   PixelRegion   *mask);
+static void  gimp_histogram_count_region         (gdouble       *values,
+                                                  PixelRegion   *region);
 
 
 /*  public functions  */
@@ -97,6 +117,7 @@ gimp_histogram_unref (GimpHistogram *histogram)
 
   if (histogram->ref_count == 0)
     {
+      gimp_histogram_free_blocks (histogram);
       gimp_histogram_free_values (histogram);
       g_slice_free (GimpHistogram, histogram);
     }
@@ -144,6 +165,8 @@ gimp_histogram_calculate (GimpHistogram *histogram,
 
   g_return_if_fail (histogram != NULL);
 
+  gimp_histogram_free_blocks (histogram);
+
   if (! region)
     {
       gimp_histogram_free_values (histogram);
@@ -175,6 +198,146 @@ gimp_histogram_calculate (GimpHistogram *histogram,
 }
 
 
+/**
+ * gimp_histogram_calculate_incremental:
+ * @histogram: a %GimpHistogram
+ * @region:    the unmasked region to calculate the histogram of
+ *
+ * Like gimp_histogram_calculate() without a mask, but keeps the
+ * values of each block of tiles around, and on subsequent calls for
+ * the same region only recalculates the blocks that have been
+ * passed to gimp_histogram_invalidate_area() in the meantime.
+ **/
+void
+gimp_histogram_calculate_incremental (GimpHistogram *histogram,
+                                      PixelRegion   *region)
+{
+  GimpHistogram *block_histogram = NULL;
+  gint           n_values;
+  gint           n_blocks;
+  gint           i, j;
+
+  g_return_if_fail (histogram != NULL);
+  g_return_if_fail (region != NULL);
+
+  if (! histogram->block_values                     ||
+      histogram->n_channels   != region->bytes + 1 ||
+      histogram->block_tiles  != region->tiles     ||
+      histogram->block_x      != region->x         ||
+      histogram->block_y      != region->y         ||
+      histogram->block_width  != region->w         ||
+      histogram->block_height != region->h)
+    {
+      gimp_histogram_free_blocks (histogram);
+      gimp_histogram_alloc_values (histogram, region->bytes);
+
+      histogram->block_tiles  = region->tiles;
+      histogram->block_x      = region->x;
+      histogram->block_y      = region->y;
+      histogram->block_width  = region->w;
+      histogram->block_height = region->h;
+      histogram->n_blocks_x   = (region->w + BLOCK_SIZE - 1) / BLOCK_SIZE;
+      histogram->n_blocks_y   = (region->h + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+      n_blocks = histogram->n_blocks_x * histogram->n_blocks_y;
+
+      histogram->block_values = g_new0 (gdouble *, n_blocks);
+      histogram->block_dirty  = g_new (gboolean, n_blocks);
+
+      for (i = 0; i < n_blocks; i++)
+        histogram->block_dirty[i] = TRUE;
+    }
+
+  n_values = histogram->n_channels * 256;
+  n_blocks = histogram->n_blocks_x * histogram->n_blocks_y;
+
+  for (i = 0; i < n_blocks; i++)
+    {
+      PixelRegion blockPR;
+      gint        x, y;
+
+      if (! histogram->block_dirty[i])
+        continue;
+
+      if (! block_histogram)
+        block_histogram = gimp_histogram_new ();
+
+      x = (i % histogram->n_blocks_x) * BLOCK_SIZE;
+      y = (i / histogram->n_blocks_x) * BLOCK_SIZE;
+
+      pixel_region_init (&blockPR, region->tiles,
+                         region->x + x, region->y + y,
+                         MIN (BLOCK_SIZE, region->w - x),
+                         MIN (BLOCK_SIZE, region->h - y),
+                         FALSE);
+
+      gimp_histogram_calculate (block_histogram, &blockPR, NULL);
+
+      if (! histogram->block_values[i])
+        histogram->block_values[i] = g_new (gdouble, n_values);
+
+      memcpy (histogram->block_values[i], block_histogram->values[0],
+              n_values * sizeof (gdouble));
+
+      histogram->block_dirty[i] = FALSE;
+    }
+
+  if (block_histogram)
+    gimp_histogram_unref (block_histogram);
+
+  /*  sum up all blocks instead of subtracting the old values of the
+   *  changed blocks, so rounding errors can't accumulate over time
+   */
+  memset (histogram->values[0], 0, n_values * sizeof (gdouble));
+
+  for (i = 0; i < n_blocks; i++)
+    {
+      const gdouble *block = histogram->block_values[i];
+
+      for (j = 0; j < n_values; j++)
+        histogram->values[0][j] += block[j];
+    }
+}
+
+/**
+ * gimp_histogram_invalidate_area:
+ * @histogram: a %GimpHistogram
+ * @x:         x coordinate of the changed area
+ * @y:         y coordinate of the changed area
+ * @width:     width of the changed area
+ * @height:    height of the changed area
+ *
+ * Marks the blocks touching the given area, in the coordinates of the
+ * region passed to gimp_histogram_calculate_incremental(), as changed.
+ **/
+void
+gimp_histogram_invalidate_area (GimpHistogram *histogram,
+                                gint           x,
+                                gint           y,
+                                gint           width,
+                                gint           height)
+{
+  gint x1, y1, x2, y2;
+  gint bx, by;
+
+  g_return_if_fail (histogram != NULL);
+
+  if (! histogram->block_values)
+    return;
+
+  x1 = MAX (x - histogram->block_x, 0);
+  y1 = MAX (y - histogram->block_y, 0);
+  x2 = MIN (x + width  - histogram->block_x, histogram->block_width);
+  y2 = MIN (y + height - histogram->block_y, histogram->block_height);
+
+  if (x1 >= x2 || y1 >= y2)
+    return;
+
+  for (by = y1 / BLOCK_SIZE; by <= (y2 - 1) / BLOCK_SIZE; by++)
+    for (bx = x1 / BLOCK_SIZE; bx <= (x2 - 1) / BLOCK_SIZE; bx++)
+      histogram->block_dirty[by * histogram->n_blocks_x + bx] = TRUE;
+}
+
 #define HISTOGRAM_VALUE(c,i) (histogram->values[0][(c) * 256 + (i)])
 
 
@@ -557,6 +720,29 @@ gimp_histogram_alloc_values (GimpHistogram *histogram,
     }
 }
 
+static void
+gimp_histogram_free_blocks (GimpHistogram *histogram)
+{
+  if (histogram->block_values)
+    {
+      gint n_blocks = histogram->n_blocks_x * histogram->n_blocks_y;
+      gint i;
+
+      for (i = 0; i < n_blocks; i++)
+        g_free (histogram->block_values[i]);
+
+      g_free (histogram->block_values);
+      histogram->block_values = NULL;
+
+      g_free (histogram->block_dirty);
+      histogram->block_dirty = NULL;
+    }
+
+  histogram->block_tiles = NULL;
+  histogram->n_blocks_x  = 0;
+  histogram->n_blocks_y  = 0;
+}
+
 static void
 gimp_histogram_free_values (GimpHistogram *histogram)
 {
@@ -730,110 +916,130 @@ gimp_histogram_calculate_sub_region (GimpHistogram *histogram,
     }
   else /* no mask */
     {
-      src = region->data;
+      gimp_histogram_count_region (values, region);
+    }
 
-      switch (region->bytes)
-        {
-        case 1:
-          while (h--)
-            {
-              s = src;
-              w = region->w;
+#ifdef ENABLE_MP
+  /* unlock this slot */
+  g_static_mutex_lock (&histogram->mutex);
 
-              while (w--)
-                {
-                  VALUE (0, s[0]) += 1.0;
+  histogram->slots[slot] = 0;
 
-                  s += 1;
-                }
+  g_static_mutex_unlock (&histogram->mutex);
+#endif
+}
 
-              src += region->rowstride;
-            }
-          break;
+/*  Counts the pixels of an unmasked region into integer bins first and
+ *  adds them to @values once per region, which is a lot cheaper than
+ *  updating a gdouble bin for every channel of every pixel.
+ */
+static void
+gimp_histogram_count_region (gdouble     *values,
+                             PixelRegion *region)
+{
+  guint         counts[5 * 256];
+  const guchar *src = region->data;
+  const guchar *s;
+  gint          n_channels = region->bytes + 1;
+  gint          h = region->h;
+  gint          w;
+  gint          i;
 
-        case 2:
-          while (h--)
-            {
-              s = src;
-              w = region->w;
+#define COUNT(c,i) (counts[(c) * 256 + (i)]++)
+#define MAX3(s)    (MAX (MAX ((s)[0], (s)[1]), (s)[2]))
 
-              while (w--)
-                {
-                  const gdouble weight = s[1] / 255;
+  memset (counts, 0, n_channels * 256 * sizeof (guint));
 
-                  VALUE (0, s[0]) += weight;
-                  VALUE (1, s[1]) += 1.0;
+  switch (region->bytes)
+    {
+    case 1:
+      while (h--)
+        {
+          s = src;
+          w = region->w;
 
-                  s += 2;
-                }
+          while (w--)
+            {
+              COUNT (0, s[0]);
 
-              src += region->rowstride;
+              s += 1;
             }
-          break;
-
-        case 3: /* calculate separate value values */
-          while (h--)
-            {
-              s = src;
-              w = region->w;
 
-              while (w--)
-                {
-                  VALUE (1, s[0]) += 1.0;
-                  VALUE (2, s[1]) += 1.0;
-                  VALUE (3, s[2]) += 1.0;
+          src += region->rowstride;
+        }
+      break;
 
-                  max = (s[0] > s[1]) ? s[0] : s[1];
+    case 2:
+      /*  only fully opaque pixels contribute to the value bins  */
+      while (h--)
+        {
+          s = src;
+          w = region->w;
 
-                  if (s[2] > max)
-                    VALUE (0, s[2]) += 1.0;
-                  else
-                    VALUE (0, max) += 1.0;
+          while (w--)
+            {
+              if (s[1] == 255)
+                COUNT (0, s[0]);
 
-                  s += 3;
-                }
+              COUNT (1, s[1]);
 
-              src += region->rowstride;
+              s += 2;
             }
-          break;
 
-        case 4: /* calculate separate value values */
-          while (h--)
-            {
-              s = src;
-              w = region->w;
+          src += region->rowstride;
+        }
+      break;
 
-              while (w--)
-                {
-                  const gdouble weight = s[3] / 255;
+    case 3: /* calculate separate value values */
+      while (h--)
+        {
+          s = src;
+          w = region->w;
 
-                  VALUE (1, s[0]) += weight;
-                  VALUE (2, s[1]) += weight;
-                  VALUE (3, s[2]) += weight;
-                  VALUE (4, s[3]) += 1.0;
+          while (w--)
+            {
+              COUNT (1, s[0]);
+              COUNT (2, s[1]);
+              COUNT (3, s[2]);
+              COUNT (0, MAX3 (s));
 
-                  max = (s[0] > s[1]) ? s[0] : s[1];
+              s += 3;
+            }
 
-                  if (s[2] > max)
-                    VALUE (0, s[2]) += weight;
-                  else
-                    VALUE (0, max) += weight;
+          src += region->rowstride;
+        }
+      break;
 
-                  s += 4;
+    case 4: /* calculate separate value values */
+      /*  only fully opaque pixels contribute to the color bins  */
+      while (h--)
+        {
+          s = src;
+          w = region->w;
+
+          while (w--)
+            {
+              if (s[3] == 255)
+                {
+                  COUNT (1, s[0]);
+                  COUNT (2, s[1]);
+                  COUNT (3, s[2]);
+                  COUNT (0, MAX3 (s));
                 }
 
-              src += region->rowstride;
+              COUNT (4, s[3]);
+
+              s += 4;
             }
-          break;
+
+          src += region->rowstride;
         }
+      break;
     }
 
-#ifdef ENABLE_MP
-  /* unlock this slot */
-  g_static_mutex_lock (&histogram->mutex);
+#undef MAX3
+#undef COUNT
 
-  histogram->slots[slot] = 0;
-
-  g_static_mutex_unlock (&histogram->mutex);
-#endif
+  for (i = 0; i < n_channels * 256; i++)
+    values[i] += counts[i];
 }
@@ -31,6 +31,15 @@ GimpHistogram * gimp_histogram_duplicate     (GimpHistogram        *histogram);
 void            gimp_histogram_calculate     (GimpHistogram        *histogram,
                                               PixelRegion          *region,
                                               PixelRegion          *mask);
+void            gimp_histogram_calculate_incremental
+                                             (GimpHistogram        *histogram,
+                                              PixelRegion          *region);
+void            gimp_histogram_invalidate_area
+                                             (GimpHistogram        *histogram,
+                                              gint                  x,
+                                              gint                  y,
+                                              gint                  width,
+                                              gint                  height);
 
 gdouble         gimp_histogram_get_maximum   (GimpHistogram        *histogram,
                                               GimpHistogramChannel  channel);
@@ -78,6 +78,12 @@ struct _PixelProcessor
   PixelRegion         *regions[4];
 
   gulong               progress;
+
+  /*  used instead of the regions by pixel_processor_process_range()  */
+  PixelProcessorRangeFunc  range_func;
+  gint                     range_next;
+  gint                     range_end;
+  gint                     range_chunk;
 };
 
 
@@ -180,6 +186,50 @@ do_parallel_regions (PixelProcessor *processor)
       g_mutex_unlock (processor->mutex);
     }
 }
+
+static void
+do_parallel_range (PixelProcessor *processor)
+{
+  g_mutex_lock (processor->mutex);
+
+  while (processor->range_next < processor->range_end)
+    {
+      gint start = processor->range_next;
+      gint end   = MIN (start + processor->range_chunk, processor->range_end);
+
+      processor->range_next = end;
+
+      g_mutex_unlock (processor->mutex);
+
+      processor->range_func (processor->data, start, end);
+
+      g_mutex_lock (processor->mutex);
+    }
+
+  processor->threads--;
+
+  if (processor->threads == 0)
+    {
+      g_mutex_unlock (processor->mutex);
+
+      g_mutex_lock (pool_mutex);
+      g_cond_signal  (pool_cond);
+      g_mutex_unlock (pool_mutex);
+    }
+  else
+    {
+      g_mutex_unlock (processor->mutex);
+    }
+}
+
+static void
+do_parallel (PixelProcessor *processor)
+{
+  if (processor->range_func)
+    do_parallel_range (processor);
+  else
+    do_parallel_regions (processor);
+}
 #endif
 
 /*  do_parallel_regions_single is just like do_parallel_regions
@@ -443,7 +493,7 @@ pixel_processor_set_num_threads (gint num_threads)
         }
       else
         {
-          pool = g_thread_pool_new ((GFunc) do_parallel_regions, NULL,
+          pool = g_thread_pool_new ((GFunc) do_parallel, NULL,
                                     num_threads, TRUE, &error);
 
           pool_mutex = g_mutex_new ();
@@ -501,3 +551,83 @@ pixel_regions_process_parallel_progress (PixelProcessorFunc          func,
 
   va_end (va);
 }
+
+/**
+ * pixel_processor_process_range:
+ * @func:      function to call for each chunk of items
+ * @data:      user data passed to @func
+ * @n_items:   total number of items
+ * @min_items: minimum number of items handed to @func at once
+ *
+ * Calls @func for consecutive, non-overlapping [start, end) chunks
+ * covering 0 to @n_items, using the pixel processor's thread pool
+ * when there is enough work.  This is meant for work that doesn't
+ * map to a set of PixelRegions, like the rows or columns of a
+ * separable filter.  Returns when all items have been processed.
+ *
+ * @func may be called from several threads at once and must not use
+ * the pixel processor itself.
+ **/
+void
+pixel_processor_process_range (PixelProcessorRangeFunc  func,
+                               gpointer                 data,
+                               gint                     n_items,
+                               gint                     min_items)
+{
+  g_return_if_fail (func != NULL);
+
+  if (n_items <= 0)
+    return;
+
+  min_items = MAX (min_items, 1);
+
+#ifdef ENABLE_MP
+  if (pool && n_items >= 2 * min_items)
+    {
+      PixelProcessor  processor = { NULL, };
+      GError         *error     = NULL;
+      gint            max_tasks = g_thread_pool_get_max_threads (pool);
+      gint            tasks     = MIN (n_items / min_items, max_tasks);
+
+      processor.data        = data;
+      processor.range_func  = func;
+      processor.range_next  = 0;
+      processor.range_end   = n_items;
+
+      /*  hand out several chunks per thread so uneven chunks balance  */
+      processor.range_chunk = MAX (min_items, n_items / (tasks * 4));
+
+      processor.threads     = tasks;
+      processor.mutex       = g_mutex_new ();
+
+      g_mutex_lock (pool_mutex);
+
+      while (tasks--)
+        {
+          g_thread_pool_push (pool, &processor, &error);
+
+          if (G_UNLIKELY (error))
+            {
+              g_warning ("thread creation failed: %s", error->message);
+              g_clear_error (&error);
+              processor.threads--;
+            }
+        }
+
+      while (processor.threads != 0)
+        g_cond_wait (pool_cond, pool_mutex);
+
+      g_mutex_unlock (pool_mutex);
+
+      g_mutex_free (processor.mutex);
+
+      /*  in case no thread could be started at all  */
+      if (processor.range_next < n_items)
+        func (data, processor.range_next, n_items);
+
+      return;
+    }
+#endif
+
+  func (data, 0, n_items);
+}
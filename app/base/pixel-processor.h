@@ -27,6 +27,10 @@
 typedef void (* PixelProcessorProgressFunc) (gpointer  progress_data,
                                              gdouble   fraction);
 
+typedef void (* PixelProcessorRangeFunc)    (gpointer  data,
+                                             gint      start,
+                                             gint      end);
+
 
 void  pixel_processor_init            (gint num_threads);
 void  pixel_processor_set_num_threads (gint num_threads);
@@ -45,5 +49,10 @@ void  pixel_regions_process_parallel_progress
                                        gint                        num_regions,
                                        ...);
 
+void  pixel_processor_process_range   (PixelProcessorRangeFunc  func,
+                                       gpointer                 data,
+                                       gint                     n_items,
+                                       gint                     min_items);
+
 
 #endif /* __PIXEL_PROCESSOR_H__ */
@@ -35,6 +35,8 @@
 
 #include "config.h"
 
+#include <stdlib.h>
+
 #include <glib-object.h>
 
 #include "libgimpbase/gimpbase.h"
@@ -45,6 +47,7 @@
 #include "paint-funcs/paint-funcs.h"
 
 #include "cpercep.h"
+#include "pixel-processor.h"
 #include "pixel-region.h"
 #include "tile.h"
 #include "tile-manager.h"
@@ -110,6 +113,20 @@ typedef struct
   gfloat fgdist;
 } classresult;
 
+/* A struct that holds what the classification threads share */
+typedef struct
+{
+  SioxState        *state;
+  gfloat            clustersize;
+  GMutex           *mutex;
+  SioxProgressFunc  progress_callback;
+  gpointer          progress_data;
+#ifdef SIOX_DEBUG
+  gint              hits;
+  gint              miss;
+#endif
+} classdata;
+
 
 static void
 siox_cache_entry_free (gpointer entry)
@@ -173,6 +190,67 @@ calc_lab (const guchar *src,
 }
 
 
+/* Stores the RGB color of any pixel format in the fields of the lab
+ * struct, to be converted in place by rgb_to_lab_range() later
+ */
+static inline void
+store_rgb (const guchar *src,
+           gint          bpp,
+           const guchar *colormap,
+           lab          *pixel)
+{
+  switch (bpp)
+    {
+    case 3:  /* RGB  */
+    case 4:  /* RGBA */
+      pixel->l = src[RED];
+      pixel->a = src[GREEN];
+      pixel->b = src[BLUE];
+      break;
+
+    case 2:
+    case 1:
+      if (colormap) /* INDEXED(A) */
+        {
+          gint i = *src * 3;
+
+          pixel->l = colormap[i + RED];
+          pixel->a = colormap[i + GREEN];
+          pixel->b = colormap[i + BLUE];
+        }
+      else /* GRAY(A) */
+        {
+          pixel->l = *src;
+          pixel->a = *src;
+          pixel->b = *src;
+        }
+      break;
+
+    default:
+      g_return_if_reached ();
+    }
+}
+
+/* Converts the colors stored by store_rgb() to LAB, runs in parallel */
+static void
+rgb_to_lab_range (lab  *pixels,
+                  gint  start,
+                  gint  end)
+{
+  for (; start < end; start++)
+    {
+      lab     *pixel = pixels + start;
+      gdouble  l, a, b;
+
+      cpercep_rgb_to_space (pixel->l, pixel->a, pixel->b, &l, &a, &b);
+
+      pixel->l = l;
+      pixel->a = a;
+      pixel->b = b;
+    }
+}
+
+
 /*  assumes that lab starts with an array of floats (l,a,b)  */
 #define CURRENT_VALUE(points, i, dim) (((const gfloat *) (points + i))[dim])
 
@@ -366,6 +444,61 @@ euklid (const lab *p,
   return (SQR (p->l - q->l) + SQR (p->a - q->a) + SQR (p->b - q->b));
 }
 
+/* Sorts a signature by lightness for signature_min_distance() */
+static gint
+signature_compare (gconstpointer a,
+                   gconstpointer b)
+{
+  const lab *p = a;
+  const lab *q = b;
+
+  return (p->l < q->l) ? -1 : (p->l > q->l) ? 1 : 0;
+}
+
+/* Returns the squared distance of @p to the closest entry of the
+ * sorted signature @sig. Starts at the entries of similar lightness
+ * and stops walking outwards as soon as the lightness difference
+ * alone exceeds the best distance found so far.
+ */
+static gfloat
+signature_min_distance (const lab *sig,
+                        gint       siglen,
+                        const lab *p)
+{
+  gfloat min   = G_MAXFLOAT;
+  gint   lower = 0;
+  gint   upper = siglen;
+  gint   i;
+
+  while (lower < upper)
+    {
+      gint mid = (lower + upper) / 2;
+
+      if (sig[mid].l < p->l)
+        lower = mid + 1;
+      else
+        upper = mid;
+    }
+
+  for (i = lower; i < siglen && SQR (sig[i].l - p->l) < min; i++)
+    {
+      gfloat d = euklid (p, sig + i);
+
+      if (d < min)
+        min = d;
+    }
+
+  for (i = lower - 1; i >= 0 && SQR (p->l - sig[i].l) < min; i--)
+    {
+      gfloat d = euklid (p, sig + i);
+
+      if (d < min)
+        min = d;
+    }
+
+  return min;
+}
+
 /* Returns squared clustersize */
 static gfloat
 get_clustersize (const gfloat *limits)
@@ -411,6 +544,8 @@ create_signature (lab                *input,
   g_printerr ("siox.c: step #2 -> %d clusters\n", *returnlength);
 #endif
 
+  qsort (input, size2, sizeof (lab), signature_compare);
+
   return g_memdup (input, size2 * sizeof (lab));
 }
 
@@ -471,126 +606,94 @@ dilate_mask (TileManager *mask,
 
 /* Digitize mask */
 static inline void
-threshold_mask (TileManager *mask,
-                gint         x,
-                gint         y,
-                gint         width,
-                gint         height)
+threshold_mask (guchar *buffer,
+                gint    n_pixels)
 {
-  PixelRegion region;
-  gpointer    pr;
-  gint        row, col;
-
-  pixel_region_init (&region, mask, x, y, width, height, TRUE);
+  gint i;
 
-  for (pr = pixel_regions_register (1, &region);
-       pr != NULL; pr = pixel_regions_process (pr))
+  /* everything that fits the mask is in the image */
+  for (i = 0; i < n_pixels; i++)
     {
-      guchar *data = region.data;
-
-      for (row = 0; row < region.h; row++)
-        {
-          guchar *d = data;
-
-          /* everything that fits the mask is in the image */
-          for (col = 0; col < region.w; col++, d++)
-            {
-              if (*d > SIOX_HIGH)
-                *d = FIND_BLOB_FORCEFG;
-              else if (*d >= 0x80)
-                *d = FIND_BLOB_SELECTED;
-              else
-                *d = 0;
-            }
-
-          data += region.rowstride;
-        }
+      if (buffer[i] > SIOX_HIGH)
+        buffer[i] = FIND_BLOB_FORCEFG;
+      else if (buffer[i] >= 0x80)
+        buffer[i] = FIND_BLOB_SELECTED;
+      else
+        buffer[i] = 0;
     }
 }
 
 /* a struct that contains information about a blob */
 struct blob
 {
-  gint     seedx;
-  gint     seedy;
+  gint     seed;
   gint     size;
   gboolean mustkeep;
 };
 
-/* This method checks out the neighbourhood of the pixel at position
- * (x,y) in the TileManager mask, it adds the surrounding pixels to
- * the queue to allow further processing it uses maskVal to determine
- * if the surrounding pixels have already been visited x,y are passed
- * from above.
+/* Marks pixel i of the blob with mark and pushes it on the stack,
+ * unless it is not part of the mask or has already been marked.
+ * Marking pixels when they are pushed keeps every pixel on the stack
+ * at most once.
  */
-static void
-depth_first_search (TileManager *mask,
-                    gint         x,
-                    gint         y,
-                    gint         xwidth,
-                    gint         yheight,
-                    struct blob *b,
-                    guchar       mark)
+static inline void
+depth_first_search_push (guchar      *buffer,
+                         gint         i,
+                         struct blob *b,
+                         guchar       mark,
+                         GArray      *stack)
 {
-  GSList *stack = NULL;
-  gint    xx    = b->seedx;
-  gint    yy    = b->seedy;
-  gint    oldx  = -1;
+  guchar val = buffer[i];
 
-  while (TRUE)
-    {
-      guchar val;
+  if (! val || val == mark)
+    return;
 
-      if (oldx == xx)
-        {
-          if (stack == NULL)
-            break;
+  if (mark == FIND_BLOB_VISITED)
+    {
+      ++(b->size);
+      if (val == FIND_BLOB_FORCEFG)
+        b->mustkeep = TRUE;
+    }
 
-          xx    = GPOINTER_TO_INT (stack->data);
-          stack = g_slist_delete_link (stack, stack);
+  buffer[i] = mark;
 
-          yy    = GPOINTER_TO_INT (stack->data);
-          stack = g_slist_delete_link (stack, stack);
-        }
+  g_array_append_val (stack, i);
+}
 
-      oldx = xx;
+/* This method marks the pixels of the blob starting at the seed
+ * pixel in the width x height mask buffer, using a stack of pixel
+ * indices for the four-connected neighbourhood. It uses mark to
+ * determine if the surrounding pixels have already been visited.
+ */
+static void
+depth_first_search (guchar      *buffer,
+                    gint         width,
+                    gint         height,
+                    struct blob *b,
+                    guchar       mark,
+                    GArray      *stack)
+{
+  depth_first_search_push (buffer, b->seed, b, mark, stack);
 
-      tile_manager_read_pixel_data_1 (mask, xx, yy, &val);
+  while (stack->len > 0)
+    {
+      gint i  = g_array_index (stack, gint, stack->len - 1);
+      gint xx = i % width;
+      gint yy = i / width;
 
-      if (val && (val != mark))
-        {
-          if (mark == FIND_BLOB_VISITED)
-            {
-              ++(b->size);
-              if (val == FIND_BLOB_FORCEFG)
-                b->mustkeep = TRUE;
-            }
+      g_array_set_size (stack, stack->len - 1);
 
-          tile_manager_write_pixel_data_1 (mask, xx, yy, &mark);
+      if (yy > 0)
+        depth_first_search_push (buffer, i - width, b, mark, stack);
 
-          if (yy > y)
-            stack = g_slist_prepend (g_slist_prepend
-                                     (stack, GINT_TO_POINTER (yy - 1)),
-                                     GINT_TO_POINTER (xx));
+      if (yy + 1 < height)
+        depth_first_search_push (buffer, i + width, b, mark, stack);
 
-          if (yy + 1 < yheight)
-            stack = g_slist_prepend (g_slist_prepend
-                                     (stack, GINT_TO_POINTER (yy + 1)),
-                                     GINT_TO_POINTER (xx));
+      if (xx > 0)
+        depth_first_search_push (buffer, i - 1, b, mark, stack);
 
-          if (xx + 1 < xwidth)
-            {
-              if (xx > x)
-                stack = g_slist_prepend (g_slist_prepend (stack,
-                                                          GINT_TO_POINTER (yy)),
-                                         GINT_TO_POINTER (xx - 1));
-              ++xx;
-            }
-          else if (xx > x)
-            {
-              --xx;
-            }
-        }
+      if (xx + 1 < width)
+        depth_first_search_push (buffer, i + 1, b, mark, stack);
     }
 }
 
@@ -598,15 +701,15 @@ depth_first_search (TileManager *mask,
  * This method finds the biggest connected components in mask, it
  * clears everything in mask except the biggest components' Pixels that
  * should be considererd set in incoming mask, must fulfill (pixel &
- * 0x1) the method uses no further memory, except a queue, it finds
- * the biggest components by a 2 phase algorithm 1. in the first phase
- * the coordinates of an element of the biggest components are
- * identified, during this phase all pixels are visited. In the
- * second phase first visitation flags are reset, and afterwards
- * connected components starting at the found coordinates are
- * determined. These are the biggest components, the result is written
- * into mask, all pixels that belong to the biggest components are set
- * to 255, any other to 0.
+ * 0x1) the method works on a copy of the working area and uses no
+ * further memory, except a stack, it finds the biggest components by
+ * a 2 phase algorithm 1. in the first phase the coordinates of an
+ * element of the biggest components are identified, during this
+ * phase all pixels are visited. In the second phase first visitation
+ * flags are reset, and afterwards connected components starting at
+ * the found coordinates are determined. These are the biggest
+ * components, the result is written into mask, all pixels that
+ * belong to the biggest components are set to 255, any other to 0.
  */
 static void
 find_max_blob (TileManager *mask,
@@ -616,54 +719,41 @@ find_max_blob (TileManager *mask,
                gint         height,
                const gint   size_factor)
 {
-  GSList     *list = NULL;
-  GSList     *iter;
-  PixelRegion region;
-  gpointer    pr;
-  gint        row, col;
-  gint        maxsize = 0;
-  guchar      val;
+  GSList *list    = NULL;
+  GSList *iter;
+  GArray *stack;
+  guchar *buffer;
+  gint    maxsize = 0;
+  gint    i;
 
-  threshold_mask (mask, x, y, width, height);
+  buffer = g_new (guchar, width * height);
 
-  pixel_region_init (&region, mask, x, y, width, height, TRUE);
+  tile_manager_read_pixel_data (mask, x, y, x + width - 1, y + height - 1,
+                                buffer, width);
 
-  for (pr = pixel_regions_register (1, &region);
-       pr != NULL;
-       pr = pixel_regions_process (pr))
-    {
-      gint    pos_y = region.y;
-      guchar *data  = region.data;
-
-      for (row = 0; row < region.h; row++, pos_y++)
-        {
-          guchar *d = data;
+  threshold_mask (buffer, width * height);
 
-          for (col = 0; col < region.w; col++, d++)
-            {
-              val = *d;
+  stack = g_array_new (FALSE, FALSE, sizeof (gint));
 
-              if (val && (val != FIND_BLOB_VISITED))
-                {
-                  struct blob *b = g_slice_new (struct blob);
+  for (i = 0; i < width * height; i++)
+    {
+      guchar val = buffer[i];
 
-                  b->seedx    = region.x + col;
-                  b->seedy    = pos_y;
-                  b->size     = 0;
-                  b->mustkeep = FALSE;
+      if (val && (val != FIND_BLOB_VISITED))
+        {
+          struct blob *b = g_slice_new (struct blob);
 
-                  depth_first_search (mask,
-                                      x, y, x + width, y + height,
-                                      b, FIND_BLOB_VISITED);
+          b->seed     = i;
+          b->size     = 0;
+          b->mustkeep = FALSE;
 
-                  list = g_slist_prepend (list, b);
+          depth_first_search (buffer, width, height,
+                              b, FIND_BLOB_VISITED, stack);
 
-                  if (b->size > maxsize)
-                    maxsize = b->size;
-                }
-            }
+          list = g_slist_prepend (list, b);
 
-          data += region.rowstride;
+          if (b->size > maxsize)
+            maxsize = b->size;
         }
     }
 
@@ -671,14 +761,21 @@ find_max_blob (TileManager *mask,
     {
       struct blob *b = iter->data;
 
-      depth_first_search (mask, x, y, x + width, y + height, b,
+      depth_first_search (buffer, width, height, b,
                           (b->mustkeep || (b->size * size_factor >= maxsize)) ?
-                          FIND_BLOB_FINAL : 0);
+                          FIND_BLOB_FINAL : 0,
+                          stack);
 
       g_slice_free (struct blob, b);
     }
 
   g_slist_free (list);
+  g_array_free (stack, TRUE);
+
+  tile_manager_write_pixel_data (mask, x, y, x + width - 1, y + height - 1,
+                                 buffer, width);
+
+  g_free (buffer);
 }
 
 /* Creates a key for the hashtable from a given pixel color value */
@@ -732,6 +829,134 @@ siox_cache_remove_fg (gpointer key,
   return (cr->bgdist >= cr->fgdist);
 }
 
+/* Classifies a single color against the signatures */
+static void
+siox_classify_color (SioxState    *state,
+                     const guchar *src,
+                     gfloat        clustersize,
+                     classresult  *cr)
+{
+  lab labpixel;
+
+  calc_lab (src, state->bpp, state->colormap, &labpixel);
+
+  cr->bgdist = signature_min_distance (state->bgsig, state->bgsiglen,
+                                       &labpixel);
+
+  if (state->fgsiglen == 0)
+    {
+      if (cr->bgdist < clustersize)
+        cr->fgdist = cr->bgdist + clustersize;
+      else
+        cr->fgdist = 0.00001; /* This is a guess -
+                                 now we actually require a foreground
+                                 signature, !=0 to avoid div by zero
+                               */
+    }
+  else
+    {
+      cr->fgdist = signature_min_distance (state->fgsig, state->fgsiglen,
+                                           &labpixel);
+    }
+}
+
+/* Classifies the undecided pixels of a region, runs in parallel.
+ * Only the lookups in the shared color cache are serialized.
+ */
+static void
+siox_classify_region (classdata   *data,
+                      PixelRegion *srcPR,
+                      PixelRegion *mapPR)
+{
+  SioxState    *state    = data->state;
+  const guchar *src      = srcPR->data;
+  guchar       *map      = mapPR->data;
+  classresult   result   = { 0.0, 0.0 };
+  gint          last_key = -1;
+  gint          row, col;
+#ifdef SIOX_DEBUG
+  gint          hits     = 0;
+  gint          miss     = 0;
+#endif
+
+  for (row = 0; row < srcPR->h; row++)
+    {
+      const guchar *s = src;
+      guchar       *m = map;
+
+      for (col = 0; col < srcPR->w; col++, m++, s += state->bpp)
+        {
+          gint key;
+
+          if (*m < SIOX_LOW || *m > SIOX_HIGH)
+            continue;
+
+          key = create_key (s, state->bpp, state->colormap);
+
+          /* neighbouring pixels often share their color */
+          if (key != last_key)
+            {
+              classresult *cr;
+
+              g_mutex_lock (data->mutex);
+
+              cr = g_hash_table_lookup (state->cache, GINT_TO_POINTER (key));
+
+              if (cr)
+                result = *cr;
+
+              g_mutex_unlock (data->mutex);
+
+              if (cr)
+                {
+#ifdef SIOX_DEBUG
+                  ++hits;
+#endif
+                }
+              else
+                {
+#ifdef SIOX_DEBUG
+                  ++miss;
+#endif
+                  siox_classify_color (state, s, data->clustersize, &result);
+
+                  cr = g_slice_dup (classresult, &result);
+
+                  g_mutex_lock (data->mutex);
+                  g_hash_table_insert (state->cache, GINT_TO_POINTER (key), cr);
+                  g_mutex_unlock (data->mutex);
+                }
+
+              last_key = key;
+            }
+#ifdef SIOX_DEBUG
+          else
+            {
+              ++hits;
+            }
+#endif
+
+          *m = (result.bgdist >= result.fgdist) ? 254 : 0;
+        }
+
+      src += srcPR->rowstride;
+      map += mapPR->rowstride;
+    }
+
+#ifdef SIOX_DEBUG
+  g_atomic_int_add (&data->hits, hits);
+  g_atomic_int_add (&data->miss, miss);
+#endif
+}
+
+static void
+siox_classify_progress (classdata *data,
+                        gdouble    fraction)
+{
+  siox_progress_update (data->progress_callback, data->progress_data,
+                        0.5 + 0.3 * fraction);
+}
+
 /**
  * siox_init:
  * @pixels:   the tiles to extract the foreground from
@@ -846,6 +1071,7 @@ siox_foreground_extract (SioxState          *state,
   gint         n;
   gint         pixels, total;
   gfloat       limits[3];
+  classdata    data;
 
   g_return_if_fail (state != NULL);
   g_return_if_fail (mask != NULL && tile_manager_bpp (mask) == 1);
@@ -974,7 +1200,7 @@ siox_foreground_extract (SioxState          *state,
                     {
                       if (*m < SIOX_LOW)
                         {
-                          calc_lab (s, state->bpp, state->colormap, surebg + i);
+                          store_rgb (s, state->bpp, state->colormap, surebg + i);
                           i++;
                         }
                     }
@@ -1011,7 +1237,7 @@ siox_foreground_extract (SioxState          *state,
                     {
                       if (*m > SIOX_HIGH)
                         {
-                          calc_lab (s, state->bpp, state->colormap, surefg + i);
+                          store_rgb (s, state->bpp, state->colormap, surefg + i);
                           i++;
                         }
                     }
@@ -1049,12 +1275,12 @@ siox_foreground_extract (SioxState          *state,
                     {
                       if (*m < SIOX_LOW)
                         {
-                          calc_lab (s, state->bpp, state->colormap, surebg + i);
+                          store_rgb (s, state->bpp, state->colormap, surebg + i);
                           i++;
                         }
                       else if (*m > SIOX_HIGH)
                         {
-                          calc_lab (s, state->bpp, state->colormap, surefg + j);
+                          store_rgb (s, state->bpp, state->colormap, surefg + j);
                           j++;
                         }
                     }
@@ -1072,6 +1298,17 @@ siox_foreground_extract (SioxState          *state,
             }
         }
 
+      /* convert the collected colors to LAB on all processors */
+      if (surebg)
+        pixel_processor_process_range ((PixelProcessorRangeFunc)
+                                       rgb_to_lab_range,
+                                       surebg, surebgcount, 4096);
+
+      if (surefg)
+        pixel_processor_process_range ((PixelProcessorRangeFunc)
+                                       rgb_to_lab_range,
+                                       surefg, surefgcount, 4096);
+
       if (refinement & SIOX_REFINEMENT_ADD_BACKGROUND)
         {
           g_free (state->bgsig);
@@ -1116,127 +1353,39 @@ siox_foreground_extract (SioxState          *state,
                             x, y, width, height,
                             &x, &y, &width, &height);
 
-  /* Classify - the cached way....Better: Tree traversation? */
-
-#ifdef SIOX_DEBUG
-  gint hits = 0;
-  gint miss = 0;
-#endif
+  /* Classify - the cached way, on all processors */
 
   pixel_region_init (&srcPR, state->pixels,
                      x - state->offset_x, y - state->offset_y, width, height,
                      FALSE);
   pixel_region_init (&mapPR, mask, x, y, width, height, TRUE);
 
-  total = width * height;
-
-  for (pr = pixel_regions_register (2, &srcPR, &mapPR), n = 0, pixels = 0;
-       pr != NULL;
-       pr = pixel_regions_process (pr), n++)
-    {
-      const guchar *src = srcPR.data;
-      guchar       *map = mapPR.data;
-
-      for (row = 0; row < srcPR.h; row++)
-        {
-          const guchar *s = src;
-          guchar       *m = map;
-
-          for (col = 0; col < srcPR.w; col++, m++, s += state->bpp)
-            {
-              lab          labpixel;
-              gfloat       minbg, minfg, d;
-              classresult *cr;
-              gint         key;
-              gint         i;
-
-              if (*m < SIOX_LOW || *m > SIOX_HIGH)
-                continue;
-
-              key = create_key (s, state->bpp, state->colormap);
-
-              cr = g_hash_table_lookup (state->cache, GINT_TO_POINTER (key));
-
-              if (cr)
-                {
-                  *m = (cr->bgdist >= cr->fgdist) ? 254 : 0;
-
-#ifdef SIOX_DEBUG
-                  ++hits;
-#endif
-                  continue;
-                }
-
+  data.state             = state;
+  data.clustersize       = clustersize;
+  data.mutex             = g_mutex_new ();
+  data.progress_callback = progress_callback;
+  data.progress_data     = progress_data;
 #ifdef SIOX_DEBUG
-              ++miss;
+  data.hits              = 0;
+  data.miss              = 0;
 #endif
-              cr = g_slice_new0 (classresult);
-              calc_lab (s, state->bpp, state->colormap, &labpixel);
-
-              minbg = euklid (&labpixel, state->bgsig + 0);
-
-              for (i = 1; i < state->bgsiglen; i++)
-                {
-                  d = euklid (&labpixel, state->bgsig + i);
-
-                  if (d < minbg)
-                    minbg = d;
-                }
-
-              cr->bgdist = minbg;
-
-              if (state->fgsiglen == 0)
-                {
-                  if (minbg < clustersize)
-                    minfg = minbg + clustersize;
-                  else
-                    minfg = 0.00001; /* This is a guess -
-                                        now we actually require a foreground
-                                        signature, !=0 to avoid div by zero
-                                      */
-                }
-              else
-                {
-                  minfg = euklid (&labpixel, state->fgsig + 0);
-
-                  for (i = 1; i < state->fgsiglen; i++)
-                    {
-                      d = euklid (&labpixel, state->fgsig + i);
-
-                      if (d < minfg)
-                        {
-                          minfg = d;
-                        }
-                    }
-                }
 
-              cr->fgdist = minfg;
+  pixel_regions_process_parallel_progress ((PixelProcessorFunc)
+                                           siox_classify_region, &data,
+                                           (PixelProcessorProgressFunc)
+                                           siox_classify_progress, &data,
+                                           2, &srcPR, &mapPR);
 
-              g_hash_table_insert (state->cache, GINT_TO_POINTER (key), cr);
-
-              *m = minbg >= minfg ? 254 : 0;
-           }
-
-          src += srcPR.rowstride;
-          map += mapPR.rowstride;
-        }
-
-      pixels += mapPR.w * mapPR.h;
-
-      if (n % 8 == 0)
-        siox_progress_update (progress_callback, progress_data,
-                              0.5 + 0.3 * ((gdouble) pixels / (gdouble) total));
-    }
+  g_mutex_free (data.mutex);
 
 #ifdef SIOX_DEBUG
   g_printerr ("siox.c: Hashtable size %d, misses=%d, hits=%d, ratio=%f\n",
               g_hash_table_size (state->cache),
-              miss,
-              hits,
-              ((gfloat) hits) / miss);
+              data.miss,
+              data.hits,
+              ((gfloat) data.hits) / data.miss);
 #endif
 
-
   /* smooth a bit for error killing */
   smooth_mask (mask, x, y, width, height);
 
@@ -551,6 +551,41 @@ tile_manager_invalidate_area (TileManager *tm,
       }
 }
 
+/*  Like tile_manager_invalidate_area(), but leaves the tiles alone that
+ *  are locked, by a pixel region or a GEGL buffer reading them in place.
+ */
+void
+tile_manager_discard_area (TileManager *tm,
+                           gint         x,
+                           gint         y,
+                           gint         w,
+                           gint         h)
+{
+  gint  i;
+  gint  j;
+
+  if (! tm->tiles)
+    return;
+
+  for (i = y; i < (y + h); i += (TILE_HEIGHT - (i % TILE_HEIGHT)))
+    for (j = x; j < (x + w); j += (TILE_WIDTH - (j % TILE_WIDTH)))
+      {
+        gint  num  = tile_manager_get_tile_num (tm, j, i);
+        Tile *tile;
+
+        if (num < 0)
+          continue;
+
+        tile = tm->tiles[num];
+
+        /*  the cached tile is locked by the tile manager itself  */
+        if (tile->ref_count > (num == tm->cached_num ? 1 : 0))
+          continue;
+
+        tile_manager_invalidate_tile (tm, num);
+      }
+}
+
 gint
 tile_manager_width (const TileManager *tm)
 {
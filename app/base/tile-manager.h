@@ -92,6 +92,15 @@ void          tile_manager_invalidate_area   (TileManager       *tm,
                                               gint               w,
                                               gint               h);
 
+/* Free the memory and swap space of the tiles in the area that are
+ * not in use.  They read as uninitialized memory afterwards.
+ */
+void          tile_manager_discard_area      (TileManager       *tm,
+                                              gint               x,
+                                              gint               y,
+                                              gint               w,
+                                              gint               h);
+
 gint          tile_manager_width             (const TileManager *tm);
 gint          tile_manager_height            (const TileManager *tm);
 gint          tile_manager_bpp               (const TileManager *tm);
@@ -91,6 +91,8 @@ enum
   PROP_UNDO_LEVELS,
   PROP_UNDO_SIZE,
   PROP_UNDO_PREVIEW_SIZE,
+  PROP_COMPRESS_UNDO,
+  PROP_UNDO_SWAP_SIZE,
   PROP_PLUG_IN_HISTORY_SIZE,
   PROP_PLUGINRC_PATH,
   PROP_LAYER_PREVIEWS,
@@ -386,6 +388,14 @@ gimp_core_config_class_init (GimpCoreConfigClass *klass)
                                  GIMP_VIEW_SIZE_LARGE,
                                  GIMP_PARAM_STATIC_STRINGS |
                                  GIMP_CONFIG_PARAM_RESTART);
+  GIMP_CONFIG_INSTALL_PROP_BOOLEAN (object_class, PROP_COMPRESS_UNDO,
+                                    "compress-undo", COMPRESS_UNDO_BLURB,
+                                    FALSE,
+                                    GIMP_PARAM_STATIC_STRINGS);
+  GIMP_CONFIG_INSTALL_PROP_MEMSIZE (object_class, PROP_UNDO_SWAP_SIZE,
+                                    "undo-swap-size", UNDO_SWAP_SIZE_BLURB,
+                                    0, GIMP_MAX_MEMSIZE, 0,
+                                    GIMP_PARAM_STATIC_STRINGS);
   GIMP_CONFIG_INSTALL_PROP_INT (object_class, PROP_PLUG_IN_HISTORY_SIZE,
                                 "plug-in-history-size",
                                 PLUG_IN_HISTORY_SIZE_BLURB,
@@ -689,6 +699,12 @@ gimp_core_config_set_property (GObject      *object,
     case PROP_UNDO_PREVIEW_SIZE:
       core_config->undo_preview_size = g_value_get_enum (value);
       break;
+    case PROP_COMPRESS_UNDO:
+      core_config->compress_undo = g_value_get_boolean (value);
+      break;
+    case PROP_UNDO_SWAP_SIZE:
+      core_config->undo_swap_size = g_value_get_uint64 (value);
+      break;
     case PROP_PLUGINRC_PATH:
       g_free (core_config->plug_in_rc_path);
       core_config->plug_in_rc_path = g_value_dup_string (value);
@@ -864,6 +880,12 @@ gimp_core_config_get_property (GObject    *object,
     case PROP_UNDO_PREVIEW_SIZE:
       g_value_set_enum (value, core_config->undo_preview_size);
       break;
+    case PROP_COMPRESS_UNDO:
+      g_value_set_boolean (value, core_config->compress_undo);
+      break;
+    case PROP_UNDO_SWAP_SIZE:
+      g_value_set_uint64 (value, core_config->undo_swap_size);
+      break;
     case PROP_PLUGINRC_PATH:
       g_value_set_string (value, core_config->plug_in_rc_path);
       break;
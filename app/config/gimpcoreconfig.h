@@ -78,6 +78,8 @@ struct _GimpCoreConfig
   gint                    levels_of_undo;
   guint64                 undo_size;
   GimpViewSize            undo_preview_size;
+  gboolean                compress_undo;
+  guint64                 undo_swap_size;
   gint                    plug_in_history_size;
   gchar                  *plug_in_rc_path;
   gboolean                layer_previews;
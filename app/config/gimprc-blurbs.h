@@ -42,6 +42,11 @@ N_("Specifies how the area around the image should be drawn.")
 #define COLOR_PROFILE_POLICY_BLURB \
 N_("How to handle embedded color profiles when opening a file.")
 
+#define COMPRESS_UNDO_BLURB \
+N_("When enabled, the pixel data of undo steps that are no longer on " \
+   "top of the undo stack is kept compressed. This reduces the memory " \
+   "used for undo at the cost of compressing and uncompressing it.")
+
 #define CONFIRM_ON_CLOSE_BLURB \
 N_("Ask for confirmation before closing an image without saving.")
 
@@ -453,6 +458,12 @@ N_("Sets an upper limit to the memory that is used per image to keep " \
    "operations on the undo stack. Regardless of this setting, at least " \
    "as many undo-levels as configured can be undone.")
 
+#define UNDO_SWAP_SIZE_BLURB \
+N_("Sets the disk space per image that undo steps are spilled to once " \
+   "the undo-size limit is reached, instead of dropping them. This is " \
+   "independent of the tile-cache-size. Setting it to zero disables " \
+   "spilling undo steps.")
+
 #define UNDO_PREVIEW_SIZE_BLURB \
 N_("Sets the size of the previews in the Undo History.")
 
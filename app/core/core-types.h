@@ -146,6 +146,7 @@ typedef struct _GimpSamplePointUndo   GimpSamplePointUndo;
 typedef struct _GimpFloatingSelUndo   GimpFloatingSelUndo;
 typedef struct _GimpUndoStack         GimpUndoStack;
 typedef struct _GimpUndoAccumulator   GimpUndoAccumulator;
+typedef struct _GimpUndoStore         GimpUndoStore;
 
 
 /*  misc objects  */
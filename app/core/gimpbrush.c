@@ -258,6 +258,11 @@ gimp_brush_get_memsize (GimpObject *object,
   memsize += temp_buf_get_memsize (brush->mask);
   memsize += temp_buf_get_memsize (brush->pixmap);
 
+  memsize += gimp_object_get_memsize (GIMP_OBJECT (brush->mask_cache), NULL);
+  memsize += gimp_object_get_memsize (GIMP_OBJECT (brush->pixmap_cache), NULL);
+  memsize += gimp_object_get_memsize (GIMP_OBJECT (brush->boundary_cache),
+                                      NULL);
+
   return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
                                                                   gui_size);
 }
@@ -414,13 +419,19 @@ static void
 gimp_brush_real_begin_use (GimpBrush *brush)
 {
   brush->mask_cache =
-    gimp_brush_cache_new ((GDestroyNotify) temp_buf_free, 'M', 'm');
+    gimp_brush_cache_new ((GDestroyNotify) temp_buf_free,
+                          (GimpBrushCacheMemsizeFunc) temp_buf_get_memsize,
+                          'M', 'm');
 
   brush->pixmap_cache =
-    gimp_brush_cache_new ((GDestroyNotify) temp_buf_free, 'P', 'p');
+    gimp_brush_cache_new ((GDestroyNotify) temp_buf_free,
+                          (GimpBrushCacheMemsizeFunc) temp_buf_get_memsize,
+                          'P', 'p');
 
   brush->boundary_cache =
-    gimp_brush_cache_new ((GDestroyNotify) gimp_bezier_desc_free, 'B', 'b');
+    gimp_brush_cache_new ((GDestroyNotify) gimp_bezier_desc_free,
+                          (GimpBrushCacheMemsizeFunc) gimp_bezier_desc_get_memsize,
+                          'B', 'b');
 }
 
 static void
@@ -22,31 +22,69 @@
 
 #include <gegl.h>
 
+#include "libgimpmath/gimpmath.h"
+
 #include "core-types.h"
 
 #include "gimpbrushcache.h"
+#include "gimp-utils.h"
 
 #include "gimp-log.h"
 #include "gimp-intl.h"
 
 
+/*  transform parameters are compared after quantizing them to these
+ *  steps, so tiny jitter from pressure dynamics doesn't defeat the cache
+ */
+#define SCALE_QUANTUM        10000.0
+#define ASPECT_RATIO_QUANTUM  1000.0
+#define ANGLE_QUANTUM        10000.0  /* in turns */
+#define HARDNESS_QUANTUM      1000.0
+
+#define QUANTIZE(value,quantum) ((gint) RINT ((value) * (quantum)))
+
+
 enum
 {
   PROP_0,
-  PROP_DATA_DESTROY
+  PROP_DATA_DESTROY,
+  PROP_DATA_MEMSIZE
+};
+
+
+typedef struct _GimpBrushCacheUnit GimpBrushCacheUnit;
+
+struct _GimpBrushCacheUnit
+{
+  gpointer data;
+  gint64   memsize;
+
+  gint     width;
+  gint     height;
+  gint     scale;
+  gint     aspect_ratio;
+  gint     angle;
+  gint     hardness;
 };
 
 
-static void   gimp_brush_cache_constructed  (GObject      *object);
-static void   gimp_brush_cache_finalize     (GObject      *object);
-static void   gimp_brush_cache_set_property (GObject      *object,
-                                             guint         property_id,
-                                             const GValue *value,
-                                             GParamSpec   *pspec);
-static void   gimp_brush_cache_get_property (GObject      *object,
-                                             guint         property_id,
-                                             GValue       *value,
-                                             GParamSpec   *pspec);
+static void   gimp_brush_cache_constructed  (GObject            *object);
+static void   gimp_brush_cache_finalize     (GObject            *object);
+static void   gimp_brush_cache_set_property (GObject            *object,
+                                             guint               property_id,
+                                             const GValue       *value,
+                                             GParamSpec         *pspec);
+static void   gimp_brush_cache_get_property (GObject            *object,
+                                             guint               property_id,
+                                             GValue             *value,
+                                             GParamSpec         *pspec);
+
+static gint64 gimp_brush_cache_get_memsize  (GimpObject         *object,
+                                             gint64             *gui_size);
+
+static void   gimp_brush_cache_unit_free    (GimpBrushCache     *cache,
+                                             GimpBrushCacheUnit *unit);
+static void   gimp_brush_cache_evict        (GimpBrushCache     *cache);
 
 
 G_DEFINE_TYPE (GimpBrushCache, gimp_brush_cache, GIMP_TYPE_OBJECT)
@@ -57,18 +95,27 @@ G_DEFINE_TYPE (GimpBrushCache, gimp_brush_cache, GIMP_TYPE_OBJECT)
 static void
 gimp_brush_cache_class_init (GimpBrushCacheClass *klass)
 {
-  GObjectClass  *object_class = G_OBJECT_CLASS (klass);
+  GObjectClass    *object_class      = G_OBJECT_CLASS (klass);
+  GimpObjectClass *gimp_object_class = GIMP_OBJECT_CLASS (klass);
 
-  object_class->constructed  = gimp_brush_cache_constructed;
-  object_class->finalize     = gimp_brush_cache_finalize;
-  object_class->set_property = gimp_brush_cache_set_property;
-  object_class->get_property = gimp_brush_cache_get_property;
+  object_class->constructed      = gimp_brush_cache_constructed;
+  object_class->finalize         = gimp_brush_cache_finalize;
+  object_class->set_property     = gimp_brush_cache_set_property;
+  object_class->get_property     = gimp_brush_cache_get_property;
+
+  gimp_object_class->get_memsize = gimp_brush_cache_get_memsize;
 
   g_object_class_install_property (object_class, PROP_DATA_DESTROY,
                                    g_param_spec_pointer ("data-destroy",
                                                          NULL, NULL,
                                                          GIMP_PARAM_READWRITE |
                                                          G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (object_class, PROP_DATA_MEMSIZE,
+                                   g_param_spec_pointer ("data-memsize",
+                                                         NULL, NULL,
+                                                         GIMP_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT_ONLY));
 }
 
 static void
@@ -92,11 +139,13 @@ gimp_brush_cache_finalize (GObject *object)
 {
   GimpBrushCache *cache = GIMP_BRUSH_CACHE (object);
 
-  if (cache->last_data)
-    {
-      cache->data_destroy (cache->last_data);
-      cache->last_data = NULL;
-    }
+  if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
+    g_printerr ("\nbrush cache: %" G_GUINT64_FORMAT " hits, %"
+                G_GUINT64_FORMAT " misses (%.1f%%)\n",
+                cache->n_hits, cache->n_misses,
+                100.0 * gimp_brush_cache_get_hit_rate (cache));
+
+  gimp_brush_cache_clear (cache);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -114,6 +163,9 @@ gimp_brush_cache_set_property (GObject      *object,
     case PROP_DATA_DESTROY:
       cache->data_destroy = g_value_get_pointer (value);
       break;
+    case PROP_DATA_MEMSIZE:
+      cache->data_memsize = g_value_get_pointer (value);
+      break;
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -134,6 +186,9 @@ gimp_brush_cache_get_property (GObject    *object,
     case PROP_DATA_DESTROY:
       g_value_set_pointer (value, cache->data_destroy);
       break;
+    case PROP_DATA_MEMSIZE:
+      g_value_set_pointer (value, cache->data_memsize);
+      break;
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -141,13 +196,29 @@ gimp_brush_cache_get_property (GObject    *object,
     }
 }
 
+static gint64
+gimp_brush_cache_get_memsize (GimpObject *object,
+                              gint64     *gui_size)
+{
+  GimpBrushCache *cache   = GIMP_BRUSH_CACHE (object);
+  gint64          memsize = 0;
+
+  memsize += gimp_g_list_get_memsize (cache->cached_units,
+                                      sizeof (GimpBrushCacheUnit));
+  memsize += cache->memsize;
+
+  return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
+                                                                  gui_size);
+}
+
 
 /*  public functions  */
 
 GimpBrushCache *
-gimp_brush_cache_new (GDestroyNotify  data_destroy,
-                      gchar           debug_hit,
-                      gchar           debug_miss)
+gimp_brush_cache_new (GDestroyNotify             data_destroy,
+                      GimpBrushCacheMemsizeFunc  data_memsize,
+                      gchar                      debug_hit,
+                      gchar                      debug_miss)
 {
   GimpBrushCache *cache;
 
@@ -155,6 +226,7 @@ gimp_brush_cache_new (GDestroyNotify  data_destroy,
 
   cache =  g_object_new (GIMP_TYPE_BRUSH_CACHE,
                          "data-destroy", data_destroy,
+                         "data-memsize", data_memsize,
                          NULL);
 
   cache->debug_hit  = debug_hit;
@@ -166,13 +238,17 @@ gimp_brush_cache_new (GDestroyNotify  data_destroy,
 void
 gimp_brush_cache_clear (GimpBrushCache *cache)
 {
+  GList *list;
+
   g_return_if_fail (GIMP_IS_BRUSH_CACHE (cache));
 
-  if (cache->last_data)
-    {
-      cache->data_destroy (cache->last_data);
-      cache->last_data = NULL;
-    }
+  for (list = cache->cached_units; list; list = g_list_next (list))
+    gimp_brush_cache_unit_free (cache, list->data);
+
+  g_list_free (cache->cached_units);
+  cache->cached_units = NULL;
+  cache->n_units      = 0;
+  cache->memsize      = 0;
 }
 
 gconstpointer
@@ -184,22 +260,49 @@ gimp_brush_cache_get (GimpBrushCache *cache,
                       gdouble         angle,
                       gdouble         hardness)
 {
+  GList *list;
+  gint   q_scale;
+  gint   q_aspect_ratio;
+  gint   q_angle;
+  gint   q_hardness;
+
   g_return_val_if_fail (GIMP_IS_BRUSH_CACHE (cache), NULL);
 
-  if (cache->last_data                         &&
-      cache->last_width        == width        &&
-      cache->last_height       == height       &&
-      cache->last_scale        == scale        &&
-      cache->last_aspect_ratio == aspect_ratio &&
-      cache->last_angle        == angle        &&
-      cache->last_hardness     == hardness)
-    {
-      if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
-        g_printerr ("%c", cache->debug_hit);
+  q_scale        = QUANTIZE (scale,        SCALE_QUANTUM);
+  q_aspect_ratio = QUANTIZE (aspect_ratio, ASPECT_RATIO_QUANTUM);
+  q_angle        = QUANTIZE (angle,        ANGLE_QUANTUM);
+  q_hardness     = QUANTIZE (hardness,     HARDNESS_QUANTUM);
 
-      return (gconstpointer) cache->last_data;
+  for (list = cache->cached_units; list; list = g_list_next (list))
+    {
+      GimpBrushCacheUnit *unit = list->data;
+
+      if (unit->width        == width          &&
+          unit->height       == height         &&
+          unit->scale        == q_scale        &&
+          unit->aspect_ratio == q_aspect_ratio &&
+          unit->angle        == q_angle        &&
+          unit->hardness     == q_hardness)
+        {
+          /*  move the hit to the front, keeping the list in LRU order  */
+          if (list != cache->cached_units)
+            {
+              cache->cached_units = g_list_remove_link (cache->cached_units,
+                                                        list);
+              cache->cached_units = g_list_concat (list, cache->cached_units);
+            }
+
+          cache->n_hits++;
+
+          if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
+            g_printerr ("%c", cache->debug_hit);
+
+          return (gconstpointer) unit->data;
+        }
     }
 
+  cache->n_misses++;
+
   if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
     g_printerr ("%c", cache->debug_miss);
 
@@ -216,20 +319,81 @@ gimp_brush_cache_add (GimpBrushCache *cache,
                       gdouble         angle,
                       gdouble         hardness)
 {
+  GimpBrushCacheUnit *unit;
+
   g_return_if_fail (GIMP_IS_BRUSH_CACHE (cache));
   g_return_if_fail (data != NULL);
 
-  if (data == cache->last_data)
-    return;
+  if (cache->cached_units)
+    {
+      unit = cache->cached_units->data;
+
+      if (data == unit->data)
+        return;
+    }
+
+  unit = g_slice_new (GimpBrushCacheUnit);
+
+  unit->data         = data;
+  unit->memsize      = cache->data_memsize ? cache->data_memsize (data) : 0;
+  unit->width        = width;
+  unit->height       = height;
+  unit->scale        = QUANTIZE (scale,        SCALE_QUANTUM);
+  unit->aspect_ratio = QUANTIZE (aspect_ratio, ASPECT_RATIO_QUANTUM);
+  unit->angle        = QUANTIZE (angle,        ANGLE_QUANTUM);
+  unit->hardness     = QUANTIZE (hardness,     HARDNESS_QUANTUM);
+
+  cache->cached_units = g_list_prepend (cache->cached_units, unit);
+  cache->n_units++;
+  cache->memsize += unit->memsize;
+
+  gimp_brush_cache_evict (cache);
+}
+
+gdouble
+gimp_brush_cache_get_hit_rate (GimpBrushCache *cache)
+{
+  guint64 n_lookups;
+
+  g_return_val_if_fail (GIMP_IS_BRUSH_CACHE (cache), 0.0);
 
-  if (cache->last_data)
-    cache->data_destroy (cache->last_data);
+  n_lookups = cache->n_hits + cache->n_misses;
 
-  cache->last_data         = data;
-  cache->last_width        = width;
-  cache->last_height       = height;
-  cache->last_scale        = scale;
-  cache->last_aspect_ratio = aspect_ratio;
-  cache->last_angle        = angle;
-  cache->last_hardness     = hardness;
+  if (n_lookups == 0)
+    return 0.0;
+
+  return (gdouble) cache->n_hits / (gdouble) n_lookups;
+}
+
+
+/*  private functions  */
+
+static void
+gimp_brush_cache_unit_free (GimpBrushCache     *cache,
+                            GimpBrushCacheUnit *unit)
+{
+  cache->data_destroy (unit->data);
+
+  g_slice_free (GimpBrushCacheUnit, unit);
+}
+
+static void
+gimp_brush_cache_evict (GimpBrushCache *cache)
+{
+  /*  never evict the most recently added unit, callers hold on to it
+   *  until their next lookup
+   */
+  while (cache->n_units > 1 &&
+         (cache->n_units > GIMP_BRUSH_CACHE_MAX_UNITS ||
+          cache->memsize > GIMP_BRUSH_CACHE_MAX_MEMSIZE))
+    {
+      GList              *last = g_list_last (cache->cached_units);
+      GimpBrushCacheUnit *unit = last->data;
+
+      cache->cached_units = g_list_delete_link (cache->cached_units, last);
+      cache->n_units--;
+      cache->memsize -= unit->memsize;
+
+      gimp_brush_cache_unit_free (cache, unit);
+    }
 }
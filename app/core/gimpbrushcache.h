@@ -33,24 +33,34 @@
 #define GIMP_BRUSH_CACHE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GIMP_TYPE_BRUSH_CACHE, GimpBrushCacheClass))
 
 
+/*  the cache keeps at most this many transformed versions of a brush
+ *  and evicts the least recently used ones when either limit is exceeded
+ */
+#define GIMP_BRUSH_CACHE_MAX_UNITS   32
+#define GIMP_BRUSH_CACHE_MAX_MEMSIZE (32 * 1024 * 1024)
+
+
+typedef gsize (* GimpBrushCacheMemsizeFunc) (gconstpointer data);
+
+
 typedef struct _GimpBrushCacheClass GimpBrushCacheClass;
 
 struct _GimpBrushCache
 {
-  GimpObject      parent_instance;
+  GimpObject                 parent_instance;
+
+  GDestroyNotify             data_destroy;
+  GimpBrushCacheMemsizeFunc  data_memsize;
 
-  GDestroyNotify  data_destroy;
+  GList                     *cached_units; /* most recently used first */
+  gint                       n_units;
+  gint64                     memsize;
 
-  gpointer        last_data;
-  gint            last_width;
-  gint            last_height;
-  gdouble         last_scale;
-  gdouble         last_aspect_ratio;
-  gdouble         last_angle;
-  gdouble         last_hardness;
+  guint64                    n_hits;
+  guint64                    n_misses;
 
-  gchar           debug_hit;
-  gchar           debug_miss;
+  gchar                      debug_hit;
+  gchar                      debug_miss;
 };
 
 struct _GimpBrushCacheClass
@@ -59,29 +69,32 @@ struct _GimpBrushCacheClass
 };
 
 
-GType            gimp_brush_cache_get_type (void) G_GNUC_CONST;
-
-GimpBrushCache * gimp_brush_cache_new      (GDestroyNotify  data_destory,
-                                            gchar           debug_hit,
-                                            gchar           debug_miss);
-
-void             gimp_brush_cache_clear    (GimpBrushCache *cache);
-
-gconstpointer    gimp_brush_cache_get      (GimpBrushCache *cache,
-                                            gint            width,
-                                            gint            height,
-                                            gdouble         scale,
-                                            gdouble         aspect_ratio,
-                                            gdouble         angle,
-                                            gdouble         hardness);
-void             gimp_brush_cache_add      (GimpBrushCache *cache,
-                                            gpointer        data,
-                                            gint            width,
-                                            gint            height,
-                                            gdouble         scale,
-                                            gdouble         aspect_ratio,
-                                            gdouble         angle,
-                                            gdouble         hardness);
+GType            gimp_brush_cache_get_type     (void) G_GNUC_CONST;
+
+GimpBrushCache * gimp_brush_cache_new          (GDestroyNotify             data_destory,
+                                                GimpBrushCacheMemsizeFunc  data_memsize,
+                                                gchar                      debug_hit,
+                                                gchar                      debug_miss);
+
+void             gimp_brush_cache_clear        (GimpBrushCache            *cache);
+
+gconstpointer    gimp_brush_cache_get          (GimpBrushCache            *cache,
+                                                gint                       width,
+                                                gint                       height,
+                                                gdouble                    scale,
+                                                gdouble                    aspect_ratio,
+                                                gdouble                    angle,
+                                                gdouble                    hardness);
+void             gimp_brush_cache_add          (GimpBrushCache            *cache,
+                                                gpointer                   data,
+                                                gint                       width,
+                                                gint                       height,
+                                                gdouble                    scale,
+                                                gdouble                    aspect_ratio,
+                                                gdouble                    angle,
+                                                gdouble                    hardness);
+
+gdouble          gimp_brush_cache_get_hit_rate (GimpBrushCache            *cache);
 
 
 #endif  /*  __GIMP_BRUSH_CACHE_H__  */
@@ -47,6 +47,9 @@
 #include "gimp-intl.h"
 
 
+#define SHAPEBURST_CACHE_KEY "gimp-drawable-blend-shapeburst"
+
+
 typedef struct
 {
   GimpGradient     *gradient;
@@ -72,6 +75,19 @@ typedef struct
   GRand       *dither_rand;
 } PutPixelData;
 
+/*  the distance map of the selection is kept on the selection mask
+ *  until the mask changes, so repeated blends don't recompute it
+ */
+typedef struct
+{
+  GimpChannel *mask;
+  gulong       update_id;
+  TileManager *tiles;   /*  the normalized distance map           */
+  gint         x, y;    /*  the part of the mask it was made for  */
+  gint         width;
+  gint         height;
+} ShapeburstCache;
+
 
 /*  local function prototypes  */
 
@@ -117,6 +133,13 @@ static gdouble  gradient_calc_shapeburst_spherical_factor (gdouble x,
 static gdouble  gradient_calc_shapeburst_dimpled_factor   (gdouble x,
                                                            gdouble y);
 
+static void     shapeburst_cache_free       (ShapeburstCache  *cache);
+static void     shapeburst_cache_invalidate (GimpDrawable     *mask,
+                                             gint              x,
+                                             gint              y,
+                                             gint              width,
+                                             gint              height,
+                                             gpointer          data);
 static void     gradient_precalc_shapeburst (GimpImage        *image,
                                              GimpDrawable     *drawable,
                                              PixelRegion      *PR,
@@ -255,6 +278,23 @@ gimp_drawable_blend (GimpDrawable         *drawable,
   gimp_unset_busy (image->gimp);
 }
 
+/*  the shapeburst distance map kept on a selection mask  */
+gint64
+gimp_drawable_blend_get_memsize (GimpDrawable *drawable)
+{
+  ShapeburstCache *cache;
+
+  g_return_val_if_fail (GIMP_IS_DRAWABLE (drawable), 0);
+
+  cache = g_object_get_data (G_OBJECT (drawable), SHAPEBURST_CACHE_KEY);
+
+  if (! cache)
+    return 0;
+
+  return sizeof (ShapeburstCache) + tile_manager_get_memsize (cache->tiles,
+                                                              FALSE);
+}
+
 static gdouble
 gradient_calc_conical_sym_factor (gdouble  dist,
                                   gdouble *axis,
@@ -560,6 +600,28 @@ gradient_calc_shapeburst_dimpled_factor (gdouble x,
   return value;
 }
 
+static void
+shapeburst_cache_free (ShapeburstCache *cache)
+{
+  if (g_signal_handler_is_connected (cache->mask, cache->update_id))
+    g_signal_handler_disconnect (cache->mask, cache->update_id);
+
+  tile_manager_unref (cache->tiles);
+
+  g_slice_free (ShapeburstCache, cache);
+}
+
+static void
+shapeburst_cache_invalidate (GimpDrawable *mask,
+                             gint          x,
+                             gint          y,
+                             gint          width,
+                             gint          height,
+                             gpointer      data)
+{
+  g_object_set_data (G_OBJECT (mask), SHAPEBURST_CACHE_KEY, NULL);
+}
+
 static void
 gradient_precalc_shapeburst (GimpImage    *image,
                              GimpDrawable *drawable,
@@ -567,13 +629,48 @@ gradient_precalc_shapeburst (GimpImage    *image,
                              gdouble       dist,
                              GimpProgress *progress)
 {
-  GimpChannel *mask;
-  PixelRegion  tempR;
-  gfloat       max_iteration;
-  gfloat      *distp;
-  gint         size;
-  gpointer     pr;
-  guchar       white[1] = { OPAQUE_OPACITY };
+  GimpChannel     *mask;
+  ShapeburstCache *cache = NULL;
+  PixelRegion      tempR;
+  gfloat           max_iteration;
+  gfloat          *distp;
+  gint             size;
+  gpointer         pr;
+  guchar           white[1] = { OPAQUE_OPACITY };
+
+  mask = gimp_image_get_mask (image);
+
+  /*  If the image mask is not empty, use it as the shape burst source  */
+  if (! gimp_channel_is_empty (mask))
+    {
+      gint x, y, width, height;
+      gint off_x, off_y;
+
+      gimp_item_mask_intersect (GIMP_ITEM (drawable), &x, &y, &width, &height);
+      gimp_item_get_offset (GIMP_ITEM (drawable), &off_x, &off_y);
+
+      cache = g_object_get_data (G_OBJECT (mask), SHAPEBURST_CACHE_KEY);
+
+      if (cache                        &&
+          cache->x      == x + off_x   &&
+          cache->y      == y + off_y   &&
+          cache->width  == width       &&
+          cache->height == height)
+        {
+          distR.tiles = tile_manager_ref (cache->tiles);
+          pixel_region_init (&distR, distR.tiles, 0, 0, PR->w, PR->h, FALSE);
+
+          return;
+        }
+
+      cache = g_slice_new (ShapeburstCache);
+
+      cache->mask   = mask;
+      cache->x      = x + off_x;
+      cache->y      = y + off_y;
+      cache->width  = width;
+      cache->height = height;
+    }
 
   /*  allocate the distance map  */
   distR.tiles = tile_manager_new (PR->w, PR->h, sizeof (gfloat));
@@ -582,20 +679,13 @@ gradient_precalc_shapeburst (GimpImage    *image,
   tempR.tiles = tile_manager_new (PR->w, PR->h, 1);
   pixel_region_init (&tempR, tempR.tiles, 0, 0, PR->w, PR->h, TRUE);
 
-  mask = gimp_image_get_mask (image);
-
-  /*  If the image mask is not empty, use it as the shape burst source  */
-  if (! gimp_channel_is_empty (mask))
+  if (cache)
     {
       PixelRegion maskR;
-      gint        x, y, width, height;
-      gint        off_x, off_y;
-
-      gimp_item_mask_intersect (GIMP_ITEM (drawable), &x, &y, &width, &height);
-      gimp_item_get_offset (GIMP_ITEM (drawable), &off_x, &off_y);
 
       pixel_region_init (&maskR, gimp_drawable_get_tiles (GIMP_DRAWABLE (mask)),
-                         x + off_x, y + off_y, width, height, FALSE);
+                         cache->x, cache->y, cache->width, cache->height,
+                         FALSE);
 
       /*  copy the mask to the temp mask  */
       copy_region (&maskR, &tempR);
@@ -646,6 +736,17 @@ gradient_precalc_shapeburst (GimpImage    *image,
     }
 
   tile_manager_unref (tempR.tiles);
+
+  if (cache)
+    {
+      cache->tiles     = tile_manager_ref (distR.tiles);
+      cache->update_id =
+        g_signal_connect (mask, "update",
+                          G_CALLBACK (shapeburst_cache_invalidate), NULL);
+
+      g_object_set_data_full (G_OBJECT (mask), SHAPEBURST_CACHE_KEY, cache,
+                              (GDestroyNotify) shapeburst_cache_free);
+    }
 }
 
 
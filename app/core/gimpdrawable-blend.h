@@ -38,5 +38,7 @@ void   gimp_drawable_blend (GimpDrawable         *drawable,
                             gdouble               endy,
                             GimpProgress         *progress);
 
+gint64 gimp_drawable_blend_get_memsize (GimpDrawable         *drawable);
+
 
 #endif /* __GIMP_DRAWABLE_BLEND_H__ */
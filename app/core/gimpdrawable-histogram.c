@@ -72,3 +72,40 @@ gimp_drawable_calculate_histogram (GimpDrawable  *drawable,
       gimp_histogram_calculate (histogram, &region, NULL);
     }
 }
+
+/*  like gimp_drawable_calculate_histogram(), but reuses the values of
+ *  parts of @histogram which have not been passed to
+ *  gimp_histogram_invalidate_area() since the last call, as long as
+ *  there is no selection to take into account
+ */
+void
+gimp_drawable_calculate_histogram_incremental (GimpDrawable  *drawable,
+                                               GimpHistogram *histogram)
+{
+  GimpImage   *image;
+  PixelRegion  region;
+  gint         width, height;
+
+  g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
+  g_return_if_fail (gimp_item_is_attached (GIMP_ITEM (drawable)));
+  g_return_if_fail (histogram != NULL);
+
+  image = gimp_item_get_image (GIMP_ITEM (drawable));
+
+  if (! gimp_channel_is_empty (gimp_image_get_mask (image)))
+    {
+      gimp_drawable_calculate_histogram (drawable, histogram);
+      return;
+    }
+
+  width  = gimp_item_get_width  (GIMP_ITEM (drawable));
+  height = gimp_item_get_height (GIMP_ITEM (drawable));
+
+  if (width < 1 || height < 1)
+    return;
+
+  pixel_region_init (&region, gimp_drawable_get_tiles (drawable),
+                     0, 0, width, height, FALSE);
+
+  gimp_histogram_calculate_incremental (histogram, &region);
+}
@@ -40,6 +40,7 @@
 #include "gimp-utils.h" /* temp for GIMP_TIMER */
 #include "gimpchannel.h"
 #include "gimpcontext.h"
+#include "gimpdrawable-blend.h"
 #include "gimpdrawable-combine.h"
 #include "gimpdrawable-convert.h"
 #include "gimpdrawable-operation.h"
@@ -49,6 +50,7 @@
 #include "gimpdrawable-transform.h"
 #include "gimpimage.h"
 #include "gimpimage-colormap.h"
+#include "gimpimage-undo.h"
 #include "gimpimage-undo-push.h"
 #include "gimplayer.h"
 #include "gimpmarshal.h"
@@ -322,6 +324,7 @@ gimp_drawable_get_memsize (GimpObject *object,
   memsize += tile_manager_get_memsize (gimp_drawable_get_tiles (drawable),
                                        FALSE);
   memsize += tile_manager_get_memsize (drawable->private->shadow, FALSE);
+  memsize += gimp_drawable_blend_get_memsize (drawable);
 
   *gui_size += gimp_preview_cache_get_memsize (drawable->private->preview_cache);
 
@@ -497,7 +500,8 @@ gimp_drawable_scale (GimpItem              *item,
     }
   else
     {
-      PixelRegion srcPR, destPR;
+      GimpImage   *image = gimp_item_get_image (item);
+      PixelRegion  srcPR, destPR;
 
       pixel_region_init (&srcPR, gimp_drawable_get_tiles (drawable),
                          0, 0,
@@ -514,11 +518,25 @@ gimp_drawable_scale (GimpItem              *item,
        *   resampling because that doesn't necessarily make sense for indexed
        *   images.
        */
-      scale_region (&srcPR, &destPR,
-                    gimp_drawable_is_indexed (drawable) ?
-                    GIMP_INTERPOLATION_NONE : interpolation_type,
-                    progress ? gimp_progress_update_and_flush : NULL,
-                    progress);
+      if (gimp_drawable_is_indexed (drawable))
+        interpolation_type = GIMP_INTERPOLATION_NONE;
+
+      /*  Without undo nobody is going to look at the old tiles again,
+       *  so let the scaling free them as it goes, which keeps the
+       *  memory needed for huge images in batch mode down to little
+       *  more than one copy of them.  Not for displayed images, their
+       *  projection may still read the layers while we update the
+       *  progress.
+       */
+      if (! gimp_image_undo_is_enabled (image) &&
+          gimp_image_get_display_count (image) == 0)
+        scale_region_consume (&srcPR, &destPR, interpolation_type,
+                              progress ? gimp_progress_update_and_flush : NULL,
+                              progress);
+      else
+        scale_region (&srcPR, &destPR, interpolation_type,
+                      progress ? gimp_progress_update_and_flush : NULL,
+                      progress);
     }
 
 #ifdef GIMP_UNSTABLE
@@ -17,17 +17,63 @@
 
 #include "config.h"
 
+#include <string.h>
+
+#include <gio/gio.h>
 #include <gegl.h>
 
 #include "libgimpbase/gimpbase.h"
 
 #include "core-types.h"
 
+#include "base/pixel-processor.h"
+#include "base/tile.h"
 #include "base/tile-manager.h"
 
 #include "gimpimage.h"
+#include "gimpimage-undo.h"
 #include "gimpdrawable.h"
 #include "gimpdrawableundo.h"
+#include "gimpundostack.h"
+
+
+/*  number of tiles locked at a time while uncompressing  */
+#define COMPRESS_BATCH_SIZE 64
+
+
+typedef struct _CompressedTiles CompressedTiles;
+
+struct _CompressedTiles
+{
+  gint     width;
+  gint     height;
+  gint     bpp;
+  gint     n_tiles;
+  guchar **data;  /* NULL for tiles that are not part of a sparse undo */
+  gint    *size;  /* equals the tile size if data is not compressed,
+                   * 0 for tiles that are not part of a sparse undo
+                   */
+  gint64   memsize;
+
+  GimpUndoStore *store; /* set while data is spilled to an undo store */
+  guint          chunk;
+
+  /*  while the compressor thread works on the tiles, data holds the
+   *  uncompressed copies and the results go to these arrays
+   */
+  gboolean          pending; /* only accessed from the main thread */
+  gboolean          done;    /* protected by compress_mutex        */
+  guchar          **result_data;
+  gint             *result_size;
+  GimpDrawableUndo *undo;
+};
+
+typedef struct
+{
+  CompressedTiles *compressed;
+  Tile            *tiles[COMPRESS_BATCH_SIZE];
+  gint             tile_nums[COMPRESS_BATCH_SIZE];
+} CompressBatch;
 
 
 enum
@@ -42,24 +88,36 @@ enum
 };
 
 
-static void     gimp_drawable_undo_constructed  (GObject             *object);
-static void     gimp_drawable_undo_set_property (GObject             *object,
-                                                 guint                property_id,
-                                                 const GValue        *value,
-                                                 GParamSpec          *pspec);
-static void     gimp_drawable_undo_get_property (GObject             *object,
-                                                 guint                property_id,
-                                                 GValue              *value,
-                                                 GParamSpec          *pspec);
-
-static gint64   gimp_drawable_undo_get_memsize  (GimpObject          *object,
-                                                 gint64              *gui_size);
-
-static void     gimp_drawable_undo_pop          (GimpUndo            *undo,
-                                                 GimpUndoMode         undo_mode,
-                                                 GimpUndoAccumulator *accum);
-static void     gimp_drawable_undo_free         (GimpUndo            *undo,
-                                                 GimpUndoMode         undo_mode);
+static void     gimp_drawable_undo_constructed   (GObject             *object);
+static void     gimp_drawable_undo_set_property  (GObject             *object,
+                                                  guint                property_id,
+                                                  const GValue        *value,
+                                                  GParamSpec          *pspec);
+static void     gimp_drawable_undo_get_property  (GObject             *object,
+                                                  guint                property_id,
+                                                  GValue              *value,
+                                                  GParamSpec          *pspec);
+
+static gint64   gimp_drawable_undo_get_memsize   (GimpObject          *object,
+                                                  gint64              *gui_size);
+
+static void     gimp_drawable_undo_pop           (GimpUndo            *undo,
+                                                  GimpUndoMode         undo_mode,
+                                                  GimpUndoAccumulator *accum);
+static void     gimp_drawable_undo_free          (GimpUndo            *undo,
+                                                  GimpUndoMode         undo_mode);
+static void     gimp_drawable_undo_compress_data (GimpUndo            *undo);
+static void     gimp_drawable_undo_swap_out      (GimpUndo            *undo,
+                                                  GimpUndoStore       *store);
+
+static void     gimp_drawable_undo_compress_finish
+                                                 (GimpDrawableUndo    *drawable_undo,
+                                                  gboolean             update_stack);
+static void     gimp_drawable_undo_uncompress    (GimpDrawableUndo    *drawable_undo);
+static void     compressed_tiles_compress        (CompressedTiles     *compressed);
+static void     compressed_tiles_swap_in         (CompressedTiles     *compressed);
+static void     compressed_tiles_update_memsize  (CompressedTiles     *compressed);
+static void     compressed_tiles_free            (CompressedTiles     *compressed);
 
 
 G_DEFINE_TYPE (GimpDrawableUndo, gimp_drawable_undo, GIMP_TYPE_ITEM_UNDO)
@@ -67,6 +125,13 @@ G_DEFINE_TYPE (GimpDrawableUndo, gimp_drawable_undo, GIMP_TYPE_ITEM_UNDO)
 #define parent_class gimp_drawable_undo_parent_class
 
 
+/*  undos whose data is being compressed in the background  */
+static GThreadPool *compress_pool  = NULL;
+static GMutex      *compress_mutex = NULL;
+static GCond       *compress_cond  = NULL;
+static GList       *compress_undos = NULL;
+
+
 static void
 gimp_drawable_undo_class_init (GimpDrawableUndoClass *klass)
 {
@@ -82,6 +147,8 @@ gimp_drawable_undo_class_init (GimpDrawableUndoClass *klass)
 
   undo_class->pop                = gimp_drawable_undo_pop;
   undo_class->free               = gimp_drawable_undo_free;
+  undo_class->compress_data      = gimp_drawable_undo_compress_data;
+  undo_class->swap_out           = gimp_drawable_undo_swap_out;
 
   g_object_class_install_property (object_class, PROP_TILES,
                                    g_param_spec_boxed ("tiles", NULL, NULL,
@@ -214,8 +281,11 @@ gimp_drawable_undo_get_memsize (GimpObject *object,
   GimpDrawableUndo *drawable_undo = GIMP_DRAWABLE_UNDO (object);
   gint64            memsize       = 0;
 
-  memsize += tile_manager_get_memsize (drawable_undo->tiles,
-                                       drawable_undo->sparse);
+  if (drawable_undo->compressed)
+    memsize += ((CompressedTiles *) drawable_undo->compressed)->memsize;
+  else
+    memsize += tile_manager_get_memsize (drawable_undo->tiles,
+                                         drawable_undo->sparse);
 
   return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
                                                                   gui_size);
@@ -230,6 +300,9 @@ gimp_drawable_undo_pop (GimpUndo            *undo,
 
   GIMP_UNDO_CLASS (parent_class)->pop (undo, undo_mode, accum);
 
+  if (drawable_undo->compressed)
+    gimp_drawable_undo_uncompress (drawable_undo);
+
   gimp_drawable_swap_pixels (GIMP_DRAWABLE (GIMP_ITEM_UNDO (undo)->item),
                              drawable_undo->tiles,
                              drawable_undo->sparse,
@@ -257,5 +330,492 @@ gimp_drawable_undo_free (GimpUndo     *undo,
       drawable_undo->src2_tiles = NULL;
     }
 
+  if (drawable_undo->compressed)
+    {
+      gimp_drawable_undo_compress_finish (drawable_undo, FALSE);
+
+      compressed_tiles_free (drawable_undo->compressed);
+      drawable_undo->compressed = NULL;
+    }
+
   GIMP_UNDO_CLASS (parent_class)->free (undo, undo_mode);
 }
+
+static gboolean
+gimp_drawable_undo_compress_idle (GimpDrawableUndo *drawable_undo)
+{
+  CompressedTiles *compressed = drawable_undo->compressed;
+
+  if (compressed && compressed->pending)
+    {
+      gboolean done;
+
+      g_mutex_lock (compress_mutex);
+      done = compressed->done;
+      g_mutex_unlock (compress_mutex);
+
+      /*  otherwise this is a later job, which has its own idle  */
+      if (done)
+        gimp_drawable_undo_compress_finish (drawable_undo, TRUE);
+    }
+
+  g_object_unref (drawable_undo);
+
+  return FALSE;
+}
+
+/*  runs in the compressor thread  */
+static void
+compressed_tiles_compress_thread (CompressedTiles *compressed)
+{
+  GimpDrawableUndo *drawable_undo = compressed->undo;
+
+  compressed_tiles_compress (compressed);
+
+  /*  compressed may be freed as soon as done is set  */
+  g_mutex_lock (compress_mutex);
+  compressed->done = TRUE;
+  g_cond_broadcast (compress_cond);
+  g_mutex_unlock (compress_mutex);
+
+  g_idle_add ((GSourceFunc) gimp_drawable_undo_compress_idle, drawable_undo);
+}
+
+static void
+compressed_tiles_compress (CompressedTiles *compressed)
+{
+  GConverter *converter;
+  gint        i;
+
+  converter = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW,
+                                                  1));
+
+  for (i = 0; i < compressed->n_tiles; i++)
+    {
+      const guchar *src  = compressed->data[i];
+      gsize         size = compressed->size[i];
+      guchar       *dest;
+      gsize         max_size;
+      gsize         bytes_read;
+      gsize         bytes_written;
+
+      if (! src)
+        continue;
+
+      max_size = size + size / 8 + 64;
+      dest     = g_malloc (max_size);
+
+      g_converter_reset (converter);
+
+      if (g_converter_convert (converter,
+                               src, size, dest, max_size,
+                               G_CONVERTER_INPUT_AT_END,
+                               &bytes_read, &bytes_written,
+                               NULL) == G_CONVERTER_FINISHED &&
+          bytes_written < size)
+        {
+          compressed->result_data[i] = g_realloc (dest, bytes_written);
+          compressed->result_size[i] = bytes_written;
+        }
+      else
+        {
+          /*  keep incompressible tiles as they are  */
+          g_free (dest);
+        }
+    }
+
+  g_object_unref (converter);
+}
+
+static void
+uncompress_tiles_range (CompressBatch *batch,
+                        gint           start,
+                        gint           end)
+{
+  CompressedTiles *compressed = batch->compressed;
+  GConverter      *converter;
+
+  converter = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+
+  for (; start < end; start++)
+    {
+      Tile   *tile = batch->tiles[start];
+      gint    num  = batch->tile_nums[start];
+      guchar *dest;
+      gsize   size;
+      gsize   bytes_read;
+      gsize   bytes_written;
+
+      if (! tile)
+        continue;
+
+      dest = tile_data_pointer (tile, 0, 0);
+      size = tile_size (tile);
+
+      if (compressed->size[num] == size)
+        {
+          memcpy (dest, compressed->data[num], size);
+        }
+      else
+        {
+          GConverterResult  result;
+          GError           *error = NULL;
+
+          g_converter_reset (converter);
+
+          result = g_converter_convert (converter,
+                                        compressed->data[num],
+                                        compressed->size[num],
+                                        dest, size,
+                                        G_CONVERTER_INPUT_AT_END,
+                                        &bytes_read, &bytes_written,
+                                        &error);
+
+          if (result != G_CONVERTER_FINISHED || bytes_written != size)
+            {
+              g_warning ("Failed to uncompress undo tile %d: %s",
+                         num,
+                         error ? error->message : "truncated data");
+              g_clear_error (&error);
+
+              /*  don't leave partially restored pixels behind  */
+              memset (dest, 0, size);
+            }
+        }
+    }
+
+  g_object_unref (converter);
+}
+
+/*  copies the tiles and lets the compressor thread work on the copies,
+ *  the tiles can only be accessed from the main thread
+ */
+static void
+gimp_drawable_undo_compress_data (GimpUndo *undo)
+{
+  GimpDrawableUndo *drawable_undo = GIMP_DRAWABLE_UNDO (undo);
+  TileManager      *tiles         = drawable_undo->tiles;
+  CompressedTiles  *compressed;
+  gint              i;
+
+  if (drawable_undo->compressed || ! tiles)
+    return;
+
+  compressed = g_slice_new0 (CompressedTiles);
+
+  compressed->width   = tile_manager_width  (tiles);
+  compressed->height  = tile_manager_height (tiles);
+  compressed->bpp     = tile_manager_bpp    (tiles);
+  compressed->n_tiles = (((compressed->width  + TILE_WIDTH  - 1) / TILE_WIDTH) *
+                         ((compressed->height + TILE_HEIGHT - 1) / TILE_HEIGHT));
+  compressed->data    = g_new0 (guchar *, compressed->n_tiles);
+  compressed->size    = g_new0 (gint, compressed->n_tiles);
+
+  for (i = 0; i < compressed->n_tiles; i++)
+    {
+      Tile *tile;
+
+      if (drawable_undo->sparse &&
+          ! tile_is_valid (tile_manager_get (tiles, i, FALSE, FALSE)))
+        continue;
+
+      tile = tile_manager_get (tiles, i, TRUE, FALSE);
+
+      compressed->size[i] = tile_size (tile);
+      compressed->data[i] = g_memdup (tile_data_pointer (tile, 0, 0),
+                                      compressed->size[i]);
+
+      tile_release (tile, FALSE);
+    }
+
+  compressed->pending     = TRUE;
+  compressed->result_data = g_new0 (guchar *, compressed->n_tiles);
+  compressed->result_size = g_new0 (gint, compressed->n_tiles);
+  compressed->undo        = drawable_undo;
+
+  compressed_tiles_update_memsize (compressed);
+
+  tile_manager_unref (drawable_undo->tiles);
+  drawable_undo->tiles      = NULL;
+  drawable_undo->compressed = compressed;
+
+  if (! compress_pool)
+    {
+      compress_pool  = g_thread_pool_new ((GFunc)
+                                          compressed_tiles_compress_thread,
+                                          NULL, 1, FALSE, NULL);
+      compress_mutex = g_mutex_new ();
+      compress_cond  = g_cond_new ();
+    }
+
+  if (compress_pool)
+    {
+      GError *error = NULL;
+
+      /*  the idle callback queued by the thread owns this reference  */
+      g_object_ref (drawable_undo);
+
+      g_thread_pool_push (compress_pool, compressed, &error);
+
+      if (! error)
+        {
+          compress_undos = g_list_prepend (compress_undos, drawable_undo);
+          return;
+        }
+
+      g_clear_error (&error);
+      g_object_unref (drawable_undo);
+    }
+
+  compressed_tiles_compress (compressed);
+  compressed->done = TRUE;
+
+  gimp_drawable_undo_compress_finish (drawable_undo, FALSE);
+}
+
+/*  waits for the compressor thread and replaces the uncompressed
+ *  copies by the results
+ */
+static void
+gimp_drawable_undo_compress_finish (GimpDrawableUndo *drawable_undo,
+                                    gboolean          update_stack)
+{
+  CompressedTiles *compressed = drawable_undo->compressed;
+  gint             i;
+
+  if (! compressed || ! compressed->pending)
+    return;
+
+  if (compress_mutex)
+    {
+      g_mutex_lock (compress_mutex);
+
+      while (! compressed->done)
+        g_cond_wait (compress_cond, compress_mutex);
+
+      g_mutex_unlock (compress_mutex);
+    }
+
+  for (i = 0; i < compressed->n_tiles; i++)
+    {
+      if (compressed->result_data[i])
+        {
+          g_free (compressed->data[i]);
+
+          compressed->data[i] = compressed->result_data[i];
+          compressed->size[i] = compressed->result_size[i];
+        }
+    }
+
+  g_free (compressed->result_data);
+  g_free (compressed->result_size);
+
+  compressed->result_data = NULL;
+  compressed->result_size = NULL;
+  compressed->pending     = FALSE;
+
+  compress_undos = g_list_remove (compress_undos, drawable_undo);
+
+  compressed_tiles_update_memsize (compressed);
+
+  if (update_stack)
+    gimp_undo_stack_update_memsize (gimp_image_get_undo_stack (GIMP_UNDO (drawable_undo)->image),
+                                    GIMP_UNDO (drawable_undo));
+}
+
+/*  waits for all undo data that is being compressed in the background
+ *  and measures the undo steps it belongs to again, returns TRUE if
+ *  there was any
+ */
+gboolean
+gimp_drawable_undo_finish_compression (void)
+{
+  if (! compress_undos)
+    return FALSE;
+
+  while (compress_undos)
+    gimp_drawable_undo_compress_finish (compress_undos->data, TRUE);
+
+  return TRUE;
+}
+
+/*  the compressed tiles are concatenated into a single chunk of the
+ *  undo store, the sizes stay in memory to split it up again
+ */
+static void
+gimp_drawable_undo_swap_out (GimpUndo      *undo,
+                             GimpUndoStore *store)
+{
+  GimpDrawableUndo *drawable_undo = GIMP_DRAWABLE_UNDO (undo);
+  CompressedTiles  *compressed;
+  guchar           *data;
+  gsize             total         = 0;
+  gsize             offset        = 0;
+  gint              i;
+
+  gimp_drawable_undo_compress_data (undo);
+  gimp_drawable_undo_compress_finish (drawable_undo, FALSE);
+
+  compressed = drawable_undo->compressed;
+
+  if (! compressed || compressed->store)
+    return;
+
+  for (i = 0; i < compressed->n_tiles; i++)
+    total += compressed->size[i];
+
+  if (total == 0)
+    return;
+
+  data = g_malloc (total);
+
+  for (i = 0; i < compressed->n_tiles; i++)
+    {
+      if (compressed->data[i])
+        {
+          memcpy (data + offset, compressed->data[i], compressed->size[i]);
+          offset += compressed->size[i];
+        }
+    }
+
+  compressed->chunk = gimp_undo_store_add (store, data, total);
+
+  if (! compressed->chunk)
+    {
+      g_free (data);
+      return;
+    }
+
+  for (i = 0; i < compressed->n_tiles; i++)
+    {
+      g_free (compressed->data[i]);
+      compressed->data[i] = NULL;
+    }
+
+  compressed->store = gimp_undo_store_ref (store);
+
+  compressed_tiles_update_memsize (compressed);
+}
+
+static void
+gimp_drawable_undo_uncompress (GimpDrawableUndo *drawable_undo)
+{
+  CompressedTiles *compressed = drawable_undo->compressed;
+  TileManager     *tiles;
+  CompressBatch    batch;
+  gint             n_batch    = 0;
+  gint             i;
+
+  gimp_drawable_undo_compress_finish (drawable_undo, FALSE);
+
+  if (compressed->store)
+    compressed_tiles_swap_in (compressed);
+
+  tiles = tile_manager_new (compressed->width,
+                            compressed->height,
+                            compressed->bpp);
+
+  batch.compressed = compressed;
+
+  for (i = 0; i < compressed->n_tiles; i++)
+    {
+      if (! compressed->data[i])
+        continue;
+
+      batch.tiles[n_batch]     = tile_manager_get (tiles, i, TRUE, TRUE);
+      batch.tile_nums[n_batch] = i;
+      n_batch++;
+
+      if (n_batch == COMPRESS_BATCH_SIZE)
+        {
+          gint j;
+
+          pixel_processor_process_range ((PixelProcessorRangeFunc)
+                                         uncompress_tiles_range,
+                                         &batch, n_batch, 8);
+
+          for (j = 0; j < n_batch; j++)
+            tile_release (batch.tiles[j], TRUE);
+
+          n_batch = 0;
+        }
+    }
+
+  if (n_batch > 0)
+    {
+      pixel_processor_process_range ((PixelProcessorRangeFunc)
+                                     uncompress_tiles_range,
+                                     &batch, n_batch, 8);
+
+      for (i = 0; i < n_batch; i++)
+        tile_release (batch.tiles[i], TRUE);
+    }
+
+  compressed_tiles_free (compressed);
+
+  drawable_undo->tiles      = tiles;
+  drawable_undo->compressed = NULL;
+}
+
+static void
+compressed_tiles_swap_in (CompressedTiles *compressed)
+{
+  guchar *data;
+  gsize   size;
+  gsize   offset = 0;
+  gint    i;
+
+  data = gimp_undo_store_take (compressed->store, compressed->chunk, &size);
+
+  for (i = 0; i < compressed->n_tiles; i++)
+    {
+      if (! compressed->size[i])
+        continue;
+
+      /*  if the data could not be read back, the tiles stay empty  */
+      if (data && offset + compressed->size[i] <= size)
+        compressed->data[i] = g_memdup (data + offset, compressed->size[i]);
+
+      offset += compressed->size[i];
+    }
+
+  g_free (data);
+
+  gimp_undo_store_unref (compressed->store);
+  compressed->store = NULL;
+  compressed->chunk = 0;
+}
+
+static void
+compressed_tiles_update_memsize (CompressedTiles *compressed)
+{
+  gint i;
+
+  compressed->memsize = (sizeof (CompressedTiles) +
+                         compressed->n_tiles * (sizeof (guchar *) +
+                                                sizeof (gint)));
+
+  for (i = 0; i < compressed->n_tiles; i++)
+    if (compressed->data[i])
+      compressed->memsize += compressed->size[i];
+}
+
+static void
+compressed_tiles_free (CompressedTiles *compressed)
+{
+  gint i;
+
+  if (compressed->store)
+    {
+      gimp_undo_store_remove (compressed->store, compressed->chunk);
+      gimp_undo_store_unref (compressed->store);
+    }
+
+  for (i = 0; i < compressed->n_tiles; i++)
+    g_free (compressed->data[i]);
+
+  g_free (compressed->data);
+  g_free (compressed->size);
+
+  g_slice_free (CompressedTiles, compressed);
+}
@@ -37,6 +37,7 @@ struct _GimpDrawableUndo
   GimpItemUndo  parent_instance;
 
   TileManager  *tiles;
+  gpointer      compressed; /* replaces tiles while pushed down the stack */
   gboolean      sparse;
   gint          x;
   gint          y;
@@ -55,7 +56,9 @@ struct _GimpDrawableUndoClass
 };
 
 
-GType   gimp_drawable_undo_get_type (void) G_GNUC_CONST;
+GType      gimp_drawable_undo_get_type            (void) G_GNUC_CONST;
+
+gboolean   gimp_drawable_undo_finish_compression  (void);
 
 
 #endif /* __GIMP_DRAWABLE_UNDO_H__ */
@@ -40,6 +40,11 @@ struct _ColorHash
 };
 
 
+/*  the table is shared by all images and may be used from the pixel
+ *  processor's threads, so all access to it goes through this lock
+ */
+G_LOCK_DEFINE_STATIC (color_hash);
+
 static ColorHash  color_hash_table[HASH_TABLE_SIZE];
 static gint       color_hash_misses;
 static gint       color_hash_hits;
@@ -50,6 +55,8 @@ gimp_image_color_hash_init (void)
 {
   gint i;
 
+  G_LOCK (color_hash);
+
   /*  initialize the color hash table--invalidate all entries  */
   for (i = 0; i < HASH_TABLE_SIZE; i++)
     {
@@ -60,6 +67,8 @@ gimp_image_color_hash_init (void)
 
   color_hash_misses = 0;
   color_hash_hits   = 0;
+
+  G_UNLOCK (color_hash);
 }
 
 void
@@ -84,6 +93,8 @@ gimp_image_color_hash_invalidate (GimpImage *image,
 
   g_return_if_fail (GIMP_IS_IMAGE (image));
 
+  G_LOCK (color_hash);
+
   if (index == -1) /* invalidate all entries */
     {
       for (i = 0; i < HASH_TABLE_SIZE; i++)
@@ -105,6 +116,8 @@ gimp_image_color_hash_invalidate (GimpImage *image,
             color_hash_table[i].image = NULL;
           }
     }
+
+  G_UNLOCK (color_hash);
 }
 
 gint
@@ -124,6 +137,8 @@ gimp_image_color_hash_rgb_to_indexed (const GimpImage *image,
   pixel      = (r << 16) | (g << 8) | b;
   hash_index = pixel % HASH_TABLE_SIZE;
 
+  G_LOCK (color_hash);
+
   if (color_hash_table[hash_index].image == image &&
       color_hash_table[hash_index].pixel  == pixel)
     {
@@ -131,6 +146,8 @@ gimp_image_color_hash_rgb_to_indexed (const GimpImage *image,
 
       cmap_index = color_hash_table[hash_index].index;
       color_hash_hits++;
+
+      G_UNLOCK (color_hash);
     }
   else
     {
@@ -140,6 +157,11 @@ gimp_image_color_hash_rgb_to_indexed (const GimpImage *image,
       gint          diff, sum, max;
       gint          i;
 
+      color_hash_misses++;
+
+      /*  don't hold the lock during the colormap search  */
+      G_UNLOCK (color_hash);
+
       max        = MAXDIFF;
       cmap_index = 0;
       col        = cmap;
@@ -163,10 +185,13 @@ gimp_image_color_hash_rgb_to_indexed (const GimpImage *image,
         }
 
       /*  update the hash table  */
+      G_LOCK (color_hash);
+
       color_hash_table[hash_index].pixel  = pixel;
       color_hash_table[hash_index].index  = cmap_index;
       color_hash_table[hash_index].image = (GimpImage *) image;
-      color_hash_misses++;
+
+      G_UNLOCK (color_hash);
     }
 
   return cmap_index;
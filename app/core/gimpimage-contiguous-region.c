@@ -48,58 +48,57 @@ typedef struct
   GimpSelectCriterion  select_criterion;
   gboolean             has_alpha;
   guchar               color[MAX_CHANNELS];
+
+  gint                 bytes;        /* bytes of color, see below        */
+  gboolean             to_rgb;       /* convert pixels before comparing  */
+  guchar               diff_lut[256];   /* distance -> mask value        */
+  guchar               index_lut[256];  /* colormap index -> mask value  */
 } ContinuousRegionData;
 
+typedef struct
+{
+  gint y;
+  gint start;  /* exclusive */
+  gint end;    /* exclusive */
+} ContinuousRegionSpan;
+
 
 /*  local function prototypes  */
 
-static void contiguous_region_by_color    (ContinuousRegionData *cont,
-                                           PixelRegion          *imagePR,
-                                           PixelRegion          *maskPR);
-
-static gint pixel_difference              (const guchar        *col1,
-                                           const guchar        *col2,
-                                           gboolean             antialias,
-                                           gint                 threshold,
-                                           gint                 bytes,
-                                           gboolean             has_alpha,
-                                           gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion);
-static void ref_tiles                     (TileManager         *src,
-                                           TileManager         *mask,
-                                           Tile               **s_tile,
-                                           Tile               **m_tile,
-                                           gint                 x,
-                                           gint                 y,
-                                           guchar             **s,
-                                           guchar             **m);
-static gboolean find_contiguous_segment   (GimpImage           *image,
-                                           const guchar        *col,
-                                           PixelRegion         *src,
-                                           PixelRegion         *mask,
-                                           gint                 width,
-                                           gint                 bytes,
-                                           GimpImageType        src_type,
-                                           gboolean             has_alpha,
-                                           gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion,
-                                           gboolean             antialias,
-                                           gint                 threshold,
-                                           gint                 initial,
-                                           gint                *start,
-                                           gint                *end);
-static void find_contiguous_region_helper (GimpImage           *image,
-                                           PixelRegion         *mask,
-                                           PixelRegion         *src,
-                                           GimpImageType        src_type,
-                                           gboolean             has_alpha,
-                                           gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion,
-                                           gboolean             antialias,
-                                           gint                 threshold,
-                                           gint                 x,
-                                           gint                 y,
-                                           const guchar        *col);
+static void    contiguous_region_data_init    (ContinuousRegionData *cont);
+static void    contiguous_region_by_color     (ContinuousRegionData *cont,
+                                               PixelRegion          *imagePR,
+                                               PixelRegion          *maskPR);
+
+static inline guchar
+               contiguous_pixel_value         (const ContinuousRegionData *cont,
+                                               const guchar         *pixel);
+static gint    pixel_distance                 (const guchar         *col1,
+                                               const guchar         *col2,
+                                               gint                  bytes,
+                                               gboolean              has_alpha,
+                                               gboolean              select_transparent,
+                                               GimpSelectCriterion   select_criterion);
+static void    ref_tiles                      (TileManager          *src,
+                                               TileManager          *mask,
+                                               Tile                **s_tile,
+                                               Tile                **m_tile,
+                                               gint                  x,
+                                               gint                  y,
+                                               guchar              **s,
+                                               guchar              **m);
+static gboolean find_contiguous_segment       (ContinuousRegionData *cont,
+                                               PixelRegion          *src,
+                                               PixelRegion          *mask,
+                                               gint                  initial,
+                                               gint                  y,
+                                               gint                 *start,
+                                               gint                 *end);
+static void    find_contiguous_region_helper  (ContinuousRegionData *cont,
+                                               PixelRegion          *mask,
+                                               PixelRegion          *src,
+                                               gint                  x,
+                                               gint                  y);
 
 
 /*  public functions  */
@@ -155,8 +154,8 @@ gimp_image_contiguous_region_by_seed (GimpImage           *image,
   tile = tile_manager_get_tile (srcPR.tiles, x, y, TRUE, FALSE);
   if (tile)
     {
-      const guchar *start;
-      guchar        start_col[MAX_CHANNELS];
+      ContinuousRegionData  cont;
+      const guchar         *start;
 
       start = tile_data_pointer (tile, x, y);
 
@@ -178,23 +177,34 @@ gimp_image_contiguous_region_by_seed (GimpImage           *image,
 
       if (GIMP_IMAGE_TYPE_IS_INDEXED (src_type))
         {
-          gimp_image_get_color (image, src_type, start, start_col);
+          gimp_image_get_color (image, src_type, start, cont.color);
+
+          cont.bytes = has_alpha ? 4 : 3;
         }
       else
         {
           gint i;
 
           for (i = 0; i < bytes; i++)
-            start_col[i] = start[i];
-        }
+            cont.color[i] = start[i];
 
-      find_contiguous_region_helper (image, &maskPR, &srcPR,
-                                     src_type, has_alpha,
-                                     select_transparent, select_criterion,
-                                     antialias, threshold,
-                                     x, y, start_col);
+          cont.bytes = bytes;
+        }
 
       tile_release (tile, FALSE);
+
+      cont.image              = image;
+      cont.type               = src_type;
+      cont.has_alpha          = has_alpha;
+      cont.antialias          = antialias;
+      cont.threshold          = threshold;
+      cont.select_transparent = select_transparent;
+      cont.select_criterion   = select_criterion;
+      cont.to_rgb             = FALSE;
+
+      contiguous_region_data_init (&cont);
+
+      find_contiguous_region_helper (&cont, &maskPR, &srcPR, x, y);
     }
 
   return mask;
@@ -270,6 +280,10 @@ gimp_image_contiguous_region_by_color (GimpImage            *image,
   cont.threshold          = threshold;
   cont.select_transparent = select_transparent;
   cont.select_criterion   = select_criterion;
+  cont.bytes              = cont.has_alpha ? 4 : 3;
+  cont.to_rgb             = GIMP_IMAGE_TYPE_IS_GRAY (cont.type);
+
+  contiguous_region_data_init (&cont);
 
   mask = gimp_channel_new_mask (image, width, height);
 
@@ -287,6 +301,57 @@ gimp_image_contiguous_region_by_color (GimpImage            *image,
 
 /*  private functions  */
 
+static void
+contiguous_region_data_init (ContinuousRegionData *cont)
+{
+  gint i;
+
+  /*  map every possible color distance to its mask value once, instead
+   *  of doing the antialiasing math for each pixel
+   */
+  for (i = 0; i < G_N_ELEMENTS (cont->diff_lut); i++)
+    {
+      if (cont->antialias && cont->threshold > 0)
+        {
+          gfloat aa = 1.5 - ((gfloat) i / cont->threshold);
+
+          if (aa <= 0.0)
+            cont->diff_lut[i] = 0;
+          else if (aa < 0.5)
+            cont->diff_lut[i] = (guchar) (aa * 512);
+          else
+            cont->diff_lut[i] = 255;
+        }
+      else
+        {
+          cont->diff_lut[i] = (i > cont->threshold) ? 0 : 255;
+        }
+    }
+
+  /*  for indexed images, the distance only depends on the colormap
+   *  entry, so compare each entry just once
+   */
+  if (GIMP_IMAGE_TYPE_IS_INDEXED (cont->type))
+    {
+      for (i = 0; i < G_N_ELEMENTS (cont->index_lut); i++)
+        {
+          guchar index[2] = { i, OPAQUE_OPACITY };
+          guchar rgb[MAX_CHANNELS];
+          gint   distance;
+
+          gimp_image_get_color (cont->image, cont->type, index, rgb);
+
+          distance = pixel_distance (cont->color, rgb,
+                                     cont->bytes,
+                                     cont->has_alpha,
+                                     FALSE,
+                                     cont->select_criterion);
+
+          cont->index_lut[i] = (distance < 0) ? 0 : cont->diff_lut[distance];
+        }
+    }
+}
+
 static void
 contiguous_region_by_color (ContinuousRegionData *cont,
                             PixelRegion          *imagePR,
@@ -303,19 +368,8 @@ contiguous_region_by_color (ContinuousRegionData *cont,
 
       for (x = 0; x < imagePR->w; x++)
         {
-          guchar  rgb[MAX_CHANNELS];
-
-          /*  Get the rgb values for the color  */
-          gimp_image_get_color (cont->image, cont->type, i, rgb);
-
           /*  Find how closely the colors match  */
-          *m++ = pixel_difference (cont->color, rgb,
-                                   cont->antialias,
-                                   cont->threshold,
-                                   cont->has_alpha ? 4 : 3,
-                                   cont->has_alpha,
-                                   cont->select_transparent,
-                                   cont->select_criterion);
+          *m++ = contiguous_pixel_value (cont, i);
 
           i += imagePR->bytes;
         }
@@ -325,21 +379,62 @@ contiguous_region_by_color (ContinuousRegionData *cont,
     }
 }
 
+static inline guchar
+contiguous_pixel_value (const ContinuousRegionData *cont,
+                        const guchar               *pixel)
+{
+  guchar rgb[MAX_CHANNELS];
+  gint   distance;
+
+  if (GIMP_IMAGE_TYPE_IS_INDEXED (cont->type))
+    {
+      if (cont->has_alpha)
+        {
+          if (cont->select_transparent)
+            return cont->diff_lut[abs (cont->color[3] - pixel[1])];
+
+          /*  never select transparent regions  */
+          if (pixel[1] == 0)
+            return 0;
+        }
+
+      return cont->index_lut[pixel[0]];
+    }
+
+  if (cont->to_rgb)
+    {
+      gimp_image_get_color (cont->image, cont->type, pixel, rgb);
+      pixel = rgb;
+    }
+
+  distance = pixel_distance (cont->color, pixel,
+                             cont->bytes,
+                             cont->has_alpha,
+                             cont->select_transparent,
+                             cont->select_criterion);
+
+  if (distance < 0)
+    return 0;
+
+  return cont->diff_lut[MIN (distance, 255)];
+}
+
+/*  returns the distance between the two colors according to the
+ *  select criterion, or -1 if col2 must never be selected
+ */
 static gint
-pixel_difference (const guchar        *col1,
-                  const guchar        *col2,
-                  gboolean             antialias,
-                  gint                 threshold,
-                  gint                 bytes,
-                  gboolean             has_alpha,
-                  gboolean             select_transparent,
-                  GimpSelectCriterion  select_criterion)
+pixel_distance (const guchar        *col1,
+                const guchar        *col2,
+                gint                 bytes,
+                gboolean             has_alpha,
+                gboolean             select_transparent,
+                GimpSelectCriterion  select_criterion)
 {
   gint max = 0;
 
   /*  if there is an alpha channel, never select transparent regions  */
   if (! select_transparent && has_alpha && col2[bytes - 1] == 0)
-    return 0;
+    return -1;
 
   if (select_transparent && has_alpha)
     {
@@ -424,24 +519,7 @@ pixel_difference (const guchar        *col1,
         }
     }
 
-  if (antialias && threshold > 0)
-    {
-      gfloat aa = 1.5 - ((gfloat) max / threshold);
-
-      if (aa <= 0.0)
-        return 0;
-      else if (aa < 0.5)
-        return (guchar) (aa * 512);
-      else
-        return 255;
-    }
-  else
-    {
-      if (max > threshold)
-        return 0;
-      else
-        return 255;
-    }
+  return max;
 }
 
 static void
@@ -467,49 +545,26 @@ ref_tiles (TileManager  *src,
 }
 
 static gboolean
-find_contiguous_segment (GimpImage           *image,
-                         const guchar        *col,
-                         PixelRegion         *src,
-                         PixelRegion         *mask,
-                         gint                 width,
-                         gint                 bytes,
-                         GimpImageType        src_type,
-                         gboolean             has_alpha,
-                         gboolean             select_transparent,
-                         GimpSelectCriterion  select_criterion,
-                         gboolean             antialias,
-                         gint                 threshold,
-                         gint                 initial,
-                         gint                *start,
-                         gint                *end)
+find_contiguous_segment (ContinuousRegionData *cont,
+                         PixelRegion          *src,
+                         PixelRegion          *mask,
+                         gint                  initial,
+                         gint                  y,
+                         gint                 *start,
+                         gint                 *end)
 {
   guchar *s;
   guchar *m;
-  guchar  s_color[MAX_CHANNELS];
   guchar  diff;
-  gint    col_bytes = bytes;
-  Tile   *s_tile    = NULL;
-  Tile   *m_tile    = NULL;
+  gint    bytes  = src->bytes;
+  gint    width  = src->w;
+  Tile   *s_tile = NULL;
+  Tile   *m_tile = NULL;
 
   ref_tiles (src->tiles, mask->tiles,
-             &s_tile, &m_tile, src->x, src->y, &s, &m);
-
-  if (GIMP_IMAGE_TYPE_IS_INDEXED (src_type))
-    {
-      col_bytes = has_alpha ? 4 : 3;
-
-      gimp_image_get_color (image, src_type, s, s_color);
+             &s_tile, &m_tile, initial, y, &s, &m);
 
-      diff = pixel_difference (col, s_color, antialias, threshold,
-                               col_bytes, has_alpha, select_transparent,
-                               select_criterion);
-     }
-  else
-    {
-      diff = pixel_difference (col, s, antialias, threshold,
-                               col_bytes, has_alpha, select_transparent,
-                               select_criterion);
-    }
+  diff = contiguous_pixel_value (cont, s);
 
   /* check the starting pixel */
   if (! diff)
@@ -527,22 +582,9 @@ find_contiguous_segment (GimpImage           *image,
     {
       if (! ((*start + 1) % TILE_WIDTH))
         ref_tiles (src->tiles, mask->tiles,
-                   &s_tile, &m_tile, *start, src->y, &s, &m);
+                   &s_tile, &m_tile, *start, y, &s, &m);
 
-      if (GIMP_IMAGE_TYPE_IS_INDEXED (src_type))
-        {
-          gimp_image_get_color (image, src_type, s, s_color);
-
-          diff = pixel_difference (col, s_color, antialias, threshold,
-                                   col_bytes, has_alpha, select_transparent,
-                                   select_criterion);
-        }
-      else
-        {
-          diff = pixel_difference (col, s, antialias, threshold,
-                                   col_bytes, has_alpha, select_transparent,
-                                   select_criterion);
-        }
+      diff = contiguous_pixel_value (cont, s);
 
       if ((*m-- = diff))
         {
@@ -556,28 +598,15 @@ find_contiguous_segment (GimpImage           *image,
 
   if (*end % TILE_WIDTH && *end < width)
     ref_tiles (src->tiles, mask->tiles,
-               &s_tile, &m_tile, *end, src->y, &s, &m);
+               &s_tile, &m_tile, *end, y, &s, &m);
 
   while (*end < width && diff)
     {
       if (! (*end % TILE_WIDTH))
         ref_tiles (src->tiles, mask->tiles,
-                   &s_tile, &m_tile, *end, src->y, &s, &m);
-
-      if (GIMP_IMAGE_TYPE_IS_INDEXED (src_type))
-        {
-          gimp_image_get_color (image, src_type, s, s_color);
+                   &s_tile, &m_tile, *end, y, &s, &m);
 
-          diff = pixel_difference (col, s_color, antialias, threshold,
-                                   col_bytes, has_alpha, select_transparent,
-                                   select_criterion);
-        }
-      else
-        {
-          diff = pixel_difference (col, s, antialias, threshold,
-                                   col_bytes, has_alpha, select_transparent,
-                                   select_criterion);
-        }
+      diff = contiguous_pixel_value (cont, s);
 
       if ((*m++ = diff))
         {
@@ -592,77 +621,89 @@ find_contiguous_segment (GimpImage           *image,
   return TRUE;
 }
 
+static inline void
+push_span (GArray *stack,
+           gint    y,
+           gint    start,
+           gint    end)
+{
+  ContinuousRegionSpan span = { y, start, end };
+
+  g_array_append_val (stack, span);
+}
+
 static void
-find_contiguous_region_helper (GimpImage           *image,
-                               PixelRegion         *mask,
-                               PixelRegion         *src,
-                               GimpImageType        src_type,
-                               gboolean             has_alpha,
-                               gboolean             select_transparent,
-                               GimpSelectCriterion  select_criterion,
-                               gboolean             antialias,
-                               gint                 threshold,
-                               gint                 x,
-                               gint                 y,
-                               const guchar        *col)
+find_contiguous_region_helper (ContinuousRegionData *cont,
+                               PixelRegion          *mask,
+                               PixelRegion          *src,
+                               gint                  x,
+                               gint                  y)
 {
-  gint    start, end;
-  gint    new_start, new_end;
-  gint    val;
-  Tile   *tile;
-  GQueue *coord_stack;
-
-  coord_stack = g_queue_new ();
-
-  /* To avoid excessive memory allocation (y, start, end) tuples are
-   * stored in interleaved format:
-   *
-   * [y1] [start1] [end1] [y2] [start2] [end2]
+  GArray *span_stack;
+
+  /*  A stack of (y, start, end) spans still to be scanned.  Popping
+   *  from the end keeps the fill walking along neighbouring rows,
+   *  which keeps the tiles it touches hot in the tile cache.
    */
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (y));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x - 1));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x + 1));
+  span_stack = g_array_sized_new (FALSE, FALSE,
+                                  sizeof (ContinuousRegionSpan), 256);
+
+  push_span (span_stack, y, x - 1, x + 1);
 
-  do
+  while (span_stack->len > 0)
     {
-      y     = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      start = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      end   = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
+      ContinuousRegionSpan span;
 
-      for (x = start + 1; x < end; x++)
-        {
-          tile = tile_manager_get_tile (mask->tiles, x, y, TRUE, FALSE);
-          val = *(const guchar *) tile_data_pointer (tile, x, y);
-          tile_release (tile, FALSE);
-          if (val != 0)
-            continue;
+      span = g_array_index (span_stack, ContinuousRegionSpan,
+                            span_stack->len - 1);
+      g_array_set_size (span_stack, span_stack->len - 1);
 
-          src->x = x;
-          src->y = y;
+      x = span.start + 1;
 
-          if (! find_contiguous_segment (image, col, src, mask, src->w,
-                                         src->bytes, src_type, has_alpha,
-                                         select_transparent, select_criterion,
-                                         antialias, threshold, x,
-                                         &new_start, &new_end))
-            continue;
+      while (x < span.end)
+        {
+          const guchar *m;
+          Tile         *tile;
+          gint          tile_end;
+          gint          new_start;
+          gint          new_end;
+
+          /*  skip already visited pixels a tile row segment at a time,
+           *  instead of looking up the mask tile for every pixel
+           */
+          tile_end = MIN (span.end, (x / TILE_WIDTH + 1) * TILE_WIDTH);
 
-          if (y + 1 < src->h)
+          tile = tile_manager_get_tile (mask->tiles, x, span.y, TRUE, FALSE);
+          m = tile_data_pointer (tile, x, span.y);
+
+          while (x < tile_end && *m)
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y + 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              x++;
+              m++;
             }
 
-          if (y - 1 >= 0)
+          tile_release (tile, FALSE);
+
+          if (x == tile_end)
+            continue;
+
+          if (! find_contiguous_segment (cont, src, mask, x, span.y,
+                                         &new_start, &new_end))
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y - 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              x++;
+              continue;
             }
+
+          if (span.y + 1 < src->h)
+            push_span (span_stack, span.y + 1, new_start, new_end);
+
+          if (span.y - 1 >= 0)
+            push_span (span_stack, span.y - 1, new_start, new_end);
+
+          /*  everything up to new_end has been visited by the segment  */
+          x = new_end + 1;
         }
     }
-  while (! g_queue_is_empty (coord_stack));
 
-  g_queue_free (coord_stack);
+  g_array_free (span_stack, TRUE);
 }
@@ -141,9 +141,12 @@
 #include "core-types.h"
 
 #include "base/cpercep.h"
+#include "base/pixel-processor.h"
 #include "base/pixel-region.h"
 #include "base/tile-manager.h"
 
+#include "config/gimpbaseconfig.h"
+
 #include "gimp.h"
 #include "gimpcontainer.h"
 #include "gimpdrawable.h"
@@ -174,6 +177,8 @@
 
 #define BITS_IN_SAMPLE 8
 
+#define HIST_N_CELLS (HIST_R_ELEMS * HIST_G_ELEMS * HIST_B_ELEMS)
+
 #define R_SHIFT  (BITS_IN_SAMPLE-PRECISION_R)
 #define G_SHIFT  (BITS_IN_SAMPLE-PRECISION_G)
 #define B_SHIFT  (BITS_IN_SAMPLE-PRECISION_B)
@@ -485,11 +490,32 @@ struct _QuantizeObj
   gboolean want_alpha_dither;
   int      error_freedom;           /* 0=much bleed, 1=controlled bleed */
 
+  gboolean prefill_inverse_cmap;    /* fill the whole inverse colormap
+                                     * up front, making it read-only
+                                     * during the second pass
+                                     */
+
   GimpProgress *progress;
   gint          nth_layer;
   gint          n_layers;
+
+  GMutex       *mutex;              /* guards index_used_count when the
+                                     * second pass runs on several threads
+                                     */
 };
 
+typedef struct
+{
+  QuantizeObj *quantobj;
+  gint         red_pix;
+  gint         green_pix;
+  gint         blue_pix;
+  gint         alpha_pix;
+  gboolean     has_alpha;
+  gint         offsetx;
+  gint         offsety;
+} Pass2Data;
+
 typedef struct
 {
   /*  The bounds of the box (inclusive); expressed as histogram indexes  */
@@ -528,6 +554,7 @@ static void generate_histogram_rgb  (CFHistogram   histogram,
                                      GimpProgress *progress,
                                      gint          nth_layer,
                                      gint          n_layers);
+static gint64 count_histogram_cells_rgb (CFHistogram histogram);
 
 static QuantizeObj * initialize_median_cut (GimpImageBaseType      old_type,
                                             gint                   num_cols,
@@ -541,6 +568,16 @@ static void          compute_color_lin8    (QuantizeObj           *quantobj,
                                             boxptr                 boxp,
                                             const int              icolor);
 
+static GimpImageType indexed_layer_type    (GimpLayer             *layer);
+
+static void    median_cut_pass2_fs_dither_rgb   (QuantizeObj *quantobj,
+                                                 GimpLayer   *layer,
+                                                 TileManager *new_tiles);
+static TileManager **
+               median_cut_pass2_layers_parallel (QuantizeObj *quantobj,
+                                                 GList       *layers,
+                                                 gint         n_layers);
+
 
 static guchar    found_cols[MAXNUMCOLORS][3];
 static gint      num_found_cols;
@@ -769,6 +806,8 @@ gimp_image_convert (GimpImage               *image,
   GList             *all_layers;
   GList             *list;
   const gchar       *undo_desc = NULL;
+  TileManager      **all_tiles = NULL;
+  gint64             n_hist_cells = -1;
   gint               nth_layer, n_layers;
 
   g_return_val_if_fail (GIMP_IS_IMAGE (image), FALSE);
@@ -889,6 +928,9 @@ gimp_image_convert (GimpImage               *image,
                *  by the user.
                */
             }
+
+          if (old_type != GIMP_GRAY)
+            n_hist_cells = count_histogram_cells_rgb (quantobj->histogram);
         }
 
       if (progress)
@@ -944,6 +986,30 @@ gimp_image_convert (GimpImage               *image,
   switch (new_type)
     {
     case GIMP_INDEXED:
+      {
+        GimpBaseConfig *config  = GIMP_BASE_CONFIG (image->gimp->config);
+        gint64          n_cells = 0;
+
+        /*  Without a pass-1 histogram, the pixel count bounds the
+         *  number of cells the second pass can hit.
+         */
+        for (list = all_layers; list; list = g_list_next (list))
+          n_cells += ((gint64) gimp_item_get_width  (GIMP_ITEM (list->data)) *
+                      (gint64) gimp_item_get_height (GIMP_ITEM (list->data)));
+
+        if (n_hist_cells >= 0)
+          n_cells = MIN (n_cells, n_hist_cells);
+
+        /*  Filling the inverse colormap lazily costs one colormap
+         *  search per occupied cell, serially; prefilling it costs
+         *  one search per cell, spread over all threads, and makes
+         *  the colormap read-only so layers can be mapped in
+         *  parallel.
+         */
+        if (n_cells * MAX (config->num_processors, 1) >= HIST_N_CELLS)
+          quantobj->prefill_inverse_cmap = TRUE;
+      }
+
       if (quantobj->second_pass_init)
         (* quantobj->second_pass_init) (quantobj);
       break;
@@ -955,6 +1021,19 @@ gimp_image_convert (GimpImage               *image,
   if (quantobj)
     quantobj->n_layers = n_layers;
 
+  /*  Floyd-Steinberg error diffusion is serial within a layer, but
+   *  with a read-only inverse colormap whole layers can be dithered
+   *  concurrently, which gives the same result.
+   */
+  if (new_type == GIMP_INDEXED       &&
+      n_layers > 1                   &&
+      quantobj->prefill_inverse_cmap &&
+      quantobj->second_pass == median_cut_pass2_fs_dither_rgb)
+    {
+      all_tiles = median_cut_pass2_layers_parallel (quantobj,
+                                                    all_layers, n_layers);
+    }
+
   for (list = all_layers, nth_layer = 0;
        list;
        list = g_list_next (list), nth_layer++)
@@ -971,20 +1050,22 @@ gimp_image_convert (GimpImage               *image,
 
         case GIMP_INDEXED:
           {
-            GimpImageType  new_layer_type;
+            GimpImageType  new_layer_type = indexed_layer_type (layer);
             TileManager   *new_tiles;
 
-            new_layer_type = GIMP_IMAGE_TYPE_FROM_BASE_TYPE (new_type);
-
-            if (gimp_drawable_has_alpha (GIMP_DRAWABLE (layer)))
-              new_layer_type = GIMP_IMAGE_TYPE_WITH_ALPHA (new_layer_type);
-
-            new_tiles = tile_manager_new (gimp_item_get_width  (GIMP_ITEM (layer)),
-                                          gimp_item_get_height (GIMP_ITEM (layer)),
-                                          GIMP_IMAGE_TYPE_BYTES (new_layer_type));
+            if (all_tiles)
+              {
+                new_tiles = all_tiles[nth_layer];
+              }
+            else
+              {
+                new_tiles = tile_manager_new (gimp_item_get_width  (GIMP_ITEM (layer)),
+                                              gimp_item_get_height (GIMP_ITEM (layer)),
+                                              GIMP_IMAGE_TYPE_BYTES (new_layer_type));
 
-            quantobj->nth_layer = nth_layer;
-            (* quantobj->second_pass) (quantobj, layer, new_tiles);
+                quantobj->nth_layer = nth_layer;
+                (* quantobj->second_pass) (quantobj, layer, new_tiles);
+              }
 
             gimp_drawable_set_tiles (GIMP_DRAWABLE (layer), TRUE, NULL,
                                      new_tiles, new_layer_type);
@@ -1091,6 +1172,7 @@ gimp_image_convert (GimpImage               *image,
   g_object_thaw_notify (G_OBJECT (image));
 
   g_list_free (all_layers);
+  g_free (all_tiles);
 
   gimp_unset_busy (image->gimp);
 
@@ -1119,6 +1201,19 @@ zero_histogram_rgb (CFHistogram histogram)
           HIST_R_ELEMS * HIST_G_ELEMS * HIST_B_ELEMS * sizeof (ColorFreq));
 }
 
+static gint64
+count_histogram_cells_rgb (CFHistogram histogram)
+{
+  gint64 n_cells = 0;
+  gint   i;
+
+  for (i = 0; i < HIST_N_CELLS; i++)
+    if (histogram[i])
+      n_cells++;
+
+  return n_cells;
+}
+
 
 static void
 generate_histogram_gray (CFHistogram  histogram,
@@ -2689,6 +2784,25 @@ fill_inverse_cmap_rgb (QuantizeObj *quantobj,
 }
 
 
+static void
+fill_inverse_cmap_rgb_range (QuantizeObj *quantobj,
+                             gint         start,
+                             gint         end)
+/* Fill all inverse-colormap entries with a red cell index in */
+/* [start, end).  Different ranges touch disjoint cells, so this */
+/* can run on several threads at once. */
+{
+  CFHistogram histogram = quantobj->histogram;
+  gint        R, G, B;
+
+  for (R = start; R < end; R++)
+    for (G = 0; G < HIST_G_ELEMS; G++)
+      for (B = 0; B < HIST_B_ELEMS; B++)
+        if (*HIST_LIN (histogram, R, G, B) == 0)
+          fill_inverse_cmap_rgb (quantobj, histogram, R, G, B);
+}
+
+
 /*  This is pass 1  */
 
 static void
@@ -2998,6 +3112,117 @@ median_cut_pass2_fixed_dither_gray (QuantizeObj *quantobj,
     }
 }
 
+static void
+median_cut_pass2_rgb_merge_counts (QuantizeObj  *quantobj,
+                                   const gulong *index_used_count)
+{
+  gint i;
+
+  g_mutex_lock (quantobj->mutex);
+
+  for (i = 0; i < quantobj->actual_number_of_colors; i++)
+    quantobj->index_used_count[i] += index_used_count[i];
+
+  g_mutex_unlock (quantobj->mutex);
+}
+
+static void
+median_cut_pass2_rgb_progress (QuantizeObj *quantobj,
+                               gdouble      fraction)
+{
+  gimp_progress_set_value (quantobj->progress,
+                           (quantobj->nth_layer + fraction) /
+                           (gdouble) quantobj->n_layers);
+}
+
+static void
+median_cut_pass2_rgb_data_init (Pass2Data   *data,
+                                QuantizeObj *quantobj,
+                                GimpLayer   *layer)
+{
+  data->quantobj  = quantobj;
+  data->red_pix   = RED;
+  data->green_pix = GREEN;
+  data->blue_pix  = BLUE;
+  data->alpha_pix = ALPHA;
+  data->has_alpha = gimp_drawable_has_alpha (GIMP_DRAWABLE (layer));
+
+  /*  In the case of web/mono palettes, we actually force
+   *   grayscale drawables through the rgb pass2 functions
+   */
+  if (gimp_drawable_is_gray (GIMP_DRAWABLE (layer)))
+    {
+      data->red_pix = data->green_pix = data->blue_pix = GRAY;
+      data->alpha_pix = ALPHA_G;
+    }
+
+  gimp_item_get_offset (GIMP_ITEM (layer), &data->offsetx, &data->offsety);
+}
+
+static void
+median_cut_pass2_no_dither_rgb_region (Pass2Data   *data,
+                                       PixelRegion *srcPR,
+                                       PixelRegion *destPR)
+/* Map one region with a completely filled inverse colormap, which */
+/* is read-only here, so regions can be processed in parallel. */
+{
+  QuantizeObj  *quantobj     = data->quantobj;
+  CFHistogram   histogram    = quantobj->histogram;
+  gboolean      alpha_dither = quantobj->want_alpha_dither;
+  gulong        index_used_count[256] = { 0, };
+  const guchar *src;
+  guchar       *dest;
+  gint          R, G, B;
+  gint          row, col;
+
+  src  = srcPR->data;
+  dest = destPR->data;
+
+  for (row = 0; row < srcPR->h; row++)
+    {
+      const guchar *s = src;
+      guchar       *d = dest;
+
+      for (col = 0; col < srcPR->w; col++, s += srcPR->bytes, d += destPR->bytes)
+        {
+          if (data->has_alpha)
+            {
+              gboolean transparent;
+
+              if (alpha_dither)
+                {
+                  gint dither_x = (col + data->offsetx + srcPR->x) & DM_WIDTHMASK;
+                  gint dither_y = (row + data->offsety + srcPR->y) & DM_HEIGHTMASK;
+
+                  transparent = (s[data->alpha_pix] < DM[dither_x][dither_y]);
+                }
+              else
+                {
+                  transparent = (s[data->alpha_pix] <= 127);
+                }
+
+              if (transparent)
+                {
+                  d[ALPHA_I] = 0;
+                  continue;
+                }
+
+              d[ALPHA_I] = 255;
+            }
+
+          rgb_to_lin (s[data->red_pix], s[data->green_pix], s[data->blue_pix],
+                      &R, &G, &B);
+
+          index_used_count[d[INDEXED] = *HIST_LIN (histogram, R, G, B) - 1]++;
+        }
+
+      src  += srcPR->rowstride;
+      dest += destPR->rowstride;
+    }
+
+  median_cut_pass2_rgb_merge_counts (quantobj, index_used_count);
+}
+
 static void
 median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
                                 GimpLayer   *layer,
@@ -3049,6 +3274,26 @@ median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
                      gimp_item_get_height (GIMP_ITEM (layer)),
                      TRUE);
 
+  if (quantobj->prefill_inverse_cmap)
+    {
+      Pass2Data                   data;
+      PixelProcessorProgressFunc  progress_func = NULL;
+
+      median_cut_pass2_rgb_data_init (&data, quantobj, layer);
+
+      if (quantobj->progress)
+        progress_func = (PixelProcessorProgressFunc)
+          median_cut_pass2_rgb_progress;
+
+      pixel_regions_process_parallel_progress ((PixelProcessorFunc)
+                                               median_cut_pass2_no_dither_rgb_region,
+                                               &data,
+                                               progress_func, quantobj,
+                                               2, &srcPR, &destPR);
+
+      return;
+    }
+
   layer_size = (gimp_item_get_width  (GIMP_ITEM (layer)) *
                 gimp_item_get_height (GIMP_ITEM (layer)));
 
@@ -3120,12 +3365,14 @@ median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
 }
 
 static void
-median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
-                                   GimpLayer   *layer,
-                                   TileManager *new_tiles)
+median_cut_pass2_fixed_dither_rgb_region (Pass2Data   *data,
+                                          PixelRegion *srcPR,
+                                          PixelRegion *destPR)
+/* The ordered dither only depends on the pixel position, so regions */
+/* can be processed in parallel once the inverse colormap is filled. */
 {
-  PixelRegion   srcPR, destPR;
-  CFHistogram   histogram = quantobj->histogram;
+  QuantizeObj  *quantobj     = data->quantobj;
+  CFHistogram   histogram    = quantobj->histogram;
   ColorFreq    *cachep;
   gint          pixval1=0, pixval2=0;
   Color*        color1;
@@ -3135,198 +3382,215 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
   gint          R, G, B;
   gint          err1,err2;
   gint          row, col;
-  gboolean      has_alpha;
-  gpointer      pr;
-  gint          red_pix          = RED;
-  gint          green_pix        = GREEN;
-  gint          blue_pix         = BLUE;
-  gint          alpha_pix        = ALPHA;
-  gboolean      alpha_dither     = quantobj->want_alpha_dither;
-  gint          offsetx, offsety;
-  gulong       *index_used_count = quantobj->index_used_count;
-  glong         total_size       = 0;
-  glong         layer_size;
-  gint          count            = 0;
-  gint          nth_layer        = quantobj->nth_layer;
-  gint          n_layers         = quantobj->n_layers;
-
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
-
-  /*  In the case of web/mono palettes, we actually force
-   *   grayscale drawables through the rgb pass2 functions
-   */
-  if (gimp_drawable_is_gray (GIMP_DRAWABLE (layer)))
-    {
-      red_pix = green_pix = blue_pix = GRAY;
-      alpha_pix = ALPHA_G;
-    }
-
-  has_alpha = gimp_drawable_has_alpha (GIMP_DRAWABLE (layer));
-
-  pixel_region_init (&srcPR, gimp_drawable_get_tiles (GIMP_DRAWABLE (layer)),
-                     0, 0,
-                     gimp_item_get_width  (GIMP_ITEM (layer)),
-                     gimp_item_get_height (GIMP_ITEM (layer)),
-                     FALSE);
-  pixel_region_init (&destPR, new_tiles,
-                     0, 0,
-                     gimp_item_get_width  (GIMP_ITEM (layer)),
-                     gimp_item_get_height (GIMP_ITEM (layer)),
-                     TRUE);
-
-  layer_size = (gimp_item_get_width  (GIMP_ITEM (layer)) *
-                gimp_item_get_height (GIMP_ITEM (layer)));
+  gint          red_pix      = data->red_pix;
+  gint          green_pix    = data->green_pix;
+  gint          blue_pix     = data->blue_pix;
+  gint          alpha_pix    = data->alpha_pix;
+  gboolean      has_alpha    = data->has_alpha;
+  gboolean      alpha_dither = quantobj->want_alpha_dither;
+  gint          offsetx      = data->offsetx;
+  gint          offsety      = data->offsety;
+  gulong        index_used_count[256] = { 0, };
 
-  for (pr = pixel_regions_register (2, &srcPR, &destPR);
-       pr != NULL;
-       pr = pixel_regions_process (pr), count++)
+  for (row = 0; row < srcPR->h; row++)
     {
-      src = srcPR.data;
-      dest = destPR.data;
-
-      total_size += srcPR.h * srcPR.w;
+      src  = srcPR->data  + row * srcPR->rowstride;
+      dest = destPR->data + row * destPR->rowstride;
 
-      for (row = 0; row < srcPR.h; row++)
+      for (col = 0; col < srcPR->w; col++)
         {
-          for (col = 0; col < srcPR.w; col++)
+          const int dmval =
+            DM[(col + offsetx + srcPR->x) & DM_WIDTHMASK]
+            [(row + offsety + srcPR->y) & DM_HEIGHTMASK];
+
+          if (has_alpha)
             {
-              const int dmval =
-                DM[(col + offsetx + srcPR.x) & DM_WIDTHMASK]
-                [(row + offsety + srcPR.y) & DM_HEIGHTMASK];
+              gboolean transparent = FALSE;
 
-              if (has_alpha)
+              if (alpha_dither)
                 {
-                  gboolean transparent = FALSE;
-
-                  if (alpha_dither)
-                    {
-                      if (src[alpha_pix] < dmval)
-                        transparent = TRUE;
-                    }
-                  else
-                    {
-                      if (src[alpha_pix] <= 127)
-                        transparent = TRUE;
-                    }
+                  if (src[alpha_pix] < dmval)
+                    transparent = TRUE;
+                }
+              else
+                {
+                  if (src[alpha_pix] <= 127)
+                    transparent = TRUE;
+                }
 
-                  if (transparent)
-                    {
-                      dest[ALPHA_I] = 0;
-                      goto next_pixel;
-                    }
-                  else
-                    {
-                      dest[ALPHA_I] = 255;
-                    }
+              if (transparent)
+                {
+                  dest[ALPHA_I] = 0;
+                  goto next_pixel;
+                }
+              else
+                {
+                  dest[ALPHA_I] = 255;
                 }
+            }
 
-              /* get pixel value and index into the cache */
-              rgb_to_lin(src[red_pix], src[green_pix], src[blue_pix],
-                         &R, &G, &B);
+          /* get pixel value and index into the cache */
+          rgb_to_lin(src[red_pix], src[green_pix], src[blue_pix],
+                     &R, &G, &B);
+          cachep = HIST_LIN(histogram,R,G,B);
+          /* If we have not seen this color before, find nearest
+             colormap entry and update the cache */
+          if (*cachep == 0)
+            fill_inverse_cmap_rgb (quantobj, histogram, R, G, B);
+
+          /* We now try to find a colour which, when mixed in some fashion
+             with the closest match, yields something closer to the
+             desired colour.  We do this by repeatedly extrapolating the
+             colour vector from one to the other until we find another
+             colour cell.  Then we assess the distance of both mixer
+             colours from the intended colour to determine their relative
+             probabilities of being chosen. */
+          pixval1 = *cachep - 1;
+          color1 = &quantobj->cmap[pixval1];
+
+          if (quantobj->actual_number_of_colors > 2) {
+            const int re = src[red_pix] - (int)color1->red;
+            const int ge = src[green_pix] - (int)color1->green;
+            const int be = src[blue_pix] - (int)color1->blue;
+            int RV = src[red_pix] + re;
+            int GV = src[green_pix] + ge;
+            int BV = src[blue_pix] + be;
+            do {
+               rgb_to_lin((CLAMP0255(RV)),
+                          (CLAMP0255(GV)),
+                          (CLAMP0255(BV)),
+                          &R, &G, &B);
               cachep = HIST_LIN(histogram,R,G,B);
               /* If we have not seen this color before, find nearest
                  colormap entry and update the cache */
-              if (*cachep == 0)
+              if (*cachep == 0) {
                 fill_inverse_cmap_rgb (quantobj, histogram, R, G, B);
-
-              /* We now try to find a colour which, when mixed in some fashion
-                 with the closest match, yields something closer to the
-                 desired colour.  We do this by repeatedly extrapolating the
-                 colour vector from one to the other until we find another
-                 colour cell.  Then we assess the distance of both mixer
-                 colours from the intended colour to determine their relative
-                 probabilities of being chosen. */
-              pixval1 = *cachep - 1;
-              color1 = &quantobj->cmap[pixval1];
-
-              if (quantobj->actual_number_of_colors > 2) {
-                const int re = src[red_pix] - (int)color1->red;
-                const int ge = src[green_pix] - (int)color1->green;
-                const int be = src[blue_pix] - (int)color1->blue;
-                int RV = src[red_pix] + re;
-                int GV = src[green_pix] + ge;
-                int BV = src[blue_pix] + be;
-                do {
-                   rgb_to_lin((CLAMP0255(RV)),
-                              (CLAMP0255(GV)),
-                              (CLAMP0255(BV)),
-                              &R, &G, &B);
-                  cachep = HIST_LIN(histogram,R,G,B);
-                  /* If we have not seen this color before, find nearest
-                     colormap entry and update the cache */
-                  if (*cachep == 0) {
-                    fill_inverse_cmap_rgb (quantobj, histogram, R, G, B);
-                  }
-                  pixval2 = *cachep - 1;
-                  RV += re;  GV += ge;  BV += be;
-                } while((pixval1 == pixval2) &&
-                        (!( (RV>255 || RV<0) || (GV>255 || GV<0) || (BV>255 || BV<0) )) &&
-                        (re || ge || be));
-              }
-              if (quantobj->actual_number_of_colors <= 2
-                  /* || pixval1 == pixval2 */) {
-                /* not enough colours to bother looking for an 'alternative'
-                   colour (we may fail to do so anyway), so decide that
-                   the alternative colour is simply the other cmap entry. */
-                pixval2 = (pixval1 + 1) %
-                  (quantobj->actual_number_of_colors);
               }
+              pixval2 = *cachep - 1;
+              RV += re;  GV += ge;  BV += be;
+            } while((pixval1 == pixval2) &&
+                    (!( (RV>255 || RV<0) || (GV>255 || GV<0) || (BV>255 || BV<0) )) &&
+                    (re || ge || be));
+          }
+          if (quantobj->actual_number_of_colors <= 2
+              /* || pixval1 == pixval2 */) {
+            /* not enough colours to bother looking for an 'alternative'
+               colour (we may fail to do so anyway), so decide that
+               the alternative colour is simply the other cmap entry. */
+            pixval2 = (pixval1 + 1) %
+              (quantobj->actual_number_of_colors);
+          }
 
-              /* always deterministically sort pixval1 and pixval2, to
-                 avoid artifacts in the dither range due to inverting our
-                 relative colour viewpoint -- most obvious in 1-bit dither. */
-              if (pixval1 > pixval2) {
-                gint tmpval = pixval1;
-                pixval1 = pixval2;
-                pixval2 = tmpval;
-                color1 = &quantobj->cmap[pixval1];
-              }
+          /* always deterministically sort pixval1 and pixval2, to
+             avoid artifacts in the dither range due to inverting our
+             relative colour viewpoint -- most obvious in 1-bit dither. */
+          if (pixval1 > pixval2) {
+            gint tmpval = pixval1;
+            pixval1 = pixval2;
+            pixval2 = tmpval;
+            color1 = &quantobj->cmap[pixval1];
+          }
 
-              color2 = &quantobj->cmap[pixval2];
+          color2 = &quantobj->cmap[pixval2];
 
-              /* now figure out the relative probabilites of choosing
-                 either of our candidates. */
+          /* now figure out the relative probabilites of choosing
+             either of our candidates. */
 #define DISTP(R1,G1,B1,R2,G2,B2,D) do {D = sqrt( 30*SQR((R1)-(R2)) + \
                                                  59*SQR((G1)-(G2)) + \
                                                  11*SQR((B1)-(B2)) ); }while(0)
 #define LIN_DISTP(R1,G1,B1,R2,G2,B2,D) do { \
-                int spacer1, spaceg1, spaceb1; \
-                int spacer2, spaceg2, spaceb2; \
-                rgb_to_unshifted_lin(R1,G1,B1, &spacer1, &spaceg1, &spaceb1); \
-                rgb_to_unshifted_lin(R2,G2,B2, &spacer2, &spaceg2, &spaceb2); \
-                D = sqrt(R_SCALE * SQR((spacer1)-(spacer2)) + \
-                         G_SCALE * SQR((spaceg1)-(spaceg2)) + \
-                         B_SCALE * SQR((spaceb1)-(spaceb2))); \
-              } while(0)
-              /* although LIN_DISTP is more correct, DISTP is much faster and
-                 barely distinguishable. */
-              DISTP(color1->red, color1->green, color1->blue,
-                    src[red_pix], src[green_pix], src[blue_pix],
-                    err1);
-              DISTP(color2->red, color2->green, color2->blue,
-                    src[red_pix], src[green_pix], src[blue_pix],
-                    err2);
-              if (err1 || err2) {
-                const int proportion2 = (255 * err2) / (err1 + err2);
-                if (dmval > proportion2) {
-                  pixval1 = pixval2; /* use color2 instead of color1*/
-                }
-              }
+            int spacer1, spaceg1, spaceb1; \
+            int spacer2, spaceg2, spaceb2; \
+            rgb_to_unshifted_lin(R1,G1,B1, &spacer1, &spaceg1, &spaceb1); \
+            rgb_to_unshifted_lin(R2,G2,B2, &spacer2, &spaceg2, &spaceb2); \
+            D = sqrt(R_SCALE * SQR((spacer1)-(spacer2)) + \
+                     G_SCALE * SQR((spaceg1)-(spaceg2)) + \
+                     B_SCALE * SQR((spaceb1)-(spaceb2))); \
+          } while(0)
+          /* although LIN_DISTP is more correct, DISTP is much faster and
+             barely distinguishable. */
+          DISTP(color1->red, color1->green, color1->blue,
+                src[red_pix], src[green_pix], src[blue_pix],
+                err1);
+          DISTP(color2->red, color2->green, color2->blue,
+                src[red_pix], src[green_pix], src[blue_pix],
+                err2);
+          if (err1 || err2) {
+            const int proportion2 = (255 * err2) / (err1 + err2);
+            if (dmval > proportion2) {
+              pixval1 = pixval2; /* use color2 instead of color1*/
+            }
+          }
 
-              /* Now emit the colormap index for this cell, barfbarf */
-              index_used_count[dest[INDEXED] = pixval1]++;
+          /* Now emit the colormap index for this cell, barfbarf */
+          index_used_count[dest[INDEXED] = pixval1]++;
 
-            next_pixel:
+        next_pixel:
 
-              src += srcPR.bytes;
-              dest += destPR.bytes;
-            }
+          src += srcPR->bytes;
+          dest += destPR->bytes;
         }
+    }
+
+  median_cut_pass2_rgb_merge_counts (quantobj, index_used_count);
+}
+
+static void
+median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
+                                   GimpLayer   *layer,
+                                   TileManager *new_tiles)
+{
+  PixelRegion  srcPR, destPR;
+  Pass2Data    data;
+  gpointer     pr;
+  glong        total_size = 0;
+  glong        layer_size;
+  gint         count      = 0;
+
+  median_cut_pass2_rgb_data_init (&data, quantobj, layer);
+
+  pixel_region_init (&srcPR, gimp_drawable_get_tiles (GIMP_DRAWABLE (layer)),
+                     0, 0,
+                     gimp_item_get_width  (GIMP_ITEM (layer)),
+                     gimp_item_get_height (GIMP_ITEM (layer)),
+                     FALSE);
+  pixel_region_init (&destPR, new_tiles,
+                     0, 0,
+                     gimp_item_get_width  (GIMP_ITEM (layer)),
+                     gimp_item_get_height (GIMP_ITEM (layer)),
+                     TRUE);
+
+  if (quantobj->prefill_inverse_cmap)
+    {
+      PixelProcessorProgressFunc  progress_func = NULL;
+
+      if (quantobj->progress)
+        progress_func = (PixelProcessorProgressFunc)
+          median_cut_pass2_rgb_progress;
+
+      pixel_regions_process_parallel_progress ((PixelProcessorFunc)
+                                               median_cut_pass2_fixed_dither_rgb_region,
+                                               &data,
+                                               progress_func, quantobj,
+                                               2, &srcPR, &destPR);
+
+      return;
+    }
+
+  layer_size = (gimp_item_get_width  (GIMP_ITEM (layer)) *
+                gimp_item_get_height (GIMP_ITEM (layer)));
+
+  for (pr = pixel_regions_register (2, &srcPR, &destPR);
+       pr != NULL;
+       pr = pixel_regions_process (pr), count++)
+    {
+      median_cut_pass2_fixed_dither_rgb_region (&data, &srcPR, &destPR);
+
+      total_size += srcPR.h * srcPR.w;
 
       if (quantobj->progress && (count % 16 == 0))
-        gimp_progress_set_value (quantobj->progress,
-                                 (nth_layer + ((gdouble) total_size)/
-                                  layer_size) / (gdouble) n_layers);
+        median_cut_pass2_rgb_progress (quantobj,
+                                       (gdouble) total_size / layer_size);
     }
 }
 
@@ -3772,6 +4036,11 @@ median_cut_pass2_rgb_init (QuantizeObj *quantobj)
                            &quantobj->clin[i].green,
                            &quantobj->clin[i].blue);
     }
+
+  if (quantobj->prefill_inverse_cmap)
+    pixel_processor_process_range ((PixelProcessorRangeFunc)
+                                   fill_inverse_cmap_rgb_range,
+                                   quantobj, HIST_R_ELEMS, 4);
 }
 
 static void
@@ -3820,7 +4089,7 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
   gint          alpha_pix = ALPHA;
   gint          offsetx, offsety;
   gboolean      alpha_dither     = quantobj->want_alpha_dither;
-  gulong       *index_used_count = quantobj->index_used_count;
+  gulong        index_used_count[256] = { 0, };
   gint          global_rmax = 0, global_rmin = G_MAXINT;
   gint          global_gmax = 0, global_gmin = G_MAXINT;
   gint          global_bmax = 0, global_bmin = G_MAXINT;
@@ -3888,7 +4157,12 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
 
   for (row = 0; row < height; row++)
     {
+      /*  layers may be dithered concurrently, but tile access
+       *  is not thread-safe
+       */
+      g_mutex_lock (quantobj->mutex);
       pixel_region_get_row (&srcPR, 0, row, width, src_buf, 1);
+      g_mutex_unlock (quantobj->mutex);
 
       src = src_buf;
       dest = dest_buf;
@@ -4135,7 +4409,9 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
 
       odd_row = !odd_row;
 
+      g_mutex_lock (quantobj->mutex);
       pixel_region_set_row (&destPR, 0, row, width, dest_buf);
+      g_mutex_unlock (quantobj->mutex);
 
       if (quantobj->progress && (row % 16 == 0))
         gimp_progress_set_value (quantobj->progress,
@@ -4152,12 +4428,89 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
   g_free (blu_p_row);
   g_free (src_buf);
   g_free (dest_buf);
+
+  median_cut_pass2_rgb_merge_counts (quantobj, index_used_count);
+}
+
+static GimpImageType
+indexed_layer_type (GimpLayer *layer)
+{
+  GimpImageType type = GIMP_IMAGE_TYPE_FROM_BASE_TYPE (GIMP_INDEXED);
+
+  if (gimp_drawable_has_alpha (GIMP_DRAWABLE (layer)))
+    type = GIMP_IMAGE_TYPE_WITH_ALPHA (type);
+
+  return type;
+}
+
+typedef struct
+{
+  QuantizeObj  *quantobj;
+  GimpLayer   **layers;
+  TileManager **tiles;
+} LayersData;
+
+static void
+median_cut_pass2_layers_range (LayersData *data,
+                               gint        start,
+                               gint        end)
+{
+  gint i;
+
+  for (i = start; i < end; i++)
+    (* data->quantobj->second_pass) (data->quantobj,
+                                     data->layers[i], data->tiles[i]);
+}
+
+static TileManager **
+median_cut_pass2_layers_parallel (QuantizeObj *quantobj,
+                                  GList       *layers,
+                                  gint         n_layers)
+/* Run the second pass on all layers, one layer per thread.  The */
+/* second pass must not use the pixel processor itself.  Returns */
+/* the new tiles, in the order of @layers. */
+{
+  LayersData    data;
+  GimpProgress *progress = quantobj->progress;
+  GList        *list;
+  gint          i;
+
+  data.quantobj = quantobj;
+  data.layers   = g_new (GimpLayer *, n_layers);
+  data.tiles    = g_new (TileManager *, n_layers);
+
+  for (list = layers, i = 0; list; list = g_list_next (list), i++)
+    {
+      GimpLayer *layer = list->data;
+
+      data.layers[i] = layer;
+      data.tiles[i]  = tile_manager_new (gimp_item_get_width  (GIMP_ITEM (layer)),
+                                         gimp_item_get_height (GIMP_ITEM (layer)),
+                                         GIMP_IMAGE_TYPE_BYTES (indexed_layer_type (layer)));
+    }
+
+  /*  progress can only be updated from the main thread  */
+  quantobj->progress = NULL;
+
+  pixel_processor_process_range ((PixelProcessorRangeFunc)
+                                 median_cut_pass2_layers_range,
+                                 &data, n_layers, 1);
+
+  quantobj->progress = progress;
+
+  if (progress)
+    gimp_progress_set_value (progress, 1.0);
+
+  g_free (data.layers);
+
+  return data.tiles;
 }
 
 
 static void
 delete_median_cut (QuantizeObj *quantobj)
 {
+  g_mutex_free (quantobj->mutex);
   g_free (quantobj->histogram);
   g_free (quantobj);
 }
@@ -4214,7 +4567,9 @@ initialize_median_cut (GimpImageBaseType       type,
 
   quantobj->desired_number_of_colors = num_colors;
   quantobj->want_alpha_dither        = want_alpha_dither;
+  quantobj->prefill_inverse_cmap     = FALSE;
   quantobj->progress                 = progress;
+  quantobj->mutex                    = g_mutex_new ();
 
   switch (type)
     {
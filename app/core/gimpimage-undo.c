@@ -40,6 +40,8 @@ static void          gimp_image_undo_pop_stack       (GimpImage     *image,
                                                       GimpUndoStack *undo_stack,
                                                       GimpUndoStack *redo_stack,
                                                       GimpUndoMode   undo_mode);
+static void          gimp_image_undo_compress_top    (GimpImage     *image);
+static gboolean      gimp_image_undo_swap_out_bottom (GimpImage     *image);
 static void          gimp_image_undo_free_space      (GimpImage     *image);
 static void          gimp_image_undo_free_redo       (GimpImage     *image);
 
@@ -312,6 +314,8 @@ gimp_image_undo_group_start (GimpImage    *image,
   GIMP_UNDO (undo_group)->undo_type  = undo_type;
   GIMP_UNDO (undo_group)->dirty_mask = dirty_mask;
 
+  gimp_image_undo_compress_top (image);
+
   gimp_undo_stack_push_undo (private->undo_stack, GIMP_UNDO (undo_group));
 
   private->pushing_undo_group = undo_type;
@@ -403,6 +407,8 @@ gimp_image_undo_push (GimpImage     *image,
 
   if (private->pushing_undo_group == GIMP_UNDO_GROUP_NONE)
     {
+      gimp_image_undo_compress_top (image);
+
       gimp_undo_stack_push_undo (private->undo_stack, undo);
 
       gimp_image_undo_event (image, GIMP_UNDO_EVENT_UNDO_PUSHED, undo);
@@ -530,6 +536,52 @@ gimp_image_undo_pop_stack (GimpImage     *image,
   g_object_thaw_notify (G_OBJECT (image));
 }
 
+/*  called before a new undo step is pushed on top of the current one  */
+static void
+gimp_image_undo_compress_top (GimpImage *image)
+{
+  GimpImagePrivate *private = GIMP_IMAGE_GET_PRIVATE (image);
+  GimpUndo         *undo;
+
+  if (! image->gimp->config->compress_undo)
+    return;
+
+  undo = gimp_undo_stack_peek (private->undo_stack);
+
+  if (undo)
+    gimp_undo_compress_data (undo);
+}
+
+/*  returns TRUE if an undo step was spilled to the undo store  */
+static gboolean
+gimp_image_undo_swap_out_bottom (GimpImage *image)
+{
+  GimpImagePrivate *private = GIMP_IMAGE_GET_PRIVATE (image);
+  GimpCoreConfig   *config  = image->gimp->config;
+  GimpUndoStore    *store;
+  GimpUndo         *undo;
+
+  if (config->undo_swap_size == 0)
+    return FALSE;
+
+  store = gimp_undo_stack_get_store (private->undo_stack,
+                                     GIMP_BASE_CONFIG (config)->swap_path);
+
+  if (gimp_undo_store_get_size (store) >= config->undo_swap_size)
+    return FALSE;
+
+  undo = gimp_undo_stack_swap_out_bottom (private->undo_stack, store);
+
+#ifdef DEBUG_IMAGE_UNDO
+  if (undo)
+    g_printerr ("spilled one step: undo_bytes: %ld    swap_bytes: %ld\n",
+                (glong) gimp_undo_stack_get_undos_memsize (private->undo_stack),
+                (glong) gimp_undo_store_get_size (store));
+#endif
+
+  return (undo != NULL);
+}
+
 static void
 gimp_image_undo_free_space (GimpImage *image)
 {
@@ -548,24 +600,38 @@ gimp_image_undo_free_space (GimpImage *image)
 #ifdef DEBUG_IMAGE_UNDO
   g_printerr ("undo_steps: %d    undo_bytes: %ld\n",
               gimp_container_get_n_children (container),
-              (glong) gimp_object_get_memsize (GIMP_OBJECT (container), NULL));
+              (glong) gimp_undo_stack_get_undos_memsize (private->undo_stack));
 #endif
 
   /*  keep at least min_undo_levels undo steps  */
   if (gimp_container_get_n_children (container) <= min_undo_levels)
     return;
 
-  while ((gimp_object_get_memsize (GIMP_OBJECT (container), NULL) > undo_size) ||
+  while ((gimp_undo_stack_get_undos_memsize (private->undo_stack) > undo_size) ||
          (gimp_container_get_n_children (container) > max_undo_levels))
     {
-      GimpUndo *freed = gimp_undo_stack_free_bottom (private->undo_stack,
-                                                     GIMP_UNDO_MODE_UNDO);
+      GimpUndo *freed;
+
+      /*  rather spill old undo steps to disk than drop them, as long
+       *  as there are not too many of them and the swap budget allows
+       */
+      if (gimp_container_get_n_children (container) <= max_undo_levels &&
+          gimp_image_undo_swap_out_bottom (image))
+        continue;
+
+      /*  undo data that is still being compressed is counted at its
+       *  full size, wait for it before dropping undo steps
+       */
+      if (gimp_drawable_undo_finish_compression ())
+        continue;
+
+      freed = gimp_undo_stack_free_bottom (private->undo_stack,
+                                           GIMP_UNDO_MODE_UNDO);
 
 #ifdef DEBUG_IMAGE_UNDO
       g_printerr ("freed one step: undo_steps: %d    undo_bytes: %ld\n",
                   gimp_container_get_n_children (container),
-                  (glong) gimp_object_get_memsize (GIMP_OBJECT (container),
-                                                   NULL));
+                  (glong) gimp_undo_stack_get_undos_memsize (private->undo_stack));
 #endif
 
       gimp_image_undo_event (image, GIMP_UNDO_EVENT_UNDO_EXPIRED, freed);
@@ -33,11 +33,16 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <glib-object.h>
 #include <gegl.h>
 
+#include "libgimpmath/gimpmath.h"
+
 #include "core-types.h"
 
+#include "base/pixel-processor.h"
 #include "base/pixel-region.h"
 #include "base/tile-manager.h"
 #include "base/tile.h"
@@ -53,6 +58,18 @@
 #include "gimpviewable.h"
 
 
+/*  the preview is computed in chunks of about this many tiles per
+ *  idle callback, small enough to keep the UI responsive
+ */
+#define CHUNK_TILES   64
+
+/*  the visible area is first computed at a resolution of about this
+ *  many pixels if it is more than four times as large, and the result
+ *  is written back in chunks of about as many pixels
+ */
+#define PROXY_PIXELS  (512 * 512)
+
+
 enum
 {
   FLUSH,
@@ -73,9 +90,13 @@ struct _GimpImageMap
 
   GimpImageMapApplyFunc  apply_func;
   gpointer               apply_data;
-  PixelRegion            srcPR;
-  PixelRegion            destPR;
-  PixelRegionIterator   *PRI;
+
+  GArray                *chunks;
+  guint                  next_chunk;
+  GeglRectangle          proxy;
+  guchar                *proxy_data;
+  gint                   proxy_scale;
+  gint                   proxy_y;
 
   GeglNode              *gegl;
   GeglNode              *input;
@@ -108,7 +129,17 @@ static gboolean        gimp_image_map_get_pixel_at   (GimpPickable        *picka
 static void            gimp_image_map_update_undo_tiles
                                                      (GimpImageMap        *image_map,
                                                       const GeglRectangle *rect);
+static void            gimp_image_map_add_chunks     (GimpImageMap        *image_map,
+                                                      const GeglRectangle *area);
 static gboolean        gimp_image_map_do             (GimpImageMap        *image_map);
+static void            gimp_image_map_do_chunk       (GimpImageMap        *image_map,
+                                                      const GeglRectangle *chunk);
+static void            gimp_image_map_do_proxy       (GimpImageMap        *image_map);
+static void            gimp_image_map_do_proxy_chunk (GimpImageMap        *image_map);
+static void            gimp_image_map_clear_proxy    (GimpImageMap        *image_map);
+static void            gimp_image_map_update_drawable
+                                                     (GimpImageMap        *image_map,
+                                                      const GeglRectangle *area);
 static void            gimp_image_map_data_written   (GObject             *operation,
                                                       const GeglRectangle *extent,
                                                       GimpImageMap        *image_map);
@@ -165,7 +196,8 @@ gimp_image_map_init (GimpImageMap *image_map)
   image_map->undo_offset_y = 0;
   image_map->apply_func    = NULL;
   image_map->apply_data    = NULL;
-  image_map->PRI           = NULL;
+  image_map->chunks        = g_array_new (FALSE, FALSE, sizeof (GeglRectangle));
+  image_map->next_chunk    = 0;
   image_map->idle_id       = 0;
 
 #ifdef GIMP_UNSTABLE
@@ -210,6 +242,12 @@ gimp_image_map_finalize (GObject *object)
 
   gimp_image_map_cancel_any_idle_jobs (image_map);
 
+  if (image_map->chunks)
+    {
+      g_array_free (image_map->chunks, TRUE);
+      image_map->chunks = NULL;
+    }
+
   if (image_map->gegl)
     {
       g_object_unref (image_map->gegl);
@@ -353,6 +391,8 @@ gimp_image_map_apply (GimpImageMap        *image_map,
                       const GeglRectangle *visible)
 {
   GeglRectangle rect;
+  GeglRectangle area;
+  GeglRectangle rest;
 
   g_return_if_fail (GIMP_IS_IMAGE_MAP (image_map));
 
@@ -470,30 +510,48 @@ gimp_image_map_apply (GimpImageMap        *image_map,
                      "tile-manager", gimp_drawable_get_shadow_tiles (image_map->drawable),
                      "linear",       TRUE,
                      NULL);
+    }
 
-      image_map->processor = gegl_node_new_processor (image_map->output,
-                                                      &rect);
+  /*  Work on the visible part first, and on the rest afterwards  */
+  if (visible && gegl_rectangle_intersect (&area, visible, &rect))
+    {
+      /*  When the visible part is large, show a quick low resolution
+       *  version of it first, the GEGL graph does its own chunking
+       */
+      if (! image_map->gegl &&
+          area.width * area.height > 4 * PROXY_PIXELS)
+        {
+          image_map->proxy = area;
+        }
+
+      gimp_image_map_add_chunks (image_map, &area);
+
+      /*  the areas left and right of it, then above and below  */
+      gegl_rectangle_set (&rest,
+                          rect.x, area.y,
+                          area.x - rect.x, area.height);
+      gimp_image_map_add_chunks (image_map, &rest);
+
+      gegl_rectangle_set (&rest,
+                          area.x + area.width, area.y,
+                          rect.x + rect.width - area.x - area.width,
+                          area.height);
+      gimp_image_map_add_chunks (image_map, &rest);
+
+      gegl_rectangle_set (&rest,
+                          rect.x, rect.y,
+                          rect.width, area.y - rect.y);
+      gimp_image_map_add_chunks (image_map, &rest);
+
+      gegl_rectangle_set (&rest,
+                          rect.x, area.y + area.height,
+                          rect.width,
+                          rect.y + rect.height - area.y - area.height);
+      gimp_image_map_add_chunks (image_map, &rest);
     }
   else
     {
-      /*  Configure the src from the drawable data  */
-      pixel_region_init (&image_map->srcPR,
-                         image_map->undo_tiles,
-                         0, 0,
-                         rect.width, rect.height,
-                         FALSE);
-
-      /*  Configure the dest as the shadow buffer  */
-      pixel_region_init (&image_map->destPR,
-                         gimp_drawable_get_shadow_tiles (image_map->drawable),
-                         rect.x, rect.y,
-                         rect.width, rect.height,
-                         TRUE);
-
-      /*  Apply the image transformation to the pixels  */
-      image_map->PRI = pixel_regions_register (2,
-                                               &image_map->srcPR,
-                                               &image_map->destPR);
+      gimp_image_map_add_chunks (image_map, &rect);
     }
 
   if (image_map->timer)
@@ -517,7 +575,9 @@ gimp_image_map_commit (GimpImageMap *image_map)
       g_source_remove (image_map->idle_id);
       image_map->idle_id = 0;
 
-      /*  Finish the changes  */
+      /*  Finish the changes, no need for a proxy any longer  */
+      gimp_image_map_clear_proxy (image_map);
+
       while (gimp_image_map_do (image_map));
     }
 
@@ -636,6 +696,9 @@ gimp_image_map_update_undo_tiles (GimpImageMap        *image_map,
       undo_width    != rect->width ||
       undo_height   != rect->height)
     {
+      PixelRegion srcPR;
+      PixelRegion destPR;
+
       /* If either the extents changed or the tiles don't exist,
        * allocate new
        */
@@ -654,18 +717,18 @@ gimp_image_map_update_undo_tiles (GimpImageMap        *image_map,
         }
 
       /*  Copy from the image to the new tiles  */
-      pixel_region_init (&image_map->srcPR,
+      pixel_region_init (&srcPR,
                          gimp_drawable_get_tiles (image_map->drawable),
                          rect->x, rect->y,
                          rect->width, rect->height,
                          FALSE);
-      pixel_region_init (&image_map->destPR,
+      pixel_region_init (&destPR,
                          image_map->undo_tiles,
                          0, 0,
                          rect->width, rect->height,
                          TRUE);
 
-      copy_region (&image_map->srcPR, &image_map->destPR);
+      copy_region (&srcPR, &destPR);
 
       /*  Set the offsets  */
       image_map->undo_offset_x = rect->x;
@@ -673,6 +736,46 @@ gimp_image_map_update_undo_tiles (GimpImageMap        *image_map,
     }
 }
 
+/*  split an area to be processed into chunks, tile rows of about
+ *  CHUNK_TILES tiles when applying a function and the whole area when
+ *  GEGL processes it
+ */
+static void
+gimp_image_map_add_chunks (GimpImageMap        *image_map,
+                           const GeglRectangle *area)
+{
+  gint rows;
+  gint y;
+
+  if (area->width <= 0 || area->height <= 0)
+    return;
+
+  if (image_map->gegl)
+    {
+      g_array_append_val (image_map->chunks, *area);
+      return;
+    }
+
+  rows = CHUNK_TILES * TILE_WIDTH * TILE_HEIGHT / area->width;
+  rows = MAX (rows / TILE_HEIGHT, 1) * TILE_HEIGHT;
+
+  for (y = area->y; y < area->y + area->height; )
+    {
+      GeglRectangle chunk;
+      gint          next = MIN ((y / TILE_HEIGHT) * TILE_HEIGHT + rows,
+                                area->y + area->height);
+
+      chunk.x      = area->x;
+      chunk.y      = y;
+      chunk.width  = area->width;
+      chunk.height = next - y;
+
+      g_array_append_val (image_map->chunks, chunk);
+
+      y = next;
+    }
+}
+
 static gboolean
 gimp_image_map_do (GimpImageMap *image_map)
 {
@@ -685,163 +788,273 @@ gimp_image_map_do (GimpImageMap *image_map)
       return FALSE;
     }
 
-  if (image_map->gegl)
-    {
-      gboolean pending;
-
-      if (image_map->timer)
-        g_timer_continue (image_map->timer);
+  if (image_map->timer)
+    g_timer_continue (image_map->timer);
 
-      pending = gegl_processor_work (image_map->processor, NULL);
+  if (image_map->proxy.width > 0)
+    {
+      if (! image_map->proxy_data)
+        gimp_image_map_do_proxy (image_map);
+      else
+        gimp_image_map_do_proxy_chunk (image_map);
+    }
+  else if (image_map->gegl)
+    {
+      if (! image_map->processor &&
+          image_map->next_chunk < image_map->chunks->len)
+        {
+          GeglRectangle *chunk = &g_array_index (image_map->chunks,
+                                                 GeglRectangle,
+                                                 image_map->next_chunk++);
 
-      if (image_map->timer)
-        g_timer_stop (image_map->timer);
+          image_map->processor = gegl_node_new_processor (image_map->output,
+                                                          chunk);
+        }
 
-      if (! pending)
+      if (image_map->processor &&
+          ! gegl_processor_work (image_map->processor, NULL))
         {
-          if (image_map->timer)
-            g_printerr ("%s: %g MPixels/sec\n",
-                        image_map->undo_desc,
-                        (gdouble) image_map->pixel_count /
-                        (1000000.0 *
-                         g_timer_elapsed (image_map->timer, NULL)));
-
           g_object_unref (image_map->processor);
           image_map->processor = NULL;
+        }
+    }
+  else if (image_map->next_chunk < image_map->chunks->len)
+    {
+      GeglRectangle *chunk = &g_array_index (image_map->chunks,
+                                             GeglRectangle,
+                                             image_map->next_chunk++);
 
-          image_map->idle_id = 0;
+      gimp_image_map_do_chunk (image_map, chunk);
+    }
 
-          g_signal_emit (image_map, image_map_signals[FLUSH], 0);
+  if (image_map->timer)
+    g_timer_stop (image_map->timer);
 
-          return FALSE;
-        }
-    }
-  else
+  if (! image_map->processor      &&
+      image_map->proxy.width == 0 &&
+      image_map->next_chunk == image_map->chunks->len)
     {
-      gint i;
+      if (image_map->timer)
+        g_printerr ("%s: %g MPixels/sec\n",
+                    image_map->undo_desc,
+                    (gdouble) image_map->pixel_count /
+                    (1000000.0 *
+                     g_timer_elapsed (image_map->timer, NULL)));
 
-      /*  Process up to 16 tiles in one go. This reduces the overhead
-       *  caused by updating the display while the imagemap is being
-       *  applied and gives us a tiny speedup.
-       */
-      for (i = 0; i < 16; i++)
-        {
-          PixelRegion  srcPR;
-          PixelRegion  destPR;
-          gint         x, y, w, h;
-
-          if (image_map->timer)
-            g_timer_continue (image_map->timer);
-
-          x = image_map->destPR.x;
-          y = image_map->destPR.y;
-          w = image_map->destPR.w;
-          h = image_map->destPR.h;
-
-          /* Reset to initial drawable conditions. */
-          pixel_region_init (&srcPR, image_map->undo_tiles,
-                             x - image_map->undo_offset_x,
-                             y - image_map->undo_offset_y,
-                             w, h, FALSE);
-          pixel_region_init (&destPR,
-                             gimp_drawable_get_tiles (image_map->drawable),
-                             x, y, w, h, TRUE);
-          copy_region (&srcPR, &destPR);
+      g_array_set_size (image_map->chunks, 0);
+      image_map->next_chunk = 0;
+
+      image_map->idle_id = 0;
+
+      g_signal_emit (image_map, image_map_signals[FLUSH], 0);
 
-          image_map->apply_func (image_map->apply_data,
-                                 &image_map->srcPR,
-                                 &image_map->destPR);
+      return FALSE;
+    }
 
+  g_signal_emit (image_map, image_map_signals[FLUSH], 0);
 
-          pixel_region_init (&srcPR,
-                             gimp_drawable_get_shadow_tiles (image_map->drawable),
-                             x, y, w, h, FALSE);
+  return TRUE;
+}
 
-          gimp_drawable_apply_region (image_map->drawable, &srcPR,
-                                      FALSE, NULL,
-                                      GIMP_OPACITY_OPAQUE, GIMP_REPLACE_MODE,
-                                      NULL, NULL,
-                                      x, y);
+/*  apply the function to a chunk, spread across the pixel processor's
+ *  threads
+ */
+static void
+gimp_image_map_do_chunk (GimpImageMap        *image_map,
+                         const GeglRectangle *chunk)
+{
+  PixelRegion srcPR;
+  PixelRegion destPR;
 
-          gimp_drawable_update (image_map->drawable, x, y, w, h);
+  pixel_region_init (&srcPR, image_map->undo_tiles,
+                     chunk->x - image_map->undo_offset_x,
+                     chunk->y - image_map->undo_offset_y,
+                     chunk->width, chunk->height,
+                     FALSE);
+  pixel_region_init (&destPR,
+                     gimp_drawable_get_shadow_tiles (image_map->drawable),
+                     chunk->x, chunk->y,
+                     chunk->width, chunk->height,
+                     TRUE);
 
-          image_map->PRI = pixel_regions_process (image_map->PRI);
+  pixel_regions_process_parallel ((PixelProcessorFunc) image_map->apply_func,
+                                  image_map->apply_data,
+                                  2, &srcPR, &destPR);
 
-          if (image_map->timer)
-            {
-              g_timer_stop (image_map->timer);
-              image_map->pixel_count += w * h;
-            }
+  gimp_image_map_update_drawable (image_map, chunk);
 
-          if (image_map->PRI == NULL)
-            {
-              if (image_map->timer)
-                g_printerr ("%s: %g MPixels/sec\n",
-                            image_map->undo_desc,
-                            (gdouble) image_map->pixel_count /
-                            (1000000.0 *
-                             g_timer_elapsed (image_map->timer, NULL)));
+  if (image_map->timer)
+    image_map->pixel_count += chunk->width * chunk->height;
+}
 
-              image_map->idle_id = 0;
+/*  apply the function to every n-th pixel of every n-th row of the
+ *  proxy area, gimp_image_map_do_proxy_chunk() then scales the result
+ *  up in the following idle callbacks
+ */
+static void
+gimp_image_map_do_proxy (GimpImageMap *image_map)
+{
+  const GeglRectangle *area  = &image_map->proxy;
+  PixelRegion          srcPR;
+  PixelRegion          destPR;
+  gint                 bytes = gimp_drawable_bytes (image_map->drawable);
+  gint                 scale;
+  gint                 width;
+  gint                 height;
+  guchar              *src;
+  gint                 y;
+
+  scale  = ceil (sqrt ((gdouble) area->width * area->height / PROXY_PIXELS));
+  width  = (area->width  + scale - 1) / scale;
+  height = (area->height + scale - 1) / scale;
+
+  src                   = g_new (guchar, width * height * bytes);
+  image_map->proxy_data = g_new (guchar, width * height * bytes);
+
+  pixel_region_init (&srcPR, image_map->undo_tiles,
+                     area->x - image_map->undo_offset_x,
+                     area->y - image_map->undo_offset_y,
+                     area->width, area->height,
+                     FALSE);
 
-              g_signal_emit (image_map, image_map_signals[FLUSH], 0);
+  for (y = 0; y < height; y++)
+    pixel_region_get_row (&srcPR,
+                          srcPR.x, srcPR.y + y * scale, area->width,
+                          src + y * width * bytes, scale);
 
-              return FALSE;
-            }
+  pixel_region_init_data (&srcPR, src, bytes, width * bytes,
+                          0, 0, width, height);
+  pixel_region_init_data (&destPR, image_map->proxy_data, bytes, width * bytes,
+                          0, 0, width, height);
+
+  image_map->apply_func (image_map->apply_data, &srcPR, &destPR);
+
+  g_free (src);
+
+  image_map->proxy_scale = scale;
+  image_map->proxy_y     = area->y;
+}
+
+/*  scale the next PROXY_PIXELS or so of the proxy result up into the
+ *  shadow tiles with nearest neighbor and show them, the full
+ *  resolution chunks replace them shortly after
+ */
+static void
+gimp_image_map_do_proxy_chunk (GimpImageMap *image_map)
+{
+  const GeglRectangle *area  = &image_map->proxy;
+  GeglRectangle        chunk;
+  PixelRegion          destPR;
+  gint                 bytes = gimp_drawable_bytes (image_map->drawable);
+  gint                 scale = image_map->proxy_scale;
+  gint                 width = (area->width + scale - 1) / scale;
+  guchar              *row;
+  gint                 x, y;
+
+  chunk.x      = area->x;
+  chunk.y      = image_map->proxy_y;
+  chunk.width  = area->width;
+  chunk.height = MIN (MAX (PROXY_PIXELS / area->width, 1),
+                      area->y + area->height - chunk.y);
+
+  row = g_new (guchar, area->width * bytes);
+
+  pixel_region_init (&destPR,
+                     gimp_drawable_get_shadow_tiles (image_map->drawable),
+                     chunk.x, chunk.y,
+                     chunk.width, chunk.height,
+                     TRUE);
+
+  for (y = chunk.y; y < chunk.y + chunk.height; y++)
+    {
+      if (y == chunk.y || (y - area->y) % scale == 0)
+        {
+          const guchar *d = (image_map->proxy_data +
+                             ((y - area->y) / scale) * width * bytes);
+
+          for (x = 0; x < area->width; x++)
+            memcpy (row + x * bytes, d + (x / scale) * bytes, bytes);
         }
+
+      pixel_region_set_row (&destPR, chunk.x, y, chunk.width, row);
     }
 
-  g_signal_emit (image_map, image_map_signals[FLUSH], 0);
+  g_free (row);
 
-  return TRUE;
+  gimp_image_map_update_drawable (image_map, &chunk);
+
+  image_map->proxy_y += chunk.height;
+
+  if (image_map->proxy_y >= area->y + area->height)
+    gimp_image_map_clear_proxy (image_map);
 }
 
 static void
-gimp_image_map_data_written (GObject             *operation,
-                             const GeglRectangle *extent,
-                             GimpImageMap        *image_map)
+gimp_image_map_clear_proxy (GimpImageMap *image_map)
+{
+  if (image_map->proxy_data)
+    {
+      g_free (image_map->proxy_data);
+      image_map->proxy_data = NULL;
+    }
+
+  image_map->proxy.width = 0;
+}
+
+/*  put the result from the shadow tiles on the original pixels  */
+static void
+gimp_image_map_update_drawable (GimpImageMap        *image_map,
+                                const GeglRectangle *area)
 {
   PixelRegion srcPR;
   PixelRegion destPR;
 
-#if 0
-  g_print ("%s: rect = { %d, %d, %d, %d }\n",
-           G_STRFUNC, extent->x, extent->y, extent->width, extent->height);
-#endif
-
   /* Reset to initial drawable conditions. */
   pixel_region_init (&srcPR, image_map->undo_tiles,
-                     extent->x - image_map->undo_offset_x,
-                     extent->y - image_map->undo_offset_y,
-                     extent->width,
-                     extent->height,
+                     area->x - image_map->undo_offset_x,
+                     area->y - image_map->undo_offset_y,
+                     area->width,
+                     area->height,
                      FALSE);
   pixel_region_init (&destPR, gimp_drawable_get_tiles (image_map->drawable),
-                     extent->x,
-                     extent->y,
-                     extent->width,
-                     extent->height,
+                     area->x,
+                     area->y,
+                     area->width,
+                     area->height,
                      TRUE);
   copy_region (&srcPR, &destPR);
 
-  /* Apply the result of the gegl graph. */
+  /* Apply the result */
   pixel_region_init (&srcPR,
                      gimp_drawable_get_shadow_tiles (image_map->drawable),
-                     extent->x,
-                     extent->y,
-                     extent->width,
-                     extent->height,
+                     area->x,
+                     area->y,
+                     area->width,
+                     area->height,
                      FALSE);
 
   gimp_drawable_apply_region (image_map->drawable, &srcPR,
                               FALSE, NULL,
                               GIMP_OPACITY_OPAQUE, GIMP_REPLACE_MODE,
                               NULL, NULL,
-                              extent->x, extent->y);
+                              area->x, area->y);
 
   gimp_drawable_update (image_map->drawable,
-                        extent->x, extent->y,
-                        extent->width, extent->height);
+                        area->x, area->y,
+                        area->width, area->height);
+}
+
+static void
+gimp_image_map_data_written (GObject             *operation,
+                             const GeglRectangle *extent,
+                             GimpImageMap        *image_map)
+{
+#if 0
+  g_print ("%s: rect = { %d, %d, %d, %d }\n",
+           G_STRFUNC, extent->x, extent->y, extent->width, extent->height);
+#endif
+
+  gimp_image_map_update_drawable (image_map, extent);
 
   if (image_map->timer)
     image_map->pixel_count += extent->width * extent->height;
@@ -868,9 +1081,8 @@ gimp_image_map_kill_any_idle_processors (GimpImageMap *image_map)
       image_map->processor = NULL;
     }
 
-  if (image_map->PRI)
-    {
-      pixel_regions_process_stop (image_map->PRI);
-      image_map->PRI = NULL;
-    }
+  g_array_set_size (image_map->chunks, 0);
+  image_map->next_chunk = 0;
+
+  gimp_image_map_clear_proxy (image_map);
 }
@@ -26,8 +26,12 @@
 #include "gimppreviewcache.h"
 
 
-#define MAX_CACHE_PREVIEWS 5
-
+/*  The previews of all objects share one memory budget.  Each object
+ *  keeps its own list of previews for the lookups, and all of them
+ *  are also linked into one list from the most recently used to the
+ *  least recently used, which is where previews are dropped from
+ *  when the budget is exceeded.
+ */
 
 typedef struct
 {
@@ -36,6 +40,18 @@ typedef struct
   gint     height;
 } PreviewNearest;
 
+typedef struct
+{
+  TempBuf  *buf;
+  GSList  **plist;  /*  the list of the object owning buf  */
+} PreviewEntry;
+
+
+static GQueue      preview_lru         = G_QUEUE_INIT;
+static GHashTable *preview_links       = NULL;  /*  TempBuf -> link in lru  */
+static gsize       preview_memsize     = 0;
+static gsize       preview_max_memsize = PREVIEW_CACHE_MAX_MEMSIZE;
+
 
 static gint
 preview_cache_compare (gconstpointer  a,
@@ -90,43 +106,58 @@ preview_cache_find_biggest (gpointer data,
     }
 }
 
+/*  move buf to the front of the lru list  */
 static void
-preview_cache_remove_smallest (GSList **plist)
+preview_cache_touch (TempBuf *buf)
 {
-  GSList  *list;
-  TempBuf *smallest = NULL;
+  GList *link = g_hash_table_lookup (preview_links, buf);
 
-#ifdef PREVIEW_CACHE_DEBUG
-  g_print ("preview_cache_remove_smallest\n");
-#endif
+  if (link && link != preview_lru.head)
+    {
+      g_queue_unlink (&preview_lru, link);
+      g_queue_push_head_link (&preview_lru, link);
+    }
+}
 
-  for (list = *plist; list; list = list->next)
+/*  forget buf, but leave it in the list of its object  */
+static void
+preview_cache_forget (TempBuf *buf)
+{
+  GList *link = g_hash_table_lookup (preview_links, buf);
+
+  if (link)
     {
-      if (!smallest)
-        {
-          smallest = list->data;
-        }
-      else
-        {
-          TempBuf *this = list->data;
+      PreviewEntry *entry = link->data;
 
-          if (smallest->height * smallest->width > this->height * this->width)
-            {
-              smallest = this;
-            }
-        }
+      g_hash_table_remove (preview_links, buf);
+      g_queue_delete_link (&preview_lru, link);
+      g_slice_free (PreviewEntry, entry);
+
+      preview_memsize -= temp_buf_get_memsize (buf);
     }
+}
 
-  if (smallest)
+/*  drop the least recently used previews until the budget is met,
+ *  keep the most recently used one even if it alone exceeds it
+ */
+static void
+preview_cache_trim (void)
+{
+  while (preview_memsize > preview_max_memsize &&
+         preview_lru.tail != preview_lru.head)
     {
-      *plist = g_slist_remove (*plist, smallest);
+      PreviewEntry *entry = preview_lru.tail->data;
+      TempBuf      *buf   = entry->buf;
 
 #ifdef PREVIEW_CACHE_DEBUG
-      g_print ("preview_cache_remove_smallest: removed %d x %d\n",
-               smallest->width, smallest->height);
+      g_print ("preview_cache_trim: removed %d x %d\n",
+               buf->width, buf->height);
 #endif
 
-      temp_buf_free (smallest);
+      *entry->plist = g_slist_remove (*entry->plist, buf);
+
+      preview_cache_forget (buf);
+      temp_buf_free (buf);
     }
 }
 
@@ -155,6 +186,8 @@ gimp_preview_cache_invalidate (GSList **plist)
   preview_cache_print (*plist);
 #endif
 
+  g_slist_foreach (*plist, (GFunc) preview_cache_forget, NULL);
+
   g_slist_free_full (*plist, (GDestroyNotify) temp_buf_free);
   *plist = NULL;
 }
@@ -163,17 +196,29 @@ void
 gimp_preview_cache_add (GSList  **plist,
                         TempBuf  *buf)
 {
+  PreviewEntry *entry;
+
 #ifdef PREVIEW_CACHE_DEBUG
   g_print ("gimp_preview_cache_add: %d x %d\n", buf->width, buf->height);
   preview_cache_print (*plist);
 #endif
 
-  if (g_slist_length (*plist) >= MAX_CACHE_PREVIEWS)
-    {
-      preview_cache_remove_smallest (plist);
-    }
+  if (! preview_links)
+    preview_links = g_hash_table_new (g_direct_hash, g_direct_equal);
 
   *plist = g_slist_insert_sorted (*plist, buf, preview_cache_compare);
+
+  entry = g_slice_new (PreviewEntry);
+
+  entry->buf   = buf;
+  entry->plist = plist;
+
+  g_queue_push_head (&preview_lru, entry);
+  g_hash_table_insert (preview_links, buf, preview_lru.head);
+
+  preview_memsize += temp_buf_get_memsize (buf);
+
+  preview_cache_trim ();
 }
 
 TempBuf *
@@ -201,6 +246,8 @@ gimp_preview_cache_get (GSList **plist,
                pn.buf->width, pn.buf->height);
 #endif
 
+      preview_cache_touch (pn.buf);
+
       return pn.buf;
     }
 
@@ -223,6 +270,8 @@ gimp_preview_cache_get (GSList **plist,
                pn.buf->width, pn.buf->height);
 #endif
 
+      preview_cache_touch (pn.buf);
+
       /* Make up new preview from the large one... */
       pwidth  = pn.buf->width;
       pheight = pn.buf->height;
@@ -288,3 +337,29 @@ gimp_preview_cache_get_memsize (GSList *cache)
 
   return memsize;
 }
+
+/**
+ * gimp_preview_cache_set_max_memsize:
+ * @max_memsize: the memory all cached previews may use together
+ *
+ * Sets the budget of the preview cache and drops the least recently
+ * used previews that don't fit into it any longer.
+ **/
+void
+gimp_preview_cache_set_max_memsize (gsize max_memsize)
+{
+  preview_max_memsize = max_memsize;
+
+  preview_cache_trim ();
+}
+
+/**
+ * gimp_preview_cache_get_total_memsize:
+ *
+ * Returns: the memory used by the previews of all objects.
+ **/
+gsize
+gimp_preview_cache_get_total_memsize (void)
+{
+  return preview_memsize;
+}
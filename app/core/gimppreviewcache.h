@@ -21,16 +21,20 @@
 
 #define PREVIEW_CACHE_PRIME_WIDTH  112
 #define PREVIEW_CACHE_PRIME_HEIGHT 112
+#define PREVIEW_CACHE_MAX_MEMSIZE  (32 * 1024 * 1024)
 
 
-TempBuf * gimp_preview_cache_get         (GSList  **plist,
-                                          gint      width,
-                                          gint      height);
-void      gimp_preview_cache_add         (GSList  **plist,
-                                          TempBuf  *buf);
-void      gimp_preview_cache_invalidate  (GSList  **plist);
+TempBuf * gimp_preview_cache_get               (GSList  **plist,
+                                                gint      width,
+                                                gint      height);
+void      gimp_preview_cache_add               (GSList  **plist,
+                                                TempBuf  *buf);
+void      gimp_preview_cache_invalidate        (GSList  **plist);
 
-gsize     gimp_preview_cache_get_memsize (GSList   *cache);
+gsize     gimp_preview_cache_get_memsize       (GSList   *cache);
+
+void      gimp_preview_cache_set_max_memsize   (gsize     max_memsize);
+gsize     gimp_preview_cache_get_total_memsize (void);
 
 
 #endif /* __GIMP_PREVIEW_CACHE_H__ */
@@ -381,6 +381,43 @@ gimp_undo_free (GimpUndo     *undo,
   g_signal_emit (undo, undo_signals[FREE], 0, undo_mode);
 }
 
+/**
+ * gimp_undo_compress_data:
+ * @undo: a #GimpUndo
+ *
+ * Asks @undo to keep its data in a compressed form until it is
+ * popped. Called on undo steps that are no longer on top of the undo
+ * stack when the "compress-undo" preference is enabled.
+ **/
+void
+gimp_undo_compress_data (GimpUndo *undo)
+{
+  g_return_if_fail (GIMP_IS_UNDO (undo));
+
+  if (GIMP_UNDO_GET_CLASS (undo)->compress_data)
+    GIMP_UNDO_GET_CLASS (undo)->compress_data (undo);
+}
+
+/**
+ * gimp_undo_swap_out:
+ * @undo:  a #GimpUndo
+ * @store: the #GimpUndoStore of @undo's image
+ *
+ * Asks @undo to move its data to @store until it is popped. Called
+ * on old undo steps when the "undo-size" limit is reached and there
+ * is room left in the "undo-swap-size" budget.
+ **/
+void
+gimp_undo_swap_out (GimpUndo      *undo,
+                    GimpUndoStore *store)
+{
+  g_return_if_fail (GIMP_IS_UNDO (undo));
+  g_return_if_fail (store != NULL);
+
+  if (GIMP_UNDO_GET_CLASS (undo)->swap_out)
+    GIMP_UNDO_GET_CLASS (undo)->swap_out (undo, store);
+}
+
 typedef struct _GimpUndoIdle GimpUndoIdle;
 
 struct _GimpUndoIdle
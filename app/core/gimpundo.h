@@ -60,6 +60,9 @@ struct _GimpUndo
 
   TempBuf          *preview;
   guint             preview_idle_id;
+
+  gint64            stacked_memsize; /* memsize when pushed down a stack  */
+  gboolean          swapped;        /* data was spilled to the undo store */
 };
 
 struct _GimpUndoClass
@@ -71,6 +74,9 @@ struct _GimpUndoClass
                  GimpUndoAccumulator *accum);
   void (* free) (GimpUndo            *undo,
                  GimpUndoMode         undo_mode);
+  void (* compress_data) (GimpUndo            *undo);
+  void (* swap_out)      (GimpUndo            *undo,
+                          GimpUndoStore       *store);
 };
 
 
@@ -81,6 +87,9 @@ void          gimp_undo_pop             (GimpUndo            *undo,
                                          GimpUndoAccumulator *accum);
 void          gimp_undo_free            (GimpUndo            *undo,
                                          GimpUndoMode         undo_mode);
+void          gimp_undo_compress_data   (GimpUndo            *undo);
+void          gimp_undo_swap_out        (GimpUndo            *undo,
+                                         GimpUndoStore       *store);
 
 void          gimp_undo_create_preview  (GimpUndo            *undo,
                                          GimpContext         *context,
@@ -17,15 +17,114 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 #include <gegl.h>
+#include <glib/gstdio.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpconfig/gimpconfig.h"
+
+#ifdef G_OS_WIN32
+#include <windows.h>
+#include "libgimpbase/gimpwin32-io.h"
+#endif
 
 #include "core-types.h"
 
+#include "base/base-utils.h"
+
 #include "gimpimage.h"
 #include "gimplist.h"
 #include "gimpundo.h"
 #include "gimpundostack.h"
 
+#include "gimp-intl.h"
+
+
+#ifndef _O_BINARY
+#define _O_BINARY 0
+#endif
+#ifndef _O_TEMPORARY
+#define _O_TEMPORARY 0
+#endif
+
+#ifdef G_OS_WIN32
+
+#define LARGE_SEEK(f, o, w) _lseeki64 (f, o, w)
+#define LARGE_TRUNCATE(f, s) win32_large_truncate (f, s)
+
+static gint
+win32_large_truncate (gint   fd,
+                      gint64 size)
+{
+  if (LARGE_SEEK (fd, size, SEEK_SET) == size &&
+      SetEndOfFile ((HANDLE) _get_osfhandle (fd)))
+    return 0;
+  else
+    return -1;
+}
+
+#else
+
+#define LARGE_SEEK(f, o, w) lseek (f, o, w)
+#define LARGE_TRUNCATE(f, s) ftruncate (f, s)
+
+#endif
+
+
+typedef enum
+{
+  CHUNK_PENDING,  /* queued for the writer, data in memory         */
+  CHUNK_WRITING,  /* being written, data still in memory           */
+  CHUNK_ON_DISK,  /* written, data freed                           */
+  CHUNK_RESIDENT, /* writing failed, data stays in memory          */
+  CHUNK_DEAD      /* taken or removed while the writer still has it */
+} ChunkState;
+
+typedef struct _StoreChunk StoreChunk;
+typedef struct _StoreGap   StoreGap;
+
+struct _StoreChunk
+{
+  ChunkState  state;
+  gint64      offset;
+  gsize       size;
+  gpointer    data;
+};
+
+struct _StoreGap
+{
+  gint64      start;
+  gint64      end;
+};
+
+struct _GimpUndoStore
+{
+  gint         ref_count;
+
+  gchar       *filename;
+  gint         fd;
+  gint64       file_end;
+
+  GList       *gaps;     /* sorted unused ranges below file_end        */
+
+  GHashTable  *chunks;   /* chunk id -> StoreChunk                      */
+  guint        next_id;
+  gint         n_queued; /* chunks the writer did not finish yet        */
+  gboolean     failed;
+
+  GMutex      *lock;     /* protects everything above                   */
+  GMutex      *io_lock;  /* serializes access to fd                     */
+  GThreadPool *writer;
+};
+
 
 static void    gimp_undo_stack_finalize    (GObject             *object);
 
@@ -37,6 +136,19 @@ static void    gimp_undo_stack_pop         (GimpUndo            *undo,
                                             GimpUndoAccumulator *accum);
 static void    gimp_undo_stack_free        (GimpUndo            *undo,
                                             GimpUndoMode         undo_mode);
+static void    gimp_undo_stack_compress_data (GimpUndo          *undo);
+static void    gimp_undo_stack_swap_out    (GimpUndo            *undo,
+                                            GimpUndoStore       *store);
+
+static GimpUndoStore * gimp_undo_store_new (const gchar         *filename);
+static gint64  gimp_undo_store_find_offset (GimpUndoStore       *store,
+                                            gsize                size);
+static void    gimp_undo_store_free_range  (GimpUndoStore       *store,
+                                            gint64               offset,
+                                            gsize                size);
+static void    gimp_undo_store_write_chunk (StoreChunk          *chunk,
+                                            GimpUndoStore       *store);
+static void    gimp_undo_store_maybe_reset (GimpUndoStore       *store);
 
 
 G_DEFINE_TYPE (GimpUndoStack, gimp_undo_stack, GIMP_TYPE_UNDO)
@@ -57,6 +169,8 @@ gimp_undo_stack_class_init (GimpUndoStackClass *klass)
 
   undo_class->pop                = gimp_undo_stack_pop;
   undo_class->free               = gimp_undo_stack_free;
+  undo_class->compress_data      = gimp_undo_stack_compress_data;
+  undo_class->swap_out           = gimp_undo_stack_swap_out;
 }
 
 static void
@@ -76,6 +190,12 @@ gimp_undo_stack_finalize (GObject *object)
       stack->undos = NULL;
     }
 
+  if (stack->store)
+    {
+      gimp_undo_store_unref (stack->store);
+      stack->store = NULL;
+    }
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -128,6 +248,42 @@ gimp_undo_stack_free (GimpUndo     *undo,
     }
 
   gimp_container_clear (stack->undos);
+
+  stack->undos_memsize = 0;
+  stack->swap_last     = NULL;
+}
+
+static void
+gimp_undo_stack_compress_data (GimpUndo *undo)
+{
+  GimpUndoStack *stack = GIMP_UNDO_STACK (undo);
+  GList         *list;
+
+  for (list = GIMP_LIST (stack->undos)->list;
+       list;
+       list = g_list_next (list))
+    {
+      GimpUndo *child = list->data;
+
+      gimp_undo_compress_data (child);
+    }
+}
+
+static void
+gimp_undo_stack_swap_out (GimpUndo      *undo,
+                          GimpUndoStore *store)
+{
+  GimpUndoStack *stack = GIMP_UNDO_STACK (undo);
+  GList         *list;
+
+  for (list = GIMP_LIST (stack->undos)->list;
+       list;
+       list = g_list_next (list))
+    {
+      GimpUndo *child = list->data;
+
+      gimp_undo_swap_out (child, store);
+    }
 }
 
 GimpUndoStack *
@@ -144,9 +300,23 @@ void
 gimp_undo_stack_push_undo (GimpUndoStack *stack,
                            GimpUndo      *undo)
 {
+  GimpUndo *top;
+
   g_return_if_fail (GIMP_IS_UNDO_STACK (stack));
   g_return_if_fail (GIMP_IS_UNDO (undo));
 
+  /*  only the top undo can still change, remember the size of the
+   *  previous one now that it is pushed down the stack
+   */
+  top = gimp_undo_stack_peek (stack);
+
+  if (top)
+    {
+      top->stacked_memsize = gimp_object_get_memsize (GIMP_OBJECT (top), NULL);
+
+      stack->undos_memsize += top->stacked_memsize;
+    }
+
   gimp_container_add (stack->undos, GIMP_OBJECT (undo));
 }
 
@@ -164,9 +334,25 @@ gimp_undo_stack_pop_undo (GimpUndoStack       *stack,
 
   if (undo)
     {
+      GimpUndo *top;
+
+      /*  the undos below a spilled one are spilled too  */
+      if (stack->swap_last && stack->swap_last->data == undo)
+        stack->swap_last = g_list_next (stack->swap_last);
+
       gimp_container_remove (stack->undos, GIMP_OBJECT (undo));
+
+      /*  the new top undo may change again  */
+      top = gimp_undo_stack_peek (stack);
+
+      if (top)
+        stack->undos_memsize -= top->stacked_memsize;
+
       gimp_undo_pop (undo, undo_mode, accum);
 
+      /*  popping pages spilled data back in  */
+      undo->swapped = FALSE;
+
       return undo;
     }
 
@@ -185,6 +371,12 @@ gimp_undo_stack_free_bottom (GimpUndoStack *stack,
 
   if (undo)
     {
+      if (undo != gimp_undo_stack_peek (stack))
+        stack->undos_memsize -= undo->stacked_memsize;
+
+      if (stack->swap_last && stack->swap_last->data == undo)
+        stack->swap_last = NULL;
+
       gimp_container_remove (stack->undos, GIMP_OBJECT (undo));
       gimp_undo_free (undo, undo_mode);
 
@@ -209,3 +401,728 @@ gimp_undo_stack_get_depth (GimpUndoStack *stack)
 
   return gimp_container_get_n_children (stack->undos);
 }
+
+/**
+ * gimp_undo_stack_get_undos_memsize:
+ * @stack: a #GimpUndoStack
+ *
+ * Returns the memory used by the undos on @stack without walking all
+ * of them. The sizes of the undos below the top are remembered when
+ * they are pushed down the stack, only the top undo is measured.
+ *
+ * Return value: the memsize of the undos on @stack
+ **/
+gint64
+gimp_undo_stack_get_undos_memsize (GimpUndoStack *stack)
+{
+  GimpUndo *top;
+
+  g_return_val_if_fail (GIMP_IS_UNDO_STACK (stack), 0);
+
+  top = gimp_undo_stack_peek (stack);
+
+  if (top)
+    return stack->undos_memsize + gimp_object_get_memsize (GIMP_OBJECT (top),
+                                                           NULL);
+
+  return 0;
+}
+
+/**
+ * gimp_undo_stack_get_store:
+ * @stack:     a #GimpUndoStack
+ * @swap_path: the directory to create the store's file in
+ *
+ * Returns the #GimpUndoStore that old undo steps on @stack are
+ * spilled to, creating it on first use. The store's file is only
+ * created once data is actually written.
+ *
+ * Return value: the store of @stack, owned by @stack
+ **/
+GimpUndoStore *
+gimp_undo_stack_get_store (GimpUndoStack *stack,
+                           const gchar   *swap_path)
+{
+  g_return_val_if_fail (GIMP_IS_UNDO_STACK (stack), NULL);
+  g_return_val_if_fail (swap_path != NULL, NULL);
+
+  if (! stack->store)
+    {
+      static guint  store_count = 0;
+      gchar        *dirname;
+      gchar        *basename;
+      gchar        *filename;
+
+      dirname  = gimp_config_path_expand (swap_path, TRUE, NULL);
+      basename = g_strdup_printf ("gimpundo.%lu.%u",
+                                  (unsigned long) get_pid (), store_count++);
+      filename = g_build_filename (dirname, basename, NULL);
+
+      stack->store = gimp_undo_store_new (filename);
+
+      g_free (filename);
+      g_free (basename);
+      g_free (dirname);
+    }
+
+  return stack->store;
+}
+
+/**
+ * gimp_undo_stack_swap_out_bottom:
+ * @stack: a #GimpUndoStack
+ * @store: the #GimpUndoStore to spill to
+ *
+ * Moves the data of the oldest undo step on @stack that was not
+ * spilled yet to @store. The top undo step is never spilled. The
+ * search continues above the last spilled step, so spilling the
+ * whole stack step by step walks it only once.
+ *
+ * Return value: the spilled undo step, or %NULL if there was none
+ **/
+GimpUndo *
+gimp_undo_stack_swap_out_bottom (GimpUndoStack *stack,
+                                 GimpUndoStore *store)
+{
+  GList    *list;
+  GimpUndo *undo;
+
+  g_return_val_if_fail (GIMP_IS_UNDO_STACK (stack), NULL);
+  g_return_val_if_fail (store != NULL, NULL);
+
+  if (stack->swap_last)
+    list = g_list_previous (stack->swap_last);
+  else
+    list = g_list_last (GIMP_LIST (stack->undos)->list);
+
+  if (! list || ! list->prev)
+    return NULL;
+
+  undo = list->data;
+
+  stack->undos_memsize -= undo->stacked_memsize;
+
+  gimp_undo_swap_out (undo, store);
+  undo->swapped = TRUE;
+
+  undo->stacked_memsize = gimp_object_get_memsize (GIMP_OBJECT (undo), NULL);
+  stack->undos_memsize += undo->stacked_memsize;
+
+  stack->swap_last = list;
+
+  return undo;
+}
+
+static gboolean
+gimp_undo_stack_contains (GimpUndoStack *stack,
+                          GimpUndo      *undo)
+{
+  GList *list;
+
+  for (list = GIMP_LIST (stack->undos)->list;
+       list;
+       list = g_list_next (list))
+    {
+      GimpUndo *child = list->data;
+
+      if (child == undo ||
+          (GIMP_IS_UNDO_STACK (child) &&
+           gimp_undo_stack_contains (GIMP_UNDO_STACK (child), undo)))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/**
+ * gimp_undo_stack_update_memsize:
+ * @stack: a #GimpUndoStack
+ * @undo:  an undo step on @stack, or inside a group on @stack
+ *
+ * Measures the undo step on @stack that contains @undo again, after
+ * the size of @undo changed while it was pushed down the stack, for
+ * example because its data was compressed in the background. The
+ * search starts at the top, where recently pushed steps are.
+ **/
+void
+gimp_undo_stack_update_memsize (GimpUndoStack *stack,
+                                GimpUndo      *undo)
+{
+  GList *list;
+
+  g_return_if_fail (GIMP_IS_UNDO_STACK (stack));
+  g_return_if_fail (GIMP_IS_UNDO (undo));
+
+  for (list = GIMP_LIST (stack->undos)->list;
+       list;
+       list = g_list_next (list))
+    {
+      GimpUndo *child = list->data;
+
+      if (child == undo ||
+          (GIMP_IS_UNDO_STACK (child) &&
+           gimp_undo_stack_contains (GIMP_UNDO_STACK (child), undo)))
+        {
+          /*  the top undo is measured when needed anyway  */
+          if (! list->prev)
+            return;
+
+          stack->undos_memsize -= child->stacked_memsize;
+
+          child->stacked_memsize = gimp_object_get_memsize (GIMP_OBJECT (child),
+                                                            NULL);
+          stack->undos_memsize += child->stacked_memsize;
+
+          return;
+        }
+    }
+}
+
+
+/*  GimpUndoStore  */
+
+static GimpUndoStore *
+gimp_undo_store_new (const gchar *filename)
+{
+  GimpUndoStore *store = g_slice_new0 (GimpUndoStore);
+
+  store->ref_count = 1;
+  store->filename  = g_strdup (filename);
+  store->fd        = -1;
+  store->chunks    = g_hash_table_new (g_direct_hash, g_direct_equal);
+  store->next_id   = 1;
+  store->lock      = g_mutex_new ();
+  store->io_lock   = g_mutex_new ();
+
+  /*  a single writer writes the chunks in the order they are added  */
+  store->writer = g_thread_pool_new ((GFunc) gimp_undo_store_write_chunk,
+                                     store, 1, FALSE, NULL);
+
+  return store;
+}
+
+GimpUndoStore *
+gimp_undo_store_ref (GimpUndoStore *store)
+{
+  g_return_val_if_fail (store != NULL, NULL);
+
+  store->ref_count++;
+
+  return store;
+}
+
+void
+gimp_undo_store_unref (GimpUndoStore *store)
+{
+  g_return_if_fail (store != NULL);
+
+  store->ref_count--;
+
+  if (store->ref_count > 0)
+    return;
+
+  /*  all chunks are gone, let the writer drop the dead ones  */
+  g_thread_pool_free (store->writer, FALSE, TRUE);
+
+  g_hash_table_destroy (store->chunks);
+
+  if (store->fd != -1)
+    {
+      close (store->fd);
+      g_unlink (store->filename);
+    }
+
+  g_mutex_free (store->io_lock);
+  g_mutex_free (store->lock);
+  g_free (store->filename);
+
+  g_slice_free (GimpUndoStore, store);
+}
+
+/**
+ * gimp_undo_store_add:
+ * @store: a #GimpUndoStore
+ * @data:  the data to store, the store takes ownership of it
+ * @size:  the size of @data in bytes
+ *
+ * Queues @data to be written to the store's file, reusing the space
+ * of chunks that were taken or removed if possible. The data stays in
+ * memory until the background writer has written it.
+ *
+ * Return value: an id to get the data back with, or 0 if the store
+ * is unusable and the caller keeps @data
+ **/
+guint
+gimp_undo_store_add (GimpUndoStore *store,
+                     gpointer       data,
+                     gsize          size)
+{
+  StoreChunk *chunk;
+  guint       id;
+
+  g_return_val_if_fail (store != NULL, 0);
+  g_return_val_if_fail (data != NULL, 0);
+
+  g_mutex_lock (store->lock);
+
+  if (store->failed)
+    {
+      g_mutex_unlock (store->lock);
+
+      return 0;
+    }
+
+  chunk = g_slice_new (StoreChunk);
+
+  chunk->state  = CHUNK_PENDING;
+  chunk->offset = gimp_undo_store_find_offset (store, size);
+  chunk->size   = size;
+  chunk->data   = data;
+
+  id = store->next_id++;
+
+  g_hash_table_insert (store->chunks, GUINT_TO_POINTER (id), chunk);
+
+  store->n_queued++;
+
+  g_mutex_unlock (store->lock);
+
+  g_thread_pool_push (store->writer, chunk, NULL);
+
+  return id;
+}
+
+static gboolean
+gimp_undo_store_read_chunk (GimpUndoStore *store,
+                            StoreChunk    *chunk,
+                            guchar        *data)
+{
+  gboolean success = FALSE;
+
+  g_mutex_lock (store->io_lock);
+
+  if (store->fd != -1 &&
+      LARGE_SEEK (store->fd, chunk->offset, SEEK_SET) == chunk->offset)
+    {
+      gsize left = chunk->size;
+
+      while (left > 0)
+        {
+          gssize n = read (store->fd, data, left);
+
+          if (n < 0 && errno == EINTR)
+            continue;
+
+          if (n <= 0)
+            break;
+
+          data += n;
+          left -= n;
+        }
+
+      success = (left == 0);
+    }
+
+  g_mutex_unlock (store->io_lock);
+
+  return success;
+}
+
+/**
+ * gimp_undo_store_take:
+ * @store: a #GimpUndoStore
+ * @chunk: the id returned by gimp_undo_store_add()
+ * @size:  return location for the size of the data
+ *
+ * Removes @chunk from @store and returns its data, reading it back
+ * from the store's file if it was written already.
+ *
+ * Return value: the data, to be freed with g_free(), or %NULL if it
+ * could not be read back
+ **/
+gpointer
+gimp_undo_store_take (GimpUndoStore *store,
+                      guint          chunk,
+                      gsize         *size)
+{
+  StoreChunk *c;
+  gpointer    data = NULL;
+
+  g_return_val_if_fail (store != NULL, NULL);
+  g_return_val_if_fail (size != NULL, NULL);
+
+  g_mutex_lock (store->lock);
+
+  c = g_hash_table_lookup (store->chunks, GUINT_TO_POINTER (chunk));
+
+  if (! c)
+    {
+      g_mutex_unlock (store->lock);
+      g_return_val_if_reached (NULL);
+    }
+
+  g_hash_table_remove (store->chunks, GUINT_TO_POINTER (chunk));
+
+  *size = c->size;
+
+  /*  the writer still needs the space of a chunk it is writing  */
+  if (c->state != CHUNK_WRITING)
+    gimp_undo_store_free_range (store, c->offset, c->size);
+
+  switch (c->state)
+    {
+    case CHUNK_PENDING:
+      data     = c->data;
+      c->data  = NULL;
+      c->state = CHUNK_DEAD;
+      break;
+
+    case CHUNK_WRITING:
+      data     = g_memdup (c->data, c->size);
+      c->state = CHUNK_DEAD;
+      break;
+
+    case CHUNK_RESIDENT:
+      data = c->data;
+      g_slice_free (StoreChunk, c);
+      break;
+
+    case CHUNK_ON_DISK:
+      /*  keep the lock so the file can't go away while reading  */
+      data = g_malloc (c->size);
+
+      if (! gimp_undo_store_read_chunk (store, c, data))
+        {
+          g_message (_("Unable to read undo data from '%s': %s"),
+                     gimp_filename_to_utf8 (store->filename),
+                     g_strerror (errno));
+
+          g_free (data);
+          data = NULL;
+        }
+
+      g_slice_free (StoreChunk, c);
+      break;
+
+    case CHUNK_DEAD:
+      g_assert_not_reached ();
+      break;
+    }
+
+  gimp_undo_store_maybe_reset (store);
+
+  g_mutex_unlock (store->lock);
+
+  return data;
+}
+
+/**
+ * gimp_undo_store_remove:
+ * @store: a #GimpUndoStore
+ * @chunk: the id returned by gimp_undo_store_add()
+ *
+ * Drops @chunk from @store without reading it back.
+ **/
+void
+gimp_undo_store_remove (GimpUndoStore *store,
+                        guint          chunk)
+{
+  StoreChunk *c;
+
+  g_return_if_fail (store != NULL);
+
+  g_mutex_lock (store->lock);
+
+  c = g_hash_table_lookup (store->chunks, GUINT_TO_POINTER (chunk));
+
+  if (c)
+    {
+      g_hash_table_remove (store->chunks, GUINT_TO_POINTER (chunk));
+
+      if (c->state != CHUNK_WRITING)
+        gimp_undo_store_free_range (store, c->offset, c->size);
+
+      switch (c->state)
+        {
+        case CHUNK_PENDING:
+        case CHUNK_WRITING:
+          /*  the writer frees it  */
+          c->state = CHUNK_DEAD;
+          break;
+
+        default:
+          g_free (c->data);
+          g_slice_free (StoreChunk, c);
+          break;
+        }
+
+      gimp_undo_store_maybe_reset (store);
+    }
+
+  g_mutex_unlock (store->lock);
+}
+
+/**
+ * gimp_undo_store_get_size:
+ * @store: a #GimpUndoStore
+ *
+ * Returns the size of @store's file, including chunks that are still
+ * queued for writing and unused space between chunks. This is what
+ * the undo steps spilled to @store cost on disk.
+ *
+ * Return value: the size of @store in bytes
+ **/
+gint64
+gimp_undo_store_get_size (GimpUndoStore *store)
+{
+  gint64 size;
+
+  g_return_val_if_fail (store != NULL, 0);
+
+  g_mutex_lock (store->lock);
+  size = store->file_end;
+  g_mutex_unlock (store->lock);
+
+  return size;
+}
+
+/*  called with the lock held, returns the offset for a new chunk  */
+static gint64
+gimp_undo_store_find_offset (GimpUndoStore *store,
+                             gsize          size)
+{
+  GList  *list;
+  gint64  offset;
+
+  for (list = store->gaps; list; list = g_list_next (list))
+    {
+      StoreGap *gap = list->data;
+
+      if (gap->end - gap->start >= size)
+        {
+          offset = gap->start;
+          gap->start += size;
+
+          if (gap->start == gap->end)
+            {
+              g_slice_free (StoreGap, gap);
+              store->gaps = g_list_delete_link (store->gaps, list);
+            }
+
+          return offset;
+        }
+    }
+
+  offset = store->file_end;
+
+  store->file_end += size;
+
+  return offset;
+}
+
+/*  called with the lock held, makes a range available again, merging
+ *  it with adjacent gaps and cutting it off the file if it is at the
+ *  end
+ */
+static void
+gimp_undo_store_free_range (GimpUndoStore *store,
+                            gint64         offset,
+                            gsize          size)
+{
+  GList    *list;
+  GList    *prev = NULL;
+  StoreGap *gap;
+  gint64    end  = offset + size;
+
+  if (size == 0)
+    return;
+
+  for (list = store->gaps; list; prev = list, list = g_list_next (list))
+    {
+      gap = list->data;
+
+      if (gap->start >= end)
+        break;
+    }
+
+  if (prev && ((StoreGap *) prev->data)->end == offset)
+    {
+      gap = prev->data;
+      gap->end = end;
+
+      if (list && ((StoreGap *) list->data)->start == end)
+        {
+          StoreGap *next = list->data;
+
+          gap->end = next->end;
+
+          g_slice_free (StoreGap, next);
+          store->gaps = g_list_delete_link (store->gaps, list);
+        }
+
+      list = prev;
+    }
+  else if (list && ((StoreGap *) list->data)->start == end)
+    {
+      gap = list->data;
+      gap->start = offset;
+    }
+  else
+    {
+      gap = g_slice_new (StoreGap);
+
+      gap->start = offset;
+      gap->end   = end;
+
+      if (list)
+        {
+          store->gaps = g_list_insert_before (store->gaps, list, gap);
+          list = list->prev;
+        }
+      else
+        {
+          store->gaps = g_list_append (store->gaps, gap);
+          list = g_list_last (store->gaps);
+        }
+    }
+
+  /*  give trailing space back to the file system, if that fails the
+   *  gap stays and is counted as part of the file
+   */
+  if (gap->end == store->file_end)
+    {
+      gboolean truncated;
+
+      g_mutex_lock (store->io_lock);
+
+      truncated = (store->fd == -1 ||
+                   LARGE_TRUNCATE (store->fd, gap->start) == 0);
+
+      g_mutex_unlock (store->io_lock);
+
+      if (truncated)
+        {
+          store->file_end = gap->start;
+
+          g_slice_free (StoreGap, gap);
+          store->gaps = g_list_delete_link (store->gaps, list);
+        }
+    }
+}
+
+/*  runs in the writer thread  */
+static void
+gimp_undo_store_write_chunk (StoreChunk    *chunk,
+                             GimpUndoStore *store)
+{
+  gboolean success = FALSE;
+
+  g_mutex_lock (store->lock);
+
+  if (chunk->state == CHUNK_DEAD)
+    {
+      store->n_queued--;
+
+      gimp_undo_store_maybe_reset (store);
+
+      g_mutex_unlock (store->lock);
+
+      g_free (chunk->data);
+      g_slice_free (StoreChunk, chunk);
+
+      return;
+    }
+
+  chunk->state = CHUNK_WRITING;
+
+  g_mutex_unlock (store->lock);
+
+  g_mutex_lock (store->io_lock);
+
+  if (store->fd == -1)
+    store->fd = g_open (store->filename,
+                        O_CREAT | O_TRUNC | O_RDWR | _O_BINARY | _O_TEMPORARY,
+                        S_IRUSR | S_IWUSR);
+
+  if (store->fd != -1 &&
+      LARGE_SEEK (store->fd, chunk->offset, SEEK_SET) == chunk->offset)
+    {
+      const guchar *data = chunk->data;
+      gsize         left = chunk->size;
+
+      while (left > 0)
+        {
+          gssize n = write (store->fd, data, left);
+
+          if (n < 0 && errno == EINTR)
+            continue;
+
+          if (n <= 0)
+            break;
+
+          data += n;
+          left -= n;
+        }
+
+      success = (left == 0);
+    }
+
+  g_mutex_unlock (store->io_lock);
+
+  g_mutex_lock (store->lock);
+
+  store->n_queued--;
+
+  if (chunk->state == CHUNK_DEAD)
+    {
+      /*  taken or removed while it was being written  */
+      gimp_undo_store_free_range (store, chunk->offset, chunk->size);
+
+      g_free (chunk->data);
+      g_slice_free (StoreChunk, chunk);
+    }
+  else if (success)
+    {
+      g_free (chunk->data);
+      chunk->data  = NULL;
+      chunk->state = CHUNK_ON_DISK;
+    }
+  else
+    {
+      /*  keep the data around and stop accepting new chunks  */
+      chunk->state  = CHUNK_RESIDENT;
+      store->failed = TRUE;
+    }
+
+  gimp_undo_store_maybe_reset (store);
+
+  g_mutex_unlock (store->lock);
+}
+
+/*  called with the lock held, drops the file once nothing refers to it  */
+static void
+gimp_undo_store_maybe_reset (GimpUndoStore *store)
+{
+  if (g_hash_table_size (store->chunks) > 0 || store->n_queued > 0)
+    return;
+
+  store->file_end = 0;
+
+  while (store->gaps)
+    {
+      g_slice_free (StoreGap, store->gaps->data);
+      store->gaps = g_list_delete_link (store->gaps, store->gaps);
+    }
+
+  g_mutex_lock (store->io_lock);
+
+  if (store->fd != -1)
+    {
+      close (store->fd);
+      g_unlink (store->filename);
+
+      store->fd = -1;
+    }
+
+  g_mutex_unlock (store->io_lock);
+}
@@ -37,6 +37,12 @@ struct _GimpUndoStack
   GimpUndo       parent_instance;
 
   GimpContainer *undos;
+  gint64         undos_memsize; /* stacked memsize of all but the top undo */
+
+  GimpUndoStore *store;         /* created on demand for spilled undos     */
+  GList         *swap_last;     /* link of the topmost spilled undo, the
+                                 * spilled undos are always at the bottom
+                                 */
 };
 
 struct _GimpUndoStackClass
@@ -59,6 +65,35 @@ GimpUndo      * gimp_undo_stack_free_bottom (GimpUndoStack       *stack,
                                              GimpUndoMode         undo_mode);
 GimpUndo      * gimp_undo_stack_peek        (GimpUndoStack       *stack);
 gint            gimp_undo_stack_get_depth   (GimpUndoStack       *stack);
+gint64          gimp_undo_stack_get_undos_memsize
+                                            (GimpUndoStack       *stack);
+
+GimpUndoStore * gimp_undo_stack_get_store   (GimpUndoStack       *stack,
+                                             const gchar         *swap_path);
+GimpUndo      * gimp_undo_stack_swap_out_bottom
+                                            (GimpUndoStack       *stack,
+                                             GimpUndoStore       *store);
+void            gimp_undo_stack_update_memsize
+                                            (GimpUndoStack       *stack,
+                                             GimpUndo            *undo);
+
+
+/*  a file that undo data can be spilled to, written by a background
+ *  thread, the space of dropped chunks is reused
+ */
+
+GimpUndoStore * gimp_undo_store_ref         (GimpUndoStore       *store);
+void            gimp_undo_store_unref       (GimpUndoStore       *store);
+
+guint           gimp_undo_store_add         (GimpUndoStore       *store,
+                                             gpointer             data,
+                                             gsize                size);
+gpointer        gimp_undo_store_take        (GimpUndoStore       *store,
+                                             guint                chunk,
+                                             gsize               *size);
+void            gimp_undo_store_remove      (GimpUndoStore       *store,
+                                             guint                chunk);
+gint64          gimp_undo_store_get_size    (GimpUndoStore       *store);
 
 
 #endif /* __GIMP_UNDO_STACK_H__ */
@@ -20,6 +20,7 @@
 
 #include "config.h"
 
+#undef G_DISABLE_DEPRECATED /* GStaticRecMutex */
 #include <gegl.h>
 
 #include "gimp-gegl-types.h"
@@ -29,6 +30,9 @@
 #include "gimp-gegl-utils.h"
 
 
+static GStaticRecMutex tiles_mutex = G_STATIC_REC_MUTEX_INIT;
+
+
 /**
  * gimp_bpp_to_babl_format:
  * @bpp: bytes per pixel
@@ -168,3 +172,29 @@ gimp_interpolation_to_gegl_filter (GimpInterpolationType interpolation)
 
   return "nearest";
 }
+
+/**
+ * gimp_gegl_tiles_lock:
+ *
+ * GEGL runs the operations that read and write tile managers on its
+ * worker threads, but locking and releasing tiles is not thread-safe.
+ * Those operations hold this lock around every call that locks or
+ * releases tiles. The lock is recursive because validating a tile can
+ * run a whole projection, which may use the same operations again.
+ **/
+void
+gimp_gegl_tiles_lock (void)
+{
+  g_static_rec_mutex_lock (&tiles_mutex);
+}
+
+/**
+ * gimp_gegl_tiles_unlock:
+ *
+ * Releases the lock taken with gimp_gegl_tiles_lock().
+ **/
+void
+gimp_gegl_tiles_unlock (void)
+{
+  g_static_rec_mutex_unlock (&tiles_mutex);
+}
@@ -30,5 +30,8 @@ TileManager * gimp_buffer_to_tiles              (GeglBuffer            *buffer);
 const gchar * gimp_layer_mode_to_gegl_operation (GimpLayerModeEffects   mode) G_GNUC_CONST;
 const gchar * gimp_interpolation_to_gegl_filter (GimpInterpolationType  interpolation) G_GNUC_CONST;
 
+void          gimp_gegl_tiles_lock              (void);
+void          gimp_gegl_tiles_unlock            (void);
+
 
 #endif /* __GIMP_GEGL_UTILS_H__ */
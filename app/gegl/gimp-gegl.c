@@ -73,6 +73,7 @@
 
 
 static void  gimp_gegl_notify_tile_cache_size (GimpBaseConfig *config);
+static void  gimp_gegl_notify_num_processors  (GimpBaseConfig *config);
 
 
 void
@@ -94,6 +95,12 @@ gimp_gegl_init (Gimp *gimp)
                     G_CALLBACK (gimp_gegl_notify_tile_cache_size),
                     NULL);
 
+  gimp_gegl_notify_num_processors (config);
+
+  g_signal_connect (config, "notify::num-processors",
+                    G_CALLBACK (gimp_gegl_notify_num_processors),
+                    NULL);
+
   g_type_class_ref (GIMP_TYPE_OPERATION_TILE_SINK);
   g_type_class_ref (GIMP_TYPE_OPERATION_TILE_SOURCE);
 
@@ -143,3 +150,38 @@ gimp_gegl_notify_tile_cache_size (GimpBaseConfig *config)
                 "cache-size", (gint) MIN (config->tile_cache_size, G_MAXINT),
                 NULL);
 }
+
+/*  Let GEGL split the chunks it processes across as many threads as
+ *  the pixel processor uses.  GEGL evaluates the graph itself, so this
+ *  is how the projection and other GEGL code paths get their threads;
+ *  the GEGL version decides the type and the limit of the property.
+ *  The operations that access tile managers serialize their tile
+ *  locking with gimp_gegl_tiles_lock().
+ */
+static void
+gimp_gegl_notify_num_processors (GimpBaseConfig *config)
+{
+  GObject    *gegl    = G_OBJECT (gegl_config ());
+  GParamSpec *pspec;
+  GValue      value   = { 0, };
+  GValue      threads = { 0, };
+
+  pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (gegl), "threads");
+
+  if (! pspec)
+    return;
+
+  g_value_init (&value, G_TYPE_UINT);
+  g_value_init (&threads, G_PARAM_SPEC_VALUE_TYPE (pspec));
+
+  g_value_set_uint (&value, config->num_processors);
+
+  if (g_value_transform (&value, &threads))
+    {
+      g_param_value_validate (pspec, &threads);
+      g_object_set_property (gegl, "threads", &threads);
+    }
+
+  g_value_unset (&threads);
+  g_value_unset (&value);
+}
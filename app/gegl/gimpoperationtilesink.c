@@ -215,15 +215,28 @@ gimp_operation_tile_sink_process (GeglOperation       *operation,
                      result->width, result->height,
                      TRUE);
 
-  for (pr = pixel_regions_register (1, &destPR);
-       pr;
-       pr = pixel_regions_process (pr))
+  /*  this runs on GEGL's worker threads, only the tile locking has to
+   *  be serialized, the tiles' data stays put while they are locked.
+   *  GEGL converts straight into the locked tiles, so writing through
+   *  a GeglBuffer on the tile manager would not save a copy, but would
+   *  write its copies of the edge tiles back whole, over the pixels
+   *  other threads write to the same tiles
+   */
+  gimp_gegl_tiles_lock ();
+  pr = pixel_regions_register (1, &destPR);
+  gimp_gegl_tiles_unlock ();
+
+  while (pr)
     {
       GeglRectangle rect = { destPR.x, destPR.y, destPR.w, destPR.h };
 
       gegl_buffer_get (input, &rect, 1.0,
                        format, destPR.data, destPR.rowstride,
                        GEGL_ABYSS_NONE);
+
+      gimp_gegl_tiles_lock ();
+      pr = pixel_regions_process (pr);
+      gimp_gegl_tiles_unlock ();
     }
 
   g_static_mutex_lock (&mutex); 
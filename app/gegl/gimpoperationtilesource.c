@@ -28,10 +28,10 @@
 #include "gimp-gegl-types.h"
 
 #include "base/tile-manager.h"
-#include "base/pixel-region.h"
 
 #include "gimp-gegl-utils.h"
 #include "gimpoperationtilesource.h"
+#include "gimptilebackendtilemanager.h"
 
 
 enum
@@ -55,10 +55,11 @@ static void     gimp_operation_tile_source_set_property (GObject       *object,
 static void     gimp_operation_tile_source_prepare      (GeglOperation *operation);
 static GeglRectangle
             gimp_operation_tile_source_get_bounding_box (GeglOperation *operation);
-static gboolean gimp_operation_tile_source_process      (GeglOperation *operation,
-                                                         GeglBuffer          *output,
-                                                         const GeglRectangle *result,
-                                                         gint                 level);
+static gboolean gimp_operation_tile_source_process      (GeglOperation        *operation,
+                                                         GeglOperationContext *context,
+                                                         const gchar          *output_pad,
+                                                         const GeglRectangle  *result,
+                                                         gint                  level);
 
 
 G_DEFINE_TYPE (GimpOperationTileSource, gimp_operation_tile_source,
@@ -70,9 +71,8 @@ G_DEFINE_TYPE (GimpOperationTileSource, gimp_operation_tile_source,
 static void
 gimp_operation_tile_source_class_init (GimpOperationTileSourceClass *klass)
 {
-  GObjectClass             *object_class    = G_OBJECT_CLASS (klass);
-  GeglOperationClass       *operation_class = GEGL_OPERATION_CLASS (klass);
-  GeglOperationSourceClass *source_class    = GEGL_OPERATION_SOURCE_CLASS (klass);
+  GObjectClass       *object_class    = G_OBJECT_CLASS (klass);
+  GeglOperationClass *operation_class = GEGL_OPERATION_CLASS (klass);
 
   object_class->finalize              = gimp_operation_tile_source_finalize;
   object_class->set_property          = gimp_operation_tile_source_set_property;
@@ -92,7 +92,7 @@ gimp_operation_tile_source_class_init (GimpOperationTileSourceClass *klass)
                                                  this behavior is at least a
                                                  little unexpected. */
 
-  source_class->process               = gimp_operation_tile_source_process;
+  operation_class->process            = gimp_operation_tile_source_process;
 
 
   g_object_class_install_property (object_class, PROP_TILE_MANAGER,
@@ -189,7 +189,8 @@ gimp_operation_tile_source_prepare (GeglOperation *operation)
   if (self->tile_manager)
     {
       gegl_operation_set_format (operation, "output",
-                                 babl_format ("RaGaBaA float"));
+                                 gimp_bpp_to_babl_format (tile_manager_bpp (self->tile_manager),
+                                                          self->linear));
     }
 }
 
@@ -210,36 +211,33 @@ gimp_operation_tile_source_get_bounding_box (GeglOperation *operation)
   return result;
 }
 
+/*  Instead of copying the requested area into the output buffer, hand
+ *  out a buffer on the tile manager itself, like gegl:buffer-source
+ *  does, and let the operations that read it convert straight from the
+ *  tiles.  The buffer is made for every call, so the tiles it locks are
+ *  released as soon as the area is processed, and GEGL never caches
+ *  tiles that the core may change afterwards.
+ */
 static gboolean
-gimp_operation_tile_source_process (GeglOperation       *operation,
-                                    GeglBuffer          *output,
-                                    const GeglRectangle *result,
-                                    gint                 level)
+gimp_operation_tile_source_process (GeglOperation        *operation,
+                                    GeglOperationContext *context,
+                                    const gchar          *output_pad,
+                                    const GeglRectangle  *result,
+                                    gint                  level)
 {
   GimpOperationTileSource *self = GIMP_OPERATION_TILE_SOURCE (operation);
-  const Babl              *format;
-  PixelRegion              srcPR;
-  gpointer                 pr;
+  GeglTileBackend         *backend;
+  GeglBuffer              *buffer;
 
   if (! self->tile_manager)
     return FALSE;
 
-  format = gimp_bpp_to_babl_format (tile_manager_bpp (self->tile_manager),
-                                    self->linear);
-
-  pixel_region_init (&srcPR, self->tile_manager,
-                     result->x,     result->y,
-                     result->width, result->height,
-                     FALSE);
+  backend = gimp_tile_backend_tile_manager_new (self->tile_manager,
+                                                self->linear, FALSE);
+  buffer  = gegl_buffer_new_for_backend (NULL, backend);
+  g_object_unref (backend);
 
-  for (pr = pixel_regions_register (1, &srcPR);
-       pr;
-       pr = pixel_regions_process (pr))
-    {
-      GeglRectangle rect = { srcPR.x, srcPR.y, srcPR.w, srcPR.h };
-
-      gegl_buffer_set (output, &rect, 0, format, srcPR.data, srcPR.rowstride);
-    }
+  gegl_operation_context_take_object (context, "output", G_OBJECT (buffer));
 
   return TRUE;
 }
@@ -37,21 +37,10 @@
 #include "gimp-gegl-utils.h"
 
 
-struct _GimpTileBackendTileManagerPrivate 
+struct _GimpTileBackendTileManagerPrivate
 {
-  GHashTable      *entries;
-  TileManager     *tile_manager;
-};
-
-
-typedef struct _RamEntry RamEntry;
-
-struct _RamEntry
-{
-  gint    x;
-  gint    y;
-  gint    z;
-  guchar *offset;
+  TileManager *tile_manager;
+  gboolean     write;
 };
 
 
@@ -71,21 +60,15 @@ static gpointer gimp_tile_backend_tile_manager_command      (GeglTileSource  *ti
                                                              gint             z,
                                                              gpointer         data);
 
-static void       dbg_alloc         (int                         size);
-static void       dbg_dealloc       (int                         size);
-static RamEntry * lookup_entry      (GimpTileBackendTileManager *self,
-                                     gint                        x,
-                                     gint                        y,
-                                     gint                        z);
-static guint      hash_func         (gconstpointer               key);
-static gboolean   equal_func        (gconstpointer               a,
-                                     gconstpointer               b);
-static void       ram_entry_write   (GimpTileBackendTileManager *ram,
-                                     RamEntry                   *entry,
-                                     guchar                     *source);
-static RamEntry * ram_entry_new     (GimpTileBackendTileManager *ram);
-static void       ram_entry_destroy (RamEntry                   *entry,
-                                     GimpTileBackendTileManager *ram);
+static GeglTile * gimp_tile_read       (GimpTileBackendTileManager *backend_tm,
+                                        gint                        x,
+                                        gint                        y);
+static void       gimp_tile_write      (GimpTileBackendTileManager *backend_tm,
+                                        gint                        x,
+                                        gint                        y,
+                                        guchar                     *source);
+static void       gimp_tile_done       (gpointer                    data);
+static void       gimp_tile_done_dirty (gpointer                    data);
 
 
 G_DEFINE_TYPE (GimpTileBackendTileManager, gimp_tile_backend_tile_manager,
@@ -115,8 +98,6 @@ gimp_tile_backend_tile_manager_init (GimpTileBackendTileManager *backend)
                                                GIMP_TYPE_TILE_BACKEND_TILE_MANAGER,
                                                GimpTileBackendTileManagerPrivate);
   source->command  = gimp_tile_backend_tile_manager_command;
-
-  backend->priv->entries = g_hash_table_new (hash_func, equal_func);
 }
 
 static void
@@ -124,7 +105,11 @@ gimp_tile_backend_tile_manager_finalize (GObject *object)
 {
   GimpTileBackendTileManager *backend = GIMP_TILE_BACKEND_TILE_MANAGER (object);
 
-  g_hash_table_unref (backend->priv->entries);
+  if (backend->priv->tile_manager)
+    {
+      tile_manager_unref (backend->priv->tile_manager);
+      backend->priv->tile_manager = NULL;
+    }
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -166,83 +151,43 @@ gimp_tile_backend_tile_manager_command (GeglTileSource  *tile_store,
                                         gpointer         data)
 {
   GimpTileBackendTileManager *backend_tm;
-  GeglTileBackend            *backend;
 
   backend_tm = GIMP_TILE_BACKEND_TILE_MANAGER (tile_store);
-  backend    = GEGL_TILE_BACKEND (tile_store);
 
   switch (command)
     {
     case GEGL_TILE_GET:
-      {
-        GeglTile *tile;
-        gint      tile_size;
-        Tile     *gimp_tile;
-        gint      tile_stride;
-        gint      gimp_tile_stride;
-        int       row;
-
-        gimp_tile = tile_manager_get_at (backend_tm->priv->tile_manager,
-                                         x, y, TRUE, FALSE);
-
-        g_return_val_if_fail (gimp_tile != NULL, NULL);
-
-        tile_size        = gegl_tile_backend_get_tile_size (backend);
-        tile_stride      = TILE_WIDTH * tile_bpp (gimp_tile);
-        gimp_tile_stride = tile_ewidth (gimp_tile) * tile_bpp (gimp_tile);
-
-        /* XXX: Point to Tile data directly instead of using memcpy */
-        tile = gegl_tile_new (tile_size);
-        for (row = 0; row < tile_eheight (gimp_tile); row++)
-          {
-            memcpy (gegl_tile_get_data (tile) + row * tile_stride,
-                    tile_data_pointer (gimp_tile, 0, row),
-                    gimp_tile_stride);
-          }
-
-        return tile;
-      }
-
-    case GEGL_TILE_SET:
-      {
-        GeglTile *tile  = data;
-        RamEntry *entry = lookup_entry (backend_tm, x, y, z);
-
-        if (! entry)
-          {
-            entry    = ram_entry_new (backend_tm);
-            entry->x = x;
-            entry->y = y;
-            entry->z = z;
+      /*  the tile manager has no mipmap levels, GEGL builds them from
+       *  the level 0 tiles when we don't provide them
+       */
+      if (z != 0)
+        return NULL;
 
-            g_hash_table_insert (backend_tm->priv->entries, entry, entry);
-          }
+      return gimp_tile_read (backend_tm, x, y);
 
-        ram_entry_write (backend_tm, entry, gegl_tile_get_data (tile));
+    case GEGL_TILE_SET:
+      if (backend_tm->priv->write && z == 0)
+        gimp_tile_write (backend_tm, x, y, gegl_tile_get_data (data));
 
-        gegl_tile_mark_as_stored (tile);
+      gegl_tile_mark_as_stored (data);
 
-        return NULL;
-      }
+      return NULL;
 
     case GEGL_TILE_IDLE:
       return NULL;
 
     case GEGL_TILE_VOID:
-      {
-        RamEntry *entry = lookup_entry (backend_tm, x, y, z);
-
-        if (entry)
-          ram_entry_destroy (entry, backend_tm);
-
-        return NULL;
-      }
+      return NULL;
 
     case GEGL_TILE_EXIST:
       {
-        RamEntry *entry = lookup_entry (backend_tm, x, y, z);
+        TileManager *tm     = backend_tm->priv->tile_manager;
+        gint         n_cols = (tile_manager_width (tm)  + TILE_WIDTH  - 1) / TILE_WIDTH;
+        gint         n_rows = (tile_manager_height (tm) + TILE_HEIGHT - 1) / TILE_HEIGHT;
 
-        return GINT_TO_POINTER (entry != NULL);
+        return GINT_TO_POINTER (z == 0 &&
+                                x >= 0 && x < n_cols &&
+                                y >= 0 && y < n_rows);
       }
 
     default:
@@ -252,127 +197,154 @@ gimp_tile_backend_tile_manager_command (GeglTileSource  *tile_store,
   return NULL;
 }
 
-static gint allocs                 = 0;
-static gint ram_size               = 0;
-static gint peak_allocs            = 0;
-static gint peak_tile_manager_size = 0;
-
-static void
-dbg_alloc (gint size)
+/*  Hand out the Tile's own memory when it has the layout of a GEGL
+ *  tile, which is the case for all but the right and bottom edge tiles
+ *  of a drawable.  The GimpTile stays locked until GEGL frees the
+ *  GeglTile, which keeps it from being swapped out underneath, and a
+ *  writable backend locks it for writing, so it is detached from any
+ *  other tile manager sharing it before GEGL gets to see it.  GEGL may
+ *  fetch and free tiles on its worker threads, hence the tile lock.
+ */
+static GeglTile *
+gimp_tile_read (GimpTileBackendTileManager *backend_tm,
+                gint                        x,
+                gint                        y)
 {
-  allocs++;
-  ram_size += size;
-  if (allocs > peak_allocs)
-    peak_allocs = allocs;
-  if (ram_size > peak_tile_manager_size)
-    peak_tile_manager_size = ram_size;
-}
+  GeglTileBackend *backend = GEGL_TILE_BACKEND (backend_tm);
+  GeglTile        *tile;
+  Tile            *gimp_tile;
+  gint             tile_size;
+  gint             tile_stride;
+  gint             gimp_tile_stride;
+  gint             row;
 
-static void
-dbg_dealloc (gint size)
-{
-  allocs--;
-  ram_size -= size;
-}
+  gimp_gegl_tiles_lock ();
 
-static RamEntry *
-lookup_entry (GimpTileBackendTileManager *self,
-              gint                        x,
-              gint                        y,
-              gint                        z)
-{
-  RamEntry key;
+  gimp_tile = tile_manager_get_at (backend_tm->priv->tile_manager,
+                                   x, y, TRUE, backend_tm->priv->write);
 
-  key.x      = x;
-  key.y      = y;
-  key.z      = z;
-  key.offset = 0;
+  if (! gimp_tile)
+    {
+      gimp_gegl_tiles_unlock ();
+      return NULL;
+    }
 
-  return g_hash_table_lookup (self->priv->entries, &key);
-}
+  tile_size        = gegl_tile_backend_get_tile_size (backend);
+  tile_stride      = TILE_WIDTH * tile_bpp (gimp_tile);
+  gimp_tile_stride = tile_ewidth (gimp_tile) * tile_bpp (gimp_tile);
 
-static guint
-hash_func (gconstpointer key)
-{
-  const RamEntry *e = key;
-  guint           hash;
-  gint            srcA = e->x;
-  gint            srcB = e->y;
-  gint            srcC = e->z;
-  gint            i;
-
-  /* interleave the 10 least significant bits of all coordinates,
-   * this gives us Z-order / morton order of the space and should
-   * work well as a hash
-   */
-  hash = 0;
-
-#define ADD_BIT(bit)    do { hash |= (((bit) != 0) ? 1 : 0); hash <<= 1; \
-      }                                                                 \
-      while (0)
-
-  for (i = 9; i >= 0; i--)
+  if (tile_stride == gimp_tile_stride && tile_eheight (gimp_tile) == TILE_HEIGHT)
     {
-      ADD_BIT (srcA & (1 << i));
-      ADD_BIT (srcB & (1 << i));
-      ADD_BIT (srcC & (1 << i));
+      tile = gegl_tile_new_bare ();
+
+      gegl_tile_set_data_full (tile,
+                               tile_data_pointer (gimp_tile, 0, 0),
+                               tile_size,
+                               backend_tm->priv->write ?
+                               gimp_tile_done_dirty : gimp_tile_done,
+                               gimp_tile);
+
+      gimp_gegl_tiles_unlock ();
+
+      return tile;
     }
 
-#undef ADD_BIT
+  tile = gegl_tile_new (tile_size);
 
-  return hash;
-}
+  for (row = 0; row < tile_eheight (gimp_tile); row++)
+    {
+      memcpy (gegl_tile_get_data (tile) + row * tile_stride,
+              tile_data_pointer (gimp_tile, 0, row),
+              gimp_tile_stride);
+    }
 
-static gboolean
-equal_func (gconstpointer a,
-            gconstpointer b)
-{
-  const RamEntry *ea = a;
-  const RamEntry *eb = b;
+  tile_release (gimp_tile, backend_tm->priv->write);
 
-  if (ea->x == eb->x &&
-      ea->y == eb->y &&
-      ea->z == eb->z)
-    return TRUE;
+  gimp_gegl_tiles_unlock ();
 
-  return FALSE;
+  return tile;
 }
 
+/*  Aliased tiles were written in place, only the copies of edge tiles
+ *  need to be written back
+ */
 static void
-ram_entry_write (GimpTileBackendTileManager *ram,
-                 RamEntry                   *entry,
+gimp_tile_write (GimpTileBackendTileManager *backend_tm,
+                 gint                        x,
+                 gint                        y,
                  guchar                     *source)
 {
-  g_printerr ("WRITE %i %i %i\n", entry->x, entry->y, entry->z);
-  //memcpy (entry->offset, source, tile_size);
-}
+  Tile *gimp_tile;
+  gint  tile_stride;
+  gint  gimp_tile_stride;
+  gint  row;
 
-static RamEntry *
-ram_entry_new (GimpTileBackendTileManager *ram)
-{
-  gint tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (ram));
-  RamEntry *self = g_slice_new (RamEntry);
+  gimp_gegl_tiles_lock ();
+
+  gimp_tile = tile_manager_get_at (backend_tm->priv->tile_manager,
+                                   x, y, TRUE, TRUE);
+
+  if (! gimp_tile)
+    {
+      gimp_gegl_tiles_unlock ();
+      return;
+    }
+
+  if (source != tile_data_pointer (gimp_tile, 0, 0))
+    {
+      tile_stride      = TILE_WIDTH * tile_bpp (gimp_tile);
+      gimp_tile_stride = tile_ewidth (gimp_tile) * tile_bpp (gimp_tile);
+
+      for (row = 0; row < tile_eheight (gimp_tile); row++)
+        {
+          memcpy (tile_data_pointer (gimp_tile, 0, row),
+                  source + row * tile_stride,
+                  gimp_tile_stride);
+        }
+    }
 
-  self->offset = g_malloc (tile_size);
-  dbg_alloc (tile_size);
+  tile_release (gimp_tile, TRUE);
 
-  return self;
+  gimp_gegl_tiles_unlock ();
 }
 
 static void
-ram_entry_destroy (RamEntry           *entry,
-                   GimpTileBackendTileManager *ram)
+gimp_tile_done (gpointer data)
 {
-  gint tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (ram));
-  g_free (entry->offset);
-  g_hash_table_remove (ram->priv->entries, entry);
+  gimp_gegl_tiles_lock ();
+  tile_release (data, FALSE);
+  gimp_gegl_tiles_unlock ();
+}
 
-  dbg_dealloc (tile_size);
-  g_slice_free (RamEntry, entry);
+static void
+gimp_tile_done_dirty (gpointer data)
+{
+  gimp_gegl_tiles_lock ();
+  tile_release (data, TRUE);
+  gimp_gegl_tiles_unlock ();
 }
 
+/**
+ * gimp_tile_backend_tile_manager_new:
+ * @tm:     a #TileManager
+ * @linear: whether the data in @tm is linear or gamma-corrected
+ * @write:  whether GEGL may write to the tiles
+ *
+ * Creates a GEGL tile backend that makes the tiles of @tm available
+ * to a #GeglBuffer without copying them, except for the edge tiles
+ * which are smaller than a GEGL tile.  The tiles stay locked for as
+ * long as GEGL holds on to them, so a buffer on this backend should
+ * be short-lived.  A buffer on a backend created with @write set to
+ * %FALSE must only be read from, and a writable buffer must be flushed
+ * and destroyed before @tm is duplicated, because GEGL writes right
+ * into the tiles it holds.
+ *
+ * Return value: the new backend.
+ **/
 GeglTileBackend *
-gimp_tile_backend_tile_manager_new (TileManager *tm)
+gimp_tile_backend_tile_manager_new (TileManager *tm,
+                                    gboolean     linear,
+                                    gboolean     write)
 {
   GeglTileBackend *ret;
   gint             width  = tile_manager_width (tm);
@@ -383,20 +355,72 @@ gimp_tile_backend_tile_manager_new (TileManager *tm)
   ret = g_object_new (GIMP_TYPE_TILE_BACKEND_TILE_MANAGER,
                       "tile-width",  TILE_WIDTH,
                       "tile-height", TILE_HEIGHT,
-                      "format",      gimp_bpp_to_babl_format (bpp, FALSE),
+                      "format",      gimp_bpp_to_babl_format (bpp, linear),
                       NULL);
 
   GIMP_TILE_BACKEND_TILE_MANAGER (ret)->priv->tile_manager = tile_manager_ref (tm);
+  GIMP_TILE_BACKEND_TILE_MANAGER (ret)->priv->write        = write;
 
   gegl_tile_backend_set_extent (ret, &rect);
 
   return ret;
 }
 
-void
-gimp_tile_backend_tile_manager_stats (void)
+/**
+ * gimp_tile_backend_tile_manager_get_tiles:
+ * @backend: a #GimpTileBackendTileManager
+ * @rect:    the area to fetch, in pixels
+ *
+ * Fetches all tiles that intersect @rect in one pass, row by row,
+ * instead of one GEGL_TILE_GET command at a time.  This swaps in and
+ * locks a whole area of the tile manager before it is processed, and
+ * like the tiles GEGL fetches, the returned tiles use the memory of
+ * the tile manager where possible.
+ *
+ * Return value: a list of #GeglTile, free it with g_list_free_full()
+ *               and gegl_tile_unref().
+ **/
+GList *
+gimp_tile_backend_tile_manager_get_tiles (GeglTileBackend     *backend,
+                                          const GeglRectangle *rect)
 {
-  g_warning ("leaked: %i chunks (%f mb)  peak: %i (%i bytes %fmb))",
-             allocs, ram_size / 1024 / 1024.0, peak_allocs,
-             peak_tile_manager_size, peak_tile_manager_size / 1024 / 1024.0);
+  GimpTileBackendTileManager *backend_tm;
+  GeglRectangle               extent;
+  GeglRectangle               area;
+  GList                      *tiles = NULL;
+  gint                        x, y;
+
+  g_return_val_if_fail (GIMP_IS_TILE_BACKEND_TILE_MANAGER (backend), NULL);
+  g_return_val_if_fail (rect != NULL, NULL);
+
+  backend_tm = GIMP_TILE_BACKEND_TILE_MANAGER (backend);
+
+  extent.x      = 0;
+  extent.y      = 0;
+  extent.width  = tile_manager_width  (backend_tm->priv->tile_manager);
+  extent.height = tile_manager_height (backend_tm->priv->tile_manager);
+
+  if (! gegl_rectangle_intersect (&area, rect, &extent))
+    return NULL;
+
+  gimp_gegl_tiles_lock ();
+
+  for (y = area.y / TILE_HEIGHT;
+       y <= (area.y + area.height - 1) / TILE_HEIGHT;
+       y++)
+    {
+      for (x = area.x / TILE_WIDTH;
+           x <= (area.x + area.width - 1) / TILE_WIDTH;
+           x++)
+        {
+          GeglTile *tile = gimp_tile_read (backend_tm, x, y);
+
+          if (tile)
+            tiles = g_list_prepend (tiles, tile);
+        }
+    }
+
+  gimp_gegl_tiles_unlock ();
+
+  return g_list_reverse (tiles);
 }
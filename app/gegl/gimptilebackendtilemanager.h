@@ -47,11 +47,14 @@ struct _GimpTileBackendTileManagerClass
   GeglTileBackendClass parent_class;
 };
 
-GType             gimp_tile_backend_tile_manager_get_type (void) G_GNUC_CONST;
+GType             gimp_tile_backend_tile_manager_get_type  (void) G_GNUC_CONST;
 
-GeglTileBackend * gimp_tile_backend_tile_manager_new      (TileManager *tm);
+GeglTileBackend * gimp_tile_backend_tile_manager_new       (TileManager         *tm,
+                                                            gboolean             linear,
+                                                            gboolean             write);
 
-void              gimp_tile_backend_tile_manager_stats    (void);
+GList           * gimp_tile_backend_tile_manager_get_tiles (GeglTileBackend     *backend,
+                                                            const GeglRectangle *rect);
 
 G_END_DECLS
 
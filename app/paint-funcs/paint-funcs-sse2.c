@@ -0,0 +1,365 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib-object.h>
+
+#include "paint-funcs-types.h"
+
+#include "paint-funcs.h"
+#include "paint-funcs-sse2.h"
+
+#if defined(USE_SSE2)
+
+#include <emmintrin.h>
+
+
+/*  SSE2 versions of the functions that combine a brush mask with the
+ *  alpha channel of the canvas. They compute exactly the same values
+ *  as the generic versions in paint-funcs-generic.h and leave the
+ *  pixels that don't fill a whole vector to them.
+ *
+ *  Also the inner loop of the recursive gaussian blur in paint-funcs.c
+ *  and the two passes of the separable scale in scale-region.c.
+ */
+
+
+/*  INT_MULT() on 16 bit lanes holding values from 0 to 255  */
+static inline __m128i
+int_mult_epi16 (__m128i a,
+                __m128i b)
+{
+  __m128i t = _mm_add_epi16 (_mm_mullo_epi16 (a, b), _mm_set1_epi16 (0x80));
+
+  return _mm_srli_epi16 (_mm_add_epi16 (_mm_srli_epi16 (t, 8), t), 8);
+}
+
+/*  INT_MULT3() on 16 bit lanes, p is the product of the first two
+ *  factors and must not exceed 255 * 255
+ */
+static inline __m128i
+int_mult3_epi16 (__m128i p,
+                 __m128i c)
+{
+  const __m128i round = _mm_set1_epi32 (0x7F5B);
+  __m128i       lo    = _mm_mullo_epi16 (p, c);
+  __m128i       hi    = _mm_mulhi_epu16 (p, c);
+  __m128i       t0    = _mm_add_epi32 (_mm_unpacklo_epi16 (lo, hi), round);
+  __m128i       t1    = _mm_add_epi32 (_mm_unpackhi_epi16 (lo, hi), round);
+
+  t0 = _mm_srli_epi32 (_mm_add_epi32 (_mm_srli_epi32 (t0, 7), t0), 16);
+  t1 = _mm_srli_epi32 (_mm_add_epi32 (_mm_srli_epi32 (t1, 7), t1), 16);
+
+  return _mm_packs_epi32 (t0, t1);
+}
+
+/*  multiply the 16 bit lanes of s that are selected by alpha with
+ *  m and opacity, the others are left alone
+ */
+static inline __m128i
+apply_mask_epi16 (__m128i s,
+                  __m128i m,
+                  __m128i alpha,
+                  guint   opacity)
+{
+  const __m128i full = _mm_set1_epi16 (255);
+
+  m = _mm_or_si128 (_mm_and_si128 (alpha, m), _mm_andnot_si128 (alpha, full));
+
+  if (opacity == 255)
+    {
+      return int_mult_epi16 (s, m);
+    }
+  else
+    {
+      __m128i o = _mm_or_si128 (_mm_and_si128 (alpha,
+                                               _mm_set1_epi16 (opacity)),
+                                _mm_andnot_si128 (alpha, full));
+
+      /*  INT_MULT3 (x, 255, 255) is x, so the color lanes stay as they are  */
+      return int_mult3_epi16 (_mm_mullo_epi16 (s, m), o);
+    }
+}
+
+void
+apply_mask_to_alpha_channel_sse2 (guchar       *src,
+                                  const guchar *mask,
+                                  guint         opacity,
+                                  guint         length,
+                                  guint         bytes)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+
+  if (bytes == 4)
+    {
+      const __m128i alpha = _mm_set_epi16 (-1, 0, 0, 0, -1, 0, 0, 0);
+
+      for (; length >= 4; length -= 4, src += 16, mask += 4)
+        {
+          __m128i s = _mm_loadu_si128 ((const __m128i *) src);
+          __m128i m;
+          guint32 m4;
+
+          memcpy (&m4, mask, 4);
+
+          m = _mm_unpacklo_epi8 (_mm_cvtsi32_si128 (m4), zero);
+          m = _mm_unpacklo_epi16 (m, m);
+
+          s = _mm_packus_epi16 (apply_mask_epi16 (_mm_unpacklo_epi8 (s, zero),
+                                                  _mm_unpacklo_epi32 (m, m),
+                                                  alpha, opacity),
+                                apply_mask_epi16 (_mm_unpackhi_epi8 (s, zero),
+                                                  _mm_unpackhi_epi32 (m, m),
+                                                  alpha, opacity));
+
+          _mm_storeu_si128 ((__m128i *) src, s);
+        }
+    }
+  else if (bytes == 2)
+    {
+      const __m128i alpha = _mm_set_epi16 (-1, 0, -1, 0, -1, 0, -1, 0);
+
+      for (; length >= 8; length -= 8, src += 16, mask += 8)
+        {
+          __m128i s = _mm_loadu_si128 ((const __m128i *) src);
+          __m128i m;
+
+          m = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) mask), zero);
+
+          s = _mm_packus_epi16 (apply_mask_epi16 (_mm_unpacklo_epi8 (s, zero),
+                                                  _mm_unpacklo_epi16 (m, m),
+                                                  alpha, opacity),
+                                apply_mask_epi16 (_mm_unpackhi_epi8 (s, zero),
+                                                  _mm_unpackhi_epi16 (m, m),
+                                                  alpha, opacity));
+
+          _mm_storeu_si128 ((__m128i *) src, s);
+        }
+    }
+
+  if (length)
+    apply_mask_to_alpha_channel (src, mask, opacity, length, bytes);
+}
+
+void
+combine_mask_and_alpha_channel_stipple_sse2 (guchar       *src,
+                                             const guchar *mask,
+                                             guint         opacity,
+                                             guint         length,
+                                             guint         bytes)
+{
+  if (bytes == 1)
+    {
+      const __m128i zero = _mm_setzero_si128 ();
+      const __m128i full = _mm_set1_epi16 (255);
+      const __m128i op   = _mm_set1_epi16 (opacity);
+
+      for (; length >= 16; length -= 16, src += 16, mask += 16)
+        {
+          __m128i s  = _mm_loadu_si128 ((const __m128i *) src);
+          __m128i m  = _mm_loadu_si128 ((const __m128i *) mask);
+          __m128i s0 = _mm_unpacklo_epi8 (s, zero);
+          __m128i s1 = _mm_unpackhi_epi8 (s, zero);
+          __m128i m0 = int_mult_epi16 (_mm_unpacklo_epi8 (m, zero), op);
+          __m128i m1 = int_mult_epi16 (_mm_unpackhi_epi8 (m, zero), op);
+
+          s0 = _mm_add_epi16 (s0, int_mult_epi16 (_mm_sub_epi16 (full, s0), m0));
+          s1 = _mm_add_epi16 (s1, int_mult_epi16 (_mm_sub_epi16 (full, s1), m1));
+
+          _mm_storeu_si128 ((__m128i *) src, _mm_packus_epi16 (s0, s1));
+        }
+    }
+
+  if (length)
+    combine_mask_and_alpha_channel_stipple (src, mask, opacity, length, bytes);
+}
+
+void
+combine_mask_and_alpha_channel_stroke_sse2 (guchar       *src,
+                                            const guchar *mask,
+                                            guint         opacity,
+                                            guint         length,
+                                            guint         bytes)
+{
+  if (bytes == 1)
+    {
+      const __m128i zero = _mm_setzero_si128 ();
+      const __m128i op   = _mm_set1_epi16 (opacity);
+
+      for (; length >= 16; length -= 16, src += 16, mask += 16)
+        {
+          __m128i s  = _mm_loadu_si128 ((const __m128i *) src);
+          __m128i m  = _mm_loadu_si128 ((const __m128i *) mask);
+          __m128i s0 = _mm_unpacklo_epi8 (s, zero);
+          __m128i s1 = _mm_unpackhi_epi8 (s, zero);
+          __m128i m0 = int_mult_epi16 (_mm_unpacklo_epi8 (m, zero), op);
+          __m128i m1 = int_mult_epi16 (_mm_unpackhi_epi8 (m, zero), op);
+
+          /*  the saturated difference is zero where the canvas
+           *  already reached the opacity, which leaves it alone
+           */
+          s0 = _mm_add_epi16 (s0, int_mult_epi16 (_mm_subs_epu16 (op, s0), m0));
+          s1 = _mm_add_epi16 (s1, int_mult_epi16 (_mm_subs_epu16 (op, s1), m1));
+
+          _mm_storeu_si128 ((__m128i *) src, _mm_packus_epi16 (s0, s1));
+        }
+    }
+
+  if (length)
+    combine_mask_and_alpha_channel_stroke (src, mask, opacity, length, bytes);
+}
+
+
+/*  one step of the recursive gaussian filter on two lines at a time,
+ *  adding up in the same order as gaussian_iir_lines() does
+ */
+static inline void
+gaussian_iir_step_sse2 (gdouble       *d,
+                        const gdouble *p1,
+                        const gdouble *p2,
+                        const gdouble *p3,
+                        gint           n_lines,
+                        const gdouble *coeff)
+{
+  const __m128d b0 = _mm_set1_pd (coeff[0]);
+  const __m128d b1 = _mm_set1_pd (coeff[1]);
+  const __m128d b2 = _mm_set1_pd (coeff[2]);
+  const __m128d b3 = _mm_set1_pd (coeff[3]);
+  gint          l;
+
+  for (l = 0; l + 2 <= n_lines; l += 2)
+    {
+      __m128d v = _mm_mul_pd (b0, _mm_loadu_pd (d + l));
+
+      v = _mm_add_pd (v, _mm_mul_pd (b1, _mm_loadu_pd (p1 + l)));
+      v = _mm_add_pd (v, _mm_mul_pd (b2, _mm_loadu_pd (p2 + l)));
+      v = _mm_add_pd (v, _mm_mul_pd (b3, _mm_loadu_pd (p3 + l)));
+
+      _mm_storeu_pd (d + l, v);
+    }
+
+  if (l < n_lines)
+    d[l] = (coeff[0] * d[l] + coeff[1] * p1[l] +
+            coeff[2] * p2[l] + coeff[3] * p3[l]);
+}
+
+void
+gaussian_iir_lines_sse2 (gdouble       *buf,
+                         gint           n_lines,
+                         gint           length,
+                         const gdouble *coeff)
+{
+  gint i;
+
+  for (i = 1; i < length; i++)
+    gaussian_iir_step_sse2 (buf + i * n_lines,
+                            buf + (i - 1) * n_lines,
+                            buf + MAX (i - 2, 0) * n_lines,
+                            buf + MAX (i - 3, 0) * n_lines,
+                            n_lines, coeff);
+
+  for (i = length - 2; i >= 0; i--)
+    gaussian_iir_step_sse2 (buf + i * n_lines,
+                            buf + (i + 1) * n_lines,
+                            buf + MIN (i + 2, length - 1) * n_lines,
+                            buf + MIN (i + 3, length - 1) * n_lines,
+                            n_lines, coeff);
+}
+
+
+/*  the horizontal pass of the separable scale, an RGBA pixel fills a
+ *  vector, the other formats are summed up one channel at a time
+ */
+void
+scale_row_sse2 (gfloat       *dest,
+                const gfloat *src,
+                const gint   *index,
+                const gfloat *weights,
+                gint          n_taps,
+                gint          width,
+                gint          bytes)
+{
+  gint x, k, b;
+
+  if (bytes == 4)
+    {
+      for (x = 0; x < width; x++, index += n_taps, weights += n_taps)
+        {
+          __m128 sum = _mm_setzero_ps ();
+
+          for (k = 0; k < n_taps; k++)
+            sum = _mm_add_ps (sum,
+                              _mm_mul_ps (_mm_set1_ps (weights[k]),
+                                          _mm_loadu_ps (src + index[k] * 4)));
+
+          _mm_storeu_ps (dest, sum);
+          dest += 4;
+        }
+    }
+  else
+    {
+      for (x = 0; x < width; x++, index += n_taps, weights += n_taps)
+        {
+          for (b = 0; b < bytes; b++)
+            {
+              gfloat sum = 0.0;
+
+              for (k = 0; k < n_taps; k++)
+                sum += weights[k] * src[index[k] * bytes + b];
+
+              *dest++ = sum;
+            }
+        }
+    }
+}
+
+/*  the vertical pass, four channels at a time  */
+void
+scale_column_sse2 (gfloat        *dest,
+                   const gfloat **src,
+                   const gfloat  *weights,
+                   gint           n_taps,
+                   gint           length)
+{
+  gint i, k;
+
+  for (i = 0; i + 4 <= length; i += 4)
+    {
+      __m128 sum = _mm_setzero_ps ();
+
+      for (k = 0; k < n_taps; k++)
+        sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (weights[k]),
+                                           _mm_loadu_ps (src[k] + i)));
+
+      _mm_storeu_ps (dest + i, sum);
+    }
+
+  for (; i < length; i++)
+    {
+      gfloat sum = 0.0;
+
+      for (k = 0; k < n_taps; k++)
+        sum += weights[k] * src[k][i];
+
+      dest[i] = sum;
+    }
+}
+
+#endif /* USE_SSE2 */
@@ -0,0 +1,64 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PAINT_FUNCS_SSE2_H__
+#define __PAINT_FUNCS_SSE2_H__
+
+
+#if defined(USE_SSE2)
+
+void  apply_mask_to_alpha_channel_sse2            (guchar       *src,
+                                                   const guchar *mask,
+                                                   guint         opacity,
+                                                   guint         length,
+                                                   guint         bytes);
+
+void  combine_mask_and_alpha_channel_stipple_sse2 (guchar       *src,
+                                                   const guchar *mask,
+                                                   guint         opacity,
+                                                   guint         length,
+                                                   guint         bytes);
+
+void  combine_mask_and_alpha_channel_stroke_sse2  (guchar       *src,
+                                                   const guchar *mask,
+                                                   guint         opacity,
+                                                   guint         length,
+                                                   guint         bytes);
+
+void  gaussian_iir_lines_sse2                     (gdouble       *buf,
+                                                   gint           n_lines,
+                                                   gint           length,
+                                                   const gdouble *coeff);
+
+void  scale_row_sse2                              (gfloat        *dest,
+                                                   const gfloat  *src,
+                                                   const gint    *index,
+                                                   const gfloat  *weights,
+                                                   gint           n_taps,
+                                                   gint           width,
+                                                   gint           bytes);
+
+void  scale_column_sse2                           (gfloat        *dest,
+                                                   const gfloat **src,
+                                                   const gfloat  *weights,
+                                                   gint           n_taps,
+                                                   gint           length);
+
+#endif /* USE_SSE2 */
+
+
+#endif  /*  __PAINT_FUNCS_SSE2_H__  */
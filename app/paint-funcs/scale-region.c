@@ -25,12 +25,18 @@
 
 #include "paint-funcs-types.h"
 
+#include "libgimpbase/gimpbase.h"
+
+#include "base/pixel-processor.h"
 #include "base/tile.h"
 #include "base/tile-manager.h"
 #include "base/pixel-region.h"
 #include "base/pixel-surround.h"
 
+#include "composite/gimp-composite.h"
+
 #include "paint-funcs.h"
+#include "paint-funcs-sse2.h"
 #include "scale-region.h"
 
 #include "gimp-log.h"
@@ -49,16 +55,28 @@ static gint           scale_determine_progress (PixelRegion           *srcPR,
                                                 gint                   levelx,
                                                 gint                   levely);
 
+static void           scale_region_full        (PixelRegion           *srcPR,
+                                                PixelRegion           *dstPR,
+                                                GimpInterpolationType  interpolation,
+                                                gboolean               consume,
+                                                GimpProgressFunc       progress_callback,
+                                                gpointer               progress_data);
+static void           scale_consume_rows       (TileManager           *srcTM,
+                                                gint                  *consumed,
+                                                gint                   y);
+
 static void           scale_region_buffer      (PixelRegion           *srcPR,
                                                 PixelRegion           *dstPR);
 static void           scale_region_tile        (PixelRegion           *srcPR,
                                                 PixelRegion           *dstPR,
                                                 GimpInterpolationType  interpolation,
+                                                gboolean               consume,
                                                 GimpProgressFunc       progress_callback,
                                                 gpointer               progress_data);
 static void           scale                    (TileManager           *srcTM,
                                                 TileManager           *dstTM,
                                                 GimpInterpolationType  interpolation,
+                                                gboolean               consume,
                                                 GimpProgressFunc       progress_callback,
                                                 gpointer               progress_data,
                                                 gint                  *progress,
@@ -66,6 +84,7 @@ static void           scale                    (TileManager           *srcTM,
 static void           decimate_xy              (TileManager           *srcTM,
                                                 TileManager           *dstTM,
                                                 GimpInterpolationType  interpolation,
+                                                gboolean               consume,
                                                 GimpProgressFunc       progress_callback,
                                                 gpointer               progress_data,
                                                 gint                  *progress,
@@ -73,6 +92,7 @@ static void           decimate_xy              (TileManager           *srcTM,
 static void           decimate_x               (TileManager           *srcTM,
                                                 TileManager           *dstTM,
                                                 GimpInterpolationType  interpolation,
+                                                gboolean               consume,
                                                 GimpProgressFunc       progress_callback,
                                                 gpointer               progress_data,
                                                 gint                  *progress,
@@ -80,6 +100,7 @@ static void           decimate_x               (TileManager           *srcTM,
 static void           decimate_y               (TileManager           *srcTM,
                                                 TileManager           *dstTM,
                                                 GimpInterpolationType  interpolation,
+                                                gboolean               consume,
                                                 GimpProgressFunc       progress_callback,
                                                 gpointer               progress_data,
                                                 gint                  *progress,
@@ -105,29 +126,7 @@ static void           interpolate_nearest      (TileManager   *srcTM,
                                                 const gdouble  xfrac,
                                                 const gdouble  yfrac,
                                                 guchar        *pixel);
-static void           interpolate_bilinear     (PixelSurround *surround,
-                                                const gint     x0,
-                                                const gint     y0,
-                                                const gdouble  xfrac,
-                                                const gdouble  yfrac,
-                                                const gint     bytes,
-                                                guchar        *pixel);
-static void           interpolate_cubic        (PixelSurround *surround,
-                                                const gint     x0,
-                                                const gint     y0,
-                                                const gdouble  xfrac,
-                                                const gdouble  yfrac,
-                                                const gint     bytes,
-                                                guchar        *pixel);
 static gfloat *       create_lanczos3_lookup   (void);
-static void           interpolate_lanczos3     (PixelSurround *surround,
-                                                const gint     x0,
-                                                const gint     y0,
-                                                const gdouble  xfrac,
-                                                const gdouble  yfrac,
-                                                const gint     bytes,
-                                                guchar        *pixel,
-                                                const gfloat  *kernel_lookup);
 static void           interpolate_bilinear_pr  (PixelRegion   *srcPR,
                                                 const gint     x0,
                                                 const gint     y0,
@@ -136,11 +135,6 @@ static void           interpolate_bilinear_pr  (PixelRegion   *srcPR,
                                                 const gdouble  xfrac,
                                                 const gdouble  yfrac,
                                                 guchar        *pixel);
-static inline gdouble cubic_spline_fit         (const gdouble  dx,
-                                                const gdouble  x1,
-                                                const gdouble  y1,
-                                                const gdouble  x2,
-                                                const gdouble  y2);
 static inline gdouble weighted_sum             (const gdouble  dx,
                                                 const gdouble  dy,
                                                 const gint     s00,
@@ -148,18 +142,28 @@ static inline gdouble weighted_sum             (const gdouble  dx,
                                                 const gint     s01,
                                                 const gint     s11);
 static inline gdouble sinc                     (const gdouble  x);
-static inline gdouble lanczos3_mul_alpha       (const guchar  *pixels,
-                                                const gdouble *x_kernel,
-                                                const gdouble *y_kernel,
-                                                const gint     stride,
-                                                const gint     bytes,
-                                                const gint     byte);
-static inline gdouble lanczos3_mul             (const guchar  *pixels,
-                                                const gdouble *x_kernel,
-                                                const gdouble *y_kernel,
-                                                const gint     stride,
-                                                const gint     bytes,
-                                                const gint     byte);
+
+static void           scale_separable          (TileManager           *srcTM,
+                                                TileManager           *dstTM,
+                                                GimpInterpolationType  interpolation,
+                                                gboolean               consume,
+                                                GimpProgressFunc       progress_callback,
+                                                gpointer               progress_data,
+                                                gint                  *progress,
+                                                gint                   max_progress);
+static void           scale_row                (gfloat        *dest,
+                                                const gfloat  *src,
+                                                const gint    *index,
+                                                const gfloat  *weights,
+                                                gint           n_taps,
+                                                gint           width,
+                                                gint           bytes);
+static void           scale_column             (gfloat        *dest,
+                                                const gfloat **src,
+                                                const gfloat  *weights,
+                                                gint           n_taps,
+                                                gint           length);
+
 
 
 
@@ -169,11 +173,47 @@ scale_region (PixelRegion           *srcPR,
               GimpInterpolationType  interpolation,
               GimpProgressFunc       progress_callback,
               gpointer               progress_data)
+{
+  scale_region_full (srcPR, dstPR, interpolation, FALSE,
+                     progress_callback, progress_data);
+}
+
+/*  Scaling a drawable that is thrown away afterwards, like when undo
+ *  is disabled, doesn't need to keep all of the source around until
+ *  it is done.  With consume_source, the tiles of the source are freed
+ *  as soon as all of the rows they hold have been read, so the source
+ *  and the result together take little more memory than the bigger
+ *  of them.  The source is garbage afterwards.
+ */
+void
+scale_region_consume (PixelRegion           *srcPR,
+                      PixelRegion           *dstPR,
+                      GimpInterpolationType  interpolation,
+                      GimpProgressFunc       progress_callback,
+                      gpointer               progress_data)
+{
+  g_return_if_fail (srcPR->tiles != NULL);
+
+  scale_region_full (srcPR, dstPR, interpolation, TRUE,
+                     progress_callback, progress_data);
+}
+
+static void
+scale_region_full (PixelRegion           *srcPR,
+                   PixelRegion           *dstPR,
+                   GimpInterpolationType  interpolation,
+                   gboolean               consume,
+                   GimpProgressFunc       progress_callback,
+                   gpointer               progress_data)
 {
   /* Copy and return if scale = 1.0 */
   if (srcPR->h == dstPR->h && srcPR->w == dstPR->w)
     {
       copy_region (srcPR, dstPR);
+
+      if (consume)
+        tile_manager_discard_area (srcPR->tiles,
+                                   srcPR->x, srcPR->y, srcPR->w, srcPR->h);
       return;
     }
 
@@ -188,7 +228,7 @@ scale_region (PixelRegion           *srcPR,
 
   if (srcPR->tiles != NULL && srcPR->data == NULL)
     {
-      scale_region_tile (srcPR, dstPR, interpolation,
+      scale_region_tile (srcPR, dstPR, interpolation, consume,
                          progress_callback, progress_data);
       return;
     }
@@ -196,6 +236,23 @@ scale_region (PixelRegion           *srcPR,
   g_assert_not_reached ();
 }
 
+/*  frees the tiles of a source that is read from top to bottom, once
+ *  all of their rows are above row y
+ */
+static void
+scale_consume_rows (TileManager *srcTM,
+                    gint        *consumed,
+                    gint         y)
+{
+  while (*consumed + TILE_HEIGHT <= y)
+    {
+      tile_manager_discard_area (srcTM, 0, *consumed,
+                                 tile_manager_width (srcTM), TILE_HEIGHT);
+
+      *consumed += TILE_HEIGHT;
+    }
+}
+
 static void
 scale_determine_levels (PixelRegion *srcPR,
                         PixelRegion *dstPR,
@@ -301,6 +358,7 @@ static void
 scale_region_tile (PixelRegion           *srcPR,
                    PixelRegion           *dstPR,
                    GimpInterpolationType  interpolation,
+                   gboolean               consume,
                    GimpProgressFunc       progress_callback,
                    gpointer               progress_data)
 {
@@ -314,6 +372,9 @@ scale_region_tile (PixelRegion           *srcPR,
   gint         progress     = 0;
   gint         levelx       = 0;
   gint         levely       = 0;
+  gboolean     consume_src  = consume;  /*  the intermediate levels
+                                         *  are always consumed
+                                         */
 
   /* determine scaling levels */
   if (interpolation != GIMP_INTERPOLATION_NONE)
@@ -325,7 +386,7 @@ scale_region_tile (PixelRegion           *srcPR,
 
   if (levelx == 0 && levely == 0)
     {
-      scale (srcTM, dstTM, interpolation,
+      scale (srcTM, dstTM, interpolation, consume_src,
              progress_callback, progress_data, &progress, max_progress);
     }
 
@@ -335,13 +396,14 @@ scale_region_tile (PixelRegion           *srcPR,
       height <<= 1;
 
       tmpTM = tile_manager_new (width, height, bytes);
-      scale (srcTM, tmpTM, interpolation,
+      scale (srcTM, tmpTM, interpolation, consume_src,
              progress_callback, progress_data, &progress, max_progress);
 
       if (srcTM != srcPR->tiles)
         tile_manager_unref (srcTM);
 
-      srcTM = tmpTM;
+      srcTM       = tmpTM;
+      consume_src = TRUE;
       levelx++;
       levely++;
     }
@@ -351,13 +413,14 @@ scale_region_tile (PixelRegion           *srcPR,
       width <<= 1;
 
       tmpTM = tile_manager_new (width, height, bytes);
-      scale (srcTM, tmpTM, interpolation,
+      scale (srcTM, tmpTM, interpolation, consume_src,
              progress_callback, progress_data, &progress, max_progress);
 
       if (srcTM != srcPR->tiles)
         tile_manager_unref (srcTM);
 
-      srcTM = tmpTM;
+      srcTM       = tmpTM;
+      consume_src = TRUE;
       levelx++;
     }
 
@@ -366,13 +429,14 @@ scale_region_tile (PixelRegion           *srcPR,
       height <<= 1;
 
       tmpTM = tile_manager_new (width, height, bytes);
-      scale (srcTM, tmpTM, interpolation,
+      scale (srcTM, tmpTM, interpolation, consume_src,
              progress_callback, progress_data, &progress, max_progress);
 
       if (srcTM != srcPR->tiles)
         tile_manager_unref (srcTM);
 
-      srcTM = tmpTM;
+      srcTM       = tmpTM;
+      consume_src = TRUE;
       levely++;
     }
 
@@ -382,13 +446,14 @@ scale_region_tile (PixelRegion           *srcPR,
       height >>= 1;
 
       tmpTM = tile_manager_new (width, height, bytes);
-      decimate_xy (srcTM, tmpTM, interpolation,
+      decimate_xy (srcTM, tmpTM, interpolation, consume_src,
                    progress_callback, progress_data, &progress, max_progress);
 
       if (srcTM != srcPR->tiles)
         tile_manager_unref (srcTM);
 
-      srcTM = tmpTM;
+      srcTM       = tmpTM;
+      consume_src = TRUE;
       levelx--;
       levely--;
     }
@@ -398,13 +463,14 @@ scale_region_tile (PixelRegion           *srcPR,
       width >>= 1;
 
       tmpTM = tile_manager_new (width, height, bytes);
-      decimate_x (srcTM, tmpTM, interpolation,
+      decimate_x (srcTM, tmpTM, interpolation, consume_src,
                   progress_callback, progress_data, &progress, max_progress);
 
       if (srcTM != srcPR->tiles)
         tile_manager_unref (srcTM);
 
-      srcTM = tmpTM;
+      srcTM       = tmpTM;
+      consume_src = TRUE;
       levelx--;
     }
 
@@ -413,19 +479,20 @@ scale_region_tile (PixelRegion           *srcPR,
       height >>= 1;
 
       tmpTM = tile_manager_new (width, height, bytes);
-      decimate_y (srcTM, tmpTM, interpolation,
+      decimate_y (srcTM, tmpTM, interpolation, consume_src,
                   progress_callback, progress_data, &progress, max_progress);
 
       if (srcTM != srcPR->tiles)
         tile_manager_unref (srcTM);
 
-      srcTM = tmpTM;
+      srcTM       = tmpTM;
+      consume_src = TRUE;
       levely--;
     }
 
   if (tmpTM != NULL)
     {
-      scale (tmpTM, dstTM, interpolation,
+      scale (tmpTM, dstTM, interpolation, TRUE,
              progress_callback, progress_data, &progress, max_progress);
       tile_manager_unref (tmpTM);
     }
@@ -440,22 +507,21 @@ static void
 scale (TileManager           *srcTM,
        TileManager           *dstTM,
        GimpInterpolationType  interpolation,
+       gboolean               consume,
        GimpProgressFunc       progress_callback,
        gpointer               progress_data,
        gint                  *progress,
        gint                   max_progress)
 {
   PixelRegion     region;
-  PixelSurround  *surround   = NULL;
   const guint     src_width  = tile_manager_width  (srcTM);
   const guint     src_height = tile_manager_height (srcTM);
-  const guint     bytes      = tile_manager_bpp    (dstTM);
   const guint     dst_width  = tile_manager_width  (dstTM);
   const guint     dst_height = tile_manager_height (dstTM);
   const gdouble   scaley     = (gdouble) src_height / (gdouble) dst_height;
   const gdouble   scalex     = (gdouble) src_width  / (gdouble) dst_width;
+  gint            consumed   = 0;
   gpointer        pr;
-  gfloat         *kernel_lookup = NULL;
 
   GIMP_LOG (SCALE, "scale: %dx%d -> %dx%d",
             src_width, src_height, dst_width, dst_height);
@@ -475,23 +541,12 @@ scale (TileManager           *srcTM,
         }
     }
 
-  switch (interpolation)
+  if (interpolation != GIMP_INTERPOLATION_NONE)
     {
-    case GIMP_INTERPOLATION_NONE:
-      break;
-
-    case GIMP_INTERPOLATION_LINEAR:
-      surround = pixel_surround_new (srcTM, 2, 2, PIXEL_SURROUND_SMEAR);
-      break;
-
-    case GIMP_INTERPOLATION_CUBIC:
-      surround = pixel_surround_new (srcTM, 4, 4, PIXEL_SURROUND_SMEAR);
-      break;
-
-    case GIMP_INTERPOLATION_LANCZOS:
-      surround = pixel_surround_new (srcTM, 6, 6, PIXEL_SURROUND_SMEAR);
-      kernel_lookup = create_lanczos3_lookup ();
-      break;
+      scale_separable (srcTM, dstTM, interpolation, consume,
+                       progress_callback, progress_data,
+                       progress, max_progress);
+      return;
     }
 
   pixel_region_init (&region, dstTM, 0, 0, dst_width, dst_height, TRUE);
@@ -505,6 +560,10 @@ scale (TileManager           *srcTM,
       guchar     *row = region.data;
       gint        y;
 
+      if (consume && region.x == 0)
+        scale_consume_rows (srcTM, &consumed,
+                            (gint) ((region.y + 0.5) * scaley - 0.5));
+
       for (y = region.y; y < y1; y++)
         {
           guchar  *pixel = row;
@@ -521,28 +580,7 @@ scale (TileManager           *srcTM,
 
               xfrac = xfrac - sx;
 
-              switch (interpolation)
-                {
-                case GIMP_INTERPOLATION_NONE:
-                  interpolate_nearest (srcTM, sx, sy, xfrac, yfrac, pixel);
-                  break;
-
-                case GIMP_INTERPOLATION_LINEAR:
-                  interpolate_bilinear (surround,
-                                        sx, sy, xfrac, yfrac, bytes, pixel);
-                  break;
-
-                case GIMP_INTERPOLATION_CUBIC:
-                  interpolate_cubic (surround,
-                                     sx, sy, xfrac, yfrac, bytes, pixel);
-                  break;
-
-                case GIMP_INTERPOLATION_LANCZOS:
-                  interpolate_lanczos3 (surround,
-                                        sx, sy, xfrac, yfrac, bytes, pixel,
-                                        kernel_lookup);
-                  break;
-                }
+              interpolate_nearest (srcTM, sx, sy, xfrac, yfrac, pixel);
 
               pixel += region.bytes;
             }
@@ -559,17 +597,456 @@ scale (TileManager           *srcTM,
         }
     }
 
+  if (consume)
+    tile_manager_discard_area (srcTM, 0, 0, src_width, src_height);
+}
+
+
+/*  The interpolating scale is separable: every destination column
+ *  takes a weighted sum of the same few source columns in every row,
+ *  and every destination row of the same few source rows.  The
+ *  weights are computed once per column and once per row, and both
+ *  passes are done in floats on premultiplied pixels, which is the
+ *  same computation interpolating each pixel in two dimensions was.
+ *
+ *  The destination is written a band of rows at a time.  The source
+ *  rows a band needs are scaled horizontally first, then combined
+ *  vertically, with the rows of each pass spread across the pixel
+ *  processor threads.
+ */
+
+#define SCALE_BAND   TILE_HEIGHT  /*  destination rows per band         */
+#define SCALE_CHUNK  8            /*  rows handed to a thread at once  */
+
+typedef void (* ScaleRowFunc)    (gfloat        *dest,
+                                  const gfloat  *src,
+                                  const gint    *index,
+                                  const gfloat  *weights,
+                                  gint           n_taps,
+                                  gint           width,
+                                  gint           bytes);
+typedef void (* ScaleColumnFunc) (gfloat        *dest,
+                                  const gfloat **src,
+                                  const gfloat  *weights,
+                                  gint           n_taps,
+                                  gint           length);
+
+/*  replaced in scale_region_setup() by versions for the CPU we are
+ *  running on
+ */
+static ScaleRowFunc     scale_row_func    = scale_row;
+static ScaleColumnFunc  scale_column_func = scale_column;
+
+typedef struct
+{
+  gint   *index;    /*  n_taps source pixels for each destination pixel  */
+  gfloat *weights;  /*  and their weights                               */
+  gint    n_taps;
+} ScaleFilter;
+
+typedef struct
+{
+  const guchar      *src;     /*  the source rows of the band           */
+  gfloat            *dest;    /*  the same rows, scaled horizontally    */
+  const ScaleFilter *filter;
+  gint               src_width;
+  gint               dst_width;
+  gint               bytes;
+} ScaleRows;
+
+typedef struct
+{
+  const gfloat      *src;     /*  the rows from ScaleRows               */
+  guchar            *dest;    /*  the destination rows of the band      */
+  const ScaleFilter *filter;
+  gint               first;   /*  the source row of the first src row   */
+  gint               y;       /*  the destination row of the first dest */
+  gint               width;
+  gint               bytes;
+} ScaleColumns;
+
+
+static void
+scale_filter_init (ScaleFilter           *filter,
+                   GimpInterpolationType  interpolation,
+                   gint                   src_length,
+                   gint                   dst_length,
+                   const gfloat          *kernel_lookup)
+{
+  const gdouble scale = (gdouble) src_length / (gdouble) dst_length;
+  gint          d, k;
+
+  switch (interpolation)
+    {
+    case GIMP_INTERPOLATION_LINEAR:
+      filter->n_taps = 2;
+      break;
+
+    case GIMP_INTERPOLATION_CUBIC:
+      filter->n_taps = 4;
+      break;
+
+    default:
+      filter->n_taps = 6;
+      break;
+    }
+
+  filter->index   = g_new (gint,   dst_length * filter->n_taps);
+  filter->weights = g_new (gfloat, dst_length * filter->n_taps);
+
+  for (d = 0; d < dst_length; d++)
+    {
+      gint   *index   = filter->index   + d * filter->n_taps;
+      gfloat *weights = filter->weights + d * filter->n_taps;
+      gdouble frac    = (d + 0.5) * scale - 0.5;
+      gint    s       = (gint) frac;
+      gdouble t       = frac - s;
+      gint    first;
+
+      switch (interpolation)
+        {
+        case GIMP_INTERPOLATION_LINEAR:
+          first = s;
+
+          weights[0] = 1.0 - t;
+          weights[1] = t;
+          break;
+
+        case GIMP_INTERPOLATION_CUBIC:
+          /*  the Catmull-Rom spline through the four pixels  */
+          first = s - 1;
+
+          weights[0] = (-t * t * t + 2.0 * t * t - t) / 2.0;
+          weights[1] = (3.0 * t * t * t - 5.0 * t * t + 2.0) / 2.0;
+          weights[2] = (-3.0 * t * t * t + 4.0 * t * t + t) / 2.0;
+          weights[3] = (t * t * t - t * t) / 2.0;
+          break;
+
+        default:
+          {
+            const gint shift = (gint) (t * LANCZOS_SPP + 0.5);
+            gdouble    kernel[6];
+            gdouble    sum   = 0.0;
+
+            first = s - 2;
+
+            for (k = 0; k < 6; k++)
+              {
+                kernel[k] = kernel_lookup[ABS (shift - (k - 2) * LANCZOS_SPP)];
+                sum += kernel[k];
+              }
+
+            for (k = 0; k < 6; k++)
+              weights[k] = kernel[k] / sum;
+          }
+          break;
+        }
+
+      /*  pixels outside are the nearest edge pixel, like with
+       *  PIXEL_SURROUND_SMEAR
+       */
+      for (k = 0; k < filter->n_taps; k++)
+        index[k] = CLAMP (first + k, 0, src_length - 1);
+    }
+}
+
+static void
+scale_filter_free (ScaleFilter *filter)
+{
+  g_free (filter->index);
+  g_free (filter->weights);
+}
+
+static void
+scale_row (gfloat       *dest,
+           const gfloat *src,
+           const gint   *index,
+           const gfloat *weights,
+           gint          n_taps,
+           gint          width,
+           gint          bytes)
+{
+  gint x, k, b;
+
+  for (x = 0; x < width; x++, index += n_taps, weights += n_taps)
+    {
+      for (b = 0; b < bytes; b++)
+        {
+          gfloat sum = 0.0;
+
+          for (k = 0; k < n_taps; k++)
+            sum += weights[k] * src[index[k] * bytes + b];
+
+          *dest++ = sum;
+        }
+    }
+}
+
+static void
+scale_column (gfloat        *dest,
+              const gfloat **src,
+              const gfloat  *weights,
+              gint           n_taps,
+              gint           length)
+{
+  gint i, k;
+
+  for (i = 0; i < length; i++)
+    {
+      gfloat sum = 0.0;
+
+      for (k = 0; k < n_taps; k++)
+        sum += weights[k] * src[k][i];
+
+      dest[i] = sum;
+    }
+}
+
+static void
+scale_rows_range (gpointer data,
+                  gint     start,
+                  gint     end)
+{
+  ScaleRows  *rows   = data;
+  const gint  bytes  = rows->bytes;
+  const gint  length = rows->src_width * bytes;
+  gfloat     *buf    = g_new (gfloat, length);
+  gint        y, i;
+
+  for (y = start; y < end; y++)
+    {
+      const guchar *src = rows->src + y * length;
+
+      if (bytes == 2 || bytes == 4)
+        {
+          for (i = 0; i < length; i += bytes)
+            {
+              const gfloat alpha = src[i + bytes - 1];
+              gint         b;
+
+              for (b = 0; b < bytes - 1; b++)
+                buf[i + b] = src[i + b] * alpha;
+
+              buf[i + bytes - 1] = alpha;
+            }
+        }
+      else
+        {
+          for (i = 0; i < length; i++)
+            buf[i] = src[i];
+        }
+
+      scale_row_func (rows->dest + y * rows->dst_width * bytes, buf,
+                      rows->filter->index, rows->filter->weights,
+                      rows->filter->n_taps, rows->dst_width, bytes);
+    }
+
+  g_free (buf);
+}
+
+static void
+scale_columns_range (gpointer data,
+                     gint     start,
+                     gint     end)
+{
+  ScaleColumns      *columns = data;
+  const ScaleFilter *filter  = columns->filter;
+  const gint         bytes   = columns->bytes;
+  const gint         length  = columns->width * bytes;
+  gfloat            *buf     = g_new (gfloat, length);
+  gint               y, i, k;
+
+  for (y = start; y < end; y++)
+    {
+      const gint   *index = filter->index + (columns->y + y) * filter->n_taps;
+      const gfloat *src[6];
+      guchar       *dest  = columns->dest + y * length;
+
+      for (k = 0; k < filter->n_taps; k++)
+        src[k] = columns->src + (index[k] - columns->first) * length;
+
+      scale_column_func (buf, src,
+                         filter->weights + (columns->y + y) * filter->n_taps,
+                         filter->n_taps, length);
+
+      if (bytes == 2 || bytes == 4)
+        {
+          for (i = 0; i < length; i += bytes)
+            {
+              const gfloat alpha = buf[i + bytes - 1];
+              gint         b;
+
+              if (alpha > 0)
+                {
+                  for (b = 0; b < bytes - 1; b++)
+                    dest[i + b] = CLAMP (buf[i + b] / alpha, 0, 255);
+
+                  dest[i + bytes - 1] = CLAMP (alpha, 0, 255);
+                }
+              else
+                {
+                  for (b = 0; b < bytes; b++)
+                    dest[i + b] = 0;
+                }
+            }
+        }
+      else
+        {
+          for (i = 0; i < length; i++)
+            dest[i] = CLAMP (buf[i], 0, 255);
+        }
+    }
+
+  g_free (buf);
+}
+
+static void
+scale_separable (TileManager           *srcTM,
+                 TileManager           *dstTM,
+                 GimpInterpolationType  interpolation,
+                 gboolean               consume,
+                 GimpProgressFunc       progress_callback,
+                 gpointer               progress_data,
+                 gint                  *progress,
+                 gint                   max_progress)
+{
+  const gint    src_width     = tile_manager_width  (srcTM);
+  const gint    src_height    = tile_manager_height (srcTM);
+  const gint    dst_width     = tile_manager_width  (dstTM);
+  const gint    dst_height    = tile_manager_height (dstTM);
+  const gint    bytes         = tile_manager_bpp    (dstTM);
+  gfloat       *kernel_lookup = NULL;
+  ScaleFilter   x_filter;
+  ScaleFilter   y_filter;
+  PixelRegion   srcPR;
+  PixelRegion   dstPR;
+  guchar       *src;
+  gfloat       *tmp;
+  guchar       *dest;
+  gint          max_rows      = 0;
+  gint          consumed      = 0;
+  gint          y, i;
+
+  if (interpolation == GIMP_INTERPOLATION_LANCZOS)
+    kernel_lookup = create_lanczos3_lookup ();
+
+  scale_filter_init (&x_filter, interpolation,
+                     src_width, dst_width, kernel_lookup);
+  scale_filter_init (&y_filter, interpolation,
+                     src_height, dst_height, kernel_lookup);
+
+  /*  the most source rows any band needs  */
+  for (y = 0; y < dst_height; y += SCALE_BAND)
+    {
+      const gint end   = MIN (y + SCALE_BAND, dst_height) * y_filter.n_taps;
+      gint       first = src_height;
+      gint       last  = 0;
+
+      for (i = y * y_filter.n_taps; i < end; i++)
+        {
+          first = MIN (first, y_filter.index[i]);
+          last  = MAX (last,  y_filter.index[i]);
+        }
+
+      max_rows = MAX (max_rows, last - first + 1);
+    }
+
+  src  = g_new (guchar, max_rows * src_width * bytes);
+  tmp  = g_new (gfloat, max_rows * dst_width * bytes);
+  dest = g_new (guchar, SCALE_BAND * dst_width * bytes);
+
+  pixel_region_init (&srcPR, srcTM, 0, 0, src_width, src_height, FALSE);
+  pixel_region_init (&dstPR, dstTM, 0, 0, dst_width, dst_height, TRUE);
+
+  for (y = 0; y < dst_height; y += SCALE_BAND)
+    {
+      const gint   n_rows = MIN (SCALE_BAND, dst_height - y);
+      const gint   end    = (y + n_rows) * y_filter.n_taps;
+      gint         first  = src_height;
+      gint         last   = 0;
+      ScaleRows    rows;
+      ScaleColumns columns;
+
+      for (i = y * y_filter.n_taps; i < end; i++)
+        {
+          first = MIN (first, y_filter.index[i]);
+          last  = MAX (last,  y_filter.index[i]);
+        }
+
+      for (i = first; i <= last; i++)
+        pixel_region_get_row (&srcPR, 0, i, src_width,
+                              src + (i - first) * src_width * bytes, 1);
+
+      rows.src       = src;
+      rows.dest      = tmp;
+      rows.filter    = &x_filter;
+      rows.src_width = src_width;
+      rows.dst_width = dst_width;
+      rows.bytes     = bytes;
+
+      pixel_processor_process_range (scale_rows_range, &rows,
+                                     last - first + 1, SCALE_CHUNK);
+
+      columns.src    = tmp;
+      columns.dest   = dest;
+      columns.filter = &y_filter;
+      columns.first  = first;
+      columns.y      = y;
+      columns.width  = dst_width;
+      columns.bytes  = bytes;
+
+      pixel_processor_process_range (scale_columns_range, &columns,
+                                     n_rows, SCALE_CHUNK);
+
+      for (i = 0; i < n_rows; i++)
+        pixel_region_set_row (&dstPR, 0, y + i, dst_width,
+                              dest + i * dst_width * bytes);
+
+      /*  the next band starts at its first tap  */
+      if (consume && y + n_rows < dst_height)
+        scale_consume_rows (srcTM, &consumed,
+                            y_filter.index[(y + n_rows) * y_filter.n_taps]);
+
+      if (progress_callback)
+        {
+          *progress += NUM_TILES (dst_width, n_rows);
+
+          progress_callback (0, max_progress, *progress, progress_data);
+        }
+    }
+
+  g_free (dest);
+  g_free (tmp);
+  g_free (src);
+
+  if (consume)
+    tile_manager_discard_area (srcTM, 0, 0, src_width, src_height);
+
+  scale_filter_free (&y_filter);
+  scale_filter_free (&x_filter);
+
   if (kernel_lookup)
     g_free (kernel_lookup);
+}
 
-  if (surround)
-    pixel_surround_destroy (surround);
+void
+scale_region_setup (void)
+{
+#if defined(USE_SSE2)
+  if (gimp_composite_use_cpu_accel () &&
+      (gimp_cpu_accel_get_support () & GIMP_CPU_ACCEL_X86_SSE2))
+    {
+      scale_row_func    = scale_row_sse2;
+      scale_column_func = scale_column_sse2;
+    }
+#endif
 }
 
 static void
 decimate_xy (TileManager           *srcTM,
              TileManager           *dstTM,
              GimpInterpolationType  interpolation,
+             gboolean               consume,
              GimpProgressFunc       progress_callback,
              gpointer               progress_data,
              gint                  *progress,
@@ -580,6 +1057,7 @@ decimate_xy (TileManager           *srcTM,
   const guint     bytes      = tile_manager_bpp    (dstTM);
   const guint     dst_width  = tile_manager_width  (dstTM);
   const guint     dst_height = tile_manager_height (dstTM);
+  gint            consumed   = 0;
   gpointer        pr;
 
   GIMP_LOG (SCALE, "decimate_xy: %dx%d -> %dx%d\n",
@@ -599,6 +1077,9 @@ decimate_xy (TileManager           *srcTM,
       guchar     *row = region.data;
       gint        y;
 
+      if (consume && region.x == 0)
+        scale_consume_rows (srcTM, &consumed, region.y * 2);
+
       for (y = region.y; y < y1; y++)
         {
           const gint  sy    = y * 2;
@@ -625,12 +1106,18 @@ decimate_xy (TileManager           *srcTM,
     }
 
   pixel_surround_destroy (surround);
+
+  if (consume)
+    tile_manager_discard_area (srcTM, 0, 0,
+                               tile_manager_width  (srcTM),
+                               tile_manager_height (srcTM));
 }
 
 static void
 decimate_x (TileManager           *srcTM,
             TileManager           *dstTM,
             GimpInterpolationType  interpolation,
+            gboolean               consume,
             GimpProgressFunc       progress_callback,
             gpointer               progress_data,
             gint                  *progress,
@@ -641,6 +1128,7 @@ decimate_x (TileManager           *srcTM,
   const guint     bytes      = tile_manager_bpp    (dstTM);
   const guint     dst_width  = tile_manager_width  (dstTM);
   const guint     dst_height = tile_manager_height (dstTM);
+  gint            consumed   = 0;
   gpointer        pr;
 
   GIMP_LOG (SCALE, "decimate_x: %dx%d -> %dx%d\n",
@@ -660,6 +1148,9 @@ decimate_x (TileManager           *srcTM,
       guchar     *row = region.data;
       gint        y;
 
+      if (consume && region.x == 0)
+        scale_consume_rows (srcTM, &consumed, region.y);
+
       for (y = region.y; y < y1; y++)
         {
           guchar *pixel = row;
@@ -685,12 +1176,18 @@ decimate_x (TileManager           *srcTM,
     }
 
   pixel_surround_destroy (surround);
+
+  if (consume)
+    tile_manager_discard_area (srcTM, 0, 0,
+                               tile_manager_width  (srcTM),
+                               tile_manager_height (srcTM));
 }
 
 static void
 decimate_y (TileManager           *srcTM,
             TileManager           *dstTM,
             GimpInterpolationType  interpolation,
+            gboolean               consume,
             GimpProgressFunc       progress_callback,
             gpointer               progress_data,
             gint                  *progress,
@@ -701,6 +1198,7 @@ decimate_y (TileManager           *srcTM,
   const guint     bytes      = tile_manager_bpp    (dstTM);
   const guint     dst_width  = tile_manager_width  (dstTM);
   const guint     dst_height = tile_manager_height (dstTM);
+  gint            consumed   = 0;
   gpointer        pr;
 
   GIMP_LOG (SCALE, "decimate_y: %dx%d -> %dx%d\n",
@@ -720,6 +1218,9 @@ decimate_y (TileManager           *srcTM,
       guchar     *row = region.data;
       gint        y;
 
+      if (consume && region.x == 0)
+        scale_consume_rows (srcTM, &consumed, region.y * 2);
+
       for (y = region.y; y < y1; y++)
         {
           const gint  sy    = y * 2;
@@ -746,6 +1247,11 @@ decimate_y (TileManager           *srcTM,
     }
 
   pixel_surround_destroy (surround);
+
+  if (consume)
+    tile_manager_discard_area (srcTM, 0, 0,
+                               tile_manager_width  (srcTM),
+                               tile_manager_height (srcTM));
 }
 
 static void inline
@@ -1029,375 +1535,6 @@ weighted_sum (const gdouble dx,
           ((1 - dx) * s00 + dx * s10) + dy * ((1 - dx) * s01 + dx * s11));
 }
 
-static void
-interpolate_bilinear (PixelSurround *surround,
-                      const gint     x0,
-                      const gint     y0,
-                      const gdouble  xfrac,
-                      const gdouble  yfrac,
-                      const gint     bytes,
-                      guchar        *pixel)
-{
-  gint          stride;
-  const guchar *src = pixel_surround_lock (surround, x0, y0, &stride);
-  const guchar *p1  = src;
-  const guchar *p2  = p1 + bytes;
-  const guchar *p3  = src + stride;
-  const guchar *p4  = p3 + bytes;
-  gdouble       sum;
-  gdouble       alphasum;
-  gint          b;
-
-  switch (bytes)
-    {
-    case 1:
-      sum = weighted_sum (xfrac, yfrac, p1[0], p2[0], p3[0], p4[0]);
-
-      pixel[0] = CLAMP (sum, 0, 255);
-      break;
-
-    case 2:
-      alphasum = weighted_sum (xfrac, yfrac, p1[1], p2[1], p3[1], p4[1]);
-      if (alphasum > 0)
-        {
-          sum = weighted_sum (xfrac, yfrac,
-                              p1[0] * p1[1], p2[0] * p2[1],
-                              p3[0] * p3[1], p4[0] * p4[1]);
-          sum /= alphasum;
-
-          pixel[0] = CLAMP (sum, 0, 255);
-          pixel[1] = CLAMP (alphasum, 0, 255);
-        }
-      else
-        {
-          pixel[0] = pixel[1] = 0;
-        }
-      break;
-
-    case 3:
-      for (b = 0; b < 3; b++)
-        {
-          sum = weighted_sum (xfrac, yfrac, p1[b], p2[b], p3[b], p4[b]);
-
-          pixel[b] = CLAMP (sum, 0, 255);
-        }
-      break;
-
-    case 4:
-      alphasum = weighted_sum (xfrac, yfrac, p1[3], p2[3], p3[3], p4[3]);
-      if (alphasum > 0)
-        {
-          for (b = 0; b < 3; b++)
-            {
-              sum = weighted_sum (xfrac, yfrac,
-                                  p1[b] * p1[3], p2[b] * p2[3],
-                                  p3[b] * p3[3], p4[b] * p4[3]);
-              sum /= alphasum;
-
-              pixel[b] = CLAMP (sum, 0, 255);
-            }
-
-          pixel[3] = CLAMP (alphasum, 0, 255);
-        }
-      else
-        {
-          pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
-        }
-      break;
-    }
-}
-
-/* Catmull-Rom spline - not bad
-  * basic intro http://www.mvps.org/directx/articles/catmull/
-  * This formula will calculate an interpolated point between pt1 and pt2
-  * dx=0 returns pt1; dx=1 returns pt2
-  */
-
-static inline gdouble
-cubic_spline_fit (const gdouble  dx,
-                  const gdouble  pt0,
-                  const gdouble  pt1,
-                  const gdouble  pt2,
-                  const gdouble  pt3)
-{
-  return (gdouble) ((( ( -pt0 + 3 * pt1 - 3 * pt2 + pt3 ) *   dx +
-                       ( 2 * pt0 - 5 * pt1 + 4 * pt2 - pt3 ) ) * dx +
-                     ( -pt0 + pt2 ) ) * dx + (pt1 + pt1) ) / 2.0;
-}
-
-static void
-interpolate_cubic (PixelSurround *surround,
-                   const gint     x0,
-                   const gint     y0,
-                   const gdouble  xfrac,
-                   const gdouble  yfrac,
-                   const gint     bytes,
-                   guchar        *pixel)
-{
-  gint          stride;
-  const guchar *src = pixel_surround_lock (surround, x0 - 1, y0 - 1, &stride);
-  const guchar *s0  = src;
-  const guchar *s1  = s0 + stride;
-  const guchar *s2  = s1 + stride;
-  const guchar *s3  = s2 + stride;
-  gint          b;
-  gdouble       p0, p1, p2, p3;
-  gdouble       sum, alphasum;
-
-  switch (bytes)
-    {
-    case 1:
-      p0 = cubic_spline_fit (xfrac, s0[0], s0[1], s0[2], s0[3]);
-      p1 = cubic_spline_fit (xfrac, s1[0], s1[1], s1[2], s1[3]);
-      p2 = cubic_spline_fit (xfrac, s2[0], s2[1], s2[2], s2[3]);
-      p3 = cubic_spline_fit (xfrac, s3[0], s3[1], s3[2], s3[3]);
-
-      sum = cubic_spline_fit (yfrac, p0, p1, p2, p3);
-
-      pixel[0]= CLAMP (sum, 0, 255);
-      break;
-
-    case 2:
-      p0 = cubic_spline_fit (xfrac, s0[1], s0[3], s0[5], s0[7]);
-      p1 = cubic_spline_fit (xfrac, s1[1], s1[3], s1[5], s1[7]);
-      p2 = cubic_spline_fit (xfrac, s2[1], s2[3], s2[5], s2[7]);
-      p3 = cubic_spline_fit (xfrac, s3[1], s3[3], s3[5], s3[7]);
-
-      alphasum = cubic_spline_fit (yfrac, p0, p1, p2, p3);
-
-      if (alphasum > 0)
-        {
-          p0 = cubic_spline_fit (xfrac,
-                                 s0[0] * s0[1], s0[2] * s0[3],
-                                 s0[4] * s0[5], s0[6] * s0[7]);
-          p1 = cubic_spline_fit (xfrac,
-                                 s1[0] * s1[1], s1[2] * s1[3],
-                                 s1[4] * s1[5], s1[6] * s1[7]);
-          p2 = cubic_spline_fit (xfrac,
-                                 s2[0] * s2[1], s2[2] * s2[3],
-                                 s2[4] * s2[5], s2[6] * s2[7]);
-          p3 = cubic_spline_fit (xfrac,
-                                 s3[0] * s3[1], s3[2] * s3[3],
-                                 s3[4] * s3[5], s3[6] * s3[7]);
-
-          sum  = cubic_spline_fit (yfrac, p0, p1, p2, p3);
-          sum /= alphasum;
-
-          pixel[0] = CLAMP (sum, 0, 255);
-          pixel[1] = CLAMP (alphasum, 0, 255);
-        }
-      else
-        {
-          pixel[0] = pixel[1] = 0;
-        }
-      break;
-
-    case 3:
-      for (b = 0; b < 3; b++)
-        {
-          p0 = cubic_spline_fit (xfrac, s0[b], s0[3 + b], s0[6 + b], s0[9 + b]);
-          p1 = cubic_spline_fit (xfrac, s1[b], s1[3 + b], s1[6 + b], s1[9 + b]);
-          p2 = cubic_spline_fit (xfrac, s2[b], s2[3 + b], s2[6 + b], s2[9 + b]);
-          p3 = cubic_spline_fit (xfrac, s3[b], s3[3 + b], s3[6 + b], s3[9 + b]);
-
-          sum = cubic_spline_fit (yfrac, p0, p1, p2, p3);
-
-          pixel[b] = CLAMP (sum, 0, 255);
-        }
-      break;
-
-    case 4:
-      p0 = cubic_spline_fit (xfrac, s0[3], s0[7], s0[11], s0[15]);
-      p1 = cubic_spline_fit (xfrac, s1[3], s1[7], s1[11], s1[15]);
-      p2 = cubic_spline_fit (xfrac, s2[3], s2[7], s2[11], s2[15]);
-      p3 = cubic_spline_fit (xfrac, s3[3], s3[7], s3[11], s3[15]);
-
-      alphasum = cubic_spline_fit (yfrac, p0, p1, p2, p3);
-
-      if (alphasum > 0)
-        {
-          for (b = 0; b < 3; b++)
-            {
-              p0 = cubic_spline_fit (xfrac,
-                                     s0[0 + b] * s0[ 3], s0[ 4 + b] * s0[7],
-                                     s0[8 + b] * s0[11], s0[12 + b] * s0[15]);
-              p1 = cubic_spline_fit (xfrac,
-                                     s1[0 + b] * s1[ 3], s1[ 4 + b] * s1[7],
-                                     s1[8 + b] * s1[11], s1[12 + b] * s1[15]);
-              p2 = cubic_spline_fit (xfrac,
-                                     s2[0 + b] * s2[ 3], s2[ 4 + b] * s2[7],
-                                     s2[8 + b] * s2[11], s2[12 + b] * s2[15]);
-              p3 = cubic_spline_fit (xfrac,
-                                     s3[0 + b] * s3[ 3], s3[ 4 + b] * s3[7],
-                                     s3[8 + b] * s3[11], s3[12 + b] * s3[15]);
-
-              sum  = cubic_spline_fit (yfrac, p0, p1, p2, p3);
-              sum /= alphasum;
-
-              pixel[b] = CLAMP (sum, 0, 255);
-            }
-
-          pixel[3] = CLAMP (alphasum, 0, 255);
-        }
-      else
-        {
-          pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
-        }
-      break;
-    }
-}
-
-static gdouble inline
-lanczos3_mul_alpha (const guchar  *pixels,
-                    const gdouble *x_kernel,
-                    const gdouble *y_kernel,
-                    const gint     stride,
-                    const gint     bytes,
-                    const gint     byte)
-{
-  const guchar *row   = pixels;
-  const guchar  alpha = bytes - 1;
-  gdouble       sum   = 0.0;
-  gint          x, y;
-
-  for (y = 0; y < 6; y++, row += stride)
-    {
-      const guchar *p      = row;
-      gdouble       tmpsum = 0.0;
-
-      for (x = 0; x < 6; x++, p += bytes)
-        {
-          tmpsum += x_kernel[x] * p[byte] * p[alpha];
-        }
-
-      tmpsum *= y_kernel[y];
-      sum    += tmpsum;
-    }
-
-  return sum;
-}
-
-static gdouble inline
-lanczos3_mul (const guchar  *pixels,
-              const gdouble *x_kernel,
-              const gdouble *y_kernel,
-              const gint     stride,
-              const gint     bytes,
-              const gint     byte)
-{
-  const guchar *row = pixels;
-  gdouble       sum = 0.0;
-  gint          x, y;
-
-  for (y = 0; y < 6; y++, row += stride)
-    {
-      const guchar *p = row;
-      gdouble       tmpsum = 0.0;
-
-      for (x = 0; x < 6; x++, p += bytes)
-        {
-          tmpsum += x_kernel[x] * p[byte];
-        }
-
-      tmpsum *= y_kernel[y];
-      sum    += tmpsum;
-    }
-
-  return sum;
-}
-
-static void
-interpolate_lanczos3 (PixelSurround *surround,
-                      const gint     x0,
-                      const gint     y0,
-                      const gdouble  xfrac,
-                      const gdouble  yfrac,
-                      const gint     bytes,
-                      guchar        *pixel,
-                      const gfloat  *kernel_lookup)
-{
-  gint          stride;
-  const guchar *src = pixel_surround_lock (surround, x0 - 2, y0 - 2, &stride);
-  const gint    x_shift    = (gint) (xfrac * LANCZOS_SPP + 0.5);
-  const gint    y_shift    = (gint) (yfrac * LANCZOS_SPP + 0.5);
-  gint          b, i;
-  gdouble       kx_sum, ky_sum;
-  gdouble       x_kernel[6];
-  gdouble       y_kernel[6];
-  gdouble       sum, alphasum;
-
-  kx_sum  = ky_sum = 0.0;
-
-  for (i = 3; i >= -2; i--)
-    {
-      gint pos = i * LANCZOS_SPP;
-
-      kx_sum += x_kernel[2 + i] = kernel_lookup[ABS (x_shift - pos)];
-      ky_sum += y_kernel[2 + i] = kernel_lookup[ABS (y_shift - pos)];
-    }
-
-  /* normalise the kernel arrays */
-  for (i = -2; i <= 3; i++)
-    {
-      x_kernel[2 + i] /= kx_sum;
-      y_kernel[2 + i] /= ky_sum;
-    }
-
-  switch (bytes)
-    {
-    case 1:
-      sum = lanczos3_mul (src, x_kernel, y_kernel, stride, 1, 0);
-
-      pixel[0] = CLAMP (sum, 0, 255);
-      break;
-
-    case 2:
-      alphasum  = lanczos3_mul (src, x_kernel, y_kernel, stride, 2, 1);
-      if (alphasum > 0)
-        {
-          sum = lanczos3_mul_alpha (src, x_kernel, y_kernel, stride, 2, 0);
-          sum /= alphasum;
-
-          pixel[0] = CLAMP (sum, 0, 255);
-          pixel[1] = CLAMP (alphasum, 0, 255);
-        }
-      else
-        {
-          pixel[0] = pixel[1] = 0;
-        }
-      break;
-
-    case 3:
-      for (b = 0; b < 3; b++)
-        {
-          sum = lanczos3_mul (src, x_kernel, y_kernel, stride, 3, b);
-
-          pixel[b] = CLAMP (sum, 0, 255);
-        }
-      break;
-
-    case 4:
-      alphasum = lanczos3_mul (src, x_kernel, y_kernel, stride, 4, 3);
-      if (alphasum > 0)
-        {
-          for (b = 0; b < 3; b++)
-            {
-              sum = lanczos3_mul_alpha (src, x_kernel, y_kernel, stride, 4, b);
-              sum /= alphasum;
-
-              pixel[b] = CLAMP (sum, 0, 255);
-            }
-
-          pixel[3] = CLAMP (alphasum, 0, 255);
-        }
-      else
-        {
-          pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
-        }
-      break;
-    }
-}
-
 static void
 scale_region_buffer (PixelRegion *srcPR,
                      PixelRegion *dstPR)
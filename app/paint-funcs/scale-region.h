@@ -31,6 +31,13 @@ void     scale_region          (PixelRegion           *srcPR,
                                 GimpInterpolationType  interpolation,
                                 GimpProgressFunc       progress_callback,
                                 gpointer               progress_data);
+void     scale_region_consume  (PixelRegion           *srcPR,
+                                PixelRegion           *destPR,
+                                GimpInterpolationType  interpolation,
+                                GimpProgressFunc       progress_callback,
+                                gpointer               progress_data);
+
+void     scale_region_setup    (void);
 
 gfloat * create_lanczos_lookup (void);
 
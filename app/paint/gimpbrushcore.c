@@ -1014,11 +1014,11 @@ gimp_brush_core_invalidate_cache (GimpBrush     *brush,
  ************************************************************/
 
 static inline void
-rotate_pointers (gulong  **p,
-                 guint32   n)
+rotate_pointers (guint32  **p,
+                 guint32    n)
 {
   guint32  i;
-  gulong  *tmp;
+  guint32 *tmp;
 
   tmp = p[0];
 
@@ -1046,9 +1046,8 @@ gimp_brush_core_subsample_mask (GimpBrushCore *core,
   const gint   *kernel;
   gint          i, j;
   gint          r, s;
-  gulong       *accum[KERNEL_HEIGHT];
+  guint32      *accum[KERNEL_HEIGHT];
   const guchar  empty = TRANSPARENT_OPACITY;
-  gint          offs;
 
   while (x < 0)
     x += mask->width;
@@ -1114,25 +1113,31 @@ gimp_brush_core_subsample_mask (GimpBrushCore *core,
 
   /* Allocate and initialize the accum buffer */
   for (i = 0; i < KERNEL_HEIGHT ; i++)
-    accum[i] = g_new0 (gulong, dest->width + 1);
+    accum[i] = g_new0 (guint32, dest->width + 1);
 
   core->subsample_brushes[index2][index1] = dest;
 
   m = temp_buf_get_data (mask);
   for (i = 0; i < mask->height; i++)
     {
-      for (j = 0; j < mask->width; j++)
-        {
-          k = kernel;
-          for (r = 0; r < KERNEL_HEIGHT; r++)
-            {
-              offs = j + dest_offset_x;
-              s = KERNEL_WIDTH;
-              while (s--)
-                accum[r][offs++] += *m * *k++;
-            }
-          m++;
-        }
+      /*  add the row once per kernel entry, the inner loop then runs
+       *  over contiguous memory and the compiler can vectorize it
+       */
+      k = kernel;
+      for (r = 0; r < KERNEL_HEIGHT; r++)
+        for (s = 0; s < KERNEL_WIDTH; s++, k++)
+          {
+            const guint32  kv = *k;
+            guint32       *a  = accum[r] + dest_offset_x + s;
+
+            if (kv == 0)
+              continue;
+
+            for (j = 0; j < mask->width; j++)
+              a[j] += m[j] * kv;
+          }
+
+      m += mask->width;
 
       /* store the accum buffer into the destination mask */
       d = temp_buf_get_data (dest) + (i + dest_offset_y) * dest->width;
@@ -1141,7 +1146,7 @@ gimp_brush_core_subsample_mask (GimpBrushCore *core,
 
       rotate_pointers (accum, KERNEL_HEIGHT);
 
-      memset (accum[KERNEL_HEIGHT - 1], 0, sizeof (gulong) * dest->width);
+      memset (accum[KERNEL_HEIGHT - 1], 0, sizeof (guint32) * dest->width);
     }
 
   /* store the rest of the accum buffer into the dest mask */
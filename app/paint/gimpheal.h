@@ -48,5 +48,18 @@ void    gimp_heal_register (Gimp                      *gimp,
 
 GType   gimp_heal_get_type (void) G_GNUC_CONST;
 
+void    gimp_heal_laplace_loop           (gdouble *matrix,
+                                          gint     height,
+                                          gint     depth,
+                                          gint     width,
+                                          gdouble *solution,
+                                          guchar  *mask);
+void    gimp_heal_laplace_loop_reference (gdouble *matrix,
+                                          gint     height,
+                                          gint     depth,
+                                          gint     width,
+                                          gdouble *solution,
+                                          guchar  *mask);
+
 
 #endif  /*  __GIMP_HEAL_H__  */
@@ -0,0 +1,349 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpcolor/gimpcolor.h"
+
+#include "widgets/widgets-types.h"
+
+#include "base/pixel-region.h"
+#include "base/tile-manager.h"
+
+#include "core/gimp.h"
+#include "core/gimpchannel.h"
+#include "core/gimpimage.h"
+#include "core/gimpimage-contiguous-region.h"
+#include "core/gimplayer.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define GIMP_TEST_IMAGE_SIZE       257
+#define GIMP_TEST_BENCHMARK_SIZE 10000
+#define GIMP_TEST_THRESHOLD         15
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-contiguous-region/" #function, gimp, function);
+
+
+typedef enum
+{
+  SMOOTH_PATTERN,
+  NOISY_PATTERN
+} PatternType;
+
+
+static GimpLayer *
+create_test_layer (GimpImage   *image,
+                   gint         size,
+                   PatternType  pattern)
+{
+  GimpLayer   *layer;
+  PixelRegion  pr;
+  guchar      *row;
+  GRand       *rand = g_rand_new_with_seed (42);
+  gint         x, y;
+
+  layer = gimp_layer_new (image, size, size, GIMP_RGB_IMAGE,
+                          "Test Layer", 1.0, GIMP_NORMAL_MODE);
+
+  gimp_image_add_layer (image, layer, GIMP_IMAGE_ACTIVE_PARENT, 0, FALSE);
+
+  pixel_region_init (&pr, gimp_drawable_get_tiles (GIMP_DRAWABLE (layer)),
+                     0, 0, size, size, TRUE);
+
+  row = g_new (guchar, size * 3);
+
+  for (y = 0; y < size; y++)
+    {
+      for (x = 0; x < size; x++)
+        {
+          guchar value;
+
+          if (pattern == SMOOTH_PATTERN)
+            {
+              /*  concentric rings with a soft gradient  */
+              gint dx = x - size / 2;
+              gint dy = y - size / 2;
+
+              value = ((dx * dx + dy * dy) / (size / 4 + 1)) & 0xff;
+            }
+          else
+            {
+              value = g_rand_int_range (rand, 0, 2 * GIMP_TEST_THRESHOLD);
+
+              /*  walls of unselectable pixels  */
+              if (g_rand_int_range (rand, 0, 4) == 0)
+                value = 255;
+            }
+
+          row[x * 3 + 0] = value;
+          row[x * 3 + 1] = value;
+          row[x * 3 + 2] = value;
+        }
+
+      pixel_region_set_row (&pr, 0, y, size, row);
+    }
+
+  g_free (row);
+  g_rand_free (rand);
+
+  return layer;
+}
+
+/*  a straightforward per-pixel flood fill to compare against  */
+static guchar *
+reference_fill (GimpLayer *layer,
+                gint       seed_x,
+                gint       seed_y)
+{
+  gint         width  = gimp_item_get_width  (GIMP_ITEM (layer));
+  gint         height = gimp_item_get_height (GIMP_ITEM (layer));
+  guchar      *src    = g_new (guchar, width * height * 3);
+  guchar      *mask   = g_new0 (guchar, width * height);
+  GArray      *stack  = g_array_new (FALSE, FALSE, sizeof (gint));
+  guchar       seed[3];
+
+  tile_manager_read_pixel_data (gimp_drawable_get_tiles (GIMP_DRAWABLE (layer)),
+                                0, 0, width - 1, height - 1,
+                                src, width * 3);
+
+  memcpy (seed, src + (seed_y * width + seed_x) * 3, 3);
+
+  g_array_append_val (stack, seed_x);
+  g_array_append_val (stack, seed_y);
+
+  while (stack->len > 0)
+    {
+      gint    x = g_array_index (stack, gint, stack->len - 2);
+      gint    y = g_array_index (stack, gint, stack->len - 1);
+      guchar *p;
+      gint    max = 0;
+      gint    b;
+
+      g_array_set_size (stack, stack->len - 2);
+
+      if (x < 0 || x >= width || y < 0 || y >= height || mask[y * width + x])
+        continue;
+
+      p = src + (y * width + x) * 3;
+
+      for (b = 0; b < 3; b++)
+        max = MAX (max, ABS (p[b] - seed[b]));
+
+      if (max > GIMP_TEST_THRESHOLD)
+        continue;
+
+      mask[y * width + x] = 255;
+
+#define PUSH(px,py) G_STMT_START {            \
+        gint _x = (px), _y = (py);            \
+        g_array_append_val (stack, _x);       \
+        g_array_append_val (stack, _y);       \
+      } G_STMT_END
+
+      PUSH (x - 1, y);
+      PUSH (x + 1, y);
+      PUSH (x, y - 1);
+      PUSH (x, y + 1);
+
+#undef PUSH
+    }
+
+  g_array_free (stack, TRUE);
+  g_free (src);
+
+  return mask;
+}
+
+static void
+check_fill (Gimp        *gimp,
+            PatternType  pattern)
+{
+  GimpImage   *image;
+  GimpLayer   *layer;
+  GimpChannel *mask;
+  guchar      *expected;
+  guchar      *actual;
+  gint         size = GIMP_TEST_IMAGE_SIZE;
+  gint         i;
+
+  image = gimp_image_new (gimp, size, size, GIMP_RGB);
+  layer = create_test_layer (image, size, pattern);
+
+  mask = gimp_image_contiguous_region_by_seed (image, GIMP_DRAWABLE (layer),
+                                               FALSE, FALSE,
+                                               GIMP_TEST_THRESHOLD,
+                                               FALSE,
+                                               GIMP_SELECT_CRITERION_COMPOSITE,
+                                               size / 2, size / 2);
+
+  expected = reference_fill (layer, size / 2, size / 2);
+  actual   = g_new (guchar, size * size);
+
+  tile_manager_read_pixel_data (gimp_drawable_get_tiles (GIMP_DRAWABLE (mask)),
+                                0, 0, size - 1, size - 1,
+                                actual, size);
+
+  for (i = 0; i < size * size; i++)
+    g_assert_cmpint (actual[i], ==, expected[i]);
+
+  g_free (actual);
+  g_free (expected);
+  g_object_unref (mask);
+  g_object_unref (image);
+}
+
+static void
+benchmark_fill (Gimp        *gimp,
+                PatternType  pattern)
+{
+  GimpImage   *image;
+  GimpLayer   *layer;
+  GimpChannel *mask;
+  GimpRGB      color;
+  GTimer      *timer;
+  gint         size = GIMP_TEST_BENCHMARK_SIZE;
+
+  image = gimp_image_new (gimp, size, size, GIMP_RGB);
+  layer = create_test_layer (image, size, pattern);
+
+  timer = g_timer_new ();
+
+  mask = gimp_image_contiguous_region_by_seed (image, GIMP_DRAWABLE (layer),
+                                               FALSE, TRUE,
+                                               GIMP_TEST_THRESHOLD,
+                                               FALSE,
+                                               GIMP_SELECT_CRITERION_COMPOSITE,
+                                               size / 2, size / 2);
+  g_test_minimized_result (g_timer_elapsed (timer, NULL),
+                           "contiguous region by seed: %gs",
+                           g_timer_elapsed (timer, NULL));
+  g_object_unref (mask);
+
+  gimp_rgba_set_uchar (&color, 0, 0, 0, 255);
+
+  g_timer_start (timer);
+  mask = gimp_image_contiguous_region_by_color (image, GIMP_DRAWABLE (layer),
+                                                FALSE, TRUE,
+                                                GIMP_TEST_THRESHOLD,
+                                                FALSE,
+                                                GIMP_SELECT_CRITERION_COMPOSITE,
+                                                &color);
+  g_test_minimized_result (g_timer_elapsed (timer, NULL),
+                           "contiguous region by color: %gs",
+                           g_timer_elapsed (timer, NULL));
+  g_object_unref (mask);
+
+  g_timer_destroy (timer);
+  g_object_unref (image);
+}
+
+/**
+ * fill_smooth:
+ * @data:
+ *
+ * Make sure the span fill selects exactly the pixels a naive
+ * four-connected flood fill selects on a smooth image.
+ **/
+static void
+fill_smooth (gconstpointer data)
+{
+  check_fill (GIMP (data), SMOOTH_PATTERN);
+}
+
+/**
+ * fill_noisy:
+ * @data:
+ *
+ * Same as fill_smooth(), but on noise with many small spans.
+ **/
+static void
+fill_noisy (gconstpointer data)
+{
+  check_fill (GIMP (data), NOISY_PATTERN);
+}
+
+/**
+ * benchmark_smooth:
+ * @data:
+ *
+ * Time seed and color selection on a large smooth image, only run
+ * with -m perf.
+ **/
+static void
+benchmark_smooth (gconstpointer data)
+{
+  if (g_test_perf ())
+    benchmark_fill (GIMP (data), SMOOTH_PATTERN);
+}
+
+/**
+ * benchmark_noisy:
+ * @data:
+ *
+ * Time seed and color selection on a large noisy image, only run
+ * with -m perf.
+ **/
+static void
+benchmark_noisy (gconstpointer data)
+{
+  if (g_test_perf ())
+    benchmark_fill (GIMP (data), NOISY_PATTERN);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_thread_init (NULL);
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  /* We share the same application instance across all tests */
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (fill_smooth);
+  ADD_TEST (fill_noisy);
+  ADD_TEST (benchmark_smooth);
+  ADD_TEST (benchmark_noisy);
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Exit so we don't break script-fu plug-in wire */
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
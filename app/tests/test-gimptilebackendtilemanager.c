@@ -0,0 +1,278 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * test-gimptilebackendtilemanager.c
+ * Copyright (C) 2011 Martin Nordholts <martinn@src.gnome.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+#include <string.h>
+
+#include "widgets/widgets-types.h"
+
+#include "base/tile.h"
+#include "base/tile-private.h"
+#include "base/tile-manager.h"
+#include "base/pixel-region.h"
+#include "base/tile-cache.h"
+
+#include "gegl/gimptilebackendtilemanager.h"
+
+#include "paint-funcs/paint-funcs.h"
+
+#include "tests.h"
+#include "gimp-app-test-utils.h"
+
+
+#define ADD_TEST(function) \
+  g_test_add_func ("/gimptilebackendtilemanager/" #function, function);
+
+
+/**
+ * basic_usage:
+ * @fixture:
+ * @data:
+ *
+ * Test basic usage.
+ **/
+static void
+basic_usage (void)
+{
+  GeglRectangle rect                = { 0, 0, 10, 10 };
+  GeglRectangle pixel_rect          = { 5, 5, 1, 1 };
+  guchar        opaque_magenta8[4]  = { 0xff, 0, 0xff, 0xff };
+  guint16       opaque_magenta16[4] = { 0xffff, 0, 0xffff, 0xffff };
+
+  PixelRegion      pr;
+  TileManager     *tm;
+  GeglTileBackend *backend;
+  GeglBuffer      *buffer;
+  guint16          actual_data[4];
+
+  /* Write some pixels to the tile manager */
+  tm = tile_manager_new (rect.width, rect.height, 4);
+  pixel_region_init (&pr, tm, rect.x, rect.y, rect.width, rect.height, TRUE);
+  color_region (&pr, opaque_magenta8);
+
+  /* Make sure we can read them through the GeglBuffer using the
+   * TileManager backend. Use u16 to complicate code paths, decreasing
+   * risk of the test accidentally passing
+   */
+  backend = gimp_tile_backend_tile_manager_new (tm, FALSE, FALSE);
+  buffer  = gegl_buffer_new_for_backend (NULL, backend);
+  gegl_buffer_get (buffer,
+                   &pixel_rect, 1.0 /*scale*/,
+                   babl_format ("RGBA u16"), actual_data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  g_assert_cmpint (0, ==, memcmp (opaque_magenta16, actual_data, sizeof (actual_data)));
+}
+
+/**
+ * zero_copy:
+ *
+ * Make sure the tiles handed to GEGL use the memory of the tile
+ * manager, except for the edge tiles which need to be padded.
+ **/
+static void
+zero_copy (void)
+{
+  GeglRectangle    rect = { 0, 0, 2 * TILE_WIDTH + 10, TILE_HEIGHT };
+  TileManager     *tm;
+  GeglTileBackend *backend;
+  GList           *tiles;
+  GList           *list;
+  gint             x;
+
+  tm      = tile_manager_new (rect.width, rect.height, 4);
+  backend = gimp_tile_backend_tile_manager_new (tm, FALSE, FALSE);
+  tiles   = gimp_tile_backend_tile_manager_get_tiles (backend, &rect);
+
+  g_assert_cmpint (g_list_length (tiles), ==, 3);
+
+  for (list = tiles, x = 0; list; list = g_list_next (list), x++)
+    {
+      Tile *tile = tile_manager_get_at (tm, x, 0, TRUE, FALSE);
+
+      if (x < 2)
+        g_assert (gegl_tile_get_data (list->data) ==
+                  tile_data_pointer (tile, 0, 0));
+      else
+        g_assert (gegl_tile_get_data (list->data) !=
+                  tile_data_pointer (tile, 0, 0));
+
+      tile_release (tile, FALSE);
+    }
+
+  g_list_free_full (tiles, (GDestroyNotify) gegl_tile_unref);
+  g_object_unref (backend);
+  tile_manager_unref (tm);
+}
+
+/**
+ * zero_copy_buffer:
+ *
+ * Make sure a GeglBuffer on the backend reads the tile manager's own
+ * memory: pixels changed in the tile manager after GEGL fetched the
+ * tile show up in the buffer without GEGL fetching it again.
+ **/
+static void
+zero_copy_buffer (void)
+{
+  GeglRectangle    rect              = { 0, 0, TILE_WIDTH, TILE_HEIGHT };
+  GeglRectangle    pixel_rect        = { 5, 5, 1, 1 };
+  guchar           transparent[4]    = { 0, 0, 0, 0 };
+  guchar           opaque_magenta[4] = { 0xff, 0, 0xff, 0xff };
+  PixelRegion      pr;
+  TileManager     *tm;
+  GeglTileBackend *backend;
+  GeglBuffer      *buffer;
+  guchar           actual_data[4];
+
+  tm = tile_manager_new (rect.width, rect.height, 4);
+  pixel_region_init (&pr, tm, rect.x, rect.y, rect.width, rect.height, TRUE);
+  color_region (&pr, transparent);
+
+  backend = gimp_tile_backend_tile_manager_new (tm, FALSE, FALSE);
+  buffer  = gegl_buffer_new_for_backend (NULL, backend);
+
+  gegl_buffer_get (buffer, &pixel_rect, 1.0, babl_format ("R'G'B'A u8"),
+                   actual_data, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  g_assert_cmpint (0, ==, memcmp (transparent, actual_data, 4));
+
+  pixel_region_init (&pr, tm, rect.x, rect.y, rect.width, rect.height, TRUE);
+  color_region (&pr, opaque_magenta);
+
+  gegl_buffer_get (buffer, &pixel_rect, 1.0, babl_format ("R'G'B'A u8"),
+                   actual_data, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  g_assert_cmpint (0, ==, memcmp (opaque_magenta, actual_data, 4));
+
+  g_object_unref (buffer);
+  g_object_unref (backend);
+  tile_manager_unref (tm);
+}
+
+/**
+ * tiles_locked_while_held:
+ *
+ * Make sure the aliased tiles stay locked for as long as GEGL holds on
+ * to them and are released when the buffer goes away, and that the
+ * copied edge tiles are released right away.
+ **/
+static void
+tiles_locked_while_held (void)
+{
+  GeglRectangle    rect = { 0, 0, 2 * TILE_WIDTH + 10, TILE_HEIGHT };
+  TileManager     *tm;
+  GeglTileBackend *backend;
+  GeglBuffer      *buffer;
+  guchar          *data;
+  gint             x;
+
+  tm      = tile_manager_new (rect.width, rect.height, 4);
+  backend = gimp_tile_backend_tile_manager_new (tm, FALSE, FALSE);
+  buffer  = gegl_buffer_new_for_backend (NULL, backend);
+
+  data = g_new (guchar, rect.width * rect.height * 4);
+
+  gegl_buffer_get (buffer, &rect, 1.0, babl_format ("R'G'B'A u8"), data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (x = 0; x < 3; x++)
+    {
+      Tile *tile = tile_manager_get_at (tm, x, 0, TRUE, FALSE);
+
+      g_assert_cmpint (tile->ref_count, ==, x < 2 ? 2 : 1);
+
+      tile_release (tile, FALSE);
+    }
+
+  g_object_unref (buffer);
+  g_object_unref (backend);
+
+  for (x = 0; x < 3; x++)
+    {
+      Tile *tile = tile_manager_get_at (tm, x, 0, TRUE, FALSE);
+
+      g_assert_cmpint (tile->ref_count, ==, 1);
+
+      tile_release (tile, FALSE);
+    }
+
+  g_free (data);
+  tile_manager_unref (tm);
+}
+
+/**
+ * write_back:
+ *
+ * Make sure pixels written to a GeglBuffer on a writable backend end
+ * up in the tile manager, in full tiles as well as in edge tiles.
+ **/
+static void
+write_back (void)
+{
+  GeglRectangle    rect              = { 0, 0, TILE_WIDTH + 10, 10 };
+  guchar           opaque_magenta[4] = { 0xff, 0, 0xff, 0xff };
+  TileManager     *tm;
+  GeglTileBackend *backend;
+  GeglBuffer      *buffer;
+  guchar          *data;
+  gint             i;
+
+  tm      = tile_manager_new (rect.width, rect.height, 4);
+  backend = gimp_tile_backend_tile_manager_new (tm, FALSE, TRUE);
+  buffer  = gegl_buffer_new_for_backend (NULL, backend);
+
+  data = g_new (guchar, rect.width * rect.height * 4);
+
+  for (i = 0; i < rect.width * rect.height; i++)
+    memcpy (data + i * 4, opaque_magenta, 4);
+
+  gegl_buffer_set (buffer, &rect, 0, babl_format ("R'G'B'A u8"),
+                   data, GEGL_AUTO_ROWSTRIDE);
+  g_object_unref (buffer);
+  g_object_unref (backend);
+
+  memset (data, 0, rect.width * rect.height * 4);
+
+  tile_manager_read_pixel_data (tm, 0, 0, rect.width - 1, rect.height - 1,
+                                data, rect.width * 4);
+
+  for (i = 0; i < rect.width * rect.height; i++)
+    g_assert_cmpint (0, ==, memcmp (opaque_magenta, data + i * 4, 4));
+
+  g_free (data);
+  tile_manager_unref (tm);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_type_init ();
+  tile_cache_init (G_MAXUINT32);
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  ADD_TEST (basic_usage);
+  ADD_TEST (zero_copy);
+  ADD_TEST (zero_copy_buffer);
+  ADD_TEST (tiles_locked_while_held);
+  ADD_TEST (write_back);
+
+  return g_test_run ();
+}
@@ -0,0 +1,221 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "widgets/widgets-types.h"
+
+#include "core/gimp.h"
+
+#include "paint/gimpheal.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define GIMP_TEST_DAB_SIZE      64
+#define GIMP_TEST_DAB_DEPTH      3
+#define GIMP_TEST_MAX_ERROR      0.1
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-heal/" #function, gimp, function);
+
+
+typedef struct
+{
+  gint     size;
+  gint     depth;
+  gdouble *matrix;
+  guchar  *mask;
+} Dab;
+
+
+/*  a round brush mask on a noisy difference image, the mask stays
+ *  clear of the border like the masks of real brushes do
+ */
+static Dab *
+dab_new (gint size,
+         gint depth)
+{
+  Dab     *dab    = g_slice_new (Dab);
+  GRand   *rand   = g_rand_new_with_seed (42);
+  gdouble  radius = size / 2.0 - 2.0;
+  gint     x, y, k;
+
+  dab->size   = size;
+  dab->depth  = depth;
+  dab->matrix = g_new (gdouble, size * size * depth);
+  dab->mask   = g_new (guchar, size * size);
+
+  for (y = 0; y < size; y++)
+    for (x = 0; x < size; x++)
+      {
+        gdouble dx = x - size / 2.0 + 0.5;
+        gdouble dy = y - size / 2.0 + 0.5;
+
+        dab->mask[y * size + x] = (dx * dx + dy * dy < SQR (radius)) ? 255 : 0;
+
+        for (k = 0; k < depth; k++)
+          dab->matrix[(y * size + x) * depth + k] =
+            g_rand_int_range (rand, -100, 100) + 50.0 * sin (x * 0.1 * (k + 1));
+      }
+
+  g_rand_free (rand);
+
+  return dab;
+}
+
+static void
+dab_free (Dab *dab)
+{
+  g_free (dab->matrix);
+  g_free (dab->mask);
+
+  g_slice_free (Dab, dab);
+}
+
+static gdouble *
+dab_solve (Dab      *dab,
+           gboolean  reference)
+{
+  gint     n        = dab->size * dab->size * dab->depth;
+  gdouble *matrix   = g_memdup (dab->matrix, n * sizeof (gdouble));
+  gdouble *solution = g_new (gdouble, n);
+
+  if (reference)
+    gimp_heal_laplace_loop_reference (matrix, dab->size, dab->depth, dab->size,
+                                      solution, dab->mask);
+  else
+    gimp_heal_laplace_loop (matrix, dab->size, dab->depth, dab->size,
+                            solution, dab->mask);
+
+  g_free (matrix);
+
+  return solution;
+}
+
+/**
+ * multigrid_matches_reference:
+ * @data:
+ *
+ * Make sure the multigrid solver finds the same solution as the
+ * Gauss-Seidel solver, on a dab small enough for the latter to
+ * converge.
+ **/
+static void
+multigrid_matches_reference (gconstpointer data)
+{
+  Dab     *dab       = dab_new (GIMP_TEST_DAB_SIZE, GIMP_TEST_DAB_DEPTH);
+  gdouble *solution  = dab_solve (dab, FALSE);
+  gdouble *reference = dab_solve (dab, TRUE);
+  gint     i;
+
+  for (i = 0; i < dab->size * dab->size * dab->depth; i++)
+    {
+      if (dab->mask[i / dab->depth])
+        g_assert_cmpfloat (fabs (solution[i] - reference[i]), <,
+                           GIMP_TEST_MAX_ERROR);
+      else
+        g_assert_cmpfloat (solution[i], ==, dab->matrix[i]);
+    }
+
+  g_free (reference);
+  g_free (solution);
+  dab_free (dab);
+}
+
+/**
+ * benchmark_dab_size:
+ * @data:
+ *
+ * Time both solvers for growing brush sizes, only run with -m perf.
+ **/
+static void
+benchmark_dab_size (gconstpointer data)
+{
+  GTimer *timer;
+  gint    size;
+
+  if (! g_test_perf ())
+    return;
+
+  timer = g_timer_new ();
+
+  for (size = 32; size <= 512; size *= 2)
+    {
+      Dab     *dab = dab_new (size, GIMP_TEST_DAB_DEPTH);
+      gdouble *solution;
+
+      g_timer_start (timer);
+      solution = dab_solve (dab, FALSE);
+      g_test_minimized_result (g_timer_elapsed (timer, NULL),
+                               "multigrid, %d pixel dab: %gs",
+                               size, g_timer_elapsed (timer, NULL));
+      g_free (solution);
+
+      g_timer_start (timer);
+      solution = dab_solve (dab, TRUE);
+      g_test_minimized_result (g_timer_elapsed (timer, NULL),
+                               "gauss-seidel, %d pixel dab: %gs",
+                               size, g_timer_elapsed (timer, NULL));
+      g_free (solution);
+
+      dab_free (dab);
+    }
+
+  g_timer_destroy (timer);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_thread_init (NULL);
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  /* We share the same application instance across all tests */
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (multigrid_matches_reference);
+  ADD_TEST (benchmark_dab_size);
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Exit so we don't break script-fu plug-in wire */
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
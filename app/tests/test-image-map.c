@@ -0,0 +1,289 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "widgets/widgets-types.h"
+
+#include "base/pixel-region.h"
+#include "base/tile-manager.h"
+
+#include "core/gimp.h"
+#include "core/gimpimage.h"
+#include "core/gimpimagemap.h"
+#include "core/gimplayer.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+/*  large enough for the image map to preview the visible area with a
+ *  subsampled proxy first, PROXY_PIXELS in gimpimagemap.c is the
+ *  largest chunk it may write back at once
+ */
+#define GIMP_TEST_IMAGE_WIDTH  1200
+#define GIMP_TEST_IMAGE_HEIGHT 1000
+#define GIMP_TEST_PROXY_PIXELS (512 * 512)
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-image-map/" #function, gimp, function);
+
+
+typedef struct
+{
+  GimpImage    *image;
+  GimpLayer    *layer;
+  GimpImageMap *image_map;
+  guchar       *original;
+  gint          n_flushes;
+} MapTest;
+
+
+static void
+invert_func (gpointer     data,
+             PixelRegion *srcPR,
+             PixelRegion *destPR)
+{
+  const guchar *src  = srcPR->data;
+  guchar       *dest = destPR->data;
+  gint          x, y;
+
+  for (y = 0; y < srcPR->h; y++)
+    {
+      for (x = 0; x < srcPR->w * srcPR->bytes; x++)
+        dest[x] = 255 - src[x];
+
+      src  += srcPR->rowstride;
+      dest += destPR->rowstride;
+    }
+}
+
+static void
+image_map_flush (GimpImageMap *image_map,
+                 MapTest      *test)
+{
+  test->n_flushes++;
+}
+
+static guchar *
+read_layer (MapTest *test)
+{
+  guchar *data = g_new (guchar,
+                        GIMP_TEST_IMAGE_WIDTH * GIMP_TEST_IMAGE_HEIGHT * 3);
+
+  tile_manager_read_pixel_data (gimp_drawable_get_tiles (GIMP_DRAWABLE (test->layer)),
+                                0, 0,
+                                GIMP_TEST_IMAGE_WIDTH  - 1,
+                                GIMP_TEST_IMAGE_HEIGHT - 1,
+                                data, GIMP_TEST_IMAGE_WIDTH * 3);
+
+  return data;
+}
+
+/*  the number of pixels that differ from the original  */
+static gint
+count_changed (MapTest *test)
+{
+  guchar *data    = read_layer (test);
+  gint    changed = 0;
+  gint    i;
+
+  for (i = 0; i < GIMP_TEST_IMAGE_WIDTH * GIMP_TEST_IMAGE_HEIGHT; i++)
+    if (memcmp (data + i * 3, test->original + i * 3, 3))
+      changed++;
+
+  g_free (data);
+
+  return changed;
+}
+
+static void
+run_until_flushed (MapTest *test,
+                   gint     n_flushes)
+{
+  while (test->n_flushes < n_flushes)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+map_test_init (MapTest *test,
+               Gimp    *gimp)
+{
+  GeglRectangle  visible = { 0, 0,
+                             GIMP_TEST_IMAGE_WIDTH, GIMP_TEST_IMAGE_HEIGHT };
+  PixelRegion    pr;
+  guchar        *row;
+  gint           x, y;
+
+  test->image = gimp_image_new (gimp,
+                                GIMP_TEST_IMAGE_WIDTH, GIMP_TEST_IMAGE_HEIGHT,
+                                GIMP_RGB);
+  test->layer = gimp_layer_new (test->image,
+                                GIMP_TEST_IMAGE_WIDTH, GIMP_TEST_IMAGE_HEIGHT,
+                                GIMP_RGB_IMAGE,
+                                "Test Layer", 1.0, GIMP_NORMAL_MODE);
+
+  gimp_image_add_layer (test->image, test->layer,
+                        GIMP_IMAGE_ACTIVE_PARENT, 0, FALSE);
+
+  pixel_region_init (&pr, gimp_drawable_get_tiles (GIMP_DRAWABLE (test->layer)),
+                     0, 0, GIMP_TEST_IMAGE_WIDTH, GIMP_TEST_IMAGE_HEIGHT,
+                     TRUE);
+
+  row = g_new (guchar, GIMP_TEST_IMAGE_WIDTH * 3);
+
+  for (y = 0; y < GIMP_TEST_IMAGE_HEIGHT; y++)
+    {
+      for (x = 0; x < GIMP_TEST_IMAGE_WIDTH; x++)
+        {
+          row[x * 3 + 0] = x * 7 + y * 3;
+          row[x * 3 + 1] = x + y * 5;
+          row[x * 3 + 2] = x ^ y;
+        }
+
+      pixel_region_set_row (&pr, 0, y, GIMP_TEST_IMAGE_WIDTH, row);
+    }
+
+  g_free (row);
+
+  test->original  = read_layer (test);
+  test->n_flushes = 0;
+
+  test->image_map = gimp_image_map_new (GIMP_DRAWABLE (test->layer),
+                                        "Invert", NULL,
+                                        invert_func, NULL);
+
+  g_signal_connect (test->image_map, "flush",
+                    G_CALLBACK (image_map_flush),
+                    test);
+
+  gimp_image_map_apply (test->image_map, &visible);
+}
+
+static void
+map_test_finish (MapTest *test)
+{
+  g_object_unref (test->image_map);
+  g_object_unref (test->image);
+  g_free (test->original);
+}
+
+/**
+ * proxy_chunked:
+ * @data:
+ *
+ * Make sure the subsampled preview of a large visible area is written
+ * back in chunks, one per idle callback, and that aborting the image
+ * map stops it and restores the original pixels.
+ **/
+static void
+proxy_chunked (gconstpointer data)
+{
+  MapTest test;
+  gint    changed;
+
+  map_test_init (&test, GIMP (data));
+
+  /*  the first idle callback only computes the proxy  */
+  run_until_flushed (&test, 1);
+  g_assert_cmpint (count_changed (&test), ==, 0);
+
+  /*  the next one writes back one chunk of it  */
+  run_until_flushed (&test, 2);
+  changed = count_changed (&test);
+  g_assert_cmpint (changed, >, 0);
+  g_assert_cmpint (changed, <=, GIMP_TEST_PROXY_PIXELS);
+
+  gimp_image_map_abort (test.image_map);
+  g_assert_cmpint (count_changed (&test), ==, 0);
+
+  while (g_main_context_pending (NULL))
+    g_main_context_iteration (NULL, FALSE);
+
+  g_assert_cmpint (test.n_flushes, ==, 2);
+  g_assert_cmpint (count_changed (&test), ==, 0);
+
+  map_test_finish (&test);
+}
+
+/**
+ * proxy_commit:
+ * @data:
+ *
+ * Make sure committing while the proxy is shown gives the full
+ * resolution result everywhere.
+ **/
+static void
+proxy_commit (gconstpointer data)
+{
+  MapTest  test;
+  guchar  *result;
+  gint     i;
+
+  map_test_init (&test, GIMP (data));
+
+  run_until_flushed (&test, 2);
+
+  gimp_image_map_commit (test.image_map);
+
+  result = read_layer (&test);
+
+  for (i = 0; i < GIMP_TEST_IMAGE_WIDTH * GIMP_TEST_IMAGE_HEIGHT * 3; i++)
+    g_assert_cmpint (result[i], ==, 255 - test.original[i]);
+
+  g_free (result);
+
+  map_test_finish (&test);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_thread_init (NULL);
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  /* We share the same application instance across all tests */
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (proxy_chunked);
+  ADD_TEST (proxy_commit);
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Exit so we don't break script-fu plug-in wire */
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
@@ -0,0 +1,1688 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpmath/gimpmath.h"
+
+#include "widgets/widgets-types.h"
+
+#include "base/pixel-region.h"
+#include "base/tile-manager.h"
+
+#include "paint-funcs/paint-funcs.h"
+#include "paint-funcs/paint-funcs-sse2.h"
+#include "paint-funcs/scale-region.h"
+
+#include "core/gimp.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define GIMP_TEST_DAB_SIZE        253
+#define GIMP_TEST_BENCHMARK_TIME    1.0
+#define GIMP_TEST_MASK_WIDTH       97
+#define GIMP_TEST_MASK_HEIGHT      83
+#define GIMP_TEST_BENCHMARK_MASK 4000
+#define GIMP_TEST_LEVELS_WIDTH    241
+#define GIMP_TEST_LEVELS_HEIGHT   199
+#define GIMP_TEST_FEATHER_WIDTH   301
+#define GIMP_TEST_FEATHER_HEIGHT  211
+#define GIMP_TEST_FEATHER_ERROR     4
+#define GIMP_TEST_BENCHMARK_SCALE 4000
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-paint-funcs/" #function, gimp, function);
+
+
+typedef enum
+{
+  APPLY_MASK,
+  COMBINE_STIPPLE,
+  COMBINE_STROKE
+} DabOperation;
+
+
+typedef enum
+{
+  GROW,
+  SHRINK,
+  BORDER,
+  BORDER_FEATHER
+} MaskOperation;
+
+
+typedef struct
+{
+  gint    size;
+  gint    bytes;
+  guchar *canvas;
+  guchar *mask;
+} Dab;
+
+
+/*  a soft round brush mask over a canvas that is partly painted
+ *  already, the odd size leaves pixels over at the end of each row
+ */
+static Dab *
+dab_new (gint size,
+         gint bytes)
+{
+  Dab   *dab  = g_slice_new (Dab);
+  GRand *rand = g_rand_new_with_seed (42);
+  gint   x, y, b;
+
+  dab->size   = size;
+  dab->bytes  = bytes;
+  dab->canvas = g_new (guchar, size * size * bytes);
+  dab->mask   = g_new (guchar, size * size);
+
+  for (y = 0; y < size; y++)
+    for (x = 0; x < size; x++)
+      {
+        gdouble dx = x - size / 2.0 + 0.5;
+        gdouble dy = y - size / 2.0 + 0.5;
+        gdouble r  = sqrt (dx * dx + dy * dy) / (size / 2.0);
+
+        dab->mask[y * size + x] = 255.0 * CLAMP (1.0 - r * r, 0.0, 1.0) + 0.5;
+
+        for (b = 0; b < bytes; b++)
+          dab->canvas[(y * size + x) * bytes + b] =
+            g_rand_int_range (rand, 0, 256);
+      }
+
+  g_rand_free (rand);
+
+  return dab;
+}
+
+static void
+dab_free (Dab *dab)
+{
+  g_free (dab->canvas);
+  g_free (dab->mask);
+
+  g_slice_free (Dab, dab);
+}
+
+static void
+dab_paint (Dab          *dab,
+           DabOperation  operation,
+           guint         opacity)
+{
+  PixelRegion srcPR;
+  PixelRegion maskPR;
+
+  pixel_region_init_data (&srcPR, dab->canvas, dab->bytes,
+                          dab->size * dab->bytes,
+                          0, 0, dab->size, dab->size);
+  pixel_region_init_data (&maskPR, dab->mask, 1, dab->size,
+                          0, 0, dab->size, dab->size);
+
+  if (operation == APPLY_MASK)
+    apply_mask_to_region (&srcPR, &maskPR, opacity);
+  else
+    combine_mask_and_region (&srcPR, &maskPR, opacity,
+                             operation == COMBINE_STIPPLE);
+}
+
+/*  the same operation one row at a time, using the plain C functions  */
+static guchar *
+dab_paint_reference (Dab          *dab,
+                     DabOperation  operation,
+                     guint         opacity)
+{
+  guchar *canvas = g_memdup (dab->canvas, dab->size * dab->size * dab->bytes);
+  gint    y;
+
+  for (y = 0; y < dab->size; y++)
+    {
+      guchar       *s = canvas + y * dab->size * dab->bytes;
+      const guchar *m = dab->mask + y * dab->size;
+
+      switch (operation)
+        {
+        case APPLY_MASK:
+          apply_mask_to_alpha_channel (s, m, opacity, dab->size, dab->bytes);
+          break;
+
+        case COMBINE_STIPPLE:
+          combine_mask_and_alpha_channel_stipple (s, m, opacity,
+                                                  dab->size, dab->bytes);
+          break;
+
+        case COMBINE_STROKE:
+          combine_mask_and_alpha_channel_stroke (s, m, opacity,
+                                                 dab->size, dab->bytes);
+          break;
+        }
+    }
+
+  return canvas;
+}
+
+static void
+check_dab (DabOperation operation,
+           gint         bytes)
+{
+  const guint opacities[] = { 0, 1, 77, 128, 254, 255 };
+  gint        i;
+
+  for (i = 0; i < G_N_ELEMENTS (opacities); i++)
+    {
+      Dab    *dab      = dab_new (GIMP_TEST_DAB_SIZE, bytes);
+      guchar *expected = dab_paint_reference (dab, operation, opacities[i]);
+
+      dab_paint (dab, operation, opacities[i]);
+
+      g_assert (memcmp (dab->canvas, expected,
+                        dab->size * dab->size * bytes) == 0);
+
+      g_free (expected);
+      dab_free (dab);
+    }
+}
+
+#if defined(USE_SSE2)
+
+/*  the same operation one row at a time, using the SSE2 functions  */
+static void
+dab_paint_sse2 (Dab          *dab,
+                DabOperation  operation,
+                guint         opacity)
+{
+  gint y;
+
+  for (y = 0; y < dab->size; y++)
+    {
+      guchar       *s = dab->canvas + y * dab->size * dab->bytes;
+      const guchar *m = dab->mask + y * dab->size;
+
+      switch (operation)
+        {
+        case APPLY_MASK:
+          apply_mask_to_alpha_channel_sse2 (s, m, opacity,
+                                            dab->size, dab->bytes);
+          break;
+
+        case COMBINE_STIPPLE:
+          combine_mask_and_alpha_channel_stipple_sse2 (s, m, opacity,
+                                                       dab->size, dab->bytes);
+          break;
+
+        case COMBINE_STROKE:
+          combine_mask_and_alpha_channel_stroke_sse2 (s, m, opacity,
+                                                      dab->size, dab->bytes);
+          break;
+        }
+    }
+}
+
+static void
+check_dab_sse2 (DabOperation operation,
+                gint         bytes)
+{
+  const guint opacities[] = { 0, 1, 77, 128, 254, 255 };
+  gint        i;
+
+  for (i = 0; i < G_N_ELEMENTS (opacities); i++)
+    {
+      Dab    *dab      = dab_new (GIMP_TEST_DAB_SIZE, bytes);
+      guchar *expected = dab_paint_reference (dab, operation, opacities[i]);
+
+      dab_paint_sse2 (dab, operation, opacities[i]);
+
+      g_assert (memcmp (dab->canvas, expected,
+                        dab->size * dab->size * bytes) == 0);
+
+      g_free (expected);
+      dab_free (dab);
+    }
+}
+
+#endif /* USE_SSE2 */
+
+static gboolean
+have_sse2 (void)
+{
+#if defined(USE_SSE2)
+  if (gimp_cpu_accel_get_support () & GIMP_CPU_ACCEL_X86_SSE2)
+    return TRUE;
+#endif
+
+  return FALSE;
+}
+
+static void
+benchmark_dab (DabOperation  operation,
+               gint          bytes,
+               const gchar  *name)
+{
+  GTimer *timer = g_timer_new ();
+  gint    size;
+
+  for (size = 256; size <= 512; size *= 2)
+    {
+      Dab *dab   = dab_new (size, bytes);
+      gint count = 0;
+
+      g_timer_start (timer);
+
+      while (g_timer_elapsed (timer, NULL) < GIMP_TEST_BENCHMARK_TIME)
+        {
+          dab_paint (dab, operation, 200);
+          count++;
+        }
+
+      g_test_maximized_result (count / g_timer_elapsed (timer, NULL),
+                               "%s, %d pixel dab: %g dabs/s", name, size,
+                               count / g_timer_elapsed (timer, NULL));
+
+      dab_free (dab);
+    }
+
+  g_timer_destroy (timer);
+}
+
+/*  a few selected discs, some of them with soft edges  */
+static guchar *
+mask_new (gint width,
+          gint height)
+{
+  guchar *mask = g_new0 (guchar, width * height);
+  GRand  *rand = g_rand_new_with_seed (42);
+  gint    i, x, y;
+
+  for (i = 0; i < 6; i++)
+    {
+      gint     cx     = g_rand_int_range (rand, 0, width);
+      gint     cy     = g_rand_int_range (rand, 0, height);
+      gdouble  radius = g_rand_double_range (rand, 2.0, width / 4.0);
+      gboolean soft   = i % 2;
+
+      for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+          {
+            gdouble d = sqrt (SQR (x - cx) + SQR (y - cy)) - radius;
+            guchar  v;
+
+            if (soft)
+              v = 255.0 * CLAMP (0.5 - d / 4.0, 0.0, 1.0);
+            else
+              v = d < 0.0 ? 255 : 0;
+
+            mask[y * width + x] = MAX (mask[y * width + x], v);
+          }
+    }
+
+  g_rand_free (rand);
+
+  return mask;
+}
+
+static void
+mask_apply (guchar        *mask,
+            gint           width,
+            gint           height,
+            MaskOperation  operation,
+            gint           xradius,
+            gint           yradius)
+{
+  PixelRegion region;
+
+  pixel_region_init_data (&region, mask, 1, width, 0, 0, width, height);
+
+  switch (operation)
+    {
+    case GROW:
+      fatten_region (&region, xradius, yradius);
+      break;
+
+    case SHRINK:
+      thin_region (&region, xradius, yradius, FALSE);
+      break;
+
+    case BORDER:
+    case BORDER_FEATHER:
+      border_region (&region, xradius, yradius,
+                     operation == BORDER_FEATHER, FALSE);
+      break;
+    }
+}
+
+static gboolean
+mask_get (const guchar *mask,
+          gint          width,
+          gint          height,
+          gint          x,
+          gint          y,
+          guchar       *value)
+{
+  if (x < 0 || x >= width || y < 0 || y >= height)
+    return FALSE;
+
+  *value = mask[y * width + x];
+
+  return TRUE;
+}
+
+/*  pixels that are selected and have unselected neighbours  */
+static gboolean
+mask_is_transition (const guchar *mask,
+                    gint          width,
+                    gint          height,
+                    gint          x,
+                    gint          y)
+{
+  guchar v;
+  gint   dx, dy;
+
+  if (! mask_get (mask, width, height, x, y, &v) || v < 128)
+    return FALSE;
+
+  for (dy = -1; dy <= 1; dy++)
+    for (dx = -1; dx <= 1; dx++)
+      if (! mask_get (mask, width, height, x + dx, y + dy, &v) || v < 128)
+        return TRUE;
+
+  return FALSE;
+}
+
+/*  the operations written down straight from their definition, the
+ *  pixels around the mask count as unselected
+ */
+static guchar *
+mask_apply_reference (const guchar  *mask,
+                      gint           width,
+                      gint           height,
+                      MaskOperation  operation,
+                      gint           xradius,
+                      gint           yradius)
+{
+  guchar *result = g_new (guchar, width * height);
+  gint   *circ   = g_new (gint, xradius + 1);
+  gint    x, y, dx, dy;
+
+  for (dx = 0; dx <= xradius; dx++)
+    {
+      gdouble tmp = dx > 0 ? dx - 0.5 : 0.0;
+
+      circ[dx] = RINT (yradius / (gdouble) xradius *
+                       sqrt (SQR (xradius) - SQR (tmp)));
+    }
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+        gint value = (operation == SHRINK) ? 255 : 0;
+
+        for (dy = -yradius; dy <= yradius; dy++)
+          for (dx = -xradius; dx <= xradius; dx++)
+            {
+              gdouble tmpx = ABS (dx) > 0 ? ABS (dx) - 0.5 : 0.0;
+              gdouble tmpy = ABS (dy) > 0 ? ABS (dy) - 0.5 : 0.0;
+              gdouble dist = (SQR (tmpy) / (yradius * yradius) +
+                              SQR (tmpx) / (xradius * xradius));
+              guchar  v;
+
+              switch (operation)
+                {
+                case GROW:
+                  if (ABS (dy) <= circ[ABS (dx)] &&
+                      mask_get (mask, width, height, x + dx, y + dy, &v))
+                    value = MAX (value, v);
+                  break;
+
+                case SHRINK:
+                  if (ABS (dy) > circ[ABS (dx)])
+                    break;
+
+                  if (mask_get (mask, width, height, x + dx, y + dy, &v))
+                    value = MIN (value, v);
+                  else
+                    value = 0;
+                  break;
+
+                case BORDER:
+                case BORDER_FEATHER:
+                  if (dist < 1.0 &&
+                      mask_is_transition (mask, width, height, x + dx, y + dy))
+                    {
+                      if (operation == BORDER_FEATHER)
+                        value = MAX (value, (guchar) (255 * (1.0 - sqrt (dist))));
+                      else
+                        value = 255;
+                    }
+                  break;
+                }
+            }
+
+        result[y * width + x] = value;
+      }
+
+  g_free (circ);
+
+  return result;
+}
+
+static void
+check_mask (MaskOperation operation)
+{
+  const gint radii[][2] = { { 3, 3 }, { 2, 5 }, { 24, 24 }, { 30, 17 } };
+  gint       width      = GIMP_TEST_MASK_WIDTH;
+  gint       height     = GIMP_TEST_MASK_HEIGHT;
+  gint       i, j;
+
+  for (i = 0; i < G_N_ELEMENTS (radii); i++)
+    {
+      guchar *mask     = mask_new (width, height);
+      guchar *expected = mask_apply_reference (mask, width, height, operation,
+                                               radii[i][0], radii[i][1]);
+
+      mask_apply (mask, width, height, operation, radii[i][0], radii[i][1]);
+
+      for (j = 0; j < width * height; j++)
+        g_assert_cmpint (mask[j], ==, expected[j]);
+
+      g_free (expected);
+      g_free (mask);
+    }
+}
+
+/*  Masks with only a few gray levels take the distance transform in
+ *  fatten_region() and thin_region(). The same mask with a strip of
+ *  all the gray levels to its right takes the scanline filters, and
+ *  as the strip is farther away than the radius it doesn't change
+ *  the pixels on the left. Shrinking uses the inverted mask, most of
+ *  the discs would be gone otherwise.
+ */
+static void
+check_mask_levels (MaskOperation operation)
+{
+  const gint radii[][2] = { { 24, 24 }, { 30, 17 }, { 60, 40 } };
+  const gint n_levels[] = { 2, 3 };
+  gint       height     = GIMP_TEST_LEVELS_HEIGHT;
+  gint       i, j, x, y;
+
+  for (i = 0; i < G_N_ELEMENTS (radii); i++)
+    for (j = 0; j < G_N_ELEMENTS (n_levels); j++)
+      {
+        gint    width  = GIMP_TEST_LEVELS_WIDTH;
+        gint    stride = width + radii[i][0] + 1 + 255;
+        guchar *mask   = mask_new (width, height);
+        guchar *dt     = g_new0 (guchar, stride * height);
+        guchar *scan   = g_new0 (guchar, stride * height);
+
+        for (y = 0; y < height; y++)
+          for (x = 0; x < width; x++)
+            {
+              gint steps = n_levels[j] - 1;
+              gint m     = mask[y * width + x];
+              gint v;
+
+              if (operation == SHRINK)
+                m = 255 - m;
+
+              v = (m * steps + 127) / 255;
+
+              dt[y * stride + x] = scan[y * stride + x] = v * 255 / steps;
+            }
+
+        for (y = 0; y < height; y++)
+          for (x = 0; x < 255; x++)
+            scan[y * stride + stride - 255 + x] = x + 1;
+
+        mask_apply (dt,   stride, height, operation,
+                    radii[i][0], radii[i][1]);
+        mask_apply (scan, stride, height, operation,
+                    radii[i][0], radii[i][1]);
+
+        for (y = 0; y < height; y++)
+          for (x = 0; x < width; x++)
+            g_assert_cmpint (dt[y * stride + x], ==, scan[y * stride + x]);
+
+        g_free (scan);
+        g_free (dt);
+        g_free (mask);
+      }
+}
+
+/*  an exact gaussian blur with the edge pixels repeated, the radius
+ *  is where the gaussian drops to 1/255 like in make_curve()
+ */
+static gdouble *
+feather_reference (const guchar *mask,
+                   gint          width,
+                   gint          height,
+                   gdouble       radius_x,
+                   gdouble       radius_y)
+{
+  gdouble *result = g_new (gdouble, width * height);
+  gdouble *tmp    = g_new (gdouble, width * height);
+  gint     axis, x, y, k;
+
+  for (axis = 0; axis < 2; axis++)
+    {
+      gdouble  radius = axis ? radius_x : radius_y;
+      gdouble  sigma  = radius / sqrt (2.0 * log (255.0));
+      gint     length = ceil (radius);
+      gdouble *kernel = g_new (gdouble, 2 * length + 1) + length;
+      gdouble  sum    = 0.0;
+
+      for (k = -length; k <= length; k++)
+        sum += kernel[k] = exp (- SQR (k) / (2.0 * SQR (sigma)));
+
+      for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+          {
+            gdouble value = 0.0;
+
+            for (k = -length; k <= length; k++)
+              {
+                if (axis == 0)
+                  value += kernel[k] * mask[CLAMP (y + k, 0, height - 1) *
+                                            width + x];
+                else
+                  value += kernel[k] * tmp[y * width +
+                                           CLAMP (x + k, 0, width - 1)];
+              }
+
+            if (axis == 0)
+              tmp[y * width + x] = value / sum;
+            else
+              result[y * width + x] = value / sum;
+          }
+
+      g_free (kernel - length);
+    }
+
+  g_free (tmp);
+
+  return result;
+}
+
+/*  the coefficients of the recursive gaussian filter as published by
+ *  Young and van Vliet, gain first, for the sigma of a blur radius
+ */
+static void
+iir_coefficients (gdouble  radius,
+                  gdouble *coeff)
+{
+  gdouble sigma = radius / sqrt (2.0 * log (255.0));
+  gdouble q     = 0.98711 * sigma - 0.96330;
+  gdouble q3    = q * q * q;
+  gdouble b0    = 1.57825 + 2.44413 * q + 1.4281 * SQR (q) + 0.422205 * q3;
+  gdouble b1    = 2.44413 * q + 2.85619 * SQR (q) + 1.26661 * q3;
+  gdouble b2    = - (1.4281 * SQR (q) + 1.26661 * q3);
+  gdouble b3    = 0.422205 * q3;
+
+  coeff[0] = 1.0 - (b1 + b2 + b3) / b0;
+  coeff[1] = b1 / b0;
+  coeff[2] = b2 / b0;
+  coeff[3] = b3 / b0;
+}
+
+/*  the filter forwards and backwards along n_lines interleaved lines,
+ *  one value at a time, leaving the first and last value alone
+ */
+static void
+iir_lines_reference (gdouble       *buf,
+                     gint           n_lines,
+                     gint           length,
+                     const gdouble *coeff)
+{
+  gint i, l;
+
+  for (i = 1; i < length; i++)
+    for (l = 0; l < n_lines; l++)
+      buf[i * n_lines + l] =
+        (coeff[0] * buf[i * n_lines + l] +
+         coeff[1] * buf[(i - 1) * n_lines + l] +
+         coeff[2] * buf[MAX (i - 2, 0) * n_lines + l] +
+         coeff[3] * buf[MAX (i - 3, 0) * n_lines + l]);
+
+  for (i = length - 2; i >= 0; i--)
+    for (l = 0; l < n_lines; l++)
+      buf[i * n_lines + l] =
+        (coeff[0] * buf[i * n_lines + l] +
+         coeff[1] * buf[(i + 1) * n_lines + l] +
+         coeff[2] * buf[MIN (i + 2, length - 1) * n_lines + l] +
+         coeff[3] * buf[MIN (i + 3, length - 1) * n_lines + l]);
+}
+
+/*  the distance to the nearest unselected pixel, looking at all of
+ *  them, and at the pixels around the mask
+ */
+static gfloat *
+shapeburst_reference (const guchar *mask,
+                      gint          width,
+                      gint          height)
+{
+  gfloat *result = g_new (gfloat, width * height);
+  gint    x, y, i, j;
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+        gint min = MIN (MIN (x + 1, width - x), MIN (y + 1, height - y));
+
+        min = SQR (min);
+
+        for (j = 0; j < height; j++)
+          for (i = 0; i < width; i++)
+            if (! mask[j * width + i])
+              min = MIN (min, SQR (x - i) + SQR (y - j));
+
+        result[y * width + x] = sqrt (min) * mask[y * width + x] / 255.0;
+      }
+
+  return result;
+}
+
+/*  noise with some fully transparent pixels in it  */
+static TileManager *
+scale_source_new (gint width,
+                  gint height,
+                  gint bytes)
+{
+  TileManager *tiles = tile_manager_new (width, height, bytes);
+  GRand       *rand  = g_rand_new_with_seed (42);
+  guchar      *row   = g_new (guchar, width * bytes);
+  PixelRegion  region;
+  gint         x, y;
+
+  pixel_region_init (&region, tiles, 0, 0, width, height, TRUE);
+
+  for (y = 0; y < height; y++)
+    {
+      for (x = 0; x < width * bytes; x++)
+        row[x] = g_rand_int_range (rand, 0, 256);
+
+      if (bytes == 2 || bytes == 4)
+        for (x = bytes - 1; x < width * bytes; x += bytes * 7)
+          row[x] = 0;
+
+      pixel_region_set_row (&region, 0, y, width, row);
+    }
+
+  g_free (row);
+  g_rand_free (rand);
+
+  return tiles;
+}
+
+/*  the weight of the source pixel tap of the taps around a sample
+ *  position t pixels after the last pixel before it.  Near the top
+ *  left edge t is negative and the polynomials are extrapolated, the
+ *  lanczos window is stretched like create_lanczos3_lookup() and the
+ *  lookup index computed in scale-region.c stretch it
+ */
+static gdouble
+scale_weight (GimpInterpolationType interpolation,
+              gint                  tap,
+              gdouble               t)
+{
+  switch (interpolation)
+    {
+    case GIMP_INTERPOLATION_LINEAR:
+      return tap == 0 ? 1.0 - t : t;
+
+    case GIMP_INTERPOLATION_CUBIC:
+      {
+        /*  the catmull-rom spline, pt0 + t * (...) in powers of t  */
+        const gdouble coeff[4][4] = { {  0.0, -0.5,  1.0, -0.5 },
+                                      {  1.0,  0.0, -2.5,  1.5 },
+                                      {  0.0,  0.5,  2.0, -1.5 },
+                                      {  0.0,  0.0, -0.5,  0.5 } };
+
+        return (coeff[tap][0] + t * (coeff[tap][1] +
+                                     t * (coeff[tap][2] +
+                                          t * coeff[tap][3])));
+      }
+
+    default:
+      t = fabs (tap - 2 - t) * LANCZOS_SPP * 3.0 / (LANCZOS_SAMPLES - 1);
+
+      if (t < LANCZOS_MIN)
+        return 1.0;
+      if (t >= 3.0)
+        return 0.0;
+
+      return (sin (G_PI * t) / (G_PI * t) *
+              sin (G_PI * t / 3.0) / (G_PI * t / 3.0));
+    }
+}
+
+/*  interpolate every destination pixel in two dimensions at once, in
+ *  doubles, with the edge pixels repeated
+ */
+static guchar *
+scale_reference (const guchar          *src,
+                 gint                   src_width,
+                 gint                   src_height,
+                 gint                   dst_width,
+                 gint                   dst_height,
+                 gint                   bytes,
+                 GimpInterpolationType  interpolation)
+{
+  const gint     taps   = (interpolation == GIMP_INTERPOLATION_LINEAR ? 2 :
+                           interpolation == GIMP_INTERPOLATION_CUBIC  ? 4 : 6);
+  const gboolean alpha  = (bytes == 2 || bytes == 4);
+  guchar        *result = g_new (guchar, dst_width * dst_height * bytes);
+  gint           x, y, i, j, b;
+
+  for (y = 0; y < dst_height; y++)
+    for (x = 0; x < dst_width; x++)
+      {
+        gdouble  yfrac  = (y + 0.5) * src_height / dst_height - 0.5;
+        gdouble  xfrac  = (x + 0.5) * src_width  / dst_width  - 0.5;
+        gint     sy     = (gint) yfrac;
+        gint     sx     = (gint) xfrac;
+        gdouble  sum[4] = { 0.0, };
+        gdouble  wy_sum = 0.0;
+        gdouble  wx_sum = 0.0;
+        guchar  *pixel  = result + (y * dst_width + x) * bytes;
+
+        yfrac -= sy;
+        xfrac -= sx;
+
+        for (j = 0; j < taps; j++)
+          wy_sum += scale_weight (interpolation, j, yfrac);
+
+        for (i = 0; i < taps; i++)
+          wx_sum += scale_weight (interpolation, i, xfrac);
+
+        for (j = 0; j < taps; j++)
+          for (i = 0; i < taps; i++)
+            {
+              gint          py = CLAMP (sy + j - (taps / 2 - 1),
+                                        0, src_height - 1);
+              gint          px = CLAMP (sx + i - (taps / 2 - 1),
+                                        0, src_width - 1);
+              const guchar *p  = src + (py * src_width + px) * bytes;
+              gdouble       w;
+
+              w = (scale_weight (interpolation, j, yfrac) *
+                   scale_weight (interpolation, i, xfrac));
+              w /= wy_sum * wx_sum;
+
+              for (b = 0; b < bytes; b++)
+                {
+                  if (alpha && b < bytes - 1)
+                    sum[b] += w * p[b] * p[bytes - 1];
+                  else
+                    sum[b] += w * p[b];
+                }
+            }
+
+        if (alpha)
+          {
+            gdouble a = sum[bytes - 1];
+
+            for (b = 0; b < bytes - 1; b++)
+              pixel[b] = a > 0 ? CLAMP (sum[b] / a, 0, 255) : 0;
+
+            pixel[bytes - 1] = a > 0 ? CLAMP (a, 0, 255) : 0;
+          }
+        else
+          {
+            for (b = 0; b < bytes; b++)
+              pixel[b] = CLAMP (sum[b], 0, 255);
+          }
+      }
+
+  return result;
+}
+
+static void
+check_scale (GimpInterpolationType interpolation)
+{
+  const gint sizes[][4] = { {  97,  83, 150, 200 },
+                            { 301, 211, 200, 150 },
+                            {  64,  64, 127,  33 } };
+  gint       bytes, i, j;
+
+  for (bytes = 1; bytes <= 4; bytes++)
+    for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+      {
+        const gint   src_width  = sizes[i][0];
+        const gint   src_height = sizes[i][1];
+        const gint   dst_width  = sizes[i][2];
+        const gint   dst_height = sizes[i][3];
+        TileManager *src_tiles  = scale_source_new (src_width, src_height,
+                                                    bytes);
+        TileManager *dst_tiles  = tile_manager_new (dst_width, dst_height,
+                                                    bytes);
+        guchar      *src        = g_new (guchar,
+                                         src_width * src_height * bytes);
+        guchar      *dest       = g_new (guchar,
+                                         dst_width * dst_height * bytes);
+        guchar      *expected;
+        PixelRegion  srcPR;
+        PixelRegion  dstPR;
+
+        tile_manager_read_pixel_data (src_tiles,
+                                      0, 0, src_width - 1, src_height - 1,
+                                      src, src_width * bytes);
+
+        pixel_region_init (&srcPR, src_tiles,
+                           0, 0, src_width, src_height, FALSE);
+        pixel_region_init (&dstPR, dst_tiles,
+                           0, 0, dst_width, dst_height, TRUE);
+
+        scale_region (&srcPR, &dstPR, interpolation, NULL, NULL);
+
+        tile_manager_read_pixel_data (dst_tiles,
+                                      0, 0, dst_width - 1, dst_height - 1,
+                                      dest, dst_width * bytes);
+
+        expected = scale_reference (src, src_width, src_height,
+                                    dst_width, dst_height, bytes,
+                                    interpolation);
+
+        for (j = 0; j < dst_width * dst_height * bytes; j++)
+          g_assert_cmpint (ABS (dest[j] - expected[j]), <=, 1);
+
+        g_free (expected);
+        g_free (dest);
+        g_free (src);
+        tile_manager_unref (dst_tiles);
+        tile_manager_unref (src_tiles);
+      }
+}
+
+/*  the plain C passes of the separable scale in scale-region.c  */
+static void
+scale_row_reference (gfloat       *dest,
+                     const gfloat *src,
+                     const gint   *index,
+                     const gfloat *weights,
+                     gint          n_taps,
+                     gint          width,
+                     gint          bytes)
+{
+  gint x, k, b;
+
+  for (x = 0; x < width; x++, index += n_taps, weights += n_taps)
+    {
+      for (b = 0; b < bytes; b++)
+        {
+          gfloat sum = 0.0;
+
+          for (k = 0; k < n_taps; k++)
+            sum += weights[k] * src[index[k] * bytes + b];
+
+          *dest++ = sum;
+        }
+    }
+}
+
+static void
+scale_column_reference (gfloat        *dest,
+                        const gfloat **src,
+                        const gfloat  *weights,
+                        gint           n_taps,
+                        gint           length)
+{
+  gint i, k;
+
+  for (i = 0; i < length; i++)
+    {
+      gfloat sum = 0.0;
+
+      for (k = 0; k < n_taps; k++)
+        sum += weights[k] * src[k][i];
+
+      dest[i] = sum;
+    }
+}
+
+/*  premultiplied values go up to 255 * 255, compare them relatively  */
+static void
+check_scale_floats (const gfloat *actual,
+                    const gfloat *expected,
+                    gint          n)
+{
+  gint i;
+
+  for (i = 0; i < n; i++)
+    g_assert_cmpfloat (fabs (actual[i] - expected[i]),
+                       <=, 1e-5 * MAX (1.0, fabs (expected[i])));
+}
+
+/**
+ * apply_mask_matches_reference:
+ * @data:
+ *
+ * Make sure apply_mask_to_region() gives the same result as the
+ * plain C row function, on gray and RGB canvases with alpha.
+ **/
+static void
+apply_mask_matches_reference (gconstpointer data)
+{
+  check_dab (APPLY_MASK, 2);
+  check_dab (APPLY_MASK, 4);
+}
+
+/**
+ * combine_mask_matches_reference:
+ * @data:
+ *
+ * Same as apply_mask_matches_reference(), for the stipple and stroke
+ * versions of combine_mask_and_region() on a canvas mask.
+ **/
+static void
+combine_mask_matches_reference (gconstpointer data)
+{
+  check_dab (COMBINE_STIPPLE, 1);
+  check_dab (COMBINE_STROKE,  1);
+}
+
+/**
+ * mask_sse2_matches_reference:
+ * @data:
+ *
+ * Make sure the SSE2 row functions give the same result as the plain
+ * C ones. The test instance runs without CPU acceleration, so the
+ * tests above only ever see the C functions. Skipped when the build
+ * or the CPU has no SSE2.
+ **/
+static void
+mask_sse2_matches_reference (gconstpointer data)
+{
+  if (! have_sse2 ())
+    return;
+
+#if defined(USE_SSE2)
+  check_dab_sse2 (APPLY_MASK,      2);
+  check_dab_sse2 (APPLY_MASK,      4);
+  check_dab_sse2 (COMBINE_STIPPLE, 1);
+  check_dab_sse2 (COMBINE_STROKE,  1);
+#endif
+}
+
+/**
+ * benchmark_dabs:
+ * @data:
+ *
+ * Count how many large dabs the canvas functions get through per
+ * second, only run with -m perf.
+ **/
+static void
+benchmark_dabs (gconstpointer data)
+{
+  if (! g_test_perf ())
+    return;
+
+  benchmark_dab (COMBINE_STROKE, 1, "combine mask, stroke");
+  benchmark_dab (COMBINE_STIPPLE, 1, "combine mask, stipple");
+  benchmark_dab (APPLY_MASK, 4, "apply mask, RGBA");
+}
+
+/**
+ * grow_matches_reference:
+ * @data:
+ *
+ * Make sure fatten_region() takes the largest value within the
+ * radius, for small and large radii.
+ **/
+static void
+grow_matches_reference (gconstpointer data)
+{
+  check_mask (GROW);
+}
+
+/**
+ * shrink_matches_reference:
+ * @data:
+ *
+ * Same as grow_matches_reference(), for thin_region().
+ **/
+static void
+shrink_matches_reference (gconstpointer data)
+{
+  check_mask (SHRINK);
+}
+
+/**
+ * grow_levels_matches_scanline:
+ * @data:
+ *
+ * Make sure the distance transform that fatten_region() uses for
+ * masks with few gray levels gives the same result as the scanline
+ * filter.
+ **/
+static void
+grow_levels_matches_scanline (gconstpointer data)
+{
+  check_mask_levels (GROW);
+}
+
+/**
+ * shrink_levels_matches_scanline:
+ * @data:
+ *
+ * Same as grow_levels_matches_scanline(), for thin_region().
+ **/
+static void
+shrink_levels_matches_scanline (gconstpointer data)
+{
+  check_mask_levels (SHRINK);
+}
+
+/**
+ * border_matches_reference:
+ * @data:
+ *
+ * Same as grow_matches_reference(), for border_region() with and
+ * without feathering.
+ **/
+static void
+border_matches_reference (gconstpointer data)
+{
+  check_mask (BORDER);
+  check_mask (BORDER_FEATHER);
+}
+
+/**
+ * benchmark_grow:
+ * @data:
+ *
+ * Time growing, shrinking and bordering a large selection by 200
+ * pixels, only run with -m perf.
+ **/
+static void
+benchmark_grow (gconstpointer data)
+{
+  const MaskOperation  operations[] = { GROW, SHRINK, BORDER };
+  const gchar         *names[]      = { "grow", "shrink", "border" };
+  gint                 size         = GIMP_TEST_BENCHMARK_MASK;
+  GTimer              *timer;
+  gint                 i;
+
+  if (! g_test_perf ())
+    return;
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < G_N_ELEMENTS (operations); i++)
+    {
+      guchar *mask = g_new0 (guchar, size * size);
+      gint    y;
+
+      /*  a selected rectangle in the middle  */
+      for (y = size / 4; y < 3 * size / 4; y++)
+        memset (mask + y * size + size / 4, 255, size / 2);
+
+      g_timer_start (timer);
+      mask_apply (mask, size, size, operations[i], 200, 200);
+      g_test_minimized_result (g_timer_elapsed (timer, NULL),
+                               "%s by 200 pixels: %gs", names[i],
+                               g_timer_elapsed (timer, NULL));
+
+      g_free (mask);
+    }
+
+  g_timer_destroy (timer);
+}
+
+/**
+ * feather_matches_reference:
+ * @data:
+ *
+ * Make sure gaussian_blur_region() stays close to an exact gaussian
+ * blur, both for small radii and for the large radii that use the
+ * recursive filter.
+ **/
+static void
+feather_matches_reference (gconstpointer data)
+{
+  const gdouble radii[][2] = { { 10, 10 }, { 100, 100 }, { 120, 40 } };
+  gint          width      = GIMP_TEST_FEATHER_WIDTH;
+  gint          height     = GIMP_TEST_FEATHER_HEIGHT;
+  gint          i, j;
+
+  for (i = 0; i < G_N_ELEMENTS (radii); i++)
+    {
+      guchar      *mask = mask_new (width, height);
+      gdouble     *expected;
+      PixelRegion  region;
+
+      expected = feather_reference (mask, width, height,
+                                    radii[i][0], radii[i][1]);
+
+      pixel_region_init_data (&region, mask, 1, width, 0, 0, width, height);
+      gaussian_blur_region (&region, radii[i][0], radii[i][1]);
+
+      for (j = 0; j < width * height; j++)
+        g_assert_cmpfloat (fabs (mask[j] - expected[j]), <=,
+                           GIMP_TEST_FEATHER_ERROR);
+
+      g_free (expected);
+      g_free (mask);
+    }
+}
+
+/**
+ * feather_sse2_matches_reference:
+ * @data:
+ *
+ * Make sure the SSE2 version of the recursive gaussian filter gives
+ * the same result as running it one value at a time, for the large
+ * radii that use it and an odd number of lines. Skipped when the
+ * build or the CPU has no SSE2.
+ **/
+static void
+feather_sse2_matches_reference (gconstpointer data)
+{
+  const gdouble radii[]  = { 32, 100, 400 };
+  const gint    n_lines  = 37;
+  const gint    length   = GIMP_TEST_FEATHER_WIDTH;
+  gint          i, j;
+
+  if (! have_sse2 ())
+    return;
+
+  for (i = 0; i < G_N_ELEMENTS (radii); i++)
+    {
+      GRand   *rand     = g_rand_new_with_seed (42);
+      gdouble *buf      = g_new (gdouble, n_lines * length);
+      gdouble *expected = g_new (gdouble, n_lines * length);
+      gdouble  coeff[4];
+
+      iir_coefficients (radii[i], coeff);
+
+      for (j = 0; j < n_lines * length; j++)
+        buf[j] = expected[j] = g_rand_int_range (rand, 0, 256);
+
+      iir_lines_reference (expected, n_lines, length, coeff);
+
+#if defined(USE_SSE2)
+      gaussian_iir_lines_sse2 (buf, n_lines, length, coeff);
+#endif
+
+      for (j = 0; j < n_lines * length; j++)
+        g_assert_cmpfloat (fabs (buf[j] - expected[j]), <, 1e-6);
+
+      g_free (expected);
+      g_free (buf);
+      g_rand_free (rand);
+    }
+}
+
+/**
+ * benchmark_feather:
+ * @data:
+ *
+ * Time feathering a large selection for growing radii, only run with
+ * -m perf.
+ **/
+static void
+benchmark_feather (gconstpointer data)
+{
+  gint    size = GIMP_TEST_BENCHMARK_MASK;
+  GTimer *timer;
+  gint    radius;
+
+  if (! g_test_perf ())
+    return;
+
+  timer = g_timer_new ();
+
+  for (radius = 25; radius <= 400; radius *= 2)
+    {
+      guchar      *mask = mask_new (size, size);
+      PixelRegion  region;
+
+      pixel_region_init_data (&region, mask, 1, size, 0, 0, size, size);
+
+      g_timer_start (timer);
+      gaussian_blur_region (&region, radius, radius);
+      g_test_minimized_result (g_timer_elapsed (timer, NULL),
+                               "feather by %d pixels: %gs", radius,
+                               g_timer_elapsed (timer, NULL));
+
+      g_free (mask);
+    }
+
+  g_timer_destroy (timer);
+}
+
+/**
+ * shapeburst_matches_reference:
+ * @data:
+ *
+ * Make sure shapeburst_region() finds the exact euclidean distance
+ * of every pixel to the nearest unselected one.
+ **/
+static void
+shapeburst_matches_reference (gconstpointer data)
+{
+  gint         width  = GIMP_TEST_MASK_WIDTH;
+  gint         height = GIMP_TEST_MASK_HEIGHT;
+  guchar      *mask   = mask_new (width, height);
+  gfloat      *dist   = g_new (gfloat, width * height);
+  gfloat      *expected;
+  gfloat       max    = 0.0;
+  gfloat       result;
+  PixelRegion  maskPR;
+  PixelRegion  distPR;
+  gint         i;
+
+  expected = shapeburst_reference (mask, width, height);
+
+  pixel_region_init_data (&maskPR, mask, 1, width,
+                          0, 0, width, height);
+  pixel_region_init_data (&distPR, (guchar *) dist, sizeof (gfloat),
+                          width * sizeof (gfloat), 0, 0, width, height);
+
+  result = shapeburst_region (&maskPR, &distPR, NULL, NULL);
+
+  for (i = 0; i < width * height; i++)
+    {
+      g_assert_cmpfloat (fabs (dist[i] - expected[i]), <, 0.001);
+
+      max = MAX (max, expected[i]);
+    }
+
+  g_assert_cmpfloat (fabs (result - max), <, 0.001);
+
+  g_free (expected);
+  g_free (dist);
+  g_free (mask);
+}
+
+/**
+ * benchmark_shapeburst:
+ * @data:
+ *
+ * Time the distance map of a large selection, only run with -m perf.
+ **/
+static void
+benchmark_shapeburst (gconstpointer data)
+{
+  gint         size = GIMP_TEST_BENCHMARK_MASK;
+  guchar      *mask;
+  gfloat      *dist;
+  PixelRegion  maskPR;
+  PixelRegion  distPR;
+  GTimer      *timer;
+
+  if (! g_test_perf ())
+    return;
+
+  mask = mask_new (size, size);
+  dist = g_new (gfloat, size * size);
+
+  pixel_region_init_data (&maskPR, mask, 1, size, 0, 0, size, size);
+  pixel_region_init_data (&distPR, (guchar *) dist, sizeof (gfloat),
+                          size * sizeof (gfloat), 0, 0, size, size);
+
+  timer = g_timer_new ();
+
+  shapeburst_region (&maskPR, &distPR, NULL, NULL);
+  g_test_minimized_result (g_timer_elapsed (timer, NULL),
+                           "shapeburst: %gs", g_timer_elapsed (timer, NULL));
+
+  g_timer_destroy (timer);
+  g_free (dist);
+  g_free (mask);
+}
+
+/**
+ * scale_linear_matches_reference:
+ * @data:
+ *
+ * Make sure the separable scale of scale_region() gives the same
+ * result as interpolating each pixel in two dimensions, for up and
+ * down scaling without halving steps.
+ **/
+static void
+scale_linear_matches_reference (gconstpointer data)
+{
+  check_scale (GIMP_INTERPOLATION_LINEAR);
+}
+
+/**
+ * scale_cubic_matches_reference:
+ * @data:
+ *
+ * Same as scale_linear_matches_reference(), for cubic interpolation.
+ **/
+static void
+scale_cubic_matches_reference (gconstpointer data)
+{
+  check_scale (GIMP_INTERPOLATION_CUBIC);
+}
+
+/**
+ * scale_lanczos_matches_reference:
+ * @data:
+ *
+ * Same as scale_linear_matches_reference(), for lanczos
+ * interpolation.
+ **/
+static void
+scale_lanczos_matches_reference (gconstpointer data)
+{
+  check_scale (GIMP_INTERPOLATION_LANCZOS);
+}
+
+/**
+ * scale_row_sse2_matches_reference:
+ * @data:
+ *
+ * Make sure the SSE2 horizontal pass of the scale gives the same
+ * result as the plain C one, for all pixel sizes and the numbers of
+ * taps of the interpolations, with negative weights like lanczos has.
+ * Skipped when the build or the CPU has no SSE2.
+ **/
+static void
+scale_row_sse2_matches_reference (gconstpointer data)
+{
+  const gint n_taps[]  = { 2, 4, 6, 13 };
+  const gint src_width = 173;
+  const gint width     = GIMP_TEST_FEATHER_WIDTH;
+  gint       bytes, i, j;
+
+  if (! have_sse2 ())
+    return;
+
+  for (bytes = 1; bytes <= 4; bytes++)
+    for (i = 0; i < G_N_ELEMENTS (n_taps); i++)
+      {
+        GRand  *rand     = g_rand_new_with_seed (42);
+        gfloat *src      = g_new (gfloat, src_width * bytes);
+        gint   *index    = g_new (gint, width * n_taps[i]);
+        gfloat *weights  = g_new (gfloat, width * n_taps[i]);
+        gfloat *dest     = g_new (gfloat, width * bytes);
+        gfloat *expected = g_new (gfloat, width * bytes);
+
+        for (j = 0; j < src_width * bytes; j++)
+          src[j] = g_rand_int_range (rand, 0, 255 * 255 + 1);
+
+        for (j = 0; j < width * n_taps[i]; j++)
+          {
+            index[j]   = g_rand_int_range (rand, 0, src_width);
+            weights[j] = g_rand_double_range (rand, -0.25, 1.0);
+          }
+
+        scale_row_reference (expected, src, index, weights,
+                             n_taps[i], width, bytes);
+
+#if defined(USE_SSE2)
+        scale_row_sse2 (dest, src, index, weights,
+                        n_taps[i], width, bytes);
+#endif
+
+        check_scale_floats (dest, expected, width * bytes);
+
+        g_free (expected);
+        g_free (dest);
+        g_free (weights);
+        g_free (index);
+        g_free (src);
+        g_rand_free (rand);
+      }
+}
+
+/**
+ * scale_column_sse2_matches_reference:
+ * @data:
+ *
+ * Same as scale_row_sse2_matches_reference(), for the vertical pass,
+ * on row lengths that leave zero to three values after the last
+ * vector.
+ **/
+static void
+scale_column_sse2_matches_reference (gconstpointer data)
+{
+  const gint n_taps[] = { 2, 4, 6, 13 };
+  gint       length, i, j;
+
+  if (! have_sse2 ())
+    return;
+
+  for (length = GIMP_TEST_FEATHER_WIDTH; length < GIMP_TEST_FEATHER_WIDTH + 4;
+       length++)
+    for (i = 0; i < G_N_ELEMENTS (n_taps); i++)
+      {
+        GRand         *rand     = g_rand_new_with_seed (42);
+        const gfloat **src      = g_new (const gfloat *, n_taps[i]);
+        gfloat        *rows     = g_new (gfloat, n_taps[i] * length);
+        gfloat        *weights  = g_new (gfloat, n_taps[i]);
+        gfloat        *dest     = g_new (gfloat, length);
+        gfloat        *expected = g_new (gfloat, length);
+
+        for (j = 0; j < n_taps[i] * length; j++)
+          rows[j] = g_rand_double_range (rand, -1000.0, 255 * 255 + 1000.0);
+
+        for (j = 0; j < n_taps[i]; j++)
+          {
+            src[j]     = rows + j * length;
+            weights[j] = g_rand_double_range (rand, -0.25, 1.0);
+          }
+
+        scale_column_reference (expected, src, weights, n_taps[i], length);
+
+#if defined(USE_SSE2)
+        scale_column_sse2 (dest, src, weights, n_taps[i], length);
+#endif
+
+        check_scale_floats (dest, expected, length);
+
+        g_free (expected);
+        g_free (dest);
+        g_free (weights);
+        g_free (rows);
+        g_free (src);
+        g_rand_free (rand);
+      }
+}
+
+/**
+ * scale_consume_matches_scale:
+ * @data:
+ *
+ * Make sure scale_region_consume() gives the same result as
+ * scale_region(), also across the decimation levels, and that it
+ * leaves no tile of the source allocated.
+ **/
+static void
+scale_consume_matches_scale (gconstpointer data)
+{
+  const GimpInterpolationType types[] = { GIMP_INTERPOLATION_NONE,
+                                          GIMP_INTERPOLATION_LINEAR,
+                                          GIMP_INTERPOLATION_LANCZOS };
+  const gint sizes[][4] = { { 500, 400,  60,  50 },
+                            { 300,  90,  70,  80 },
+                            {  97,  83, 150, 200 } };
+  gint       bytes, i, j, k;
+
+  for (bytes = 1; bytes <= 4; bytes += 3)
+    for (i = 0; i < G_N_ELEMENTS (types); i++)
+      for (j = 0; j < G_N_ELEMENTS (sizes); j++)
+        {
+          const gint   src_width  = sizes[j][0];
+          const gint   src_height = sizes[j][1];
+          const gint   dst_width  = sizes[j][2];
+          const gint   dst_height = sizes[j][3];
+          TileManager *src_tiles  = scale_source_new (src_width, src_height,
+                                                      bytes);
+          TileManager *tiles1     = tile_manager_new (dst_width, dst_height,
+                                                      bytes);
+          TileManager *tiles2     = tile_manager_new (dst_width, dst_height,
+                                                      bytes);
+          guchar      *dest1      = g_new (guchar,
+                                           dst_width * dst_height * bytes);
+          guchar      *dest2      = g_new (guchar,
+                                           dst_width * dst_height * bytes);
+          PixelRegion  srcPR;
+          PixelRegion  dstPR;
+
+          pixel_region_init (&srcPR, src_tiles,
+                             0, 0, src_width, src_height, FALSE);
+          pixel_region_init (&dstPR, tiles1,
+                             0, 0, dst_width, dst_height, TRUE);
+
+          scale_region (&srcPR, &dstPR, types[i], NULL, NULL);
+
+          pixel_region_init (&srcPR, src_tiles,
+                             0, 0, src_width, src_height, FALSE);
+          pixel_region_init (&dstPR, tiles2,
+                             0, 0, dst_width, dst_height, TRUE);
+
+          scale_region_consume (&srcPR, &dstPR, types[i], NULL, NULL);
+
+          /*  only the tile manager itself is left  */
+          g_assert_cmpint (tile_manager_get_memsize (src_tiles, TRUE), ==,
+                           tile_manager_get_memsize (src_tiles, FALSE) -
+                           (gint64) src_width * src_height * bytes);
+
+          tile_manager_read_pixel_data (tiles1,
+                                        0, 0, dst_width - 1, dst_height - 1,
+                                        dest1, dst_width * bytes);
+          tile_manager_read_pixel_data (tiles2,
+                                        0, 0, dst_width - 1, dst_height - 1,
+                                        dest2, dst_width * bytes);
+
+          for (k = 0; k < dst_width * dst_height * bytes; k++)
+            g_assert_cmpint (dest1[k], ==, dest2[k]);
+
+          g_free (dest2);
+          g_free (dest1);
+          tile_manager_unref (tiles2);
+          tile_manager_unref (tiles1);
+          tile_manager_unref (src_tiles);
+        }
+}
+
+/**
+ * benchmark_scale:
+ * @data:
+ *
+ * Time scaling a large RGBA image up and down with each
+ * interpolation, only run with -m perf.
+ **/
+static void
+benchmark_scale (gconstpointer data)
+{
+  const GimpInterpolationType types[] = { GIMP_INTERPOLATION_LINEAR,
+                                          GIMP_INTERPOLATION_CUBIC,
+                                          GIMP_INTERPOLATION_LANCZOS };
+  const gdouble  factors[] = { 0.6, 1.5 };
+  gint           size      = GIMP_TEST_BENCHMARK_SCALE;
+  TileManager   *src_tiles;
+  GTimer        *timer;
+  gint           i, j;
+
+  if (! g_test_perf ())
+    return;
+
+  src_tiles = scale_source_new (size, size, 4);
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < G_N_ELEMENTS (types); i++)
+    for (j = 0; j < G_N_ELEMENTS (factors); j++)
+      {
+        gint         dst_size  = size * factors[j];
+        TileManager *dst_tiles = tile_manager_new (dst_size, dst_size, 4);
+        PixelRegion  srcPR;
+        PixelRegion  dstPR;
+
+        pixel_region_init (&srcPR, src_tiles, 0, 0, size, size, FALSE);
+        pixel_region_init (&dstPR, dst_tiles, 0, 0, dst_size, dst_size, TRUE);
+
+        g_timer_start (timer);
+        scale_region (&srcPR, &dstPR, types[i], NULL, NULL);
+        g_test_minimized_result (g_timer_elapsed (timer, NULL),
+                                 "scale %s by %g: %gs",
+                                 types[i] == GIMP_INTERPOLATION_LINEAR ?
+                                 "linear" :
+                                 types[i] == GIMP_INTERPOLATION_CUBIC ?
+                                 "cubic" : "lanczos",
+                                 factors[j], g_timer_elapsed (timer, NULL));
+
+        tile_manager_unref (dst_tiles);
+      }
+
+  g_timer_destroy (timer);
+  tile_manager_unref (src_tiles);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_thread_init (NULL);
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  /* We share the same application instance across all tests */
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (apply_mask_matches_reference);
+  ADD_TEST (combine_mask_matches_reference);
+  ADD_TEST (mask_sse2_matches_reference);
+  ADD_TEST (grow_matches_reference);
+  ADD_TEST (shrink_matches_reference);
+  ADD_TEST (grow_levels_matches_scanline);
+  ADD_TEST (shrink_levels_matches_scanline);
+  ADD_TEST (border_matches_reference);
+  ADD_TEST (feather_matches_reference);
+  ADD_TEST (feather_sse2_matches_reference);
+  ADD_TEST (shapeburst_matches_reference);
+  ADD_TEST (scale_linear_matches_reference);
+  ADD_TEST (scale_cubic_matches_reference);
+  ADD_TEST (scale_lanczos_matches_reference);
+  ADD_TEST (scale_row_sse2_matches_reference);
+  ADD_TEST (scale_column_sse2_matches_reference);
+  ADD_TEST (scale_consume_matches_scale);
+  ADD_TEST (benchmark_dabs);
+  ADD_TEST (benchmark_grow);
+  ADD_TEST (benchmark_feather);
+  ADD_TEST (benchmark_shapeburst);
+  ADD_TEST (benchmark_scale);
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Exit so we don't break script-fu plug-in wire */
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
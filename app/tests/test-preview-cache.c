@@ -0,0 +1,225 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "widgets/widgets-types.h"
+
+#include "base/temp-buf.h"
+
+#include "core/gimp.h"
+#include "core/gimpcontext.h"
+#include "core/gimpimage.h"
+#include "core/gimplayer.h"
+#include "core/gimppreviewcache.h"
+#include "core/gimpviewable.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define GIMP_TEST_PREVIEW_SIZE        32
+#define GIMP_TEST_BENCHMARK_LAYERS   500
+#define GIMP_TEST_BENCHMARK_SIZE    1000
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-preview-cache/" #function, gimp, function);
+
+
+static TempBuf *
+preview_new (void)
+{
+  return temp_buf_new (GIMP_TEST_PREVIEW_SIZE, GIMP_TEST_PREVIEW_SIZE,
+                       4, 0, 0, NULL);
+}
+
+/**
+ * lru_eviction:
+ * @data:
+ *
+ * Make sure the previews of all objects share one budget, and that
+ * the least recently used preview is dropped when it is exceeded.
+ **/
+static void
+lru_eviction (gconstpointer data)
+{
+  GSList  *list1 = NULL;
+  GSList  *list2 = NULL;
+  TempBuf *a     = preview_new ();
+  TempBuf *b     = temp_buf_new (GIMP_TEST_PREVIEW_SIZE / 2,
+                                 GIMP_TEST_PREVIEW_SIZE / 2, 4, 0, 0, NULL);
+  TempBuf *c     = preview_new ();
+  gsize    size  = temp_buf_get_memsize (a);
+
+  gimp_preview_cache_set_max_memsize (size * 2);
+
+  gimp_preview_cache_add (&list1, a);
+  gimp_preview_cache_add (&list1, b);
+
+  /*  use a again, which makes b the least recently used  */
+  g_assert (gimp_preview_cache_get (&list1,
+                                    GIMP_TEST_PREVIEW_SIZE,
+                                    GIMP_TEST_PREVIEW_SIZE) == a);
+
+  gimp_preview_cache_add (&list2, c);
+
+  g_assert (g_slist_find (list1, a));
+  g_assert (! g_slist_find (list1, b));
+  g_assert (g_slist_find (list2, c));
+
+  g_assert_cmpuint (gimp_preview_cache_get_total_memsize (), <=, size * 2);
+
+  gimp_preview_cache_invalidate (&list1);
+  gimp_preview_cache_invalidate (&list2);
+
+  g_assert (list1 == NULL);
+  g_assert (list2 == NULL);
+  g_assert_cmpuint (gimp_preview_cache_get_total_memsize (), ==, 0);
+
+  gimp_preview_cache_set_max_memsize (PREVIEW_CACHE_MAX_MEMSIZE);
+}
+
+/**
+ * scaled_from_bigger:
+ * @data:
+ *
+ * Make sure a preview scaled down from a cached bigger one is cached
+ * and accounted for too.
+ **/
+static void
+scaled_from_bigger (gconstpointer data)
+{
+  GSList  *list = NULL;
+  TempBuf *big  = preview_new ();
+  TempBuf *small;
+
+  gimp_preview_cache_add (&list, big);
+
+  small = gimp_preview_cache_get (&list,
+                                  GIMP_TEST_PREVIEW_SIZE / 2,
+                                  GIMP_TEST_PREVIEW_SIZE / 2);
+
+  g_assert (small != NULL && small != big);
+  g_assert_cmpint (g_slist_length (list), ==, 2);
+  g_assert_cmpuint (gimp_preview_cache_get_total_memsize (), ==,
+                    temp_buf_get_memsize (big) +
+                    temp_buf_get_memsize (small));
+
+  gimp_preview_cache_invalidate (&list);
+
+  g_assert_cmpuint (gimp_preview_cache_get_total_memsize (), ==, 0);
+}
+
+/**
+ * benchmark_layer_previews:
+ * @data:
+ *
+ * Time getting the previews of all layers of an image with many of
+ * them, first rendering and then from the cache, only run with
+ * -m perf.
+ **/
+static void
+benchmark_layer_previews (gconstpointer data)
+{
+  Gimp        *gimp = GIMP (data);
+  GimpContext *context;
+  GimpImage   *image;
+  GList       *list;
+  GTimer      *timer;
+  gint         pass;
+  gint         i;
+
+  if (! g_test_perf ())
+    return;
+
+  context = gimp_get_user_context (gimp);
+
+  image = gimp_image_new (gimp,
+                          GIMP_TEST_BENCHMARK_SIZE, GIMP_TEST_BENCHMARK_SIZE,
+                          GIMP_RGB);
+
+  for (i = 0; i < GIMP_TEST_BENCHMARK_LAYERS; i++)
+    {
+      GimpLayer *layer = gimp_layer_new (image,
+                                         GIMP_TEST_BENCHMARK_SIZE,
+                                         GIMP_TEST_BENCHMARK_SIZE,
+                                         GIMP_RGBA_IMAGE,
+                                         "Layer", 1.0, GIMP_NORMAL_MODE);
+
+      gimp_image_add_layer (image, layer, GIMP_IMAGE_ACTIVE_PARENT, 0, FALSE);
+    }
+
+  timer = g_timer_new ();
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      g_timer_start (timer);
+
+      for (list = gimp_image_get_layer_iter (image); list; list = list->next)
+        gimp_viewable_get_preview (list->data, context,
+                                   GIMP_TEST_PREVIEW_SIZE,
+                                   GIMP_TEST_PREVIEW_SIZE);
+
+      g_test_minimized_result (g_timer_elapsed (timer, NULL),
+                               "%s, %d layer previews: %gs",
+                               pass ? "cached" : "rendered",
+                               GIMP_TEST_BENCHMARK_LAYERS,
+                               g_timer_elapsed (timer, NULL));
+    }
+
+  g_timer_destroy (timer);
+  g_object_unref (image);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_thread_init (NULL);
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  /* We share the same application instance across all tests */
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (lru_eviction);
+  ADD_TEST (scaled_from_bigger);
+  ADD_TEST (benchmark_layer_previews);
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Exit so we don't break script-fu plug-in wire */
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
@@ -0,0 +1,295 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "widgets/widgets-types.h"
+
+#include "base/pixel-processor.h"
+#include "base/pixel-region.h"
+#include "base/tile-manager.h"
+
+#include "gegl/gimp-gegl.h"
+
+#include "core/gimp.h"
+#include "core/gimpimage.h"
+#include "core/gimplayer.h"
+#include "core/gimppickable.h"
+#include "core/gimpprojection.h"
+#include "core/gimpprojection-construct.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define GIMP_TEST_IMAGE_WIDTH      300
+#define GIMP_TEST_IMAGE_HEIGHT     200
+#define GIMP_TEST_BENCHMARK_SIZE  2000
+#define GIMP_TEST_BENCHMARK_LAYERS  8
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-projection/" #function, gimp, function);
+
+
+/*  layers of noise, with the modes and opacities of a typical stack  */
+static GimpImage *
+create_test_image (Gimp *gimp,
+                   gint  size_x,
+                   gint  size_y,
+                   gint  n_layers)
+{
+  const GimpLayerModeEffects modes[] = { GIMP_NORMAL_MODE,
+                                         GIMP_MULTIPLY_MODE,
+                                         GIMP_SCREEN_MODE,
+                                         GIMP_OVERLAY_MODE };
+  GimpImage *image = gimp_image_new (gimp, size_x, size_y, GIMP_RGB);
+  GRand     *rand  = g_rand_new_with_seed (42);
+  guchar    *row   = g_new (guchar, size_x * 4);
+  gint       i, x, y;
+
+  for (i = 0; i < n_layers; i++)
+    {
+      GimpLayer   *layer;
+      PixelRegion  pr;
+
+      if (i == 0)
+        layer = gimp_layer_new (image, size_x, size_y, GIMP_RGB_IMAGE,
+                                "Background", 1.0, GIMP_NORMAL_MODE);
+      else
+        layer = gimp_layer_new (image, size_x, size_y, GIMP_RGBA_IMAGE,
+                                "Layer", 0.7, modes[i % G_N_ELEMENTS (modes)]);
+
+      gimp_image_add_layer (image, layer, GIMP_IMAGE_ACTIVE_PARENT, 0, FALSE);
+
+      pixel_region_init (&pr, gimp_drawable_get_tiles (GIMP_DRAWABLE (layer)),
+                         0, 0, size_x, size_y, TRUE);
+
+      for (y = 0; y < size_y; y++)
+        {
+          for (x = 0; x < size_x * pr.bytes; x++)
+            row[x] = g_rand_int_range (rand, 0, 256);
+
+          pixel_region_set_row (&pr, 0, y, size_x, row);
+        }
+    }
+
+  g_free (row);
+  g_rand_free (rand);
+
+  return image;
+}
+
+/*  construct the whole projection with the legacy or the GEGL code  */
+static void
+construct_projection (GimpImage *image,
+                      gboolean   use_gegl)
+{
+  GimpProjection *proj = gimp_image_get_projection (image);
+
+  proj->use_gegl = use_gegl;
+
+  gimp_projection_construct (proj, 0, 0,
+                             gimp_image_get_width  (image),
+                             gimp_image_get_height (image));
+}
+
+static guchar *
+read_projection (GimpImage *image)
+{
+  GimpPickable *pickable = GIMP_PICKABLE (gimp_image_get_projection (image));
+  gint          width    = gimp_image_get_width  (image);
+  gint          height   = gimp_image_get_height (image);
+  guchar       *data     = g_new (guchar, width * height * 4);
+
+  tile_manager_read_pixel_data (gimp_pickable_get_tiles (pickable),
+                                0, 0, width - 1, height - 1,
+                                data, width * 4);
+
+  return data;
+}
+
+static void
+benchmark_projection (Gimp     *gimp,
+                      gboolean  use_gegl)
+{
+  GimpImage *image;
+  GTimer    *timer;
+  gdouble    megapixels;
+  guint      num_processors;
+  guint      threads;
+
+  g_object_get (gimp->config, "num-processors", &num_processors, NULL);
+
+  image = create_test_image (gimp,
+                             GIMP_TEST_BENCHMARK_SIZE,
+                             GIMP_TEST_BENCHMARK_SIZE,
+                             GIMP_TEST_BENCHMARK_LAYERS);
+
+  megapixels = SQR (GIMP_TEST_BENCHMARK_SIZE) / 1000000.0;
+
+  timer = g_timer_new ();
+
+  for (threads = 1; threads <= GIMP_MAX_NUM_THREADS; threads *= 2)
+    {
+      g_object_set (gimp->config, "num-processors", threads, NULL);
+
+      g_timer_start (timer);
+      construct_projection (image, use_gegl);
+      g_test_minimized_result (g_timer_elapsed (timer, NULL),
+                               "%s, %d layers, %u threads: %g megapixels/s",
+                               use_gegl ? "gegl" : "legacy",
+                               GIMP_TEST_BENCHMARK_LAYERS, threads,
+                               megapixels / g_timer_elapsed (timer, NULL));
+    }
+
+  g_object_set (gimp->config, "num-processors", num_processors, NULL);
+
+  g_timer_destroy (timer);
+  g_object_unref (image);
+}
+
+/**
+ * gegl_matches_legacy:
+ * @data:
+ *
+ * Make sure both code paths construct the same projection of a layer
+ * with alpha over an opaque one, for the normal mode and the modes
+ * whose GEGL version composites like the legacy code does over an
+ * opaque background. Both on one thread and on several, so GEGL's
+ * worker threads read and write the tiles at the same time.
+ **/
+static void
+gegl_matches_legacy (gconstpointer data)
+{
+  const GimpLayerModeEffects modes[]   = { GIMP_NORMAL_MODE,
+                                           GIMP_MULTIPLY_MODE,
+                                           GIMP_SCREEN_MODE,
+                                           GIMP_DIFFERENCE_MODE,
+                                           GIMP_DARKEN_ONLY_MODE,
+                                           GIMP_LIGHTEN_ONLY_MODE };
+  const guint                threads[] = { 1, 4 };
+  Gimp                      *gimp      = GIMP (data);
+  guint                      num_processors;
+  gint                       i, j, k;
+
+  g_object_get (gimp->config, "num-processors", &num_processors, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (threads); i++)
+    for (j = 0; j < G_N_ELEMENTS (modes); j++)
+      {
+        GimpImage *image;
+        guchar    *legacy;
+        guchar    *gegl;
+
+        g_object_set (gimp->config, "num-processors", threads[i], NULL);
+
+        image = create_test_image (gimp,
+                                   GIMP_TEST_IMAGE_WIDTH,
+                                   GIMP_TEST_IMAGE_HEIGHT,
+                                   2);
+
+        gimp_layer_set_mode (gimp_image_get_active_layer (image), modes[j],
+                             FALSE);
+
+        construct_projection (image, FALSE);
+        legacy = read_projection (image);
+
+        construct_projection (image, TRUE);
+        gegl = read_projection (image);
+
+        for (k = 0; k < GIMP_TEST_IMAGE_WIDTH * GIMP_TEST_IMAGE_HEIGHT * 4; k++)
+          g_assert_cmpint (ABS (legacy[k] - gegl[k]), <=, 2);
+
+        g_free (gegl);
+        g_free (legacy);
+        g_object_unref (image);
+      }
+
+  g_object_set (gimp->config, "num-processors", num_processors, NULL);
+}
+
+/**
+ * benchmark_legacy:
+ * @data:
+ *
+ * Time the legacy projection of a stack of layers for growing thread
+ * counts, only run with -m perf.
+ **/
+static void
+benchmark_legacy (gconstpointer data)
+{
+  if (g_test_perf ())
+    benchmark_projection (GIMP (data), FALSE);
+}
+
+/**
+ * benchmark_gegl:
+ * @data:
+ *
+ * Same as benchmark_legacy(), for the GEGL projection of the same
+ * stack.
+ **/
+static void
+benchmark_gegl (gconstpointer data)
+{
+  if (g_test_perf ())
+    benchmark_projection (GIMP (data), TRUE);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_thread_init (NULL);
+  g_type_init ();
+  gegl_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  /* We share the same application instance across all tests */
+  gimp = gimp_init_for_testing ();
+
+  gimp_gegl_init (gimp);
+
+  /* Add tests */
+  ADD_TEST (gegl_matches_legacy);
+  ADD_TEST (benchmark_legacy);
+  ADD_TEST (benchmark_gegl);
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Exit so we don't break script-fu plug-in wire */
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
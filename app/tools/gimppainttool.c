@@ -51,6 +51,13 @@
 #include "gimp-intl.h"
 
 
+typedef struct
+{
+  GimpCoords  coords;
+  guint32     time;
+} GimpPaintMotion;
+
+
 static void   gimp_paint_tool_constructed    (GObject               *object);
 static void   gimp_paint_tool_finalize       (GObject               *object);
 
@@ -95,6 +102,9 @@ static void   gimp_paint_tool_hard_notify    (GimpPaintOptions      *options,
                                               const GParamSpec      *pspec,
                                               GimpTool              *tool);
 
+static void     gimp_paint_tool_paint_motions (GimpPaintTool        *paint_tool);
+static gboolean gimp_paint_tool_motions_idle  (GimpPaintTool        *paint_tool);
+
 
 G_DEFINE_TYPE (GimpPaintTool, gimp_paint_tool, GIMP_TYPE_COLOR_TOOL)
 
@@ -120,6 +130,8 @@ gimp_paint_tool_class_init (GimpPaintToolClass *klass)
   tool_class->oper_update    = gimp_paint_tool_oper_update;
 
   draw_tool_class->draw      = gimp_paint_tool_draw;
+
+  klass->motions_painted     = NULL;
 }
 
 static void
@@ -140,6 +152,9 @@ gimp_paint_tool_init (GimpPaintTool *paint_tool)
   paint_tool->status_ctrl = _("%s to pick a color");
 
   paint_tool->core        = NULL;
+
+  paint_tool->motions     = g_array_new (FALSE, FALSE,
+                                         sizeof (GimpPaintMotion));
 }
 
 static void
@@ -176,6 +191,18 @@ gimp_paint_tool_finalize (GObject *object)
 {
   GimpPaintTool *paint_tool = GIMP_PAINT_TOOL (object);
 
+  if (paint_tool->motions_idle_id)
+    {
+      g_source_remove (paint_tool->motions_idle_id);
+      paint_tool->motions_idle_id = 0;
+    }
+
+  if (paint_tool->motions)
+    {
+      g_array_free (paint_tool->motions, TRUE);
+      paint_tool->motions = NULL;
+    }
+
   if (paint_tool->core)
     {
       g_object_unref (paint_tool->core);
@@ -220,6 +247,7 @@ gimp_paint_tool_control (GimpTool       *tool,
       break;
 
     case GIMP_TOOL_ACTION_HALT:
+      gimp_paint_tool_paint_motions (paint_tool);
       gimp_paint_core_cleanup (paint_tool->core);
       break;
     }
@@ -372,6 +400,9 @@ gimp_paint_tool_button_release (GimpTool              *tool,
       return;
     }
 
+  /*  paint what is still queued before the stroke ends  */
+  gimp_paint_tool_paint_motions (paint_tool);
+
   gimp_draw_tool_pause (GIMP_DRAW_TOOL (tool));
 
   /*  Let the specific painting function finish up  */
@@ -408,6 +439,7 @@ gimp_paint_tool_motion (GimpTool         *tool,
   GimpImage        *image         = gimp_display_get_image (display);
   GimpDrawable     *drawable      = gimp_image_get_active_drawable (image);
   GimpCoords        curr_coords;
+  GimpPaintMotion   motion;
   gint              off_x, off_y;
 
   GIMP_TOOL_CLASS (parent_class)->motion (tool, coords, time, state, display);
@@ -427,21 +459,90 @@ gimp_paint_tool_motion (GimpTool         *tool,
   /*  don't paint while the Shift key is pressed for line drawing  */
   if (paint_tool->draw_line)
     {
+      gimp_paint_tool_paint_motions (paint_tool);
+
       gimp_paint_core_set_current_coords (core, &curr_coords);
       return;
     }
 
+  /*  only queue the event here, painting and flushing the display for
+   *  every single event makes us fall behind fast input devices
+   */
+  motion.coords = curr_coords;
+  motion.time   = time;
+
+  g_array_append_val (paint_tool->motions, motion);
+
+  if (! paint_tool->motions_idle_id)
+    paint_tool->motions_idle_id =
+      g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+                       (GSourceFunc) gimp_paint_tool_motions_idle,
+                       paint_tool, NULL);
+}
+
+/*  Paint all queued motion events in the order they arrived and flush
+ *  the display once for all of them. Events that arrive while we are
+ *  busy painting are queued up and painted by the next batch.
+ */
+static void
+gimp_paint_tool_paint_motions (GimpPaintTool *paint_tool)
+{
+  GimpTool         *tool          = GIMP_TOOL (paint_tool);
+  GimpPaintOptions *paint_options = GIMP_PAINT_TOOL_GET_OPTIONS (tool);
+  GimpImage        *image;
+  GimpDrawable     *drawable;
+  gint              i;
+
+  if (paint_tool->motions_idle_id)
+    {
+      g_source_remove (paint_tool->motions_idle_id);
+      paint_tool->motions_idle_id = 0;
+    }
+
+  if (paint_tool->motions->len == 0)
+    return;
+
+  if (! tool->display)
+    {
+      g_array_set_size (paint_tool->motions, 0);
+      return;
+    }
+
+  image    = gimp_display_get_image (tool->display);
+  drawable = gimp_image_get_active_drawable (image);
+
   gimp_draw_tool_pause (GIMP_DRAW_TOOL (tool));
 
-  gimp_paint_core_interpolate (core, drawable, paint_options,
-                               &curr_coords, time);
+  for (i = 0; i < paint_tool->motions->len; i++)
+    {
+      GimpPaintMotion *motion = &g_array_index (paint_tool->motions,
+                                                GimpPaintMotion, i);
+
+      gimp_paint_core_interpolate (paint_tool->core, drawable, paint_options,
+                                   &motion->coords, motion->time);
+    }
+
+  g_array_set_size (paint_tool->motions, 0);
+
+  if (GIMP_PAINT_TOOL_GET_CLASS (paint_tool)->motions_painted)
+    GIMP_PAINT_TOOL_GET_CLASS (paint_tool)->motions_painted (paint_tool);
 
   gimp_projection_flush_now (gimp_image_get_projection (image));
-  gimp_display_flush_now (display);
+  gimp_display_flush_now (tool->display);
 
   gimp_draw_tool_resume (GIMP_DRAW_TOOL (tool));
 }
 
+static gboolean
+gimp_paint_tool_motions_idle (GimpPaintTool *paint_tool)
+{
+  paint_tool->motions_idle_id = 0;
+
+  gimp_paint_tool_paint_motions (paint_tool);
+
+  return FALSE;
+}
+
 static void
 gimp_paint_tool_modifier_key (GimpTool        *tool,
                               GdkModifierType  key,
@@ -46,11 +46,17 @@ struct _GimpPaintTool
   const gchar   *status_ctrl;  /* additional message for the ctrl modifier */
 
   GimpPaintCore *core;
+
+  GArray        *motions;      /* motion events that are not painted yet */
+  guint          motions_idle_id;
 };
 
 struct _GimpPaintToolClass
 {
   GimpColorToolClass  parent_class;
+
+  /*  called after a batch of queued motion events was painted  */
+  void (* motions_painted) (GimpPaintTool *paint_tool);
 };
 
 
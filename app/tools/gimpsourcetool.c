@@ -54,11 +54,6 @@ static void          gimp_source_tool_button_press  (GimpTool            *tool,
                                                      GdkModifierType      state,
                                                      GimpButtonPressType  press_type,
                                                      GimpDisplay         *display);
-static void          gimp_source_tool_motion        (GimpTool            *tool,
-                                                     const GimpCoords    *coords,
-                                                     guint32              time,
-                                                     GdkModifierType      state,
-                                                     GimpDisplay         *display);
 static void          gimp_source_tool_cursor_update (GimpTool            *tool,
                                                      const GimpCoords    *coords,
                                                      GdkModifierType      state,
@@ -76,6 +71,8 @@ static void          gimp_source_tool_oper_update   (GimpTool            *tool,
 
 static void          gimp_source_tool_draw          (GimpDrawTool        *draw_tool);
 
+static void          gimp_source_tool_motions_painted (GimpPaintTool     *paint_tool);
+
 static void          gimp_source_tool_set_src_display (GimpSourceTool      *source_tool,
                                                        GimpDisplay         *display);
 
@@ -88,19 +85,21 @@ G_DEFINE_TYPE (GimpSourceTool, gimp_source_tool, GIMP_TYPE_BRUSH_TOOL)
 static void
 gimp_source_tool_class_init (GimpSourceToolClass *klass)
 {
-  GimpToolClass     *tool_class      = GIMP_TOOL_CLASS (klass);
-  GimpDrawToolClass *draw_tool_class = GIMP_DRAW_TOOL_CLASS (klass);
+  GimpToolClass      *tool_class       = GIMP_TOOL_CLASS (klass);
+  GimpDrawToolClass  *draw_tool_class  = GIMP_DRAW_TOOL_CLASS (klass);
+  GimpPaintToolClass *paint_tool_class = GIMP_PAINT_TOOL_CLASS (klass);
 
   tool_class->has_display   = gimp_source_tool_has_display;
   tool_class->has_image     = gimp_source_tool_has_image;
   tool_class->control       = gimp_source_tool_control;
   tool_class->button_press  = gimp_source_tool_button_press;
-  tool_class->motion        = gimp_source_tool_motion;
   tool_class->modifier_key  = gimp_source_tool_modifier_key;
   tool_class->oper_update   = gimp_source_tool_oper_update;
   tool_class->cursor_update = gimp_source_tool_cursor_update;
 
   draw_tool_class->draw     = gimp_source_tool_draw;
+
+  paint_tool_class->motions_painted = gimp_source_tool_motions_painted;
 }
 
 static void
@@ -200,27 +199,6 @@ gimp_source_tool_button_press (GimpTool            *tool,
   gimp_draw_tool_resume (GIMP_DRAW_TOOL (tool));
 }
 
-static void
-gimp_source_tool_motion (GimpTool         *tool,
-                         const GimpCoords *coords,
-                         guint32           time,
-                         GdkModifierType   state,
-                         GimpDisplay      *display)
-{
-  GimpSourceTool *source_tool = GIMP_SOURCE_TOOL (tool);
-  GimpPaintTool  *paint_tool  = GIMP_PAINT_TOOL (tool);
-  GimpSourceCore *source      = GIMP_SOURCE_CORE (paint_tool->core);
-
-  gimp_draw_tool_pause (GIMP_DRAW_TOOL (tool));
-
-  GIMP_TOOL_CLASS (parent_class)->motion (tool, coords, time, state, display);
-
-  source_tool->src_x = source->src_x;
-  source_tool->src_y = source->src_y;
-
-  gimp_draw_tool_resume (GIMP_DRAW_TOOL (tool));
-}
-
 static void
 gimp_source_tool_modifier_key (GimpTool        *tool,
                                GdkModifierType  key,
@@ -428,6 +406,19 @@ gimp_source_tool_draw (GimpDrawTool *draw_tool)
     }
 }
 
+/*  motion events are only painted in batches, so the source position
+ *  is taken from the core after each batch
+ */
+static void
+gimp_source_tool_motions_painted (GimpPaintTool *paint_tool)
+{
+  GimpSourceTool *source_tool = GIMP_SOURCE_TOOL (paint_tool);
+  GimpSourceCore *source      = GIMP_SOURCE_CORE (paint_tool->core);
+
+  source_tool->src_x = source->src_x;
+  source_tool->src_y = source->src_y;
+}
+
 static void
 gimp_source_tool_set_src_display (GimpSourceTool *source_tool,
                                   GimpDisplay    *display)
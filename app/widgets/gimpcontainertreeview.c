@@ -31,6 +31,7 @@
 
 #include "core/gimpcontainer.h"
 #include "core/gimpcontext.h"
+#include "core/gimpdrawable.h"
 #include "core/gimpmarshal.h"
 #include "core/gimpviewable.h"
 
@@ -620,11 +621,27 @@ gimp_container_tree_view_insert_item (GimpContainerView *view,
 {
   GimpContainerTreeView *tree_view = GIMP_CONTAINER_TREE_VIEW (view);
   GtkTreeIter           *iter;
+  GimpViewRenderer      *renderer;
 
   iter = gimp_container_tree_store_insert_item (GIMP_CONTAINER_TREE_STORE (tree_view->model),
                                                 viewable,
                                                 parent_insert_data,
                                                 index);
+
+  /*  drawable previews are expensive, render them in the background
+   *  once their row is drawn, instead of blocking the expose
+   */
+  if (GIMP_IS_DRAWABLE (viewable))
+    {
+      gtk_tree_model_get (tree_view->model, iter,
+                          GIMP_CONTAINER_TREE_STORE_COLUMN_RENDERER, &renderer,
+                          -1);
+
+      gimp_view_renderer_set_deferred (renderer, TRUE);
+
+      g_object_unref (renderer);
+    }
+
   return iter;
 }
 
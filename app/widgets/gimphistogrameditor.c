@@ -55,6 +55,12 @@ static void     gimp_histogram_editor_layer_changed (GimpImage           *image,
 static void     gimp_histogram_editor_frozen_update (GimpHistogramEditor *editor,
                                                      const GParamSpec    *pspec);
 static void     gimp_histogram_editor_update        (GimpHistogramEditor *editor);
+static void     gimp_histogram_editor_area_update   (GimpDrawable        *drawable,
+                                                     gint                 x,
+                                                     gint                 y,
+                                                     gint                 width,
+                                                     gint                 height,
+                                                     GimpHistogramEditor *editor);
 
 static gboolean gimp_histogram_editor_idle_update   (GimpHistogramEditor *editor);
 static gboolean gimp_histogram_menu_sensitivity     (gint                 value,
@@ -325,7 +331,7 @@ gimp_histogram_editor_layer_changed (GimpImage           *image,
                                             gimp_histogram_editor_menu_update,
                                             editor);
       g_signal_handlers_disconnect_by_func (editor->drawable,
-                                            gimp_histogram_editor_update,
+                                            gimp_histogram_editor_area_update,
                                             editor);
       g_signal_handlers_disconnect_by_func (editor->drawable,
                                             gimp_histogram_editor_frozen_update,
@@ -333,6 +339,10 @@ gimp_histogram_editor_layer_changed (GimpImage           *image,
       editor->drawable = NULL;
     }
 
+  /*  forget the cached values of the previous drawable  */
+  if (editor->histogram)
+    gimp_histogram_calculate (editor->histogram, NULL, NULL);
+
   if (image)
     editor->drawable = (GimpDrawable *) gimp_image_get_active_layer (image);
 
@@ -344,8 +354,8 @@ gimp_histogram_editor_layer_changed (GimpImage           *image,
                                G_CALLBACK (gimp_histogram_editor_frozen_update),
                                editor, G_CONNECT_SWAPPED);
       g_signal_connect_object (editor->drawable, "update",
-                               G_CALLBACK (gimp_histogram_editor_update),
-                               editor, G_CONNECT_SWAPPED);
+                               G_CALLBACK (gimp_histogram_editor_area_update),
+                               editor, 0);
       g_signal_connect_object (editor->drawable, "alpha-changed",
                                G_CALLBACK (gimp_histogram_editor_menu_update),
                                editor, G_CONNECT_SWAPPED);
@@ -371,7 +381,8 @@ gimp_histogram_editor_validate (GimpHistogramEditor *editor)
   if (! editor->valid && editor->histogram)
     {
       if (editor->drawable)
-        gimp_drawable_calculate_histogram (editor->drawable, editor->histogram);
+        gimp_drawable_calculate_histogram_incremental (editor->drawable,
+                                                       editor->histogram);
       else
         gimp_histogram_calculate (editor->histogram, NULL, NULL);
 
@@ -429,6 +440,21 @@ gimp_histogram_editor_update (GimpHistogramEditor *editor)
                         NULL);
 }
 
+static void
+gimp_histogram_editor_area_update (GimpDrawable        *drawable,
+                                   gint                 x,
+                                   gint                 y,
+                                   gint                 width,
+                                   gint                 height,
+                                   GimpHistogramEditor *editor)
+{
+  /*  only the changed area needs to be counted again  */
+  if (editor->histogram)
+    gimp_histogram_invalidate_area (editor->histogram, x, y, width, height);
+
+  gimp_histogram_editor_update (editor);
+}
+
 static gboolean
 gimp_histogram_editor_idle_update (GimpHistogramEditor *editor)
 {
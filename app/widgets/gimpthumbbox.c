@@ -553,6 +553,7 @@ gimp_thumb_box_create_thumbnails (GimpThumbBox *box,
   GimpFileDialog *dialog   = NULL;
   GtkWidget      *toplevel;
   GSList         *list;
+  GimpThumbState *states   = NULL;
   gint            n_uris;
   gint            i;
 
@@ -589,10 +590,36 @@ gimp_thumb_box_create_thumbnails (GimpThumbBox *box,
 
       gimp_sub_progress_set_step (GIMP_SUB_PROGRESS (progress), 0, n_uris);
 
+      /*  check all thumbnails at once, without loading them, so the
+       *  ones that are up to date can be skipped
+       */
+      if (! force)
+        {
+          GimpBaseConfig  *config = GIMP_BASE_CONFIG (gimp->config);
+          gchar          **uris   = g_new0 (gchar *, n_uris + 1);
+
+          for (list = box->uris, i = 0; list; list = g_slist_next (list), i++)
+            uris[i] = list->data;
+
+          states = gimp_thumb_batch_process ((const gchar * const *) uris,
+                                             gimp->config->thumbnail_size,
+                                             NULL, NULL, NULL,
+                                             config->num_processors);
+
+          g_free (uris);
+        }
+
       for (list = box->uris->next, i = 1;
            list;
            list = g_slist_next (list), i++)
         {
+          if (states && states[i] == GIMP_THUMB_STATE_OK)
+            {
+              gimp_sub_progress_set_step (GIMP_SUB_PROGRESS (progress),
+                                          i, n_uris);
+              continue;
+            }
+
           str = g_strdup_printf (_("Thumbnail %d of %d"), i, n_uris);
           gtk_progress_bar_set_text (GTK_PROGRESS_BAR (box->progress), str);
           g_free (str);
@@ -637,6 +664,8 @@ gimp_thumb_box_create_thumbnails (GimpThumbBox *box,
 
  canceled:
 
+  g_free (states);
+
   if (n_uris > 1)
     {
       g_object_unref (progress);
@@ -44,6 +44,12 @@
 #include "gimpwidgets-utils.h"
 
 
+/*  how long the background rendering may block the main loop before
+ *  it lets it handle events again, in seconds
+ */
+#define RENDER_QUEUE_SLICE 0.02
+
+
 enum
 {
   UPDATE,
@@ -55,6 +61,8 @@ static void      gimp_view_renderer_dispose           (GObject            *objec
 static void      gimp_view_renderer_finalize          (GObject            *object);
 
 static gboolean  gimp_view_renderer_idle_update       (GimpViewRenderer   *renderer);
+static void      gimp_view_renderer_unqueue_render    (GimpViewRenderer   *renderer);
+static gboolean  gimp_view_renderer_render_queue_idle (gpointer            data);
 static void      gimp_view_renderer_real_set_context  (GimpViewRenderer   *renderer,
                                                        GimpContext        *context);
 static void      gimp_view_renderer_real_invalidate   (GimpViewRenderer   *renderer);
@@ -89,6 +97,12 @@ G_DEFINE_TYPE (GimpViewRenderer, gimp_view_renderer, G_TYPE_OBJECT)
 
 static guint renderer_signals[LAST_SIGNAL] = { 0 };
 
+/*  deferred renderers waiting for their preview, the ones that were
+ *  drawn last come first
+ */
+static GQueue   render_queue    = G_QUEUE_INIT;
+static guint    render_queue_id = 0;
+
 static GimpRGB  black_color;
 static GimpRGB  white_color;
 static GimpRGB  green_color;
@@ -155,6 +169,10 @@ gimp_view_renderer_init (GimpViewRenderer *renderer)
   renderer->size          = -1;
   renderer->needs_render  = TRUE;
   renderer->idle_id       = 0;
+
+  renderer->deferred      = FALSE;
+  renderer->render_widget = NULL;
+  renderer->render_link   = NULL;
 }
 
 static void
@@ -169,6 +187,7 @@ gimp_view_renderer_dispose (GObject *object)
     gimp_view_renderer_set_context (renderer, NULL);
 
   gimp_view_renderer_remove_idle (renderer);
+  gimp_view_renderer_unqueue_render (renderer);
 
   G_OBJECT_CLASS (parent_class)->dispose (object);
 }
@@ -582,6 +601,75 @@ gimp_view_renderer_remove_idle (GimpViewRenderer *renderer)
     }
 }
 
+/**
+ * gimp_view_renderer_set_deferred:
+ * @renderer: a #GimpViewRenderer
+ * @deferred: whether to render the preview in the background
+ *
+ * A deferred renderer does not render its preview when it is drawn.
+ * It draws what it has, or the viewable's icon if it has nothing yet,
+ * and queues itself to render the preview from an idle handler that
+ * emits "update" when done. Use this for views that show many
+ * previews at once.
+ **/
+void
+gimp_view_renderer_set_deferred (GimpViewRenderer *renderer,
+                                 gboolean          deferred)
+{
+  g_return_if_fail (GIMP_IS_VIEW_RENDERER (renderer));
+
+  renderer->deferred = deferred ? TRUE : FALSE;
+
+  if (! deferred)
+    gimp_view_renderer_unqueue_render (renderer);
+}
+
+/**
+ * gimp_view_renderer_queue_render:
+ * @renderer: a #GimpViewRenderer
+ * @widget:   the widget the preview is rendered for
+ *
+ * Queues @renderer to render its preview in the background, before
+ * the previews that were queued earlier.
+ **/
+void
+gimp_view_renderer_queue_render (GimpViewRenderer *renderer,
+                                 GtkWidget        *widget)
+{
+  g_return_if_fail (GIMP_IS_VIEW_RENDERER (renderer));
+  g_return_if_fail (GTK_IS_WIDGET (widget));
+
+  if (renderer->render_link)
+    {
+      g_queue_unlink (&render_queue, renderer->render_link);
+    }
+  else
+    {
+      renderer->render_link = g_list_alloc ();
+      renderer->render_link->data = g_object_ref (renderer);
+    }
+
+  if (renderer->render_widget != widget)
+    {
+      if (renderer->render_widget)
+        g_object_remove_weak_pointer (G_OBJECT (renderer->render_widget),
+                                      (gpointer) &renderer->render_widget);
+
+      renderer->render_widget = widget;
+
+      g_object_add_weak_pointer (G_OBJECT (renderer->render_widget),
+                                 (gpointer) &renderer->render_widget);
+    }
+
+  g_queue_push_head_link (&render_queue, renderer->render_link);
+
+  if (! render_queue_id)
+    render_queue_id =
+      g_idle_add_full (GIMP_VIEWABLE_PRIORITY_IDLE,
+                       gimp_view_renderer_render_queue_idle,
+                       NULL, NULL);
+}
+
 void
 gimp_view_renderer_draw (GimpViewRenderer *renderer,
                          GtkWidget        *widget,
@@ -657,6 +745,58 @@ gimp_view_renderer_idle_update (GimpViewRenderer *renderer)
   return FALSE;
 }
 
+static void
+gimp_view_renderer_unqueue_render (GimpViewRenderer *renderer)
+{
+  if (renderer->render_link)
+    {
+      g_queue_delete_link (&render_queue, renderer->render_link);
+      renderer->render_link = NULL;
+
+      g_object_unref (renderer);
+    }
+
+  if (renderer->render_widget)
+    {
+      g_object_remove_weak_pointer (G_OBJECT (renderer->render_widget),
+                                    (gpointer) &renderer->render_widget);
+      renderer->render_widget = NULL;
+    }
+}
+
+static gboolean
+gimp_view_renderer_render_queue_idle (gpointer data)
+{
+  GTimer *timer = g_timer_new ();
+
+  while (render_queue.head &&
+         g_timer_elapsed (timer, NULL) < RENDER_QUEUE_SLICE)
+    {
+      GimpViewRenderer *renderer = g_object_ref (render_queue.head->data);
+      GtkWidget        *widget   = renderer->render_widget;
+
+      gimp_view_renderer_unqueue_render (renderer);
+
+      if (renderer->needs_render && renderer->viewable && widget)
+        {
+          GIMP_VIEW_RENDERER_GET_CLASS (renderer)->render (renderer, widget);
+
+          gimp_view_renderer_update (renderer);
+        }
+
+      g_object_unref (renderer);
+    }
+
+  g_timer_destroy (timer);
+
+  if (render_queue.head)
+    return TRUE;
+
+  render_queue_id = 0;
+
+  return FALSE;
+}
+
 static void
 gimp_view_renderer_real_set_context (GimpViewRenderer *renderer,
                                      GimpContext      *context)
@@ -684,7 +824,27 @@ gimp_view_renderer_real_draw (GimpViewRenderer *renderer,
                               gint              available_height)
 {
   if (renderer->needs_render)
-    GIMP_VIEW_RENDERER_GET_CLASS (renderer)->render (renderer, widget);
+    {
+      if (renderer->deferred)
+        {
+          gimp_view_renderer_queue_render (renderer, widget);
+
+          /*  show the icon until the preview is there  */
+          if (! renderer->pixbuf && ! renderer->surface)
+            {
+              const gchar *stock_id;
+
+              stock_id = gimp_viewable_get_stock_id (renderer->viewable);
+
+              gimp_view_renderer_render_stock (renderer, widget, stock_id);
+              renderer->needs_render = TRUE;
+            }
+        }
+      else
+        {
+          GIMP_VIEW_RENDERER_GET_CLASS (renderer)->render (renderer, widget);
+        }
+    }
 
   if (renderer->pixbuf)
     {
@@ -64,6 +64,10 @@ struct _GimpViewRenderer
   gint                size;
   gboolean            needs_render;
   guint               idle_id;
+
+  gboolean            deferred;
+  GtkWidget          *render_widget;
+  GList              *render_link;
 };
 
 struct _GimpViewRendererClass
@@ -132,6 +136,11 @@ void   gimp_view_renderer_update           (GimpViewRenderer   *renderer);
 void   gimp_view_renderer_update_idle      (GimpViewRenderer   *renderer);
 void   gimp_view_renderer_remove_idle      (GimpViewRenderer   *renderer);
 
+void   gimp_view_renderer_set_deferred     (GimpViewRenderer   *renderer,
+                                            gboolean            deferred);
+void   gimp_view_renderer_queue_render     (GimpViewRenderer   *renderer,
+                                            GtkWidget          *widget);
+
 void   gimp_view_renderer_draw             (GimpViewRenderer   *renderer,
                                             GtkWidget          *widget,
                                             cairo_t            *cr,
@@ -0,0 +1,267 @@
+/*
+ * gimp-thumbnail-prewarm.c
+ *
+ * Creates the missing and outdated thumbnails of all images below the
+ * folders given on the command line, for the image formats known to
+ * gdk-pixbuf.
+ */
+
+#include <string.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <libgimpthumb/gimpthumb.h>
+
+
+#define SOFTWARE "gimp-thumbnail-prewarm"
+
+
+static gboolean    parse_option_size (const gchar    *option_name,
+                                      const gchar    *value,
+                                      gpointer        data,
+                                      GError        **error);
+static void        process_folder    (const gchar    *folder,
+                                      GPtrArray      *uris);
+static GdkPixbuf * create_thumbnail  (GimpThumbnail  *thumbnail,
+                                      GimpThumbSize   size,
+                                      gpointer        data,
+                                      GError        **error);
+
+
+static GimpThumbSize   option_size    = GIMP_THUMB_SIZE_NORMAL;
+static gint            option_threads = 4;
+static gboolean        option_check   = FALSE;
+static gboolean        option_verbose = FALSE;
+
+
+static const GOptionEntry main_entries[] =
+{
+  {
+    "size", 's', 0,
+    G_OPTION_ARG_CALLBACK, parse_option_size,
+    "Size of the thumbnails (normal|large)",
+    "<size>"
+  },
+  {
+    "threads", 't', 0,
+    G_OPTION_ARG_INT, &option_threads,
+    "Number of threads to use", "<n>"
+  },
+  {
+    "check", 'c', 0,
+    G_OPTION_ARG_NONE, &option_check,
+    "Only check the thumbnails, don't create them", NULL
+  },
+  {
+    "verbose", 'v', 0,
+    G_OPTION_ARG_NONE, &option_verbose,
+    "Print the thumbnail state of every file", NULL
+  },
+  { NULL }
+};
+
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  GOptionContext *context;
+  GPtrArray      *uris;
+  GimpThumbState *states;
+  GEnumClass     *enum_class;
+  GTimer         *timer;
+  gint            n_uris;
+  gint            n_ok = 0;
+  gint            i;
+  GError         *error = NULL;
+
+  g_thread_init (NULL);
+  g_type_init ();
+
+  context = g_option_context_new ("<folder>...");
+  g_option_context_add_main_entries (context, main_entries, NULL);
+
+  if (! g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return -1;
+    }
+
+  if (argc < 2)
+    {
+      g_printerr ("No folder given\n");
+      return -1;
+    }
+
+  if (! gimp_thumb_init (SOFTWARE, NULL))
+    {
+      g_printerr ("Could not initialize the thumbnail system\n");
+      return -1;
+    }
+
+  /*  load the gdk-pixbuf loaders before the threads need them  */
+  g_slist_free (gdk_pixbuf_get_formats ());
+
+  uris = g_ptr_array_new ();
+
+  for (i = 1; i < argc; i++)
+    process_folder (argv[i], uris);
+
+  n_uris = uris->len;
+  g_ptr_array_add (uris, NULL);
+
+  timer = g_timer_new ();
+
+  states = gimp_thumb_batch_process ((const gchar * const *) uris->pdata,
+                                     option_size,
+                                     option_check ? NULL : create_thumbnail,
+                                     NULL, SOFTWARE, option_threads);
+
+  g_timer_stop (timer);
+
+  enum_class = g_type_class_ref (GIMP_TYPE_THUMB_STATE);
+
+  for (i = 0; i < n_uris; i++)
+    {
+      if (states[i] == GIMP_THUMB_STATE_OK)
+        n_ok++;
+
+      if (option_verbose)
+        {
+          GEnumValue *value = g_enum_get_value (enum_class, states[i]);
+
+          g_print ("%s %s\n", value->value_nick,
+                   (const gchar *) g_ptr_array_index (uris, i));
+        }
+    }
+
+  g_print ("%d of %d thumbnails up to date (%.2f seconds)\n",
+           n_ok, n_uris, g_timer_elapsed (timer, NULL));
+
+  g_type_class_unref (enum_class);
+  g_timer_destroy (timer);
+  g_free (states);
+
+  g_ptr_array_foreach (uris, (GFunc) g_free, NULL);
+  g_ptr_array_free (uris, TRUE);
+
+  return 0;
+}
+
+static gboolean
+parse_option_size (const gchar  *option_name,
+                   const gchar  *value,
+                   gpointer      data,
+                   GError      **error)
+{
+  if (strcmp (value, "normal") == 0)
+    option_size = GIMP_THUMB_SIZE_NORMAL;
+  else if (strcmp (value, "large") == 0)
+    option_size = GIMP_THUMB_SIZE_LARGE;
+  else
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   "Invalid size \"%s\" for %s, use normal or large",
+                   value, option_name);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+process_folder (const gchar *folder,
+                GPtrArray   *uris)
+{
+  GDir        *dir;
+  const gchar *name;
+  GError      *error = NULL;
+
+  dir = g_dir_open (folder, 0, &error);
+
+  if (! dir)
+    {
+      g_printerr ("Error opening '%s': %s\n", folder, error->message);
+      g_clear_error (&error);
+      return;
+    }
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      gchar *filename;
+
+      /*  skip hidden files, and with them the .thumblocal folders  */
+      if (name[0] == '.')
+        continue;
+
+      filename = g_build_filename (folder, name, NULL);
+
+      if (g_file_test (filename, G_FILE_TEST_IS_DIR))
+        {
+          process_folder (filename, uris);
+        }
+      else if (g_file_test (filename, G_FILE_TEST_IS_REGULAR))
+        {
+          gchar *uri = g_filename_to_uri (filename, NULL, NULL);
+
+          if (uri)
+            g_ptr_array_add (uris, uri);
+        }
+
+      g_free (filename);
+    }
+
+  g_dir_close (dir);
+}
+
+/*  runs in the threads of gimp_thumb_batch_process()  */
+static GdkPixbuf *
+create_thumbnail (GimpThumbnail  *thumbnail,
+                  GimpThumbSize   size,
+                  gpointer        data,
+                  GError        **error)
+{
+  GdkPixbufFormat *format;
+  GdkPixbuf       *pixbuf;
+  gchar           *filename;
+  gchar          **mime_types;
+  gint             width;
+  gint             height;
+
+  filename = g_filename_from_uri (thumbnail->image_uri, NULL, NULL);
+
+  if (! filename)
+    return NULL;
+
+  format = gdk_pixbuf_get_file_info (filename, &width, &height);
+
+  /*  not an image gdk-pixbuf knows, leave it alone instead of
+   *  recording a failure, GIMP may well be able to open it
+   */
+  if (! format)
+    {
+      g_free (filename);
+      return NULL;
+    }
+
+  /*  don't scale up images that are smaller than the thumbnail  */
+  if (width <= size && height <= size)
+    pixbuf = gdk_pixbuf_new_from_file (filename, error);
+  else
+    pixbuf = gdk_pixbuf_new_from_file_at_size (filename, size, size, error);
+
+  if (pixbuf)
+    {
+      mime_types = gdk_pixbuf_format_get_mime_types (format);
+
+      g_object_set (thumbnail,
+                    "image-width",    width,
+                    "image-height",   height,
+                    "image-mimetype", mime_types ? mime_types[0] : NULL,
+                    NULL);
+
+      g_strfreev (mime_types);
+    }
+
+  g_free (filename);
+
+  return pixbuf;
+}
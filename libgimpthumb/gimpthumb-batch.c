@@ -0,0 +1,347 @@
+/* LIBGIMP - The GIMP Library
+ * Copyright (C) 1995-1997 Peter Mattis and Spencer Kimball
+ *
+ * Thumbnail handling according to the Thumbnail Managing Standard.
+ * http://triq.net/~pearl/thumbnail-spec/
+ *
+ * Copyright (C) 2001-2003  Sven Neumann <sven@gimp.org>
+ *                          Michael Natterer <mitch@gimp.org>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib/gstdio.h>
+
+#include "gimpthumb-types.h"
+#include "gimpthumb-utils.h"
+#include "gimpthumbnail.h"
+#include "gimpthumb-batch.h"
+
+
+/**
+ * SECTION: gimpthumb-batch
+ * @title: GimpThumb-batch
+ * @short_description: Checking and creating many thumbnails at once
+ *
+ * Checking and creating the thumbnails of many image files at once,
+ * in parallel.
+ **/
+
+
+/*  the text chunks we read are short, don't read anything bigger  */
+#define MAX_TEXT_CHUNK  4096
+
+
+typedef struct
+{
+  const gchar * const *uris;
+  GimpThumbState      *states;
+  GimpThumbSize        size;
+  GimpThumbBatchFunc   func;
+  gpointer             user_data;
+  const gchar         *software;
+} GimpThumbBatch;
+
+
+static GimpThumbState gimp_thumb_batch_process_uri (GimpThumbBatch *batch,
+                                                    const gchar    *uri);
+static void           gimp_thumb_batch_worker      (gpointer        data,
+                                                    gpointer        user_data);
+static gboolean       gimp_thumb_batch_is_current  (GimpThumbnail  *thumbnail);
+static gboolean       gimp_thumb_batch_read_tags   (const gchar    *filename,
+                                                    gchar         **uri,
+                                                    gchar         **mtime,
+                                                    gchar         **size);
+
+
+/**
+ * gimp_thumb_batch_process:
+ * @uris:      a %NULL-terminated array of escaped URIs
+ * @size:      the preferred size of the thumbnails
+ * @func:      the function creating missing thumbnails, or %NULL
+ * @user_data: data to pass to @func
+ * @software:  the name of the software creating the thumbnails
+ * @n_threads: the number of threads to use
+ *
+ * Checks the thumbnails of all image files in @uris, using up to
+ * @n_threads threads. Unlike gimp_thumbnail_check_thumb(), this
+ * doesn't decode the thumbnails: it only reads the text chunks in
+ * front of the image data, which is enough to decide if a thumbnail
+ * is up to date.
+ *
+ * If @func is not %NULL, it is called for every image without a
+ * thumbnail or with an outdated one, and its result is saved as the
+ * new thumbnail. If @func fails with an error, a failure thumbnail is
+ * saved instead, so the image is not tried again until it changes.
+ * If saving either of them fails, the thumbnail keeps the state it
+ * was found in, %GIMP_THUMB_STATE_NOT_FOUND or %GIMP_THUMB_STATE_OLD.
+ *
+ * Return value: a newly allocated array with the #GimpThumbState of
+ *               the thumbnail of each of the @uris, after creating
+ *               it, or the #GimpThumbState of the image itself if it
+ *               can't have one. Free it with g_free().
+ *
+ * Since: GIMP 2.8
+ **/
+GimpThumbState *
+gimp_thumb_batch_process (const gchar * const *uris,
+                          GimpThumbSize        size,
+                          GimpThumbBatchFunc   func,
+                          gpointer             user_data,
+                          const gchar         *software,
+                          gint                 n_threads)
+{
+  GimpThumbBatch  batch;
+  GThreadPool    *pool = NULL;
+  gint            n_uris;
+  gint            i;
+
+  g_return_val_if_fail (uris != NULL, NULL);
+  g_return_val_if_fail (func == NULL || software != NULL, NULL);
+
+  n_uris = g_strv_length ((gchar **) uris);
+
+  batch.uris      = uris;
+  batch.states    = g_new0 (GimpThumbState, n_uris);
+  batch.size      = size;
+  batch.func      = func;
+  batch.user_data = user_data;
+  batch.software  = software;
+
+  /*  create the folders up front, the threads would race for it  */
+  if (func)
+    {
+      gimp_thumb_ensure_thumb_dir (size, NULL);
+      gimp_thumb_ensure_thumb_dir (GIMP_THUMB_SIZE_FAIL, NULL);
+    }
+
+  if (n_threads > 1 && n_uris > 1 && g_thread_supported ())
+    pool = g_thread_pool_new (gimp_thumb_batch_worker, &batch,
+                              MIN (n_threads, n_uris), TRUE, NULL);
+
+  if (pool)
+    {
+      /*  the index is offset by one, NULL can't be pushed  */
+      for (i = 0; i < n_uris; i++)
+        g_thread_pool_push (pool, GINT_TO_POINTER (i + 1), NULL);
+
+      g_thread_pool_free (pool, FALSE, TRUE);
+    }
+  else
+    {
+      for (i = 0; i < n_uris; i++)
+        batch.states[i] = gimp_thumb_batch_process_uri (&batch, uris[i]);
+    }
+
+  return batch.states;
+}
+
+
+/*  private functions  */
+
+static void
+gimp_thumb_batch_worker (gpointer data,
+                         gpointer user_data)
+{
+  GimpThumbBatch *batch = user_data;
+  gint            i     = GPOINTER_TO_INT (data) - 1;
+
+  batch->states[i] = gimp_thumb_batch_process_uri (batch, batch->uris[i]);
+}
+
+static GimpThumbState
+gimp_thumb_batch_process_uri (GimpThumbBatch *batch,
+                              const gchar    *uri)
+{
+  GimpThumbnail  *thumbnail = gimp_thumbnail_new ();
+  GimpThumbState  state;
+  GdkPixbuf      *pixbuf;
+  GError         *error     = NULL;
+
+  gimp_thumbnail_set_uri (thumbnail, uri);
+
+  state = gimp_thumbnail_peek_image (thumbnail);
+
+  if (state != GIMP_THUMB_STATE_EXISTS)
+    goto out;
+
+  state = gimp_thumbnail_peek_thumb (thumbnail, batch->size);
+
+  if (state == GIMP_THUMB_STATE_EXISTS || state == GIMP_THUMB_STATE_FAILED)
+    {
+      if (! gimp_thumb_batch_is_current (thumbnail))
+        state = GIMP_THUMB_STATE_OLD;
+      else if (state == GIMP_THUMB_STATE_EXISTS)
+        state = GIMP_THUMB_STATE_OK;
+    }
+
+  /*  a smaller thumbnail than asked for is as good as none here  */
+  if (state == GIMP_THUMB_STATE_OK && thumbnail->thumb_size < batch->size)
+    state = GIMP_THUMB_STATE_NOT_FOUND;
+
+  if (! batch->func ||
+      (state != GIMP_THUMB_STATE_NOT_FOUND && state != GIMP_THUMB_STATE_OLD))
+    goto out;
+
+  pixbuf = batch->func (thumbnail, batch->size, batch->user_data, &error);
+
+  if (pixbuf)
+    {
+      if (gimp_thumbnail_save_thumb (thumbnail, pixbuf,
+                                     batch->software, &error))
+        state = GIMP_THUMB_STATE_OK;
+
+      g_object_unref (pixbuf);
+    }
+  else if (error)
+    {
+      g_clear_error (&error);
+
+      if (gimp_thumbnail_save_failure (thumbnail, batch->software, &error))
+        state = GIMP_THUMB_STATE_FAILED;
+    }
+
+  /*  a thumbnail that could not be saved keeps its old state  */
+  g_clear_error (&error);
+
+ out:
+  g_object_unref (thumbnail);
+
+  return state;
+}
+
+/*  does the same checks as gimp_thumbnail_load_thumb(), but without
+ *  decoding the thumbnail
+ */
+static gboolean
+gimp_thumb_batch_is_current (GimpThumbnail *thumbnail)
+{
+  gchar    *uri     = NULL;
+  gchar    *mtime   = NULL;
+  gchar    *size    = NULL;
+  gboolean  current = FALSE;
+
+  if (gimp_thumb_batch_read_tags (thumbnail->thumb_filename,
+                                  &uri, &mtime, &size) &&
+      uri && mtime)
+    {
+      const gchar *baseuri = strrchr (thumbnail->image_uri, '/');
+      gint64       image_mtime;
+      gint64       image_size;
+
+      if ((strcmp (uri, thumbnail->image_uri) == 0 ||
+           (baseuri && strcmp (uri, baseuri) == 0))                 &&
+          sscanf (mtime, "%" G_GINT64_FORMAT, &image_mtime) == 1    &&
+          image_mtime == thumbnail->image_mtime                     &&
+          /*  the size is optional but must match if present  */
+          (! size ||
+           (sscanf (size, "%" G_GINT64_FORMAT, &image_size) == 1 &&
+            image_size == thumbnail->image_filesize)))
+        {
+          current = TRUE;
+        }
+    }
+
+  g_free (uri);
+  g_free (mtime);
+  g_free (size);
+
+  return current;
+}
+
+static guint32
+gimp_thumb_batch_get_uint32 (const guchar *data)
+{
+  return ((guint32) data[0] << 24 | (guint32) data[1] << 16 |
+          (guint32) data[2] <<  8 | (guint32) data[3]);
+}
+
+/*  reads the Thumb:: text chunks of a PNG file, stopping at the
+ *  first chunk of image data, which they precede in all thumbnails
+ *  written by us and by the other implementations of the standard
+ */
+static gboolean
+gimp_thumb_batch_read_tags (const gchar  *filename,
+                            gchar       **uri,
+                            gchar       **mtime,
+                            gchar       **size)
+{
+  static const guchar  signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+  FILE                *file;
+  guchar               header[8];
+  gchar                text[MAX_TEXT_CHUNK];
+  gboolean             success = FALSE;
+
+  file = g_fopen (filename, "rb");
+  if (! file)
+    return FALSE;
+
+  if (fread (header, 1, 8, file) != 8 || memcmp (header, signature, 8))
+    goto out;
+
+  while (fread (header, 1, 8, file) == 8)
+    {
+      guint32 length = gimp_thumb_batch_get_uint32 (header);
+      guchar *type   = header + 4;
+
+      if (! memcmp (type, "IDAT", 4) || ! memcmp (type, "IEND", 4))
+        {
+          success = TRUE;
+          break;
+        }
+
+      if (! memcmp (type, "tEXt", 4) && length < sizeof (text))
+        {
+          gsize keylen;
+
+          if (fread (text, 1, length, file) != length)
+            break;
+
+          text[length] = '\0';
+          keylen = strlen (text);
+
+          if (keylen < length)
+            {
+              const gchar *value = text + keylen + 1;
+
+              if (! *uri && ! strcmp (text, "Thumb::URI"))
+                *uri = g_strdup (value);
+              else if (! *mtime && ! strcmp (text, "Thumb::MTime"))
+                *mtime = g_strdup (value);
+              else if (! *size && ! strcmp (text, "Thumb::Size"))
+                *size = g_strdup (value);
+            }
+
+          /*  skip the CRC  */
+          if (fseek (file, 4, SEEK_CUR))
+            break;
+        }
+      else if (fseek (file, (glong) length + 4, SEEK_CUR))
+        {
+          break;
+        }
+    }
+
+ out:
+  fclose (file);
+
+  return success;
+}
@@ -0,0 +1,67 @@
+/* LIBGIMP - The GIMP Library
+ * Copyright (C) 1995-1997 Peter Mattis and Spencer Kimball
+ *
+ * Thumbnail handling according to the Thumbnail Managing Standard.
+ * http://triq.net/~pearl/thumbnail-spec/
+ *
+ * Copyright (C) 2001-2003  Sven Neumann <sven@gimp.org>
+ *                          Michael Natterer <mitch@gimp.org>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined (__GIMP_THUMB_H_INSIDE__) && !defined (GIMP_THUMB_COMPILATION)
+#error "Only <libgimpthumb/gimpthumb.h> can be included directly."
+#endif
+
+#ifndef __GIMP_THUMB_BATCH_H__
+#define __GIMP_THUMB_BATCH_H__
+
+G_BEGIN_DECLS
+
+
+/**
+ * GimpThumbBatchFunc:
+ * @thumbnail: the #GimpThumbnail of the image, already peeked
+ * @size:      the preferred size of the thumbnail
+ * @user_data: the data passed to gimp_thumb_batch_process()
+ * @error:     return location for possible errors
+ *
+ * Creates the thumbnail for the image of @thumbnail. It may set the
+ * image properties of @thumbnail (like "image-width") before
+ * returning. It is called from the threads of the batch and must not
+ * touch any state of the caller that is not thread-safe.
+ *
+ * Return value: a new #GdkPixbuf, or %NULL with @error set if the
+ *               image could not be read (which is then recorded as a
+ *               failure), or %NULL without @error to skip the image.
+ **/
+typedef GdkPixbuf * (* GimpThumbBatchFunc) (GimpThumbnail  *thumbnail,
+                                            GimpThumbSize   size,
+                                            gpointer        user_data,
+                                            GError        **error);
+
+
+GimpThumbState * gimp_thumb_batch_process (const gchar * const *uris,
+                                           GimpThumbSize        size,
+                                           GimpThumbBatchFunc   func,
+                                           gpointer             user_data,
+                                           const gchar         *software,
+                                           gint                 n_threads);
+
+
+G_END_DECLS
+
+#endif /* __GIMP_THUMB_BATCH_H__ */
@@ -59,7 +59,8 @@ static gint           gimp_thumb_size       (GimpThumbSize  size);
 static gchar        * gimp_thumb_png_lookup (const gchar   *name,
                                              const gchar   *basedir,
                                              GimpThumbSize *size) G_GNUC_MALLOC;
-static const gchar  * gimp_thumb_png_name   (const gchar   *uri);
+static void           gimp_thumb_png_name   (const gchar   *uri,
+                                             gchar         *name);
 static void           gimp_thumb_exit       (void);
 
 
@@ -343,6 +344,8 @@ gchar *
 gimp_thumb_name_from_uri (const gchar   *uri,
                           GimpThumbSize  size)
 {
+  gchar name[40];
+
   g_return_val_if_fail (gimp_thumb_initialized, NULL);
   g_return_val_if_fail (uri != NULL, NULL);
 
@@ -351,9 +354,9 @@ gimp_thumb_name_from_uri (const gchar   *uri,
 
   size = gimp_thumb_size (size);
 
-  return g_build_filename (thumb_subdirs[size],
-                           gimp_thumb_png_name (uri),
-                           NULL);
+  gimp_thumb_png_name (uri, name);
+
+  return g_build_filename (thumb_subdirs[size], name, NULL);
 }
 
 /**
@@ -377,6 +380,7 @@ gimp_thumb_name_from_uri_local (const gchar   *uri,
 {
   gchar *filename;
   gchar *result = NULL;
+  gchar  name[40];
 
   g_return_val_if_fail (gimp_thumb_initialized, NULL);
   g_return_val_if_fail (uri != NULL, NULL);
@@ -396,9 +400,11 @@ gimp_thumb_name_from_uri_local (const gchar   *uri,
           gchar *dirname = g_path_get_dirname (filename);
           gint   i       = gimp_thumb_size (size);
 
+          gimp_thumb_png_name (uri, name);
+
           result = g_build_filename (dirname,
                                      ".thumblocal", thumb_sizenames[i],
-                                     gimp_thumb_png_name (uri),
+                                     name,
                                      NULL);
 
           g_free (dirname);
@@ -436,13 +442,16 @@ gimp_thumb_find_thumb (const gchar   *uri,
                        GimpThumbSize *size)
 {
   gchar *result;
+  gchar  name[40];
 
   g_return_val_if_fail (gimp_thumb_initialized, NULL);
   g_return_val_if_fail (uri != NULL, NULL);
   g_return_val_if_fail (size != NULL, NULL);
   g_return_val_if_fail (*size > GIMP_THUMB_SIZE_FAIL, NULL);
 
-  result = gimp_thumb_png_lookup (gimp_thumb_png_name (uri), NULL, size);
+  gimp_thumb_png_name (uri, name);
+
+  result = gimp_thumb_png_lookup (name, NULL, size);
 
   if (! result)
     {
@@ -456,8 +465,9 @@ gimp_thumb_find_thumb (const gchar   *uri,
             {
               gchar *dirname = g_path_get_dirname (filename);
 
-              result = gimp_thumb_png_lookup (gimp_thumb_png_name (baseuri + 1),
-                                              dirname, size);
+              gimp_thumb_png_name (baseuri + 1, name);
+
+              result = gimp_thumb_png_lookup (name, dirname, size);
 
               g_free (dirname);
             }
@@ -765,11 +775,13 @@ gimp_thumb_png_lookup (const gchar   *name,
   return thumb_name;
 }
 
-static const gchar *
-gimp_thumb_png_name (const gchar *uri)
+/*  writes to a buffer of the caller, so this can be used from more
+ *  than one thread, name needs room for at least 37 bytes
+ */
+static void
+gimp_thumb_png_name (const gchar *uri,
+                     gchar       *name)
 {
-  static gchar name[40];
-
   GChecksum *checksum;
   guchar     digest[16];
   gsize      len = sizeof (digest);
@@ -792,6 +804,4 @@ gimp_thumb_png_name (const gchar *uri)
     }
 
   strncpy (name + 32, ".png", 5);
-
-  return (const gchar *) name;
 }
@@ -29,6 +29,7 @@
 
 #include <libgimpthumb/gimpthumb-types.h>
 
+#include <libgimpthumb/gimpthumb-batch.h>
 #include <libgimpthumb/gimpthumb-error.h>
 #include <libgimpthumb/gimpthumb-utils.h>
 #include <libgimpthumb/gimpthumbnail.h>
@@ -29,6 +29,9 @@
  *   offsets_dialog()            - Asks the user about offsets when loading.
  *   respin_cmap()               - Re-order a Gimp colormap for PNG tRNS
  *   save_image()                - Save the specified image to a PNG file.
+ *   parallel_writer_new()       - Set up compressing in parallel.
+ *   parallel_writer_write_rows() - Filter and deflate rows on all cores.
+ *   parallel_writer_finish()    - Write the last IDAT and the IEND chunk.
  *   save_compression_callback() - Update the image compression level.
  *   save_interlace_update()     - Update the interlacing option.
  *   save_dialog()               - Pop up the save dialog.
@@ -41,6 +44,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
 #include <glib/gstdio.h>
@@ -49,6 +53,7 @@
 #include <libgimp/gimpui.h>
 
 #include <png.h>                /* PNG library definitions */
+#include <zlib.h>
 
 #include "libgimp/stdplugins-intl.h"
 
@@ -73,10 +78,23 @@
 
 #define PNG_DEFAULTS_PARASITE  "png-save-defaults"
 
+#define PARALLEL_BLOCK_SIZE    (128 * 1024) /* Filtered bytes per block    */
+#define PARALLEL_BLOCKS        2            /* Blocks per thread and batch */
+#define PARALLEL_DICT_SIZE     32768        /* The deflate window          */
+#define PARALLEL_IDAT_SIZE     (64 * 1024)  /* Maximum IDAT chunk length   */
+
 /*
  * Structures...
  */
 
+typedef enum
+{
+  PNG_SAVE_FILTER_ADAPTIVE,     /* Best of all filters per row, smallest */
+  PNG_SAVE_FILTER_PAETH,        /* Paeth for all rows                    */
+  PNG_SAVE_FILTER_NONE          /* No filtering, fastest                 */
+}
+PngSaveFilter;
+
 typedef struct
 {
   gboolean  interlaced;
@@ -88,6 +106,8 @@ typedef struct
   gboolean  comment;
   gboolean  save_transp_pixels;
   gint      compression_level;
+  gint      filter;
+  gboolean  parallel;
 }
 PngSaveVals;
 
@@ -104,6 +124,8 @@ typedef struct
   GtkWidget *comment;
   GtkWidget *save_transp_pixels;
   GtkAdjustment *compression_level;
+  GtkWidget *filter;
+  GtkWidget *parallel;
 }
 PngSaveGui;
 
@@ -119,6 +141,53 @@ typedef struct
 }
 PngGlobals;
 
+/* A run of rows that is filtered and deflated by one thread. */
+typedef struct
+{
+  const guchar *rows;           /* Unfiltered rows                       */
+  const guchar *prev_row;       /* Unfiltered row above the first one    */
+  gint          n_rows;
+  guchar       *filtered;       /* Filter type byte and row, per row     */
+  gsize         filtered_len;
+  const guchar *dict;           /* Filtered data preceding the block     */
+  gsize         dict_len;
+  gboolean      last;           /* Finish the deflate stream             */
+  guchar       *out;            /* Raw deflate data                      */
+  gsize         out_len;
+  gsize         out_size;
+  uLong         adler;          /* Adler-32 of the filtered data         */
+  gboolean      failed;
+}
+PngBlock;
+
+/* Compresses the image data like libpng would, but in independent
+ * blocks on several threads. Every block is primed with the last 32k
+ * of the data before it and ends with a sync flush, so the blocks
+ * concatenate to one zlib stream.
+ */
+typedef struct
+{
+  png_structp    pp;
+  gint           height;
+  gint           rows_written;
+  gsize          rowbytes;
+  gint           pixel_bytes;
+  gint           level;
+  PngSaveFilter  filter;
+  gint           n_threads;
+  gint           block_rows;    /* Rows per block                        */
+  gint           batch_rows;    /* Rows per batch of blocks              */
+  guchar        *raw;           /* Unfiltered rows of the current batch  */
+  gint           n_rows;
+  guchar        *prev_row;      /* Last row of the previous batch        */
+  guchar        *dict;          /* Filtered tail of the previous batch   */
+  gsize          dict_len;
+  PngBlock      *blocks;
+  uLong          adler;
+  GByteArray    *idat;
+}
+PngParallelWriter;
+
 /*
  * Local functions...
  */
@@ -164,6 +233,19 @@ static void      load_defaults             (void);
 static void      save_defaults             (void);
 static void      load_gui_defaults         (PngSaveGui       *pg);
 
+static gint      get_num_processors        (void);
+
+static PngParallelWriter *
+                 parallel_writer_new       (png_structp        pp,
+                                            png_infop          info,
+                                            gint               n_threads);
+static gboolean  parallel_writer_write_rows
+                                           (PngParallelWriter  *pw,
+                                            guchar            **rows,
+                                            gint                n_rows);
+static void      parallel_writer_finish    (PngParallelWriter  *pw);
+static void      parallel_writer_free      (PngParallelWriter  *pw);
+
 /*
  * Globals...
  */
@@ -186,7 +268,9 @@ static const PngSaveVals defaults =
   TRUE,
   TRUE,
   TRUE,
-  9
+  9,
+  PNG_SAVE_FILTER_ADAPTIVE,
+  TRUE
 };
 
 static PngSaveVals pngvals;
@@ -1325,6 +1409,8 @@ save_image (const gchar  *filename,
 
   png_textp  text = NULL;
 
+  PngParallelWriter *pw = NULL; /* Parallel compression, if used */
+
   pp = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
   if (!pp)
     {
@@ -1450,6 +1536,22 @@ save_image (const gchar  *filename,
 
   png_set_compression_level (pp, pngvals.compression_level);
 
+  /* Set the filters, libpng chooses them adaptively by default */
+
+  switch (pngvals.filter)
+    {
+    case PNG_SAVE_FILTER_PAETH:
+      png_set_filter (pp, PNG_FILTER_TYPE_BASE, PNG_FILTER_PAETH);
+      break;
+
+    case PNG_SAVE_FILTER_NONE:
+      png_set_filter (pp, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+      break;
+
+    default:
+      break;
+    }
+
   /* All this stuff is optional extras, if the user is aiming for smallest
      possible file size she can turn them all off */
 
@@ -1609,6 +1711,19 @@ save_image (const gchar  *filename,
       bit_depth < 8)
     png_set_packing (pp);
 
+  /*
+   * Compress in parallel, this bypasses libpng's row handling so
+   * it is only done when no interlacing or packing is needed
+   */
+
+  if (pngvals.parallel && num_passes == 1 && bit_depth == 8)
+    {
+      gint n_threads = get_num_processors ();
+
+      if (n_threads > 1)
+        pw = parallel_writer_new (pp, info, n_threads);
+    }
+
   /*
    * Allocate memory for "tile_height" rows and save the image...
    */
@@ -1694,7 +1809,26 @@ save_image (const gchar  *filename,
                 }
             }
 
-          png_write_rows (pp, pixels, num);
+          if (! pw)
+            {
+              png_write_rows (pp, pixels, num);
+            }
+          else if (! parallel_writer_write_rows (pw, pixels, num))
+            {
+              g_set_error (error, 0, 0,
+                           _("Error while saving '%s'. Could not save image."),
+                           gimp_filename_to_utf8 (filename));
+
+              parallel_writer_free (pw);
+              png_destroy_write_struct (&pp, &info);
+
+              g_free (pixel);
+              g_free (pixels);
+
+              fclose (fp);
+
+              return FALSE;
+            }
 
           gimp_progress_update (((double) pass + (double) end /
                                  (double) drawable->height) /
@@ -1704,7 +1838,16 @@ save_image (const gchar  *filename,
 
   gimp_progress_update (1.0);
 
-  png_write_end (pp, info);
+  if (pw)
+    {
+      parallel_writer_finish (pw);
+      parallel_writer_free (pw);
+    }
+  else
+    {
+      png_write_end (pp, info);
+    }
+
   png_destroy_write_struct (&pp, &info);
 
   g_free (pixel);
@@ -1728,6 +1871,494 @@ save_image (const gchar  *filename,
   return TRUE;
 }
 
+/*
+ * 'get_num_processors()' - How many threads to compress with.
+ */
+
+static gint
+get_num_processors (void)
+{
+  gchar *value = gimp_gimprc_query ("num-processors");
+  gint   n     = 1;
+
+  if (value)
+    n = atoi (value);
+
+  g_free (value);
+
+  return MAX (n, 1);
+}
+
+/*
+ * 'filter_row()' - Apply one of the PNG filters to a row.
+ */
+
+static void
+filter_row (guchar        type,
+            const guchar *row,
+            const guchar *prev,
+            gsize         rowbytes,
+            gsize         bpp,
+            guchar       *out)
+{
+  gsize i;
+
+  *out++ = type;
+
+  switch (type)
+    {
+    case PNG_FILTER_VALUE_NONE:
+      memcpy (out, row, rowbytes);
+      break;
+
+    case PNG_FILTER_VALUE_SUB:
+      for (i = 0; i < bpp; i++)
+        out[i] = row[i];
+      for (; i < rowbytes; i++)
+        out[i] = row[i] - row[i - bpp];
+      break;
+
+    case PNG_FILTER_VALUE_UP:
+      for (i = 0; i < rowbytes; i++)
+        out[i] = row[i] - prev[i];
+      break;
+
+    case PNG_FILTER_VALUE_AVG:
+      for (i = 0; i < bpp; i++)
+        out[i] = row[i] - (prev[i] >> 1);
+      for (; i < rowbytes; i++)
+        out[i] = row[i] - ((row[i - bpp] + prev[i]) >> 1);
+      break;
+
+    case PNG_FILTER_VALUE_PAETH:
+      for (i = 0; i < bpp; i++)
+        out[i] = row[i] - prev[i];
+      for (; i < rowbytes; i++)
+        {
+          gint a  = row[i - bpp];
+          gint b  = prev[i];
+          gint c  = prev[i - bpp];
+          gint pa = ABS (b - c);
+          gint pb = ABS (a - c);
+          gint pc = ABS (a + b - c - c);
+
+          if (pa <= pb && pa <= pc)
+            out[i] = row[i] - a;
+          else if (pb <= pc)
+            out[i] = row[i] - b;
+          else
+            out[i] = row[i] - c;
+        }
+      break;
+    }
+}
+
+/*
+ * 'filter_row_cost()' - The heuristic libpng picks filters by, the sum
+ *                       of the filtered bytes taken as signed values.
+ */
+
+static gsize
+filter_row_cost (const guchar *out,
+                 gsize         rowbytes)
+{
+  gsize cost = 0;
+  gsize i;
+
+  for (i = 1; i <= rowbytes; i++)
+    cost += (out[i] < 128) ? out[i] : 256 - out[i];
+
+  return cost;
+}
+
+/*
+ * 'parallel_filter_block()' - Filter the rows of a block, in a thread.
+ */
+
+static void
+parallel_filter_block (PngBlock          *block,
+                       PngParallelWriter *pw)
+{
+  const guchar *prev    = block->prev_row;
+  const guchar *row     = block->rows;
+  guchar       *out     = block->filtered;
+  gsize         stride  = pw->rowbytes + 1;
+  guchar       *scratch = NULL;
+  gint          r;
+
+  if (pw->filter == PNG_SAVE_FILTER_ADAPTIVE)
+    scratch = g_new (guchar, stride * 5);
+
+  for (r = 0; r < block->n_rows; r++)
+    {
+      switch (pw->filter)
+        {
+        case PNG_SAVE_FILTER_ADAPTIVE:
+          {
+            guchar *best      = NULL;
+            gsize   best_cost = G_MAXSIZE;
+            guchar  type;
+
+            for (type = PNG_FILTER_VALUE_NONE;
+                 type <= PNG_FILTER_VALUE_PAETH;
+                 type++)
+              {
+                guchar *candidate = scratch + type * stride;
+                gsize   cost;
+
+                filter_row (type, row, prev, pw->rowbytes, pw->pixel_bytes,
+                            candidate);
+
+                cost = filter_row_cost (candidate, pw->rowbytes);
+
+                if (cost < best_cost)
+                  {
+                    best      = candidate;
+                    best_cost = cost;
+                  }
+              }
+
+            memcpy (out, best, stride);
+          }
+          break;
+
+        case PNG_SAVE_FILTER_PAETH:
+          filter_row (PNG_FILTER_VALUE_PAETH, row, prev,
+                      pw->rowbytes, pw->pixel_bytes, out);
+          break;
+
+        case PNG_SAVE_FILTER_NONE:
+          filter_row (PNG_FILTER_VALUE_NONE, row, prev,
+                      pw->rowbytes, pw->pixel_bytes, out);
+          break;
+        }
+
+      prev = row;
+      row += pw->rowbytes;
+      out += stride;
+    }
+
+  g_free (scratch);
+}
+
+/*
+ * 'parallel_deflate_block()' - Deflate the filtered data of a block,
+ *                              in a thread.
+ */
+
+static void
+parallel_deflate_block (PngBlock          *block,
+                        PngParallelWriter *pw)
+{
+  z_stream strm = { 0 };
+  gint     flush;
+
+  block->adler   = adler32 (adler32 (0L, Z_NULL, 0),
+                            block->filtered, block->filtered_len);
+  block->out_len = 0;
+
+  /* a raw deflate stream, the zlib header and trailer are ours */
+  if (deflateInit2 (&strm, pw->level, Z_DEFLATED, -MAX_WBITS, 8,
+                    Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+      block->failed = TRUE;
+      return;
+    }
+
+  if (block->dict_len > 0)
+    deflateSetDictionary (&strm, block->dict, block->dict_len);
+
+  strm.next_in  = block->filtered;
+  strm.avail_in = block->filtered_len;
+
+  /* the sync flush ends the block on a byte boundary without ending
+   * the stream, so the next block can simply be appended
+   */
+  flush = block->last ? Z_FINISH : Z_SYNC_FLUSH;
+
+  do
+    {
+      if (block->out_len == block->out_size)
+        {
+          block->out_size = MAX (block->out_size * 2,
+                                 block->filtered_len / 2 + 64);
+          block->out      = g_renew (guchar, block->out, block->out_size);
+        }
+
+      strm.next_out  = block->out + block->out_len;
+      strm.avail_out = block->out_size - block->out_len;
+
+      if (deflate (&strm, flush) == Z_STREAM_ERROR)
+        block->failed = TRUE;
+
+      block->out_len = block->out_size - strm.avail_out;
+    }
+  while (strm.avail_out == 0 && ! block->failed);
+
+  deflateEnd (&strm);
+}
+
+/*
+ * 'parallel_writer_run()' - Run one step on all blocks of the batch.
+ */
+
+static void
+parallel_writer_run (PngParallelWriter *pw,
+                     GFunc              func,
+                     gint               n_blocks)
+{
+  GThreadPool *pool;
+  gint         b;
+
+  pool = g_thread_pool_new (func, pw, pw->n_threads, FALSE, NULL);
+
+  for (b = 0; b < n_blocks; b++)
+    g_thread_pool_push (pool, &pw->blocks[b], NULL);
+
+  g_thread_pool_free (pool, FALSE, TRUE);
+}
+
+/*
+ * 'parallel_writer_write_idat()' - Write the collected compressed data
+ *                                  in IDAT chunks.
+ */
+
+static void
+parallel_writer_write_idat (PngParallelWriter *pw,
+                            gboolean           all)
+{
+  gsize offset = 0;
+
+  while (pw->idat->len - offset >= PARALLEL_IDAT_SIZE ||
+         (all && pw->idat->len > offset))
+    {
+      gsize len = MIN (pw->idat->len - offset, PARALLEL_IDAT_SIZE);
+
+      png_write_chunk (pw->pp, (png_bytep) "IDAT",
+                       pw->idat->data + offset, len);
+
+      offset += len;
+    }
+
+  g_byte_array_remove_range (pw->idat, 0, offset);
+}
+
+/*
+ * 'parallel_writer_flush()' - Filter and deflate the rows of the batch.
+ */
+
+static gboolean
+parallel_writer_flush (PngParallelWriter *pw)
+{
+  gsize stride   = pw->rowbytes + 1;
+  gint  n_blocks = (pw->n_rows + pw->block_rows - 1) / pw->block_rows;
+  gint  b;
+
+  for (b = 0; b < n_blocks; b++)
+    {
+      PngBlock *block = &pw->blocks[b];
+
+      block->rows         = pw->raw + b * pw->block_rows * pw->rowbytes;
+      block->n_rows       = MIN (pw->block_rows,
+                                 pw->n_rows - b * pw->block_rows);
+      block->prev_row     = b ? block->rows - pw->rowbytes : pw->prev_row;
+      block->filtered_len = block->n_rows * stride;
+      block->last         = (pw->rows_written == pw->height &&
+                             b == n_blocks - 1);
+    }
+
+  parallel_writer_run (pw, (GFunc) parallel_filter_block, n_blocks);
+
+  for (b = 0; b < n_blocks; b++)
+    {
+      PngBlock *block = &pw->blocks[b];
+
+      if (b == 0)
+        {
+          block->dict     = pw->dict;
+          block->dict_len = pw->dict_len;
+        }
+      else
+        {
+          PngBlock *prev = &pw->blocks[b - 1];
+
+          block->dict_len = MIN (prev->filtered_len, PARALLEL_DICT_SIZE);
+          block->dict     = prev->filtered + prev->filtered_len -
+                            block->dict_len;
+        }
+    }
+
+  parallel_writer_run (pw, (GFunc) parallel_deflate_block, n_blocks);
+
+  for (b = 0; b < n_blocks; b++)
+    {
+      PngBlock *block = &pw->blocks[b];
+
+      if (block->failed)
+        return FALSE;
+
+      g_byte_array_append (pw->idat, block->out, block->out_len);
+
+      pw->adler = adler32_combine (pw->adler,
+                                   block->adler, block->filtered_len);
+    }
+
+  /* keep what the next batch needs from this one */
+  b = n_blocks - 1;
+
+  memcpy (pw->prev_row,
+          pw->raw + (pw->n_rows - 1) * pw->rowbytes, pw->rowbytes);
+
+  pw->dict_len = MIN (pw->blocks[b].filtered_len, PARALLEL_DICT_SIZE);
+  memcpy (pw->dict,
+          pw->blocks[b].filtered + pw->blocks[b].filtered_len - pw->dict_len,
+          pw->dict_len);
+
+  pw->n_rows = 0;
+
+  parallel_writer_write_idat (pw, FALSE);
+
+  return TRUE;
+}
+
+/*
+ * 'parallel_writer_new()' - Set up compressing the image data in
+ *                           parallel, call after png_write_info().
+ */
+
+static PngParallelWriter *
+parallel_writer_new (png_structp  pp,
+                     png_infop    info,
+                     gint         n_threads)
+{
+  PngParallelWriter *pw    = g_new0 (PngParallelWriter, 1);
+  gint               level = pngvals.compression_level;
+  guint16            header;
+  guint8             bytes[2];
+  gint               b;
+
+  if (! g_thread_supported ())
+    g_thread_init (NULL);
+
+  pw->pp          = pp;
+  pw->height      = png_get_image_height (pp, info);
+  pw->rowbytes    = png_get_rowbytes (pp, info);
+  pw->pixel_bytes = png_get_channels (pp, info);
+  pw->level       = level;
+  pw->filter      = pngvals.filter;
+  pw->n_threads   = n_threads;
+
+  /* libpng doesn't filter indexed images unless asked to */
+  if (pw->filter == PNG_SAVE_FILTER_ADAPTIVE &&
+      png_get_color_type (pp, info) == PNG_COLOR_TYPE_PALETTE)
+    pw->filter = PNG_SAVE_FILTER_NONE;
+
+  pw->block_rows = MAX (1, PARALLEL_BLOCK_SIZE / (pw->rowbytes + 1));
+  pw->batch_rows = pw->block_rows * n_threads * PARALLEL_BLOCKS;
+
+  pw->raw      = g_new (guchar, pw->batch_rows * pw->rowbytes);
+  pw->prev_row = g_new0 (guchar, pw->rowbytes);
+  pw->dict     = g_new (guchar, PARALLEL_DICT_SIZE);
+  pw->blocks   = g_new0 (PngBlock, n_threads * PARALLEL_BLOCKS);
+
+  for (b = 0; b < n_threads * PARALLEL_BLOCKS; b++)
+    pw->blocks[b].filtered = g_new (guchar,
+                                    pw->block_rows * (pw->rowbytes + 1));
+
+  pw->adler = adler32 (0L, Z_NULL, 0);
+  pw->idat  = g_byte_array_new ();
+
+  /* the zlib header, with the compression level hint zlib would use */
+  header = (Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8;
+
+  if (level >= 7)
+    header |= 3 << 6;
+  else if (level == 6)
+    header |= 2 << 6;
+  else if (level >= 2)
+    header |= 1 << 6;
+
+  header += 31 - (header % 31);
+
+  bytes[0] = header >> 8;
+  bytes[1] = header & 0xff;
+
+  g_byte_array_append (pw->idat, bytes, 2);
+
+  return pw;
+}
+
+/*
+ * 'parallel_writer_write_rows()' - Filter and deflate rows on all cores.
+ */
+
+static gboolean
+parallel_writer_write_rows (PngParallelWriter  *pw,
+                            guchar            **rows,
+                            gint                n_rows)
+{
+  gint r;
+
+  for (r = 0; r < n_rows; r++)
+    {
+      memcpy (pw->raw + pw->n_rows * pw->rowbytes, rows[r], pw->rowbytes);
+
+      pw->n_rows++;
+      pw->rows_written++;
+
+      if (pw->n_rows == pw->batch_rows || pw->rows_written == pw->height)
+        {
+          if (! parallel_writer_flush (pw))
+            return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+/*
+ * 'parallel_writer_finish()' - Write the last IDAT and the IEND chunk,
+ *                              instead of png_write_end().
+ */
+
+static void
+parallel_writer_finish (PngParallelWriter *pw)
+{
+  guchar trailer[4];
+
+  trailer[0] = (pw->adler >> 24) & 0xff;
+  trailer[1] = (pw->adler >> 16) & 0xff;
+  trailer[2] = (pw->adler >>  8) & 0xff;
+  trailer[3] = (pw->adler      ) & 0xff;
+
+  g_byte_array_append (pw->idat, trailer, 4);
+
+  parallel_writer_write_idat (pw, TRUE);
+
+  png_write_chunk (pw->pp, (png_bytep) "IEND", NULL, 0);
+}
+
+static void
+parallel_writer_free (PngParallelWriter *pw)
+{
+  gint b;
+
+  for (b = 0; b < pw->n_threads * PARALLEL_BLOCKS; b++)
+    {
+      g_free (pw->blocks[b].filtered);
+      g_free (pw->blocks[b].out);
+    }
+
+  g_free (pw->blocks);
+  g_free (pw->dict);
+  g_free (pw->prev_row);
+  g_free (pw->raw);
+
+  g_byte_array_free (pw->idat, TRUE);
+
+  g_free (pw);
+}
+
 static gboolean
 ia_has_transparent_pixels (GimpDrawable *drawable)
 {
@@ -1942,6 +2573,7 @@ save_dialog (gint32    image_ID,
 {
   PngSaveGui    pg;
   GtkWidget    *dialog;
+  GtkWidget    *label;
   GtkBuilder   *builder;
   gchar        *ui_file;
   GimpParasite *parasite;
@@ -2023,6 +2655,31 @@ save_dialog (gint32    image_ID,
                     G_CALLBACK (gimp_int_adjustment_update),
                     &pngvals.compression_level);
 
+  /* Filter combo */
+  pg.filter = gimp_int_combo_box_new (_("Adaptive (smallest file)"),
+                                      PNG_SAVE_FILTER_ADAPTIVE,
+                                      _("Paeth"),
+                                      PNG_SAVE_FILTER_PAETH,
+                                      _("None (fastest)"),
+                                      PNG_SAVE_FILTER_NONE,
+                                      NULL);
+  gtk_table_attach (GTK_TABLE (gtk_builder_get_object (builder, "table")),
+                    pg.filter, 1, 3, 9, 10,
+                    GTK_EXPAND | GTK_FILL, GTK_FILL, 0, 0);
+  label = GTK_WIDGET (gtk_builder_get_object (builder, "filter-label"));
+  gtk_label_set_mnemonic_widget (GTK_LABEL (label), pg.filter);
+  gtk_widget_show (pg.filter);
+
+  gimp_int_combo_box_connect (GIMP_INT_COMBO_BOX (pg.filter),
+                              pngvals.filter,
+                              G_CALLBACK (gimp_int_combo_box_get_active),
+                              &pngvals.filter);
+
+  /* Parallel compression toggle */
+  pg.parallel = toggle_button_init (builder, "compress-in-parallel",
+                                    pngvals.parallel,
+                                    &pngvals.parallel);
+
   /* Load/save defaults buttons */
   g_signal_connect_swapped (gtk_builder_get_object (builder, "load-defaults"),
                             "clicked",
@@ -2080,7 +2737,10 @@ load_defaults (void)
 
       gimp_parasite_free (parasite);
 
-      num_fields = sscanf (def_str, "%d %d %d %d %d %d %d %d %d",
+      /* defaults saved before the last two fields existed lack them */
+      memcpy (&tmpvals, &defaults, sizeof (defaults));
+
+      num_fields = sscanf (def_str, "%d %d %d %d %d %d %d %d %d %d %d",
                            &tmpvals.interlaced,
                            &tmpvals.bkgd,
                            &tmpvals.gama,
@@ -2089,11 +2749,13 @@ load_defaults (void)
                            &tmpvals.time,
                            &tmpvals.comment,
                            &tmpvals.save_transp_pixels,
-                           &tmpvals.compression_level);
+                           &tmpvals.compression_level,
+                           &tmpvals.filter,
+                           &tmpvals.parallel);
 
       g_free (def_str);
 
-      if (num_fields == 9)
+      if (num_fields == 9 || num_fields == 11)
         {
           memcpy (&pngvals, &tmpvals, sizeof (tmpvals));
           return;
@@ -2109,7 +2771,7 @@ save_defaults (void)
   GimpParasite *parasite;
   gchar        *def_str;
 
-  def_str = g_strdup_printf ("%d %d %d %d %d %d %d %d %d",
+  def_str = g_strdup_printf ("%d %d %d %d %d %d %d %d %d %d %d",
                              pngvals.interlaced,
                              pngvals.bkgd,
                              pngvals.gama,
@@ -2118,7 +2780,9 @@ save_defaults (void)
                              pngvals.time,
                              pngvals.comment,
                              pngvals.save_transp_pixels,
-                             pngvals.compression_level);
+                             pngvals.compression_level,
+                             pngvals.filter,
+                             pngvals.parallel);
 
   parasite = gimp_parasite_new (PNG_DEFAULTS_PARASITE,
                                 GIMP_PARASITE_PERSISTENT,
@@ -2147,9 +2811,12 @@ load_gui_defaults (PngSaveGui *pg)
   SET_ACTIVE (time);
   SET_ACTIVE (comment);
   SET_ACTIVE (save_transp_pixels);
+  SET_ACTIVE (parallel);
 
 #undef SET_ACTIVE
 
   gtk_adjustment_set_value (pg->compression_level,
                             pngvals.compression_level);
+  gimp_int_combo_box_set_active (GIMP_INT_COMBO_BOX (pg->filter),
+                                 pngvals.filter);
 }
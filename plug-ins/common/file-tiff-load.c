@@ -45,6 +45,7 @@
 #include "config.h"
 
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <sys/types.h>
@@ -75,6 +76,8 @@
 #define PLUG_IN_BINARY "file-tiff-load"
 #define PLUG_IN_ROLE   "gimp-file-tiff-load"
 
+#define PARALLEL_MAX_MEMORY  (256 * 1024 * 1024) /* for decoded units */
+
 
 typedef struct
 {
@@ -99,6 +102,37 @@ typedef struct
   gint *pages;
 } TiffSelectedPages;
 
+/* Strips or tiles decoded by several threads, each with its own TIFF
+ * handle. The units are handed to GIMP in order on the main thread,
+ * through a ring of n_slots buffers.
+ */
+typedef struct
+{
+  gboolean   tiled;
+  gint       n_units;
+  gint       strips_per_unit;
+  gint       n_strips;
+  tsize_t    strip_size;
+  tsize_t    unit_size;
+
+  gint       n_slots;
+  guchar   **buffers;
+  gboolean  *ready;
+
+  gint       next;       /* the next unit to decode    */
+  gint       consumed;   /* units already given to GIMP */
+  GMutex    *mutex;
+  GCond     *decoded;
+  GCond     *freed;
+} TiffDecoder;
+
+typedef struct
+{
+  TiffDecoder *decoder;
+  TIFF        *tif;
+  gint         fd;
+} TiffDecoderThread;
+
 /* Declare some local functions.
  */
 static void   query     (void);
@@ -132,6 +166,15 @@ static void      load_tiles    (TIFF         *tif,
                                 gboolean      alpha,
                                 gboolean      is_bw,
                                 gint          extra);
+static gboolean  load_parallel (const gchar  *filename,
+                                TIFF         *tif,
+                                gint          page,
+                                channel_data *channel,
+                                gushort       bps,
+                                gushort       photomet,
+                                gboolean      alpha,
+                                gboolean      is_bw,
+                                gint          extra);
 static void      load_paths    (TIFF         *tif,
                                 gint          image);
 
@@ -211,6 +254,7 @@ static TiffSaveVals tsvals =
 
 static GimpRunMode             run_mode      = GIMP_RUN_INTERACTIVE;
 static GimpPageSelectorTarget  target        = GIMP_PAGE_SELECTOR_TARGET_LAYERS;
+static GThread                *main_thread   = NULL;
 
 static guchar       bit2byte[256 * 8];
 
@@ -274,6 +318,11 @@ run (const gchar      *name,
   values[0].type          = GIMP_PDB_STATUS;
   values[0].data.d_status = GIMP_PDB_EXECUTION_ERROR;
 
+  if (! g_thread_supported ())
+    g_thread_init (NULL);
+
+  main_thread = g_thread_self ();
+
   TIFFSetWarningHandler (tiff_warning);
   TIFFSetErrorHandler (tiff_error);
 
@@ -395,6 +444,17 @@ tiff_warning (const gchar *module,
 {
   int tag = 0;
 
+  /* the decoding threads can't talk to GIMP, only report to stderr */
+  if (g_thread_self () != main_thread)
+    {
+      gchar *msg = g_strdup_vprintf (fmt, ap);
+
+      g_printerr ("%s: %s\n", module, msg);
+      g_free (msg);
+
+      return;
+    }
+
   if (! strcmp (fmt, "%s: unknown field with tag %d (0x%x) encountered"))
     {
       va_list ap_test;
@@ -444,6 +504,16 @@ tiff_error (const gchar *module,
   if (! strcmp (fmt, "Compression algorithm does not support random access"))
     return;
 
+  if (g_thread_self () != main_thread)
+    {
+      gchar *msg = g_strdup_vprintf (fmt, ap);
+
+      g_printerr ("%s: %s\n", module, msg);
+      g_free (msg);
+
+      return;
+    }
+
   g_logv (G_LOG_DOMAIN, G_LOG_LEVEL_MESSAGE, fmt, ap);
 }
 
@@ -1030,6 +1100,11 @@ load_image (const gchar        *filename,
         {
           load_rgba (tif, channel);
         }
+      else if (load_parallel (filename, tif, ilayer, channel,
+                              bps, photomet, alpha, is_bw, extra))
+        {
+          /* decoded on all processors */
+        }
       else if (TIFFIsTiled (tif))
         {
           load_tiles (tif, channel, bps, photomet, alpha, is_bw, extra);
@@ -1393,6 +1468,359 @@ load_paths (TIFF *tif, gint image)
 }
 
 
+static gint
+get_num_processors (void)
+{
+  gchar *value = gimp_gimprc_query ("num-processors");
+  gint   n     = 1;
+
+  if (value)
+    n = atoi (value);
+
+  g_free (value);
+
+  return MAX (n, 1);
+}
+
+static void
+decode_unit (TiffDecoder *decoder,
+             TIFF        *tif,
+             gint         unit,
+             guchar      *buffer)
+{
+  if (decoder->tiled)
+    {
+      if (TIFFReadEncodedTile (tif, unit, buffer, decoder->unit_size) == -1)
+        memset (buffer, 0, decoder->unit_size);
+    }
+  else
+    {
+      gint first = unit * decoder->strips_per_unit;
+      gint last  = MIN (first + decoder->strips_per_unit, decoder->n_strips);
+      gint strip;
+
+      for (strip = first; strip < last; strip++)
+        {
+          guchar *dest = buffer + (strip - first) * decoder->strip_size;
+
+          if (TIFFReadEncodedStrip (tif, strip,
+                                    dest, decoder->strip_size) == -1)
+            memset (dest, 0, decoder->strip_size);
+        }
+    }
+}
+
+static gpointer
+decode_thread (TiffDecoderThread *thread)
+{
+  TiffDecoder *decoder = thread->decoder;
+
+  g_mutex_lock (decoder->mutex);
+
+  while (TRUE)
+    {
+      gint unit;
+      gint slot;
+
+      /* don't get further ahead of GIMP than there are buffers */
+      while (decoder->next < decoder->n_units &&
+             decoder->next >= decoder->consumed + decoder->n_slots)
+        g_cond_wait (decoder->freed, decoder->mutex);
+
+      if (decoder->next >= decoder->n_units)
+        break;
+
+      unit = decoder->next++;
+      slot = unit % decoder->n_slots;
+
+      g_mutex_unlock (decoder->mutex);
+
+      decode_unit (decoder, thread->tif, unit, decoder->buffers[slot]);
+
+      g_mutex_lock (decoder->mutex);
+
+      decoder->ready[slot] = TRUE;
+      g_cond_broadcast (decoder->decoded);
+    }
+
+  g_mutex_unlock (decoder->mutex);
+
+  return NULL;
+}
+
+static void
+load_parallel_free (TiffDecoder *decoder)
+{
+  gint i;
+
+  g_cond_free (decoder->freed);
+  g_cond_free (decoder->decoded);
+  g_mutex_free (decoder->mutex);
+
+  for (i = 0; i < decoder->n_slots; i++)
+    g_free (decoder->buffers[i]);
+
+  g_free (decoder->buffers);
+  g_free (decoder->ready);
+}
+
+/* Decodes the strips or tiles of a contiguous image on all processors
+ * and writes them to the drawables in order, a unit of strips covering
+ * a row of GIMP tiles at a time. Returns FALSE without doing anything
+ * if the image doesn't lend itself to that.
+ */
+static gboolean
+load_parallel (const gchar  *filename,
+               TIFF         *tif,
+               gint          page,
+               channel_data *channel,
+               gushort       bps,
+               gushort       photomet,
+               gboolean      alpha,
+               gboolean      is_bw,
+               gint          extra)
+{
+  TiffDecoder        decoder = { 0, };
+  TiffDecoderThread *threads;
+  GThread          **handles;
+  uint16             planar = PLANARCONFIG_CONTIG;
+  uint32             imageWidth, imageLength;
+  uint32             tileWidth   = 0;
+  uint32             tileLength  = 0;
+  uint32             rowsPerStrip;
+  gint               tiles_across = 0;
+  gint               unit_rows    = 0;
+  gint               n_threads;
+  gint               n_started    = 0;
+  gint               unit;
+  gint               i;
+
+  TIFFGetField (tif, TIFFTAG_PLANARCONFIG, &planar);
+  TIFFGetField (tif, TIFFTAG_IMAGEWIDTH, &imageWidth);
+  TIFFGetField (tif, TIFFTAG_IMAGELENGTH, &imageLength);
+
+  n_threads = get_num_processors ();
+
+  if (planar != PLANARCONFIG_CONTIG || n_threads < 2)
+    return FALSE;
+
+  decoder.tiled = TIFFIsTiled (tif);
+
+  if (decoder.tiled)
+    {
+      TIFFGetField (tif, TIFFTAG_TILEWIDTH, &tileWidth);
+      TIFFGetField (tif, TIFFTAG_TILELENGTH, &tileLength);
+
+      tiles_across      = (imageWidth + tileWidth - 1) / tileWidth;
+      decoder.n_units   = TIFFNumberOfTiles (tif);
+      decoder.unit_size = TIFFTileSize (tif);
+    }
+  else
+    {
+      TIFFGetFieldDefaulted (tif, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+
+      rowsPerStrip = MIN (rowsPerStrip, imageLength);
+
+      decoder.n_strips        = TIFFNumberOfStrips (tif);
+      decoder.strip_size      = TIFFStripSize (tif);
+      decoder.strips_per_unit = MAX (1, gimp_tile_height () / rowsPerStrip);
+      decoder.n_units         = ((decoder.n_strips +
+                                  decoder.strips_per_unit - 1) /
+                                 decoder.strips_per_unit);
+      decoder.unit_size       = (decoder.strip_size *
+                                 decoder.strips_per_unit);
+
+      unit_rows = rowsPerStrip * decoder.strips_per_unit;
+    }
+
+  if (decoder.n_units < 2 || decoder.unit_size <= 0)
+    return FALSE;
+
+  decoder.n_slots = MIN (n_threads * 2,
+                         PARALLEL_MAX_MEMORY / decoder.unit_size);
+
+  if (decoder.n_slots < 2)
+    return FALSE;
+
+  /* open a TIFF handle per thread, here where errors can be shown */
+  threads = g_new0 (TiffDecoderThread, n_threads);
+
+  for (i = 0; i < n_threads; i++)
+    {
+      TiffDecoderThread *thread = &threads[i];
+
+      thread->decoder = &decoder;
+      thread->fd      = g_open (filename, O_RDONLY | _O_BINARY, 0);
+
+      if (thread->fd == -1)
+        break;
+
+      thread->tif = TIFFFdOpen (thread->fd, filename, "r");
+
+      if (! thread->tif || ! TIFFSetDirectory (thread->tif, page))
+        {
+          if (thread->tif)
+            TIFFClose (thread->tif);
+          else
+            close (thread->fd);
+
+          thread->tif = NULL;
+          break;
+        }
+    }
+
+  n_threads = i;
+
+  if (n_threads < 2)
+    {
+      for (i = 0; i < n_threads; i++)
+        TIFFClose (threads[i].tif);
+
+      g_free (threads);
+
+      return FALSE;
+    }
+
+  decoder.buffers = g_new (guchar *, decoder.n_slots);
+  decoder.ready   = g_new0 (gboolean, decoder.n_slots);
+
+  for (i = 0; i < decoder.n_slots; i++)
+    decoder.buffers[i] = g_malloc (decoder.unit_size);
+
+  decoder.mutex   = g_mutex_new ();
+  decoder.decoded = g_cond_new ();
+  decoder.freed   = g_cond_new ();
+
+  handles = g_new0 (GThread *, n_threads);
+
+  for (i = 0; i < n_threads; i++)
+    {
+      handles[i] = g_thread_create ((GThreadFunc) decode_thread, &threads[i],
+                                    TRUE, NULL);
+      if (handles[i])
+        n_started++;
+    }
+
+  /* the units are not written to the drawables below unless there
+   * are threads decoding them, so fall back to the other loaders
+   */
+  if (n_started == 0)
+    {
+      for (i = 0; i < n_threads; i++)
+        TIFFClose (threads[i].tif);
+
+      g_free (handles);
+      g_free (threads);
+
+      load_parallel_free (&decoder);
+
+      return FALSE;
+    }
+
+  for (i = 0; i <= extra; ++i)
+    {
+      if (decoder.tiled)
+        channel[i].pixels = g_new (guchar,
+                                   tileWidth * tileLength *
+                                   channel[i].drawable->bpp);
+      else
+        channel[i].pixels = g_new (guchar,
+                                   unit_rows * imageWidth *
+                                   channel[i].drawable->bpp);
+    }
+
+  if (decoder.tiled)
+    gimp_tile_cache_ntiles ((1 + imageWidth / gimp_tile_width ()) *
+                            (1 + tileLength / gimp_tile_height ()));
+  else
+    gimp_tile_cache_ntiles (1 + imageWidth / gimp_tile_width ());
+
+  for (unit = 0; unit < decoder.n_units; unit++)
+    {
+      gint    slot = unit % decoder.n_slots;
+      guchar *buffer;
+      gint    x, y;
+      gint    cols, rows;
+      gint    align;
+
+      g_mutex_lock (decoder.mutex);
+
+      while (! decoder.ready[slot])
+        g_cond_wait (decoder.decoded, decoder.mutex);
+
+      g_mutex_unlock (decoder.mutex);
+
+      buffer = decoder.buffers[slot];
+
+      if (decoder.tiled)
+        {
+          x     = (unit % tiles_across) * tileWidth;
+          y     = (unit / tiles_across) * tileLength;
+          cols  = MIN (imageWidth - x, tileWidth);
+          rows  = MIN (imageLength - y, tileLength);
+          align = tileWidth - cols;
+        }
+      else
+        {
+          x     = 0;
+          y     = unit * unit_rows;
+          cols  = imageWidth;
+          rows  = MIN (imageLength - y, unit_rows);
+          align = 0;
+        }
+
+      if (bps == 16)
+        {
+          read_16bit (buffer, channel, photomet, y, x, rows, cols, alpha,
+                      extra, align);
+        }
+      else if (bps == 8)
+        {
+          read_8bit (buffer, channel, photomet, y, x, rows, cols, alpha,
+                     extra, align);
+        }
+      else if (is_bw)
+        {
+          read_bw (buffer, channel, y, x, rows, cols, align);
+        }
+      else
+        {
+          read_default (buffer, channel, bps, photomet, y, x, rows, cols,
+                        alpha, extra, align);
+        }
+
+      g_mutex_lock (decoder.mutex);
+
+      decoder.ready[slot] = FALSE;
+      decoder.consumed++;
+      g_cond_broadcast (decoder.freed);
+
+      g_mutex_unlock (decoder.mutex);
+
+      if ((unit % 8) == 0)
+        gimp_progress_update ((gdouble) unit / (gdouble) decoder.n_units);
+    }
+
+  for (i = 0; i < n_threads; i++)
+    {
+      if (handles[i])
+        g_thread_join (handles[i]);
+
+      /* this closes the file descriptor too */
+      TIFFClose (threads[i].tif);
+    }
+
+  g_free (handles);
+  g_free (threads);
+
+  load_parallel_free (&decoder);
+
+  for (i = 0; i <= extra; ++i)
+    g_free (channel[i].pixels);
+
+  return TRUE;
+}
+
 static void
 load_tiles (TIFF         *tif,
             channel_data *channel,
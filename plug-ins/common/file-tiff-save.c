@@ -45,6 +45,7 @@
 #include "config.h"
 
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <sys/types.h>
@@ -73,15 +74,22 @@
 
 #define SAVE_PROC      "file-tiff-save"
 #define SAVE2_PROC     "file-tiff-save2"
+#define SAVE3_PROC     "file-tiff-save3"
 #define PLUG_IN_BINARY "file-tiff-save"
 #define PLUG_IN_ROLE   "gimp-file-tiff-save"
 
+#define TILE_SIZE          256
+#define BIGTIFF_THRESHOLD  (G_GUINT64_CONSTANT (4000) * 1024 * 1024)
+
 
 typedef struct
 {
   gint      compression;
   gint      fillorder;
   gboolean  save_transp_pixels;
+  gboolean  bigtiff;
+  gboolean  tiled;
+  gboolean  pyramid;
 } TiffSaveVals;
 
 typedef struct
@@ -93,6 +101,56 @@ typedef struct
   guchar       *pixel;
 } channel_data;
 
+/* The sample layout of a directory, shared by the main image, its
+ * reduced-resolution levels and the scratch handles of the threads.
+ */
+typedef struct
+{
+  gushort   compression;
+  gshort    predictor;
+  gshort    photometric;
+  gshort    samplesperpixel;
+  gshort    bitspersample;
+  gboolean  alpha;
+  gboolean  tiled;
+  glong     rowsperstrip;
+  gushort  *red;    /* the colormap, if there is one */
+  gushort  *grn;
+  gushort  *blu;
+} TiffFormat;
+
+typedef struct
+{
+  GByteArray *data;
+  toff_t      pos;
+} TiffMemFile;
+
+typedef struct
+{
+  TIFF             *tif;
+  const TiffFormat *format;
+  GimpImageType     drawable_type;
+  gboolean          is_bw;
+  gboolean          invert;
+  tsize_t           tile_size;
+  tsize_t           tile_row_bytes;
+  gint              batch_size;
+
+  GThreadPool      *pool;
+  GMutex           *mutex;
+  GCond            *done;
+  gint              pending;   /* tiles pushed but not compressed yet */
+} TiffTileWriter;
+
+typedef struct
+{
+  TiffTileWriter *writer;
+  ttile_t         index;
+  guchar         *data;
+  guchar         *raw;       /* the compressed tile */
+  tsize_t         raw_size;
+} TiffTile;
+
 /* Declare some local functions.
  */
 static void   query     (void);
@@ -106,6 +164,17 @@ static gboolean  image_is_monochrome (gint32 image);
 
 static gboolean  save_paths             (TIFF         *tif,
                                          gint32        image);
+static void      set_format_fields      (TIFF             *tif,
+                                         const TiffFormat *format,
+                                         gint              width,
+                                         gint              height);
+static gboolean  save_tiled_image       (TIFF             *tif,
+                                         const TiffFormat *format,
+                                         gint32            drawable_ID,
+                                         GimpImageType     drawable_type,
+                                         gboolean          is_bw,
+                                         gboolean          invert,
+                                         gint              n_levels);
 static gboolean  save_image             (const gchar  *filename,
                                          gint32        image,
                                          gint32        drawable,
@@ -122,6 +191,12 @@ static void      byte2bit               (const guchar *byteline,
                                          gint          width,
                                          guchar       *bitline,
                                          gboolean      invert);
+static void      convert_row            (const guchar  *src,
+                                         guchar        *dest,
+                                         gint           cols,
+                                         GimpImageType  drawable_type,
+                                         gboolean       is_bw,
+                                         gboolean       invert);
 
 static void      tiff_warning           (const gchar *module,
                                          const gchar *fmt,
@@ -146,6 +221,7 @@ static TiffSaveVals tsvals =
 
 static gchar       *image_comment = NULL;
 static GimpRunMode  run_mode      = GIMP_RUN_INTERACTIVE;
+static GThread     *main_thread   = NULL;
 
 
 MAIN ()
@@ -172,6 +248,15 @@ query (void)
     { GIMP_PDB_INT32, "save-transp-pixels", "Keep the color data masked by an alpha channel intact" }
   };
 
+  static const GimpParamDef save3_args[] =
+  {
+    COMMON_SAVE_ARGS,
+    { GIMP_PDB_INT32, "save-transp-pixels", "Keep the color data masked by an alpha channel intact" },
+    { GIMP_PDB_INT32, "bigtiff",            "Save as BigTIFF, which is used anyway for images close to 4 GB (TRUE or FALSE)" },
+    { GIMP_PDB_INT32, "tiled",              "Save in tiles of 256x256 pixels instead of strips (TRUE or FALSE)" },
+    { GIMP_PDB_INT32, "pyramid",            "Save reduced-resolution levels, requires tiled (TRUE or FALSE)" }
+  };
+
   gimp_install_procedure (SAVE_PROC,
                           "saves files in the tiff file format",
                           "Saves files in the Tagged Image File Format.  "
@@ -204,6 +289,26 @@ query (void)
                           save_args, NULL);
 
   gimp_register_file_handler_mime (SAVE2_PROC, "image/tiff");
+
+  gimp_install_procedure (SAVE3_PROC,
+                          "saves files in the tiff file format",
+                          "Saves files in the Tagged Image File Format, "
+                          "optionally as BigTIFF, in tiles, and with "
+                          "reduced-resolution levels of the image, each "
+                          "half the size of the one before, stored as "
+                          "SubIFDs of the main image.  The value for the "
+                          "saved comment is taken from the 'gimp-comment' "
+                          "parasite.",
+                          "Spencer Kimball & Peter Mattis",
+                          "Spencer Kimball & Peter Mattis",
+                          "1995-1996,2000-2003",
+                          N_("TIFF image"),
+                          "RGB*, GRAY*, INDEXED",
+                          GIMP_PLUGIN,
+                          G_N_ELEMENTS (save3_args), 0,
+                          save3_args, NULL);
+
+  gimp_register_file_handler_mime (SAVE3_PROC, "image/tiff");
 }
 
 static void
@@ -232,13 +337,19 @@ run (const gchar      *name,
   values[0].type          = GIMP_PDB_STATUS;
   values[0].data.d_status = GIMP_PDB_EXECUTION_ERROR;
 
+  if (! g_thread_supported ())
+    g_thread_init (NULL);
+
+  main_thread = g_thread_self ();
+
   TIFFSetWarningHandler (tiff_warning);
   TIFFSetErrorHandler (tiff_error);
 
-  if ((strcmp (name, SAVE_PROC) == 0) ||
-      (strcmp (name, SAVE2_PROC) == 0))
+  if ((strcmp (name, SAVE_PROC) == 0)  ||
+      (strcmp (name, SAVE2_PROC) == 0) ||
+      (strcmp (name, SAVE3_PROC) == 0))
     {
-      /* Plug-in is either file_tiff_save or file_tiff_save2 */
+      /* Plug-in is file_tiff_save, file_tiff_save2 or file_tiff_save3 */
       image = orig_image = param[1].data.d_int32;
       drawable = param[2].data.d_int32;
 
@@ -298,7 +409,7 @@ run (const gchar      *name,
 
         case GIMP_RUN_NONINTERACTIVE:
           /*  Make sure all the arguments are there!  */
-          if (nparams == 6 || nparams == 7)
+          if (nparams == 6 || nparams == 7 || nparams == 10)
             {
               switch (param[5].data.d_int32)
                 {
@@ -312,10 +423,20 @@ run (const gchar      *name,
                 default: status = GIMP_PDB_CALLING_ERROR; break;
                 }
 
-              if (nparams == 7)
+              if (nparams >= 7)
                 tsvals.save_transp_pixels = param[6].data.d_int32;
               else
                 tsvals.save_transp_pixels = TRUE;
+
+              if (nparams == 10)
+                {
+                  tsvals.bigtiff = param[7].data.d_int32 ? TRUE : FALSE;
+                  tsvals.tiled   = param[8].data.d_int32 ? TRUE : FALSE;
+                  tsvals.pyramid = param[9].data.d_int32 ? TRUE : FALSE;
+
+                  if (tsvals.pyramid && ! tsvals.tiled)
+                    status = GIMP_PDB_CALLING_ERROR;
+                }
             }
           else
             {
@@ -381,6 +502,12 @@ tiff_warning (const gchar *module,
 {
   va_list ap_test;
 
+  /* the warnings from the scratch files of the compressing threads
+   * are about those files, not the one being saved
+   */
+  if (g_thread_self () != main_thread)
+    return;
+
   /* Workaround for: http://bugzilla.gnome.org/show_bug.cgi?id=131975 */
   /* Ignore the warnings about unregistered private tags (>= 32768) */
   if (! strcmp (fmt, "%s: unknown field with tag %d (0x%x) encountered"))
@@ -410,6 +537,18 @@ tiff_error (const gchar *module,
   /* Ignore the errors related to random access and JPEG compression */
   if (! strcmp (fmt, "Compression algorithm does not support random access"))
     return;
+
+  /* the compressing threads can't talk to GIMP, only report to stderr */
+  if (g_thread_self () != main_thread)
+    {
+      gchar *msg = g_strdup_vprintf (fmt, ap);
+
+      g_printerr ("%s: %s\n", module, msg);
+      g_free (msg);
+
+      return;
+    }
+
   g_logv (G_LOG_DOMAIN, G_LOG_LEVEL_MESSAGE, fmt, ap);
 }
 
@@ -610,6 +749,456 @@ save_paths (TIFF   *tif,
 }
 
 
+static gint
+get_num_processors (void)
+{
+  gchar *value = gimp_gimprc_query ("num-processors");
+  gint   n     = 1;
+
+  if (value)
+    n = atoi (value);
+
+  g_free (value);
+
+  return MAX (n, 1);
+}
+
+static void
+set_format_fields (TIFF             *tif,
+                   const TiffFormat *format,
+                   gint              width,
+                   gint              height)
+{
+  TIFFSetField (tif, TIFFTAG_IMAGEWIDTH, width);
+  TIFFSetField (tif, TIFFTAG_IMAGELENGTH, height);
+  TIFFSetField (tif, TIFFTAG_BITSPERSAMPLE, format->bitspersample);
+  TIFFSetField (tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+  TIFFSetField (tif, TIFFTAG_COMPRESSION, format->compression);
+
+  if ((format->compression == COMPRESSION_LZW ||
+       format->compression == COMPRESSION_DEFLATE)
+      && (format->predictor != 0))
+    {
+      TIFFSetField (tif, TIFFTAG_PREDICTOR, format->predictor);
+    }
+
+  if (format->alpha)
+    {
+      gushort extra_samples[1];
+
+      if (tsvals.save_transp_pixels)
+        extra_samples [0] = EXTRASAMPLE_UNASSALPHA;
+      else
+        extra_samples [0] = EXTRASAMPLE_ASSOCALPHA;
+
+      TIFFSetField (tif, TIFFTAG_EXTRASAMPLES, 1, extra_samples);
+    }
+
+  TIFFSetField (tif, TIFFTAG_PHOTOMETRIC, format->photometric);
+  TIFFSetField (tif, TIFFTAG_SAMPLESPERPIXEL, format->samplesperpixel);
+
+  if (format->tiled)
+    {
+      TIFFSetField (tif, TIFFTAG_TILEWIDTH, TILE_SIZE);
+      TIFFSetField (tif, TIFFTAG_TILELENGTH, TILE_SIZE);
+    }
+  else
+    {
+      TIFFSetField (tif, TIFFTAG_ROWSPERSTRIP, format->rowsperstrip);
+    }
+
+  TIFFSetField (tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+
+  if (format->red)
+    TIFFSetField (tif, TIFFTAG_COLORMAP,
+                  format->red, format->grn, format->blu);
+}
+
+/* I/O functions of the in-memory files the threads compress into */
+
+static tsize_t
+tiff_mem_read (thandle_t handle,
+               tdata_t   buffer,
+               tsize_t   size)
+{
+  TiffMemFile *mem = (TiffMemFile *) handle;
+
+  if (mem->pos >= mem->data->len)
+    return 0;
+
+  size = MIN (size, mem->data->len - mem->pos);
+  memcpy (buffer, mem->data->data + mem->pos, size);
+  mem->pos += size;
+
+  return size;
+}
+
+static tsize_t
+tiff_mem_write (thandle_t handle,
+                tdata_t   buffer,
+                tsize_t   size)
+{
+  TiffMemFile *mem = (TiffMemFile *) handle;
+
+  if (mem->pos + size > mem->data->len)
+    g_byte_array_set_size (mem->data, mem->pos + size);
+
+  memcpy (mem->data->data + mem->pos, buffer, size);
+  mem->pos += size;
+
+  return size;
+}
+
+static toff_t
+tiff_mem_seek (thandle_t handle,
+               toff_t    offset,
+               int       whence)
+{
+  TiffMemFile *mem = (TiffMemFile *) handle;
+
+  switch (whence)
+    {
+    case SEEK_SET:
+      mem->pos = offset;
+      break;
+
+    case SEEK_CUR:
+      mem->pos += offset;
+      break;
+
+    case SEEK_END:
+      mem->pos = mem->data->len + offset;
+      break;
+    }
+
+  return mem->pos;
+}
+
+static int
+tiff_mem_close (thandle_t handle)
+{
+  return 0;
+}
+
+static toff_t
+tiff_mem_size (thandle_t handle)
+{
+  TiffMemFile *mem = (TiffMemFile *) handle;
+
+  return mem->data->len;
+}
+
+static int
+tiff_mem_map (thandle_t  handle,
+              tdata_t   *base,
+              toff_t    *size)
+{
+  return 0;
+}
+
+static void
+tiff_mem_unmap (thandle_t handle,
+                tdata_t   base,
+                toff_t    size)
+{
+}
+
+/* Runs in the thread pool of the tile writer. Each tile is written
+ * to a TIFF of its own in memory, which runs the codec and predictor
+ * exactly as the real file would, and the compressed bytes are taken
+ * from there for TIFFWriteRawTile().
+ */
+static void
+compress_tile (TiffTile       *tile,
+               TiffTileWriter *writer)
+{
+  TiffMemFile  mem;
+  TIFF        *scratch;
+  toff_t      *offsets;
+  toff_t      *sizes;
+
+  mem.data = g_byte_array_new ();
+  mem.pos  = 0;
+
+  scratch = TIFFClientOpen ("tile", "w", (thandle_t) &mem,
+                            tiff_mem_read, tiff_mem_write, tiff_mem_seek,
+                            tiff_mem_close, tiff_mem_size,
+                            tiff_mem_map, tiff_mem_unmap);
+
+  if (scratch)
+    {
+      set_format_fields (scratch, writer->format, TILE_SIZE, TILE_SIZE);
+
+      if (TIFFWriteEncodedTile (scratch, 0,
+                                tile->data, writer->tile_size) != -1 &&
+          TIFFGetField (scratch, TIFFTAG_TILEOFFSETS, &offsets) &&
+          TIFFGetField (scratch, TIFFTAG_TILEBYTECOUNTS, &sizes))
+        {
+          tile->raw_size = sizes[0];
+          tile->raw      = g_memdup (mem.data->data + offsets[0], sizes[0]);
+        }
+
+      TIFFClose (scratch);
+    }
+
+  g_byte_array_free (mem.data, TRUE);
+
+  g_mutex_lock (writer->mutex);
+
+  writer->pending--;
+  g_cond_signal (writer->done);
+
+  g_mutex_unlock (writer->mutex);
+}
+
+/* Writes the drawable to the current directory, a batch of tiles at
+ * a time. With a thread pool, the tiles of a batch are compressed
+ * while the next ones are fetched from GIMP, and written in order
+ * once the batch is done.
+ */
+static gboolean
+save_tiles (TiffTileWriter *writer,
+            gint32          drawable_ID,
+            gdouble         progress_start,
+            gdouble         progress_end)
+{
+  GimpDrawable *drawable;
+  GimpPixelRgn  pixel_rgn;
+  TiffTile     *batch;
+  guchar       *src;
+  gint          cols, rows;
+  gint          tiles_across;
+  gint          n_tiles;
+  gint          n_batch;
+  gint          t, i;
+  gboolean      success = TRUE;
+
+  drawable = gimp_drawable_get (drawable_ID);
+
+  cols = drawable->width;
+  rows = drawable->height;
+
+  gimp_pixel_rgn_init (&pixel_rgn, drawable,
+                       0, 0, cols, rows, FALSE, FALSE);
+
+  gimp_tile_cache_ntiles ((1 + cols / gimp_tile_width ()) *
+                          (1 + TILE_SIZE / gimp_tile_height ()));
+
+  tiles_across = (cols + TILE_SIZE - 1) / TILE_SIZE;
+  n_tiles      = tiles_across * ((rows + TILE_SIZE - 1) / TILE_SIZE);
+
+  batch = g_new0 (TiffTile, writer->batch_size);
+  src   = g_new (guchar, TILE_SIZE * TILE_SIZE * drawable->bpp);
+
+  for (t = 0; t < n_tiles && success; t += n_batch)
+    {
+      n_batch = MIN (writer->batch_size, n_tiles - t);
+
+      for (i = 0; i < n_batch; i++)
+        {
+          TiffTile *tile   = &batch[i];
+          gint      x      = ((t + i) % tiles_across) * TILE_SIZE;
+          gint      y      = ((t + i) / tiles_across) * TILE_SIZE;
+          gint      width  = MIN (TILE_SIZE, cols - x);
+          gint      height = MIN (TILE_SIZE, rows - y);
+          gint      row;
+
+          gimp_pixel_rgn_get_rect (&pixel_rgn, src, x, y, width, height);
+
+          tile->writer = writer;
+          tile->index  = TIFFComputeTile (writer->tif, x, y, 0, 0);
+          tile->data   = g_malloc0 (writer->tile_size);
+
+          /* the tiles on the right and bottom edges are padded */
+          for (row = 0; row < height; row++)
+            convert_row (src + row * width * drawable->bpp,
+                         tile->data + row * writer->tile_row_bytes, width,
+                         writer->drawable_type, writer->is_bw, writer->invert);
+
+          if (writer->pool)
+            {
+              g_mutex_lock (writer->mutex);
+              writer->pending++;
+              g_mutex_unlock (writer->mutex);
+
+              g_thread_pool_push (writer->pool, tile, NULL);
+            }
+        }
+
+      if (writer->pool)
+        {
+          g_mutex_lock (writer->mutex);
+
+          while (writer->pending > 0)
+            g_cond_wait (writer->done, writer->mutex);
+
+          g_mutex_unlock (writer->mutex);
+        }
+
+      for (i = 0; i < n_batch; i++)
+        {
+          TiffTile *tile = &batch[i];
+
+          if (success)
+            {
+              if (writer->pool)
+                success = (tile->raw &&
+                           TIFFWriteRawTile (writer->tif, tile->index,
+                                             tile->raw,
+                                             tile->raw_size) != -1);
+              else
+                success = (TIFFWriteEncodedTile (writer->tif, tile->index,
+                                                 tile->data,
+                                                 writer->tile_size) != -1);
+            }
+
+          g_free (tile->data);
+          g_free (tile->raw);
+
+          tile->data = NULL;
+          tile->raw  = NULL;
+        }
+
+      /* once per row of tiles */
+      if ((t + n_batch) % tiles_across < n_batch)
+        gimp_progress_update (progress_start +
+                              (progress_end - progress_start) *
+                              (gdouble) (t + n_batch) / (gdouble) n_tiles);
+    }
+
+  g_free (src);
+  g_free (batch);
+
+  gimp_drawable_detach (drawable);
+
+  return success;
+}
+
+/* Returns a copy of the drawable in an image of its own, for the
+ * caller to scale down level by level and to delete.
+ */
+static gint32
+pyramid_level_new (gint32 drawable_ID)
+{
+  gint32 image = gimp_item_get_image (drawable_ID);
+  gint32 level_image;
+  gint32 level_layer;
+
+  level_image = gimp_image_new (gimp_drawable_width (drawable_ID),
+                                gimp_drawable_height (drawable_ID),
+                                gimp_image_base_type (image));
+  gimp_image_undo_disable (level_image);
+
+  if (gimp_drawable_is_indexed (drawable_ID))
+    {
+      guchar *cmap;
+      gint    num_colors;
+
+      cmap = gimp_image_get_colormap (image, &num_colors);
+      gimp_image_set_colormap (level_image, cmap, num_colors);
+      g_free (cmap);
+    }
+
+  level_layer = gimp_layer_new_from_drawable (drawable_ID, level_image);
+  gimp_image_insert_layer (level_image, level_layer, -1, 0);
+
+  gimp_layer_set_offsets (level_layer, 0, 0);
+
+  return level_layer;
+}
+
+/* Writes the drawable in tiles to the current directory and, if
+ * n_levels isn't 0, the reduced-resolution levels to the sub-IFDs the
+ * directory announces. The last directory is left for TIFFClose().
+ */
+static gboolean
+save_tiled_image (TIFF             *tif,
+                  const TiffFormat *format,
+                  gint32            drawable_ID,
+                  GimpImageType     drawable_type,
+                  gboolean          is_bw,
+                  gboolean          invert,
+                  gint              n_levels)
+{
+  TiffTileWriter writer      = { 0, };
+  gint           n_threads   = get_num_processors ();
+  gint           width       = gimp_drawable_width (drawable_ID);
+  gint           height      = gimp_drawable_height (drawable_ID);
+  gdouble        main_part   = n_levels ? 0.75 : 1.0;
+  gint32         level_layer = -1;
+  gint           level;
+  gboolean       success;
+
+  writer.tif            = tif;
+  writer.format         = format;
+  writer.drawable_type  = drawable_type;
+  writer.is_bw          = is_bw;
+  writer.invert         = invert;
+  writer.tile_size      = TIFFTileSize (tif);
+  writer.tile_row_bytes = TIFFTileRowSize (tif);
+  writer.batch_size     = 1;
+
+  /* JPEG tiles depend on the tables in the directory of the file
+   * they are written to, so they are left to libtiff
+   */
+  if (n_threads > 1                             &&
+      format->compression != COMPRESSION_NONE &&
+      format->compression != COMPRESSION_JPEG)
+    {
+      writer.mutex      = g_mutex_new ();
+      writer.done       = g_cond_new ();
+      writer.pool       = g_thread_pool_new ((GFunc) compress_tile, &writer,
+                                             n_threads, TRUE, NULL);
+      writer.batch_size = 4 * n_threads;
+    }
+
+  success = save_tiles (&writer, drawable_ID, 0.0, main_part);
+
+  for (level = 1; level <= n_levels && success; level++)
+    {
+      gint level_width  = MAX (1, width  >> level);
+      gint level_height = MAX (1, height >> level);
+
+      /* finish the previous directory, the levels become its sub-IFDs */
+      if (! TIFFWriteDirectory (tif))
+        {
+          success = FALSE;
+          break;
+        }
+
+      /* each level is halved from the one before, not from the
+       * full-size drawable
+       */
+      if (level_layer == -1)
+        level_layer = pyramid_level_new (drawable_ID);
+
+      gimp_layer_scale_full (level_layer, level_width, level_height, FALSE,
+                             GIMP_INTERPOLATION_LANCZOS);
+
+      TIFFSetField (tif, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
+      set_format_fields (tif, format, level_width, level_height);
+
+      success = save_tiles (&writer, level_layer,
+                            main_part + ((1.0 - main_part) *
+                                         (level - 1) / n_levels),
+                            main_part + ((1.0 - main_part) *
+                                         level / n_levels));
+    }
+
+  if (level_layer != -1)
+    gimp_image_delete (gimp_item_get_image (level_layer));
+
+  if (writer.pool)
+    {
+      g_thread_pool_free (writer.pool, FALSE, TRUE);
+      g_cond_free (writer.done);
+      g_mutex_free (writer.mutex);
+    }
+
+  return success;
+}
+
+
 /*
 ** pnmtotiff.c - converts a portable anymap to a Tagged Image File
 **
@@ -638,17 +1227,18 @@ save_image (const gchar  *filename,
   gushort        red[256];
   gushort        grn[256];
   gushort        blu[256];
-  gint           cols, col, rows, row, i;
+  gint           cols, rows, row, i;
   glong          rowsperstrip;
   gushort        compression;
-  gushort        extra_samples[1];
   gboolean       alpha;
   gshort         predictor;
   gshort         photometric;
   gshort         samplesperpixel;
   gshort         bitspersample;
   gint           bytesperrow;
-  guchar        *t, *src, *data;
+  guchar        *t;
+  guchar        *src     = NULL;
+  guchar        *data    = NULL;
   guchar        *cmap;
   gint           num_colors;
   gint           success;
@@ -658,6 +1248,9 @@ save_image (const gchar  *filename,
   gint           tile_height;
   gint           y, yend;
   gint           fd;
+  const gchar   *mode     = "w";
+  TiffFormat     format;
+  gint           n_levels = 0;
   gboolean       is_bw    = FALSE;
   gboolean       invert   = TRUE;
   const guchar   bw_map[] = { 0, 0, 0, 255, 255, 255 };
@@ -676,18 +1269,6 @@ save_image (const gchar  *filename,
   tile_height = gimp_tile_height ();
   rowsperstrip = tile_height;
 
-  fd = g_open (filename, O_CREAT | O_TRUNC | O_WRONLY | _O_BINARY, 0666);
-
-  if (fd == -1)
-    {
-      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
-                   _("Could not open '%s' for writing: %s"),
-                   gimp_filename_to_utf8 (filename), g_strerror (errno));
-      return FALSE;
-    }
-
-  tif = TIFFFdOpen (fd, filename, "w");
-
   TIFFSetWarningHandler (tiff_warning);
   TIFFSetErrorHandler (tiff_error);
 
@@ -799,36 +1380,76 @@ save_image (const gchar  *filename,
         }
     }
 
-  /* Set TIFF parameters. */
-  TIFFSetField (tif, TIFFTAG_SUBFILETYPE, 0);
-  TIFFSetField (tif, TIFFTAG_IMAGEWIDTH, cols);
-  TIFFSetField (tif, TIFFTAG_IMAGELENGTH, rows);
-  TIFFSetField (tif, TIFFTAG_BITSPERSAMPLE, bitspersample);
-  TIFFSetField (tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
-  TIFFSetField (tif, TIFFTAG_COMPRESSION, compression);
+  format.compression     = compression;
+  format.predictor       = predictor;
+  format.photometric     = photometric;
+  format.samplesperpixel = samplesperpixel;
+  format.bitspersample   = bitspersample;
+  format.alpha           = alpha;
+  format.tiled           = tsvals.tiled;
+  format.rowsperstrip    = rowsperstrip;
+  format.red             = NULL;
+  format.grn             = NULL;
+  format.blu             = NULL;
 
-  if ((compression == COMPRESSION_LZW || compression == COMPRESSION_DEFLATE)
-      && (predictor != 0))
+  if (!is_bw && drawable_type == GIMP_INDEXED_IMAGE)
     {
-      TIFFSetField (tif, TIFFTAG_PREDICTOR, predictor);
+      format.red = red;
+      format.grn = grn;
+      format.blu = blu;
     }
 
-  if (alpha)
+  /* halve the size until the whole image fits in a tile */
+  if (format.tiled && tsvals.pyramid)
     {
-      if (tsvals.save_transp_pixels)
-        extra_samples [0] = EXTRASAMPLE_UNASSALPHA;
-      else
-        extra_samples [0] = EXTRASAMPLE_ASSOCALPHA;
+      gint width  = cols;
+      gint height = rows;
 
-      TIFFSetField (tif, TIFFTAG_EXTRASAMPLES, 1, extra_samples);
+      while (width > TILE_SIZE || height > TILE_SIZE)
+        {
+          width  = MAX (1, width  / 2);
+          height = MAX (1, height / 2);
+          n_levels++;
+        }
     }
 
-  TIFFSetField (tif, TIFFTAG_PHOTOMETRIC, photometric);
+#ifdef TIFF_BIGTIFF_VERSION
+  /* the offsets in classic TIFF files are 32 bit, so use BigTIFF when
+   * the uncompressed data, levels included, comes close to 4 GB
+   */
+  if (tsvals.bigtiff ||
+      ((guint64) bytesperrow * rows * (n_levels ? 4 : 3) / 3 >
+       BIGTIFF_THRESHOLD))
+    {
+      mode = "w8";
+    }
+#endif
+
+  fd = g_open (filename, O_CREAT | O_TRUNC | O_WRONLY | _O_BINARY, 0666);
+
+  if (fd == -1)
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                   _("Could not open '%s' for writing: %s"),
+                   gimp_filename_to_utf8 (filename), g_strerror (errno));
+      return FALSE;
+    }
+
+  tif = TIFFFdOpen (fd, filename, mode);
+
+  /* Set TIFF parameters. */
+  TIFFSetField (tif, TIFFTAG_SUBFILETYPE, 0);
+  set_format_fields (tif, &format, cols, rows);
   TIFFSetField (tif, TIFFTAG_DOCUMENTNAME, filename);
-  TIFFSetField (tif, TIFFTAG_SAMPLESPERPIXEL, samplesperpixel);
-  TIFFSetField (tif, TIFFTAG_ROWSPERSTRIP, rowsperstrip);
-  /* TIFFSetField( tif, TIFFTAG_STRIPBYTECOUNTS, rows / rowsperstrip ); */
-  TIFFSetField (tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+
+  if (n_levels > 0)
+    {
+      toff_t *offsets = g_new0 (toff_t, n_levels);
+
+      /* filled in by libtiff as the levels are written */
+      TIFFSetField (tif, TIFFTAG_SUBIFD, n_levels, offsets);
+      g_free (offsets);
+    }
 
   /* resolution fields */
   {
@@ -933,103 +1554,78 @@ save_image (const gchar  *filename,
   /* save path data */
   save_paths (tif, orig_image);
 
-  if (!is_bw && drawable_type == GIMP_INDEXED_IMAGE)
-    TIFFSetField (tif, TIFFTAG_COLORMAP, red, grn, blu);
+  if (format.tiled)
+    {
+      if (! save_tiled_image (tif, &format, layer,
+                              drawable_type, is_bw, invert, n_levels))
+        {
+          g_message ("Failed writing the image tiles");
 
-  /* array to rearrange data */
-  src = g_new (guchar, bytesperrow * tile_height);
-  data = g_new (guchar, bytesperrow);
+          TIFFClose (tif);
+          close (fd);
 
-  /* Now write the TIFF data. */
-  for (y = 0; y < rows; y = yend)
+          return FALSE;
+        }
+    }
+  else
     {
-      yend = y + tile_height;
-      yend = MIN (yend, rows);
-
-      gimp_pixel_rgn_get_rect (&pixel_rgn, src, 0, y, cols, yend - y);
+      /* array to rearrange data */
+      src = g_new (guchar, bytesperrow * tile_height);
+      data = g_new (guchar, bytesperrow);
 
-      for (row = y; row < yend; row++)
+      /* Now write the TIFF data. */
+      for (y = 0; y < rows; y = yend)
         {
-          t = src + bytesperrow * (row - y);
+          yend = y + tile_height;
+          yend = MIN (yend, rows);
 
-          switch (drawable_type)
-            {
-            case GIMP_INDEXED_IMAGE:
-              if (is_bw)
-                {
-                  byte2bit (t, bytesperrow, data, invert);
-                  success = (TIFFWriteScanline (tif, data, row, 0) >= 0);
-                }
-              else
-                {
-                  success = (TIFFWriteScanline (tif, t, row, 0) >= 0);
-                }
-              break;
+          gimp_pixel_rgn_get_rect (&pixel_rgn, src, 0, y, cols, yend - y);
 
-            case GIMP_GRAY_IMAGE:
-              success = (TIFFWriteScanline (tif, t, row, 0) >= 0);
-              break;
+          for (row = y; row < yend; row++)
+            {
+              t = src + bytesperrow * (row - y);
 
-            case GIMP_GRAYA_IMAGE:
-              for (col = 0; col < cols*samplesperpixel; col+=samplesperpixel)
+              switch (drawable_type)
                 {
-                  if (tsvals.save_transp_pixels)
+                case GIMP_INDEXED_IMAGE:
+                  if (is_bw)
                     {
-                      data[col + 0] = t[col + 0];
+                      convert_row (t, data, cols,
+                                   drawable_type, is_bw, invert);
+                      success = (TIFFWriteScanline (tif, data, row, 0) >= 0);
                     }
                   else
                     {
-                      /* pre-multiply gray by alpha */
-                      data[col + 0] = (t[col + 0] * t[col + 1]) / 255;
+                      success = (TIFFWriteScanline (tif, t, row, 0) >= 0);
                     }
+                  break;
 
-                  data[col + 1] = t[col + 1];  /* alpha channel */
-                }
+                case GIMP_GRAY_IMAGE:
+                case GIMP_RGB_IMAGE:
+                  success = (TIFFWriteScanline (tif, t, row, 0) >= 0);
+                  break;
 
-              success = (TIFFWriteScanline (tif, data, row, 0) >= 0);
-              break;
+                case GIMP_GRAYA_IMAGE:
+                case GIMP_RGBA_IMAGE:
+                  convert_row (t, data, cols, drawable_type, is_bw, invert);
+                  success = (TIFFWriteScanline (tif, data, row, 0) >= 0);
+                  break;
 
-            case GIMP_RGB_IMAGE:
-              success = (TIFFWriteScanline (tif, t, row, 0) >= 0);
-              break;
+                default:
+                  success = FALSE;
+                  break;
+                }
 
-            case GIMP_RGBA_IMAGE:
-              for (col = 0; col < cols*samplesperpixel; col+=samplesperpixel)
+              if (!success)
                 {
-                  if (tsvals.save_transp_pixels)
-                    {
-                      data[col+0] = t[col + 0];
-                      data[col+1] = t[col + 1];
-                      data[col+2] = t[col + 2];
-                    }
-                  else
-                    {
-                      /* pre-multiply rgb by alpha */
-                      data[col+0] = t[col + 0] * t[col + 3] / 255;
-                      data[col+1] = t[col + 1] * t[col + 3] / 255;
-                      data[col+2] = t[col + 2] * t[col + 3] / 255;
-                    }
-
-                  data[col+3] = t[col + 3];  /* alpha channel */
+                  g_message ("Failed a scanline write on row %d", row);
+                  return FALSE;
                 }
-
-              success = (TIFFWriteScanline (tif, data, row, 0) >= 0);
-              break;
-
-            default:
-              success = FALSE;
-              break;
             }
 
-          if (!success)
-            {
-              g_message ("Failed a scanline write on row %d", row);
-              return FALSE;
-            }
+          if ((row % 32) == 0)
+            gimp_progress_update ((gdouble) row / (gdouble) rows);
         }
-
-      if ((row % 32) == 0)
-        gimp_progress_update ((gdouble) row / (gdouble) rows);
     }
 
   TIFFFlushData (tif);
@@ -1039,6 +1635,7 @@ save_image (const gchar  *filename,
   gimp_progress_update (1.0);
 
   gimp_drawable_detach (drawable);
+  g_free (src);
   g_free (data);
 
   return TRUE;
@@ -1055,6 +1652,7 @@ save_dialog (gboolean has_alpha,
   GtkWidget *label;
   GtkWidget *entry;
   GtkWidget *toggle;
+  GtkWidget *tiled;
   GtkWidget *g3;
   GtkWidget *g4;
   gboolean   run;
@@ -1110,6 +1708,57 @@ save_dialog (gboolean has_alpha,
                     G_CALLBACK (gimp_toggle_button_update),
                     &tsvals.save_transp_pixels);
 
+  /* BigTIFF */
+  toggle = gtk_check_button_new_with_mnemonic (_("Save as _BigTIFF"));
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (toggle), tsvals.bigtiff);
+  gtk_box_pack_start (GTK_BOX (vbox), toggle, FALSE, FALSE, 0);
+  gtk_widget_show (toggle);
+
+  gimp_help_set_help_data (toggle,
+                           _("Allows files larger than 4 GB. Images that "
+                             "need it are saved as BigTIFF anyway, but "
+                             "not all programs can read it."),
+                           NULL);
+
+#ifndef TIFF_BIGTIFF_VERSION
+  gtk_widget_set_sensitive (toggle, FALSE);
+#endif
+
+  g_signal_connect (toggle, "toggled",
+                    G_CALLBACK (gimp_toggle_button_update),
+                    &tsvals.bigtiff);
+
+  /* tiles */
+  tiled = gtk_check_button_new_with_mnemonic (_("Save _tiled"));
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (tiled), tsvals.tiled);
+  gtk_box_pack_start (GTK_BOX (vbox), tiled, FALSE, FALSE, 0);
+  gtk_widget_show (tiled);
+
+  g_signal_connect (tiled, "toggled",
+                    G_CALLBACK (gimp_toggle_button_update),
+                    &tsvals.tiled);
+
+  /* reduced-resolution pyramid */
+  toggle = gtk_check_button_new_with_mnemonic
+    (_("Save reduced-_resolution levels"));
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (toggle), tsvals.pyramid);
+  gtk_box_pack_start (GTK_BOX (vbox), toggle, FALSE, FALSE, 0);
+  gtk_widget_show (toggle);
+
+  gimp_help_set_help_data (toggle,
+                           _("Adds copies of the image at half, quarter "
+                             "and smaller sizes down to one tile, for "
+                             "viewers that zoom out"),
+                           NULL);
+
+  g_object_bind_property (tiled,  "active",
+                          toggle, "sensitive",
+                          G_BINDING_SYNC_CREATE);
+
+  g_signal_connect (toggle, "toggled",
+                    G_CALLBACK (gimp_toggle_button_update),
+                    &tsvals.pyramid);
+
   /* comment entry */
   hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
   gtk_box_pack_start (GTK_BOX (vbox), hbox, FALSE, FALSE, 0);
@@ -1190,3 +1839,74 @@ byte2bit (const guchar *byteline,
       *bitline = invert ? ~bitval & (0xff << (8 - width)) : bitval;
     }
 }
+
+/* Convert a row of drawable pixels to the samples written to the file */
+static void
+convert_row (const guchar  *src,
+             guchar        *dest,
+             gint           cols,
+             GimpImageType  drawable_type,
+             gboolean       is_bw,
+             gboolean       invert)
+{
+  gint col;
+
+  switch (drawable_type)
+    {
+    case GIMP_INDEXED_IMAGE:
+      if (is_bw)
+        byte2bit (src, cols, dest, invert);
+      else
+        memcpy (dest, src, cols);
+      break;
+
+    case GIMP_GRAY_IMAGE:
+      memcpy (dest, src, cols);
+      break;
+
+    case GIMP_GRAYA_IMAGE:
+      for (col = 0; col < cols * 2; col += 2)
+        {
+          if (tsvals.save_transp_pixels)
+            {
+              dest[col + 0] = src[col + 0];
+            }
+          else
+            {
+              /* pre-multiply gray by alpha */
+              dest[col + 0] = (src[col + 0] * src[col + 1]) / 255;
+            }
+
+          dest[col + 1] = src[col + 1];  /* alpha channel */
+        }
+      break;
+
+    case GIMP_RGB_IMAGE:
+      memcpy (dest, src, cols * 3);
+      break;
+
+    case GIMP_RGBA_IMAGE:
+      for (col = 0; col < cols * 4; col += 4)
+        {
+          if (tsvals.save_transp_pixels)
+            {
+              dest[col + 0] = src[col + 0];
+              dest[col + 1] = src[col + 1];
+              dest[col + 2] = src[col + 2];
+            }
+          else
+            {
+              /* pre-multiply rgb by alpha */
+              dest[col + 0] = src[col + 0] * src[col + 3] / 255;
+              dest[col + 1] = src[col + 1] * src[col + 3] / 255;
+              dest[col + 2] = src[col + 2] * src[col + 3] / 255;
+            }
+
+          dest[col + 3] = src[col + 3];  /* alpha channel */
+        }
+      break;
+
+    default:
+      break;
+    }
+}
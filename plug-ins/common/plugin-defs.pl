@@ -63,7 +63,7 @@
     'file-pat' => { ui => 1 },
     'file-pcx' => { ui => 1 },
     'file-pix' => { ui => 1 },
-    'file-png' => { ui => 1, optional => 1, libs => 'PNG_LIBS', cflags => 'PNG_CFLAGS' },
+    'file-png' => { ui => 1, optional => 1, libs => 'PNG_LIBS', libdep => 'z', cflags => 'PNG_CFLAGS' },
     'file-pnm' => { ui => 1 },
     'file-pdf-load' => { ui => 1, optional => 1, libs => 'POPPLER_LIBS', cflags => 'POPPLER_CFLAGS' },
     'file-pdf-save' => { ui => 1, optional => 1, libs => 'CAIRO_PDF_LIBS', cflags => 'CAIRO_PDF_CFLAGS' },
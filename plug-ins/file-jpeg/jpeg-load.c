@@ -56,10 +56,22 @@ static void  jpeg_load_resolution           (gint32    image_ID,
 #ifdef HAVE_LIBEXIF
 static gboolean  jpeg_load_exif_resolution  (gint32    image_ID,
                                              ExifData *exif_data);
+static gint32    load_exif_thumbnail_image  (const gchar  *filename,
+                                             gint         *width,
+                                             gint         *height);
 #endif
 
 static void      jpeg_load_sanitize_comment (gchar    *comment);
 
+static gboolean  jpeg_load_get_size         (const gchar  *filename,
+                                             gint         *width,
+                                             gint         *height,
+                                             GError      **error);
+static void      jpeg_load_read_scanlines   (struct jpeg_decompress_struct
+                                                          *cinfo,
+                                             guchar      **rowbuf,
+                                             gint          scanlines);
+
 static gpointer  jpeg_load_cmyk_transform   (guint8   *profile_data,
                                              gsize     profile_len);
 static void      jpeg_load_cmyk_to_rgb      (guchar   *buf,
@@ -76,6 +88,7 @@ gint32
 load_image (const gchar  *filename,
             GimpRunMode   runmode,
             gboolean      preview,
+            gint          scale_denom,
             GError      **error)
 {
   GimpPixelRgn     pixel_rgn;
@@ -175,9 +188,14 @@ load_image (const gchar  *filename,
 
   /* Step 4: set parameters for decompression */
 
-  /* In this example, we don't need to change any of the defaults set by
-   * jpeg_read_header(), so we do nothing here.
+  /* A reduced size image is decoded from fewer DCT coefficients,
+   * which is a lot faster than decoding all of it and scaling it down.
    */
+  if (scale_denom > 1)
+    {
+      cinfo.scale_num   = 1;
+      cinfo.scale_denom = scale_denom;
+    }
 
   /* Step 5: Start decompressor */
 
@@ -320,6 +338,20 @@ load_image (const gchar  *filename,
 #endif
         jpeg_load_resolution (image_ID, &cinfo);
 
+      /* keep the print size of a reduced size image */
+      if (cinfo.output_width != cinfo.image_width)
+        {
+          gdouble xresolution;
+          gdouble yresolution;
+
+          gimp_image_get_resolution (image_ID, &xresolution, &yresolution);
+          gimp_image_set_resolution (image_ID,
+                                     xresolution * cinfo.output_width /
+                                     cinfo.image_width,
+                                     yresolution * cinfo.output_height /
+                                     cinfo.image_height);
+        }
+
       /* if we found any comments, then make a parasite for them */
       if (comment_buffer && comment_buffer->len)
         {
@@ -425,8 +457,7 @@ load_image (const gchar  *filename,
 
       scanlines = end - start;
 
-      for (i = 0; i < scanlines; i++)
-        jpeg_read_scanlines (&cinfo, (JSAMPARRAY) &rowbuf[i], 1);
+      jpeg_load_read_scanlines (&cinfo, rowbuf, scanlines);
 
       if (cinfo.out_color_space == JCS_CMYK)
         jpeg_load_cmyk_to_rgb (buf, drawable->width * scanlines,
@@ -602,6 +633,110 @@ jpeg_load_sanitize_comment (gchar *comment)
 }
 
 
+
+/*  reads the size of the image from its header, without decoding it  */
+static gboolean
+jpeg_load_get_size (const gchar  *filename,
+                    gint         *width,
+                    gint         *height,
+                    GError      **error)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct my_error_mgr           jerr;
+  FILE                         *infile;
+
+  if ((infile = g_fopen (filename, "rb")) == NULL)
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                   _("Could not open '%s' for reading: %s"),
+                   gimp_filename_to_utf8 (filename), g_strerror (errno));
+      return FALSE;
+    }
+
+  cinfo.err = jpeg_std_error (&jerr.pub);
+  jerr.pub.error_exit     = my_error_exit;
+  jerr.pub.output_message = my_output_message;
+
+  /* Establish the setjmp return context for my_error_exit to use. */
+  if (setjmp (jerr.setjmp_buffer))
+    {
+      jpeg_destroy_decompress (&cinfo);
+      fclose (infile);
+
+      return FALSE;
+    }
+
+  jpeg_create_decompress (&cinfo);
+
+  jpeg_stdio_src (&cinfo, infile);
+
+  jpeg_read_header (&cinfo, TRUE);
+
+  *width  = cinfo.image_width;
+  *height = cinfo.image_height;
+
+  jpeg_destroy_decompress (&cinfo);
+
+  fclose (infile);
+
+  return TRUE;
+}
+
+/*  jpeg_read_scanlines() returns as many scanlines as the decoder has
+ *  ready, usually all the rows of an iMCU, ask it for the rest until
+ *  we have them all
+ */
+static void
+jpeg_load_read_scanlines (struct jpeg_decompress_struct  *cinfo,
+                          guchar                        **rowbuf,
+                          gint                            scanlines)
+{
+  gint i = 0;
+
+  while (i < scanlines)
+    i += jpeg_read_scanlines (cinfo, (JSAMPARRAY) rowbuf + i, scanlines - i);
+}
+
+/*  Loads a thumbnail of at least thumb_size pixels, the one in the
+ *  EXIF data if it is big enough.  Otherwise the image is decoded at
+ *  the smallest of 1/8, 1/4 or 1/2 of its size that still is.
+ */
+gint32
+load_thumbnail_image (const gchar  *filename,
+                      gint          thumb_size,
+                      gint         *width,
+                      gint         *height,
+                      GError      **error)
+{
+  gint32 image_ID;
+  gint   scale_denom;
+
+#ifdef HAVE_LIBEXIF
+  image_ID = load_exif_thumbnail_image (filename, width, height);
+
+  if (image_ID != -1)
+    {
+      if (MAX (gimp_image_width (image_ID),
+               gimp_image_height (image_ID)) >= thumb_size)
+        return image_ID;
+
+      gimp_image_delete (image_ID);
+    }
+#endif /* HAVE_LIBEXIF */
+
+  if (! jpeg_load_get_size (filename, width, height, error))
+    return -1;
+
+  for (scale_denom = 8; scale_denom > 1; scale_denom /= 2)
+    if (MAX (*width, *height) >= thumb_size * scale_denom)
+      break;
+
+  image_ID = load_image (filename, GIMP_RUN_NONINTERACTIVE, FALSE,
+                         scale_denom, error);
+
+  return image_ID;
+}
+
 #ifdef HAVE_LIBEXIF
 
 typedef struct
@@ -652,11 +787,10 @@ term_source (j_decompress_ptr cinfo)
 {
 }
 
-gint32
-load_thumbnail_image (const gchar  *filename,
-                      gint         *width,
-                      gint         *height,
-                      GError      **error)
+static gint32
+load_exif_thumbnail_image (const gchar *filename,
+                           gint        *width,
+                           gint        *height)
 {
   gint32 volatile  image_ID;
   ExifData        *exif_data;
@@ -674,7 +808,6 @@ load_thumbnail_image (const gchar  *filename,
   gint             i, start, end;
   gint             orientation;
   my_src_ptr       src;
-  FILE            *infile;
 
   image_ID = -1;
   exif_data = jpeg_exif_data_new_from_file (filename, NULL);
@@ -838,8 +971,7 @@ load_thumbnail_image (const gchar  *filename,
       end   = MIN (end, cinfo.output_height);
       scanlines = end - start;
 
-      for (i = 0; i < scanlines; i++)
-        jpeg_read_scanlines (&cinfo, (JSAMPARRAY) &rowbuf[i], 1);
+      jpeg_load_read_scanlines (&cinfo, rowbuf, scanlines);
 
       if (cinfo.out_color_space == JCS_CMYK)
         jpeg_load_cmyk_to_rgb (buf, drawable->width * scanlines, NULL);
@@ -879,71 +1011,14 @@ load_thumbnail_image (const gchar  *filename,
   /* NOW to get the dimensions of the actual image to return the
    * calling app
    */
-  cinfo.err = jpeg_std_error (&jerr.pub);
-  jerr.pub.error_exit = my_error_exit;
-  jerr.pub.output_message = my_output_message;
-
-  if ((infile = g_fopen (filename, "rb")) == NULL)
+  if (! jpeg_load_get_size (filename, width, height, NULL))
     {
-      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
-                   _("Could not open '%s' for reading: %s"),
-                   gimp_filename_to_utf8 (filename), g_strerror (errno));
-
-      if (exif_data)
-        {
-          exif_data_unref (exif_data);
-          exif_data = NULL;
-        }
-
-      return -1;
-    }
-
-  /* Establish the setjmp return context for my_error_exit to use. */
-  if (setjmp (jerr.setjmp_buffer))
-    {
-      /* If we get here, the JPEG code has signaled an error.  We
-       * need to clean up the JPEG object, close the input file,
-       * and return.
-       */
-      jpeg_destroy_decompress (&cinfo);
-
-      if (image_ID != -1)
-        gimp_image_delete (image_ID);
-
-      if (exif_data)
-        {
-          exif_data_unref (exif_data);
-          exif_data = NULL;
-        }
+      gimp_image_delete (image_ID);
+      exif_data_unref (exif_data);
 
       return -1;
     }
 
-  /* Now we can initialize the JPEG decompression object. */
-  jpeg_create_decompress (&cinfo);
-
-  /* Step 2: specify data source (eg, a file) */
-
-  jpeg_stdio_src (&cinfo, infile);
-
-  /* Step 3: read file parameters with jpeg_read_header() */
-
-  jpeg_read_header (&cinfo, TRUE);
-
-  jpeg_start_decompress (&cinfo);
-
-  *width  = cinfo.output_width;
-  *height = cinfo.output_height;
-
-  /* Step 4: Release JPEG decompression object */
-
-  /* This is an important step since it will release a good deal
-   * of memory.
-   */
-  jpeg_destroy_decompress (&cinfo);
-
-  fclose (infile);
-
   if (exif_data)
     {
       exif_data_unref (exif_data);
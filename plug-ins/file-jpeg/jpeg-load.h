@@ -21,16 +21,13 @@
 gint32 load_image           (const gchar  *filename,
                              GimpRunMode   runmode,
                              gboolean      preview,
+                             gint          scale_denom,
                              GError      **error);
 
-
-#ifdef HAVE_LIBEXIF
-
 gint32 load_thumbnail_image (const gchar  *filename,
+                             gint          thumb_size,
                              gint         *width,
                              gint         *height,
                              GError      **error);
 
-#endif /* HAVE_LIBEXIF */
-
 #endif /* __JPEG_LOAD_H__ */
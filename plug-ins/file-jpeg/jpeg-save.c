@@ -73,6 +73,13 @@
 
 #define JPEG_DEFAULTS_PARASITE  "jpeg-save-defaults"
 
+#define PREVIEW_DELAY           300      /* milliseconds */
+
+#define ESTIMATE_STRIPS         8
+#define ESTIMATE_STRIP_HEIGHT   16       /* the largest MCU height */
+#define ESTIMATE_MAX_PIXELS     (1 << 20)
+#define ESTIMATE_BUFFER_SIZE    4096
+
 
 typedef struct
 {
@@ -92,6 +99,14 @@ typedef struct
   guint         source_id;
 } PreviewPersistent;
 
+/* a destination manager that only counts the compressed bytes */
+typedef struct
+{
+  struct jpeg_destination_mgr pub;
+  JOCTET        buffer[ESTIMATE_BUFFER_SIZE];
+  gsize         size;
+} CountingDest;
+
 /*le added : struct containing pointers to save dialog*/
 typedef struct
 {
@@ -142,6 +157,7 @@ static GtkWidget *restart_markers_scale = NULL;
 static GtkWidget *restart_markers_label = NULL;
 static GtkWidget *preview_size          = NULL;
 static PreviewPersistent *prev_p        = NULL;
+static guint              preview_timeout_id = 0;
 
 static void   save_dialog_response (GtkWidget   *widget,
                                     gint         response_id,
@@ -211,7 +227,7 @@ background_jpeg_save (PreviewPersistent *pp)
           g_free (size_text);
 
           /* and load the preview */
-          load_image (pp->file_name, GIMP_RUN_NONINTERACTIVE, TRUE, NULL);
+          load_image (pp->file_name, GIMP_RUN_NONINTERACTIVE, TRUE, 1, NULL);
         }
 
       /* we cleanup here (load_image doesn't run in the background) */
@@ -227,33 +243,146 @@ background_jpeg_save (PreviewPersistent *pp)
     }
   else
     {
-      if ((pp->cinfo.next_scanline % pp->tile_height) == 0)
+      /* compress a whole row of tiles per call, a single scanline
+       * per main loop iteration makes the preview crawl
+       */
+      yend = pp->cinfo.next_scanline + pp->tile_height;
+      yend = MIN (yend, pp->cinfo.image_height);
+      gimp_pixel_rgn_get_rect (&pp->pixel_rgn, pp->data, 0,
+                               pp->cinfo.next_scanline,
+                               pp->cinfo.image_width,
+                               (yend - pp->cinfo.next_scanline));
+      pp->src = pp->data;
+
+      while ((gint) pp->cinfo.next_scanline < yend && ! pp->abort_me)
         {
-          yend = pp->cinfo.next_scanline + pp->tile_height;
-          yend = MIN (yend, pp->cinfo.image_height);
-          gimp_pixel_rgn_get_rect (&pp->pixel_rgn, pp->data, 0,
-                                   pp->cinfo.next_scanline,
-                                   pp->cinfo.image_width,
-                                   (yend - pp->cinfo.next_scanline));
-          pp->src = pp->data;
+          t = pp->temp;
+          s = pp->src;
+          i = pp->cinfo.image_width;
+
+          while (i--)
+            {
+              for (j = 0; j < pp->cinfo.input_components; j++)
+                *t++ = *s++;
+              if (pp->has_alpha)  /* ignore alpha channel */
+                s++;
+            }
+
+          pp->src += pp->rowstride;
+          jpeg_write_scanlines (&(pp->cinfo), (JSAMPARRAY) &(pp->temp), 1);
         }
 
-      t = pp->temp;
-      s = pp->src;
-      i = pp->cinfo.image_width;
+      return TRUE;
+    }
+}
 
-      while (i--)
+/* Sets the compression parameters from jsvals, the caller has to set
+ * the input image description of @cinfo first.
+ */
+static void
+set_compress_params (struct jpeg_compress_struct *cinfo,
+                     gint32                       image_ID,
+                     gint32                       drawable_ID)
+{
+  JpegSubsampling subsampling;
+
+  jpeg_set_defaults (cinfo);
+
+  jpeg_set_quality (cinfo, (gint) (jsvals.quality + 0.5), jsvals.baseline);
+
+  if (jsvals.use_orig_quality && num_quant_tables > 0)
+    {
+      guint **quant_tables;
+      gint    t;
+
+      /* override tables generated by jpeg_set_quality() with custom tables */
+      quant_tables = jpeg_restore_original_tables (image_ID, num_quant_tables);
+      if (quant_tables)
         {
-          for (j = 0; j < pp->cinfo.input_components; j++)
-            *t++ = *s++;
-          if (pp->has_alpha)  /* ignore alpha channel */
-            s++;
+          for (t = 0; t < num_quant_tables; t++)
+            {
+              jpeg_add_quant_table (cinfo, t, quant_tables[t],
+                                    100, jsvals.baseline);
+              g_free (quant_tables[t]);
+            }
+          g_free (quant_tables);
         }
+    }
 
-      pp->src += pp->rowstride;
-      jpeg_write_scanlines (&(pp->cinfo), (JSAMPARRAY) &(pp->temp), 1);
+  cinfo->optimize_coding = jsvals.optimize;
 
-      return TRUE;
+  subsampling = (gimp_drawable_is_rgb (drawable_ID) ?
+                 jsvals.subsmp : JPEG_SUBSAMPLING_1x1_1x1_1x1);
+
+  /*  smoothing is not supported with nonstandard sampling ratios  */
+  if (subsampling != JPEG_SUBSAMPLING_2x1_1x1_1x1 &&
+      subsampling != JPEG_SUBSAMPLING_1x2_1x1_1x1)
+    {
+      cinfo->smoothing_factor = (gint) (jsvals.smoothing * 100);
+    }
+
+  if (jsvals.progressive)
+    {
+      jpeg_simple_progression (cinfo);
+    }
+
+  switch (subsampling)
+    {
+    case JPEG_SUBSAMPLING_2x2_1x1_1x1:
+    default:
+      cinfo->comp_info[0].h_samp_factor = 2;
+      cinfo->comp_info[0].v_samp_factor = 2;
+      cinfo->comp_info[1].h_samp_factor = 1;
+      cinfo->comp_info[1].v_samp_factor = 1;
+      cinfo->comp_info[2].h_samp_factor = 1;
+      cinfo->comp_info[2].v_samp_factor = 1;
+      break;
+
+    case JPEG_SUBSAMPLING_2x1_1x1_1x1:
+      cinfo->comp_info[0].h_samp_factor = 2;
+      cinfo->comp_info[0].v_samp_factor = 1;
+      cinfo->comp_info[1].h_samp_factor = 1;
+      cinfo->comp_info[1].v_samp_factor = 1;
+      cinfo->comp_info[2].h_samp_factor = 1;
+      cinfo->comp_info[2].v_samp_factor = 1;
+      break;
+
+    case JPEG_SUBSAMPLING_1x1_1x1_1x1:
+      cinfo->comp_info[0].h_samp_factor = 1;
+      cinfo->comp_info[0].v_samp_factor = 1;
+      cinfo->comp_info[1].h_samp_factor = 1;
+      cinfo->comp_info[1].v_samp_factor = 1;
+      cinfo->comp_info[2].h_samp_factor = 1;
+      cinfo->comp_info[2].v_samp_factor = 1;
+      break;
+
+    case JPEG_SUBSAMPLING_1x2_1x1_1x1:
+      cinfo->comp_info[0].h_samp_factor = 1;
+      cinfo->comp_info[0].v_samp_factor = 2;
+      cinfo->comp_info[1].h_samp_factor = 1;
+      cinfo->comp_info[1].v_samp_factor = 1;
+      cinfo->comp_info[2].h_samp_factor = 1;
+      cinfo->comp_info[2].v_samp_factor = 1;
+      break;
+    }
+
+  cinfo->restart_interval = 0;
+  cinfo->restart_in_rows = jsvals.restart;
+
+  switch (jsvals.dct)
+    {
+    case 0:
+    default:
+      cinfo->dct_method = JDCT_ISLOW;
+      break;
+
+    case 1:
+      cinfo->dct_method = JDCT_IFAST;
+      break;
+
+    case 2:
+      cinfo->dct_method = JDCT_FLOAT;
+      break;
     }
 }
 
@@ -271,7 +400,6 @@ save_image (const gchar  *filename,
   GimpParasite  *parasite;
   static struct jpeg_compress_struct cinfo;
   static struct my_error_mgr         jerr;
-  JpegSubsampling             subsampling;
   FILE     * volatile outfile;
   guchar   *temp, *t;
   guchar   *data;
@@ -373,108 +501,11 @@ save_image (const gchar  *filename,
   cinfo.in_color_space = (drawable_type == GIMP_RGB_IMAGE ||
                           drawable_type == GIMP_RGBA_IMAGE)
     ? JCS_RGB : JCS_GRAYSCALE;
-  /* Now use the library's routine to set default compression parameters.
+  /* Now set the default compression parameters and our settings on top.
    * (You must set at least cinfo.in_color_space before calling this,
    * since the defaults depend on the source color space.)
    */
-  jpeg_set_defaults (&cinfo);
-
-  jpeg_set_quality (&cinfo, (gint) (jsvals.quality + 0.5), jsvals.baseline);
-
-  if (jsvals.use_orig_quality && num_quant_tables > 0)
-    {
-      guint **quant_tables;
-      gint    t;
-
-      /* override tables generated by jpeg_set_quality() with custom tables */
-      quant_tables = jpeg_restore_original_tables (image_ID, num_quant_tables);
-      if (quant_tables)
-        {
-          for (t = 0; t < num_quant_tables; t++)
-            {
-              jpeg_add_quant_table (&cinfo, t, quant_tables[t],
-                                    100, jsvals.baseline);
-              g_free (quant_tables[t]);
-            }
-          g_free (quant_tables);
-        }
-    }
-
-  cinfo.optimize_coding = jsvals.optimize;
-
-  subsampling = (gimp_drawable_is_rgb (drawable_ID) ?
-                 jsvals.subsmp : JPEG_SUBSAMPLING_1x1_1x1_1x1);
-
-  /*  smoothing is not supported with nonstandard sampling ratios  */
-  if (subsampling != JPEG_SUBSAMPLING_2x1_1x1_1x1 &&
-      subsampling != JPEG_SUBSAMPLING_1x2_1x1_1x1)
-    {
-      cinfo.smoothing_factor = (gint) (jsvals.smoothing * 100);
-    }
-
-  if (jsvals.progressive)
-    {
-      jpeg_simple_progression (&cinfo);
-    }
-
-  switch (subsampling)
-    {
-    case JPEG_SUBSAMPLING_2x2_1x1_1x1:
-    default:
-      cinfo.comp_info[0].h_samp_factor = 2;
-      cinfo.comp_info[0].v_samp_factor = 2;
-      cinfo.comp_info[1].h_samp_factor = 1;
-      cinfo.comp_info[1].v_samp_factor = 1;
-      cinfo.comp_info[2].h_samp_factor = 1;
-      cinfo.comp_info[2].v_samp_factor = 1;
-      break;
-
-    case JPEG_SUBSAMPLING_2x1_1x1_1x1:
-      cinfo.comp_info[0].h_samp_factor = 2;
-      cinfo.comp_info[0].v_samp_factor = 1;
-      cinfo.comp_info[1].h_samp_factor = 1;
-      cinfo.comp_info[1].v_samp_factor = 1;
-      cinfo.comp_info[2].h_samp_factor = 1;
-      cinfo.comp_info[2].v_samp_factor = 1;
-      break;
-
-    case JPEG_SUBSAMPLING_1x1_1x1_1x1:
-      cinfo.comp_info[0].h_samp_factor = 1;
-      cinfo.comp_info[0].v_samp_factor = 1;
-      cinfo.comp_info[1].h_samp_factor = 1;
-      cinfo.comp_info[1].v_samp_factor = 1;
-      cinfo.comp_info[2].h_samp_factor = 1;
-      cinfo.comp_info[2].v_samp_factor = 1;
-      break;
-
-    case JPEG_SUBSAMPLING_1x2_1x1_1x1:
-      cinfo.comp_info[0].h_samp_factor = 1;
-      cinfo.comp_info[0].v_samp_factor = 2;
-      cinfo.comp_info[1].h_samp_factor = 1;
-      cinfo.comp_info[1].v_samp_factor = 1;
-      cinfo.comp_info[2].h_samp_factor = 1;
-      cinfo.comp_info[2].v_samp_factor = 1;
-      break;
-    }
-
-  cinfo.restart_interval = 0;
-  cinfo.restart_in_rows = jsvals.restart;
-
-  switch (jsvals.dct)
-    {
-    case 0:
-    default:
-      cinfo.dct_method = JDCT_ISLOW;
-      break;
-
-    case 1:
-      cinfo.dct_method = JDCT_IFAST;
-      break;
-
-    case 2:
-      cinfo.dct_method = JDCT_FLOAT;
-      break;
-    }
+  set_compress_params (&cinfo, image_ID, drawable_ID);
 
   {
     gdouble xresolution;
@@ -686,8 +717,7 @@ save_image (const gchar  *filename,
       pp->cinfo.err = jpeg_std_error(&(pp->jerr));
       pp->jerr.error_exit = background_error_exit;
 
-      gtk_label_set_text (GTK_LABEL (preview_size),
-                          _("Calculating file size..."));
+      /* the label keeps showing the estimate until we know better */
 
       pp->source_id = g_idle_add ((GSourceFunc) background_jpeg_save, pp);
 
@@ -751,36 +781,296 @@ save_image (const gchar  *filename,
 }
 
 static void
-make_preview (void)
+counting_dest_init (j_compress_ptr cinfo)
 {
-  destroy_preview ();
+  CountingDest *dest = (CountingDest *) cinfo->dest;
 
-  if (jsvals.preview)
+  dest->pub.next_output_byte = dest->buffer;
+  dest->pub.free_in_buffer   = ESTIMATE_BUFFER_SIZE;
+}
+
+static boolean
+counting_dest_empty (j_compress_ptr cinfo)
+{
+  CountingDest *dest = (CountingDest *) cinfo->dest;
+
+  dest->size += ESTIMATE_BUFFER_SIZE;
+
+  dest->pub.next_output_byte = dest->buffer;
+  dest->pub.free_in_buffer   = ESTIMATE_BUFFER_SIZE;
+
+  return TRUE;
+}
+
+static void
+counting_dest_term (j_compress_ptr cinfo)
+{
+  CountingDest *dest = (CountingDest *) cinfo->dest;
+
+  dest->size += ESTIMATE_BUFFER_SIZE - dest->pub.free_in_buffer;
+}
+
+/* Compresses @rows rows of @pixels with the current settings, only
+ * counting the bytes. Returns the size of the result or 0 on errors.
+ */
+static gsize
+estimate_encode (gint32        image_ID,
+                 gint32        drawable_ID,
+                 const guchar *pixels,
+                 gint          width,
+                 gint          rows,
+                 gint          components)
+{
+  struct jpeg_compress_struct cinfo;
+  struct my_error_mgr         jerr;
+  CountingDest                dest;
+  JSAMPROW                    row;
+  gint                        y;
+
+  cinfo.err = jpeg_std_error (&jerr.pub);
+  jerr.pub.error_exit = my_error_exit;
+
+  if (setjmp (jerr.setjmp_buffer))
+    {
+      jpeg_destroy_compress (&cinfo);
+
+      return 0;
+    }
+
+  jpeg_create_compress (&cinfo);
+
+  dest.pub.init_destination    = counting_dest_init;
+  dest.pub.empty_output_buffer = counting_dest_empty;
+  dest.pub.term_destination    = counting_dest_term;
+  dest.size                    = 0;
+
+  cinfo.dest = &dest.pub;
+
+  cinfo.image_width      = width;
+  cinfo.image_height     = rows;
+  cinfo.input_components = components;
+  cinfo.in_color_space   = (components == 3) ? JCS_RGB : JCS_GRAYSCALE;
+
+  set_compress_params (&cinfo, image_ID, drawable_ID);
+
+  jpeg_start_compress (&cinfo, TRUE);
+
+  for (y = 0; y < rows; y++)
     {
-      gchar *tn = gimp_temp_name ("jpeg");
+      row = (JSAMPROW) pixels + y * width * components;
+
+      jpeg_write_scanlines (&cinfo, &row, 1);
+    }
+
+  jpeg_finish_compress (&cinfo);
+  jpeg_destroy_compress (&cinfo);
+
+  return dest.size;
+}
+
+/* Predicts the file size by compressing a few evenly spaced strips of
+ * the drawable and scaling the result up to the full height. This is
+ * fast enough to run on every change of the settings, unlike the
+ * preview which compresses and decompresses the whole image.
+ */
+static gsize
+estimate_file_size (gint32 image_ID,
+                    gint32 drawable_ID)
+{
+  GimpDrawable *drawable;
+  GimpPixelRgn  pixel_rgn;
+  GimpParasite *parasite;
+  guchar       *data;
+  guchar       *pixels;
+  guchar       *s, *d;
+  gint          components;
+  gint          n_strips;
+  gint          strip_height;
+  gint          sample_rows;
+  gsize         overhead;
+  gsize         size;
+  gint          i;
+
+  if (gimp_drawable_is_indexed (drawable_ID))
+    return 0;
+
+  drawable = gimp_drawable_get (drawable_ID);
+
+  components = drawable->bpp;
+  if (gimp_drawable_has_alpha (drawable_ID))
+    components--;
+
+  n_strips = ESTIMATE_MAX_PIXELS / (drawable->width * ESTIMATE_STRIP_HEIGHT);
+  n_strips = CLAMP (n_strips, 1, ESTIMATE_STRIPS);
+
+  /* small images are compressed completely, which is exact */
+  if (drawable->height <= n_strips * ESTIMATE_STRIP_HEIGHT)
+    {
+      n_strips     = 1;
+      strip_height = drawable->height;
+    }
+  else
+    {
+      strip_height = ESTIMATE_STRIP_HEIGHT;
+    }
+
+  sample_rows = n_strips * strip_height;
 
-      if (! undo_touched)
+  data   = g_new (guchar, drawable->width * sample_rows * drawable->bpp);
+  pixels = g_new (guchar, drawable->width * sample_rows * components);
+
+  gimp_pixel_rgn_init (&pixel_rgn, drawable,
+                       0, 0, drawable->width, drawable->height, FALSE, FALSE);
+
+  for (i = 0; i < n_strips; i++)
+    {
+      gint y = 0;
+
+      /* aligned to the block grid of the full image */
+      if (n_strips > 1)
         {
-          /* we freeze undo saving so that we can avoid sucking up
-           * tile cache with our unneeded preview steps. */
-          gimp_image_undo_freeze (preview_image_ID);
+          y = (drawable->height - strip_height) * i / (n_strips - 1);
+          y -= y % ESTIMATE_STRIP_HEIGHT;
+        }
+
+      gimp_pixel_rgn_get_rect (&pixel_rgn,
+                               data + (i * strip_height *
+                                       drawable->width * drawable->bpp),
+                               0, y, drawable->width, strip_height);
+    }
+
+  /* drop the alpha channel */
+  s = data;
+  d = pixels;
+
+  for (i = 0; i < drawable->width * sample_rows; i++)
+    {
+      memcpy (d, s, components);
+
+      d += components;
+      s += drawable->bpp;
+    }
+
+  size = estimate_encode (image_ID, drawable_ID,
+                          pixels, drawable->width, sample_rows, components);
+
+  if (size > 0 && sample_rows < drawable->height)
+    {
+      /* the headers and tables don't grow with the image, measure them
+       * by compressing a single pixel and only scale up the rest
+       */
+      overhead = estimate_encode (image_ID, drawable_ID,
+                                  pixels, 1, 1, components);
 
-          undo_touched = TRUE;
+      if (overhead < size)
+        size = overhead + ((size - overhead) * drawable->height / sample_rows);
+    }
+
+  /* add the markers save_image() writes, except for the EXIF block
+   * which would need a thumbnail to be compressed
+   */
+  if (size > 0)
+    {
+      if (image_comment && *image_comment)
+        size += strlen (image_comment) + 4;
+
+      if (jsvals.save_xmp)
+        {
+          parasite = gimp_image_get_parasite (orig_image_ID_global,
+                                              "gimp-metadata");
+          if (parasite)
+            {
+              size += (gimp_parasite_data_size (parasite) - 10 +
+                       sizeof (JPEG_APP_HEADER_XMP) + 4);
+              gimp_parasite_free (parasite);
+            }
         }
 
-      save_image (tn,
-                  preview_image_ID,
-                  drawable_ID_global,
-                  orig_image_ID_global,
-                  TRUE, NULL);
+      parasite = gimp_image_get_parasite (orig_image_ID_global,
+                                          "icc-profile");
+      if (parasite)
+        {
+          /* the profile is split into markers of at most 65519 bytes,
+           * each with 18 bytes of overhead
+           */
+          size += (gimp_parasite_data_size (parasite) +
+                   18 * (gimp_parasite_data_size (parasite) / 65519 + 1));
+          gimp_parasite_free (parasite);
+        }
+    }
+
+  g_free (pixels);
+  g_free (data);
+
+  gimp_drawable_detach (drawable);
 
-      if (display_ID == -1)
-        display_ID = gimp_display_new (preview_image_ID);
+  return size;
+}
+
+static gboolean
+preview_timeout (gpointer data)
+{
+  gchar *tn = gimp_temp_name ("jpeg");
+
+  preview_timeout_id = 0;
+
+  if (! undo_touched)
+    {
+      /* we freeze undo saving so that we can avoid sucking up
+       * tile cache with our unneeded preview steps. */
+      gimp_image_undo_freeze (preview_image_ID);
+
+      undo_touched = TRUE;
+    }
+
+  save_image (tn,
+              preview_image_ID,
+              drawable_ID_global,
+              orig_image_ID_global,
+              TRUE, NULL);
+
+  if (display_ID == -1)
+    display_ID = gimp_display_new (preview_image_ID);
+
+  return FALSE;
+}
+
+static void
+make_preview (void)
+{
+  gsize  size;
+  gchar *size_text;
+  gchar *text;
+
+  destroy_preview ();
+
+  size = estimate_file_size (preview_image_ID, drawable_ID_global);
+
+  if (size > 0)
+    {
+      size_text = g_format_size (size);
+      text = g_strdup_printf (_("File size: about %s"), size_text);
+
+      gtk_label_set_text (GTK_LABEL (preview_size), text);
+
+      g_free (text);
+      g_free (size_text);
     }
   else
     {
       gtk_label_set_text (GTK_LABEL (preview_size), _("File size: unknown"));
+    }
 
+  if (jsvals.preview)
+    {
+      /* the preview compresses and loads the whole image, wait until
+       * the settings stop changing, e.g. while a slider is dragged
+       */
+      preview_timeout_id = g_timeout_add (PREVIEW_DELAY,
+                                          preview_timeout, NULL);
+    }
+  else
+    {
       gimp_displays_flush ();
     }
 }
@@ -788,6 +1078,12 @@ make_preview (void)
 void
 destroy_preview (void)
 {
+  if (preview_timeout_id)
+    {
+      g_source_remove (preview_timeout_id);
+      preview_timeout_id = 0;
+    }
+
   if (prev_p && !prev_p->abort_me)
     {
       guint id = prev_p->source_id;
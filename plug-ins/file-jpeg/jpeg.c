@@ -96,7 +96,13 @@ query (void)
     { GIMP_PDB_IMAGE,   "image",         "Output image" }
   };
 
-#ifdef HAVE_LIBEXIF
+  static const GimpParamDef load_scaled_args[] =
+  {
+    { GIMP_PDB_INT32,    "run-mode",     "The run mode { RUN-INTERACTIVE (0), RUN-NONINTERACTIVE (1) }" },
+    { GIMP_PDB_STRING,   "filename",     "The name of the file to load" },
+    { GIMP_PDB_STRING,   "raw-filename", "The name of the file to load" },
+    { GIMP_PDB_INT32,    "scale-denom",  "Load at 1/scale-denom of the size { 1, 2, 4, 8 }" }
+  };
 
   static const GimpParamDef thumb_args[] =
   {
@@ -110,8 +116,6 @@ query (void)
     { GIMP_PDB_INT32,  "image-height", "Height of full-sized image"    }
   };
 
-#endif /* HAVE_LIBEXIF */
-
   static const GimpParamDef save_args[] =
   {
     { GIMP_PDB_INT32,    "run-mode",     "The run mode { RUN-INTERACTIVE (0), RUN-NONINTERACTIVE (1) }" },
@@ -149,11 +153,28 @@ query (void)
                                     "",
                                     "6,string,JFIF,6,string,Exif");
 
-#ifdef HAVE_LIBEXIF
+  gimp_install_procedure (LOAD_SCALED_PROC,
+                          "loads files in the JPEG file format at a reduced size",
+                          "Loads a JPEG image at 1/2, 1/4 or 1/8 of its size, "
+                          "which libjpeg decodes from a fraction of the DCT "
+                          "coefficients, a lot faster than loading it at full "
+                          "size and scaling it down.  The resolution is "
+                          "reduced too, so the image keeps its print size.",
+                          "Spencer Kimball, Peter Mattis & others",
+                          "Spencer Kimball & Peter Mattis",
+                          "1995-2012",
+                          NULL,
+                          NULL,
+                          GIMP_PLUGIN,
+                          G_N_ELEMENTS (load_scaled_args),
+                          G_N_ELEMENTS (load_return_vals),
+                          load_scaled_args, load_return_vals);
 
   gimp_install_procedure (LOAD_THUMB_PROC,
                           "Loads a thumbnail from a JPEG image",
-                          "Loads a thumbnail from a JPEG image (only if it exists)",
+                          "Loads the thumbnail from the EXIF data of a JPEG "
+                          "image, or if there is none of the requested size, "
+                          "the image itself at a reduced size",
                           "Mukund Sivaraman <muks@mukund.org>, Sven Neumann <sven@gimp.org>",
                           "Mukund Sivaraman <muks@mukund.org>, Sven Neumann <sven@gimp.org>",
                           "November 15, 2004",
@@ -166,8 +187,6 @@ query (void)
 
   gimp_register_thumbnail_loader (LOAD_PROC, LOAD_THUMB_PROC);
 
-#endif /* HAVE_LIBEXIF */
-
   gimp_install_procedure (SAVE_PROC,
                           "saves files in the JPEG file format",
                           "saves files in the lossy, widely supported JPEG format",
@@ -218,8 +237,24 @@ run (const gchar      *name,
   orig_subsmp = JPEG_SUBSAMPLING_2x2_1x1_1x1;
   num_quant_tables = 0;
 
-  if (strcmp (name, LOAD_PROC) == 0)
+  if (strcmp (name, LOAD_PROC) == 0 || strcmp (name, LOAD_SCALED_PROC) == 0)
     {
+      gint scale_denom = 1;
+
+      if (strcmp (name, LOAD_SCALED_PROC) == 0)
+        {
+          if (nparams == 4)
+            scale_denom = param[3].data.d_int32;
+
+          if (nparams != 4 ||
+              (scale_denom != 1 && scale_denom != 2 &&
+               scale_denom != 4 && scale_denom != 8))
+            {
+              values[0].data.d_status = GIMP_PDB_CALLING_ERROR;
+              return;
+            }
+        }
+
       switch (run_mode)
         {
         case GIMP_RUN_INTERACTIVE:
@@ -232,7 +267,8 @@ run (const gchar      *name,
           break;
         }
 
-      image_ID = load_image (param[1].data.d_string, run_mode, FALSE, &error);
+      image_ID = load_image (param[1].data.d_string, run_mode, FALSE,
+                             scale_denom, &error);
 
       if (image_ID != -1)
         {
@@ -246,9 +282,6 @@ run (const gchar      *name,
         }
 
     }
-
-#ifdef HAVE_LIBEXIF
-
   else if (strcmp (name, LOAD_THUMB_PROC) == 0)
     {
       if (nparams < 2)
@@ -257,11 +290,13 @@ run (const gchar      *name,
         }
       else
         {
-          const gchar *filename = param[0].data.d_string;
-          gint         width    = 0;
-          gint         height   = 0;
+          const gchar *filename   = param[0].data.d_string;
+          gint         thumb_size = param[1].data.d_int32;
+          gint         width      = 0;
+          gint         height     = 0;
 
-          image_ID = load_thumbnail_image (filename, &width, &height, &error);
+          image_ID = load_thumbnail_image (filename, thumb_size,
+                                           &width, &height, &error);
 
           if (image_ID != -1)
             {
@@ -279,9 +314,6 @@ run (const gchar      *name,
             }
         }
     }
-
-#endif /* HAVE_LIBEXIF */
-
   else if (strcmp (name, SAVE_PROC) == 0)
     {
       image_ID = orig_image_ID = param[1].data.d_int32;